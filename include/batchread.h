@@ -0,0 +1,101 @@
+#ifndef BATCHREAD_H
+#define BATCHREAD_H
+
+#include "datfile.h"
+#include "membudget.h"
+
+// Batch reads: many entries are read with up to queue_depth reads in flight and each completed
+// payload is handed to a pool of decompression workers, so the device is not left idle while an
+// entry is being decoded. Reads are issued in offset order into a ring of slot buffers that the
+// workers release when they are done with them, which bounds memory to queue_depth slots.
+//
+// Engines:
+//   BATCH_ENGINE_URING  io_uring through the raw syscalls, slots registered as fixed buffers (Linux)
+//   BATCH_ENGINE_PREAD  queue_depth threads issuing blocking pread calls (POSIX)
+//   BATCH_ENGINE_SYNC   read and decompress one entry after another on the calling thread
+// BATCH_ENGINE_AUTO picks the first of these the platform and kernel support.
+
+#define BATCH_ENGINE_AUTO 0
+#define BATCH_ENGINE_URING 1
+#define BATCH_ENGINE_PREAD 2
+#define BATCH_ENGINE_SYNC 3
+
+#define BATCH_DEFAULT_QUEUE_DEPTH 32
+#define BATCH_MAX_QUEUE_DEPTH 1024
+#define BATCH_MAX_PREAD_THREADS 64
+#define BATCH_SLOT_SIZE (1u << 20) // payloads larger than this are read into their own buffer
+
+// Receives each entry on a decompression worker, so calls may run concurrently. data is owned by
+// the callback and released with buffer_free; it is NULL if the entry could not be read or decoded.
+typedef void (*BatchEntryCallback)(void *context, uint32_t id, uint8_t *data, uint32_t size);
+
+// Receives a streamed entry in order, chunk by chunk, on one worker: [offset, offset + chunk_size) of
+// total_size bytes. chunk belongs to the decoder and is only valid during the call. A NULL chunk means
+// the entry failed and no more chunks follow.
+typedef void (*BatchChunkCallback)(void *context, uint32_t id, const uint8_t *chunk, uint32_t chunk_size, uint32_t offset,
+                                   uint32_t total_size);
+
+// Receives an entry as stored, to decode into output_size bytes of its own choosing, on a decompression
+// worker. payload belongs to the reader and is only valid during the call. Returns false if the entry
+// could not be written, which counts it as failed.
+typedef bool (*BatchPayloadCallback)(void *context, uint32_t id, const MFTData *mft_entry, uint8_t *payload,
+                                     uint32_t output_size);
+
+typedef struct
+{
+    uint32_t engine;
+    uint32_t queue_depth; // reads in flight, 0 for BATCH_DEFAULT_QUEUE_DEPTH
+    uint32_t workers;     // decompression threads, 0 for one per CPU
+    bool raw;             // hand payloads over as stored instead of decompressing them
+
+    // Admission control: each worker charges an entry's output (and a payload too large for a slot)
+    // to budget before allocating it and releases the charge when the callback returns, so callbacks
+    // that keep data past that step outside the budget. Payloads read ahead of the workers are not
+    // charged; queue_depth bounds those. NULL runs without a budget.
+    MemoryBudget *budget;
+
+    // With chunk_callback set, compressed entries decoding to more than stream_threshold bytes are
+    // decoded in chunks of bounded memory and handed to chunk_callback instead of callback.
+    // stream_threshold 0 streams the entries that would not fit in a quarter of the budget, or none
+    // without a budget.
+    BatchChunkCallback chunk_callback;
+    uint32_t stream_threshold;
+
+    // With payload_callback set, entries that are not streamed are handed to it instead of being decoded
+    // into a buffer for callback, which then only hears of entries that fail before that point. Ignored
+    // for raw batches. The budget is charged for output_size as if the reader had decoded the entry.
+    BatchPayloadCallback payload_callback;
+} BatchReadOptions;
+
+typedef struct
+{
+    uint32_t engine; // the engine that actually ran
+    uint32_t queue_depth;
+    uint32_t workers;
+    bool registered_buffers; // io_uring fixed buffers were accepted by the kernel
+    uint64_t entries;
+    uint64_t failures;
+    uint64_t streamed;     // entries handed to the chunk callback
+    uint64_t reads;        // completed read requests, including resubmitted short reads
+    uint64_t system_calls; // io_uring_enter or pread calls
+    uint64_t bytes_read;
+    uint64_t bytes_output;
+    uint64_t io_wait_nanoseconds;     // submitter waiting for read completions
+    uint64_t worker_wait_nanoseconds; // submitter waiting for workers to free a slot
+    uint64_t nanoseconds;
+} BatchReadStats;
+
+const char *batch_engine_name(uint32_t engine);
+
+// Parse "auto", "uring", "pread" or "sync"; returns false for anything else
+bool parse_batch_engine(const char *name, uint32_t *engine);
+
+// Read ids (file ids or base ids) and pass each to callback. options may be NULL for the defaults
+// and stats may be NULL. Returns false if the batch could not be run at all; ids that fail on their
+// own are reported to the callback and counted in stats->failures.
+bool batch_read_entries(DatFile *dat_file, const uint32_t *ids, uint32_t count, const BatchReadOptions *options,
+                        BatchEntryCallback callback, void *context, BatchReadStats *stats);
+
+void print_batch_report(const BatchReadStats *stats);
+
+#endif // BATCHREAD_H
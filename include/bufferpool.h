@@ -0,0 +1,51 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Entry buffers (compressed payloads and decompressed output) are allocated with buffer_alloc and
+// must be released with buffer_free, never with free(). Underneath they come from pluggable
+// allocation hooks (malloc/free by default). With a pool limit set, each thread keeps released
+// buffers in size classes and hands them out again instead of returning them to the allocator.
+
+#define BUFFER_POOL_MIN_SIZE (1u << 12) // smallest size class
+#define BUFFER_POOL_MAX_SIZE (1u << 30) // larger buffers always go straight to the allocator
+#define BUFFER_POOL_CLASSES 73          // four classes per power of two between the two
+#define BUFFER_POOL_DEFAULT_BYTES (256u << 20)
+
+typedef struct
+{
+    void *(*allocate)(size_t size, void *user_data);
+    void (*release)(void *pointer, size_t size, void *user_data);
+    void *user_data;
+} BufferAllocator;
+
+typedef struct
+{
+    uint64_t allocator_calls;    // buffers taken from the allocator
+    uint64_t allocator_releases; // buffers given back to the allocator
+    uint64_t pool_hits;          // buffer_alloc calls served from a thread pool
+    uint64_t buffer_allocs;
+    uint64_t bytes_allocated;    // currently held from the allocator, including pooled buffers
+    uint64_t peak_bytes_allocated;
+    uint64_t bytes_pooled;       // currently idle in thread pools
+} BufferStats;
+
+// Install allocation hooks; NULL restores malloc/free. Only call while no buffers are outstanding.
+void set_buffer_allocator(const BufferAllocator *allocator);
+
+// Bytes each thread may keep idle in its pool; 0 (the default) disables pooling
+void set_buffer_pool_limit(size_t max_pooled_bytes);
+
+void *buffer_alloc(size_t size);
+void buffer_free(void *pointer);
+
+// Give the calling thread's pooled buffers back to the allocator
+void trim_buffer_pool(void);
+
+void get_buffer_stats(BufferStats *stats);
+void print_buffer_report(void);
+
+#endif // BUFFERPOOL_H
@@ -3,9 +3,26 @@
 
 #include "decompress.h"
 
+#include <threads.h>
+
 #define DAT_MAGIC_NUMBER 3
 #define MFT_MAGIC_NUMBER 4
 #define MFT_ENTRY_INDEX_NUM 2
+#define MFT_ENTRY_SIZE 24
+#define MFT_PAGE_ENTRIES 4096
+
+#if defined(_WIN32)
+#define dat_fseek _fseeki64
+#define dat_ftell _ftelli64
+#else
+#define dat_fseek fseeko
+#define dat_ftell ftello
+#endif
+
+// Open modes for load_dat_file_ex
+#define DAT_OPEN_EAGER 0
+#define DAT_OPEN_LAZY (1u << 0)             // read only the header and MFT header at open time
+#define DAT_OPEN_BACKGROUND_INDEX (1u << 1) // lazy mode: build the id index on a worker thread
 
 typedef struct
 {
@@ -46,303 +63,104 @@ typedef struct
     uint32_t base_id;
 } MFTIndexData;
 
+// Open-addressing hash from file id / base id to MFT slot
 typedef struct
 {
-    DatHeader header;
-    MFTHeader mft_header;
-    MFTData *mft_data;
-    MFTIndexData *mft_index_data;
-} DatFile;
-
-// Function to read little-endian unsigned integers
-uint16_t read_uint16_le(FILE *file)
-{
-    uint16_t value;
-    fread(&value, sizeof(value), 1, file);
-    return value;
-}
-
-uint32_t read_uint32_le(FILE *file)
-{
-    uint32_t value;
-    fread(&value, sizeof(value), 1, file);
-    return value;
-}
-
-int32_t read_int32_le(FILE *file)
-{
-    int32_t value;
-    fread(&value, sizeof(value), 1, file);
-    return value;
-}
-
-uint64_t read_uint64_le(FILE *file)
-{
-    uint64_t value;
-    fread(&value, sizeof(value), 1, file);
-    return value;
-}
+    uint32_t key;
+    uint32_t mft_slot;
+} MFTIdIndexSlot;
 
-void debug_print_header(const DatHeader *header)
-{
-    printf("Header Debug Info:\n");
-    printf("  Header Size:       %d bytes\n", header->header_size); // Unsigned integer
-    printf("  Unknown Field:     %d \n", header->unknown_field);    // 32-bit hex
-    printf("  Chunk Size:        %d bytes\n", header->chunk_size);  // Unsigned integer
-    printf("  CRC:               %d \n", header->crc);              // 32-bit hex
-    printf("  Unknown Field 2:   %d \n", header->unknown_field_2);  // 32-bit hex
-    printf("  MFT Offset:        %llu \n", header->mft_offset);     // 64-bit hex
-    printf("  MFT Size:          %d bytes\n", header->mft_size);    // Unsigned integer
-    printf("  Flags:             %d \n", header->flags);            // 32-bit hex
-}
-
-void debug_print_mft_header(const MFTHeader *header)
-{
-    printf("MFT Header Debug Info:\n");
-    printf("  Unknown:           %llu\n", header->unknown);       // 64-bit hex
-    printf("  Number of Entries: %d\n", header->num_entries);     // Unsigned integer
-    printf("  Unknown Field 2:   %d\n", header->unknown_field_2); // 32-bit hex
-    printf("  Unknown Field 3:   %d\n", header->unknown_field_3); // 32-bit hex
-}
-
-void debug_print_mft_data(const MFTData *data, uint32_t index)
-{
-    printf("MFTData[%d] Debug Info:\n", index);
-    printf("  Offset:            %llu\n", data->offset);         // 64-bit hex
-    printf("  Size:              %d bytes\n", data->size);       // Unsigned integer
-    printf("  Compression Flag:  %d\n", data->compression_flag); // 16-bit hex
-    printf("  Entry Flag:        %d\n", data->entry_flag);       // 16-bit hex
-    printf("  Counter:           %d\n", data->counter);          // Unsigned integer
-    printf("  CRC:               %d\n", data->crc);              // 32-bit hex
-}
-
-void debug_print_mft_index_data(const MFTIndexData *data, uint32_t index)
-{
-    printf("MFTIndexData[%d] Debug Info:\n", index);
-    printf("  File ID:           %d\n", data->file_id); // Unsigned integer
-    printf("  Base ID:           %d\n", data->base_id); // Unsigned integer
-}
-
-// Function to load .dat file and populate DatFile structure
-void load_dat_file(const char *file_path, DatFile *dat_file)
+typedef struct
 {
-    if (!strstr(file_path, ".dat"))
-    {
-        fprintf(stderr, "Invalid file extension. Expected '.dat'.\n");
-        exit(EXIT_FAILURE);
-    }
-
-    FILE *file = fopen(file_path, "rb");
-    if (!file)
-    {
-        perror("Error opening file");
-        exit(EXIT_FAILURE);
-    }
-
-    fread(&dat_file->header.version, sizeof(uint8_t), 1, file);
-    fread(dat_file->header.identifier, sizeof(uint8_t), DAT_MAGIC_NUMBER, file);
-    dat_file->header.header_size = read_uint32_le(file);
-    dat_file->header.unknown_field = read_uint32_le(file);
-    dat_file->header.chunk_size = read_uint32_le(file);
-    dat_file->header.crc = read_uint32_le(file);
-    dat_file->header.unknown_field_2 = read_uint32_le(file);
-    dat_file->header.mft_offset = read_uint64_le(file);
-    dat_file->header.mft_size = read_uint32_le(file);
-    dat_file->header.flags = read_uint32_le(file);
-    debug_print_header(&dat_file->header);
-
-    //fseeko(file, dat_file->header.mft_offset, SEEK_SET);
-    _fseeki64(file, dat_file->header.mft_offset, SEEK_SET);
-    fread(dat_file->mft_header.identifier, sizeof(uint8_t), MFT_MAGIC_NUMBER, file);
-    dat_file->mft_header.unknown = read_uint64_le(file);
-    dat_file->mft_header.num_entries = read_uint32_le(file);
-    dat_file->mft_header.unknown_field_2 = read_uint32_le(file);
-    dat_file->mft_header.unknown_field_3 = read_uint32_le(file);
-    debug_print_mft_header(&dat_file->mft_header);
-    if (memcmp(dat_file->mft_header.identifier, (uint8_t[]){0x4D, 0x66, 0x74, 0x1A}, MFT_MAGIC_NUMBER) != 0)
-    {
-        fprintf(stderr, "Not a MFT file: invalid header magic\n");
-        fclose(file);
-        exit(EXIT_FAILURE);
-    }
-
-    dat_file->mft_data = (MFTData *)malloc(dat_file->mft_header.num_entries * sizeof(MFTData));
-    if (dat_file->mft_data == NULL)
-    {
-        fprintf(stderr, "Memory allocation failed for MFTData\n");
-        fclose(file);
-        exit(EXIT_FAILURE);
-    }
-
-    for (uint32_t i = 1; i < dat_file->mft_header.num_entries; ++i)
-    {
-        dat_file->mft_data[i].offset = read_uint64_le(file);
-        dat_file->mft_data[i].size = read_uint32_le(file);
-        dat_file->mft_data[i].compression_flag = read_uint16_le(file);
-        dat_file->mft_data[i].entry_flag = read_uint16_le(file);
-        dat_file->mft_data[i].counter = read_uint32_le(file);
-        dat_file->mft_data[i].crc = read_uint32_le(file);
-    }
-    uint32_t mft_data_index = 16;
-    debug_print_mft_data(&dat_file->mft_data[mft_data_index], mft_data_index); // Print MFTData for each entry
-
-    uint32_t num_index_entries = dat_file->mft_data[MFT_ENTRY_INDEX_NUM].size / sizeof(MFTIndexData);
-    dat_file->mft_index_data = (MFTIndexData *)malloc(num_index_entries * sizeof(MFTIndexData));
-    if (dat_file->mft_index_data == NULL)
-    {
-        fprintf(stderr, "Memory allocation failed for MFTIndexData\n");
-        free(dat_file->mft_data); // Cleanup previous allocation
-        fclose(file);
-        exit(EXIT_FAILURE);
-    }
+    MFTIdIndexSlot *slots;
+    uint32_t mask;
+    uint32_t count;
+} MFTIdIndex;
 
-    //fseeko(file, dat_file->mft_data[MFT_ENTRY_INDEX_NUM].offset, SEEK_SET);
-    _fseeki64(file, dat_file->mft_data[MFT_ENTRY_INDEX_NUM].offset, SEEK_SET);
-    for (uint32_t i = 0; i < num_index_entries; ++i)
-    {
-        dat_file->mft_index_data[i].file_id = read_uint32_le(file);
-        dat_file->mft_index_data[i].base_id = read_uint32_le(file);
-    }
+struct DatPrefetcher;
+struct TranscodeCache;
 
-    uint32_t mft_index_data_num = num_index_entries - 1;
-    debug_print_mft_index_data(&dat_file->mft_index_data[mft_index_data_num], mft_index_data_num); // Print MFTIndexData for each entry
-
-    fclose(file);
-}
-
-uint8_t *extract_mft_data(const char *file_path, DatFile *dat_file, uint32_t number)
+typedef struct
 {
-    size_t index_number = 0;
-    bool found = false;
+    DatHeader header;
+    MFTHeader mft_header;
+    MFTData *mft_data;
+    MFTIndexData *mft_index_data;
 
-    // Find the corresponding MFT entry
-    uint32_t num_index_entries = dat_file->mft_data[MFT_ENTRY_INDEX_NUM].size / sizeof(MFTIndexData);
-    for (size_t i = 0; i < num_index_entries; i++)
-    {
-        if (dat_file->mft_index_data[i].file_id == number)
-        {
-            printf("Found!\n");
-            printf("MFT Index Entry %zu:\n", i);
-            printf("File ID: %u\n", dat_file->mft_index_data[i].file_id);
-            printf("Base ID: %u\n", dat_file->mft_index_data[i].base_id);
-            index_number = dat_file->mft_index_data[i].base_id;
-            found = true;
-            break;
-        }
+    // Lazy open state, only used when opened with DAT_OPEN_LAZY
+    char *file_path;
+    uint32_t open_flags;
+    uint32_t num_index_entries;
+    uint8_t *mft_page_loaded;
+    bool mft_index_loaded;
+    MFTIdIndex id_index;
+    mtx_t page_mutex;
+    mtx_t index_mutex;
+    thrd_t index_thread;
+    bool index_thread_running;
+    bool index_thread_failed;
+
+    // Optional access tracing, read-ahead and entry cache (see prefetch.h)
+    struct DatPrefetcher *prefetcher;
+
+    // Optional persistent cache of hot entries in a faster codec (see transcode.h)
+    struct TranscodeCache *transcode_cache;
+} DatFile;
 
-        if (dat_file->mft_index_data[i].base_id == number)
-        {
-            printf("Found!\n");
-            printf("MFT Index Entry %zu:\n", i);
-            printf("File ID: %u\n", dat_file->mft_index_data[i].file_id);
-            printf("Base ID: %u\n", dat_file->mft_index_data[i].base_id);
-            index_number = dat_file->mft_index_data[i].base_id;
-            found = true;
-            break;
-        }
-    }
+// Function to read little-endian unsigned integers
+uint16_t read_uint16_le(FILE *file);
+uint32_t read_uint32_le(FILE *file);
+int32_t read_int32_le(FILE *file);
+uint64_t read_uint64_le(FILE *file);
+void debug_print_header(const DatHeader *header);
+void debug_print_mft_header(const MFTHeader *header);
+void debug_print_mft_data(const MFTData *data, uint32_t index);
+void debug_print_mft_index_data(const MFTIndexData *data, uint32_t index);
+void read_dat_header(FILE *file, DatHeader *header);
+void read_mft_header(FILE *file, MFTHeader *header);
 
-    if (!found)
-    {
-        fprintf(stderr, "MFT entry not found!\n");
-        exit(EXIT_FAILURE);
-    }
+// Decode one MFT record from its on-disk layout
+void parse_mft_record(const uint8_t *raw, MFTData *data);
 
-    // Get the MFT data corresponding to the found index
-    MFTData *mft_entry = &dat_file->mft_data[index_number];
+// Encode one MFT record into its on-disk layout, MFT_ENTRY_SIZE bytes
+void format_mft_record(const MFTData *data, uint8_t *raw);
 
-    // Check if the file is compressed
-    if (mft_entry->compression_flag != 0)
-    {
-        printf("File is compressed!\n");
-    }
+// Function to load .dat file and populate DatFile structure; returns false if it cannot be opened or parsed
+bool load_dat_file(const char *file_path, DatFile *dat_file);
+uint32_t hash_mft_id(uint32_t key);
 
-    // Allocate buffer for MFT data
-    uint8_t *compressed_data = (uint8_t *)malloc(mft_entry->size);
-    if (compressed_data == NULL)
-    {
-        fprintf(stderr, "Memory allocation failed for compressed data\n");
-        exit(EXIT_FAILURE);
-    }
+// Insert key unless already present, so the first index entry wins like the linear search did
+void insert_mft_id(MFTIdIndex *id_index, uint32_t key, uint32_t mft_slot);
+bool build_mft_id_index(MFTIdIndex *id_index, const MFTIndexData *index_data, uint32_t num_index_entries);
+bool find_mft_id(const MFTIdIndex *id_index, uint32_t key, uint32_t *mft_slot);
 
-    // Open the file to read data
-    FILE *file = fopen(file_path, "rb"); // Open the file again to read data
-    if (!file)
-    {
-        perror("Error opening file");
-        free(compressed_data);
-        exit(EXIT_FAILURE);
-    }
+// Read one page of MFT records; the caller holds page_mutex
+bool load_mft_page(DatFile *dat_file, uint32_t page);
 
-    //fseeko(file, mft_entry->offset, SEEK_SET);
-    _fseeki64(file, mft_entry->offset, SEEK_SET);
-    fread(compressed_data, 1, mft_entry->size, file);
-    fclose(file);
+// Return the MFT record for a slot, reading its page first in lazy mode
+MFTData *get_mft_entry(DatFile *dat_file, uint32_t mft_slot);
 
-    // Print the first 16 bytes of the MFT data (Hex) before decompression
-    printf("First 16 bytes of MFT data before decompression (Hex):\n");
-    for (size_t i = 0; i < 16 && i < mft_entry->size; ++i)
-    {
-        printf("%02X ", compressed_data[i]);
-    }
-    printf("\n");
+// Read the index table (MFT entry MFT_ENTRY_INDEX_NUM) and build the id hash from it
+bool load_mft_index(DatFile *dat_file);
+int mft_index_thread_main(void *argument);
 
-    // Print the first 16 bytes of the MFT data (ASCII) before decompression
-    printf("First 16 bytes of MFT data before decompression (ASCII):\n");
-    for (size_t i = 0; i < 16 && i < mft_entry->size; ++i)
-    {
-        if (isprint(compressed_data[i]))
-        {
-            printf("%c", compressed_data[i]);
-        }
-        else
-        {
-            printf(".");
-        }
-    }
-    printf("\n");
+// Make sure the id index is available, waiting for the background builder if one is running
+bool ensure_mft_index(DatFile *dat_file);
 
-    // Decompress if the file is compressed
-    if (mft_entry->compression_flag != 0)
-    {
-        uint32_t decompressed_size = 0;
-        uint8_t *decompressed_data = decompress_data(compressed_data, mft_entry->size, &decompressed_size);
-        if (decompressed_data == NULL)
-        {
-            fprintf(stderr, "Decompression failed!\n");
-            free(compressed_data); // Free the original compressed data
-            exit(EXIT_FAILURE);
-        }
+// Resolve a file id or base id to its MFT slot
+bool find_mft_slot(DatFile *dat_file, uint32_t number, uint32_t *mft_slot);
 
-        free(compressed_data);               // Free the compressed compressed data
-        compressed_data = decompressed_data; // Update compressed data to point to decompressed data
-        printf("Decompressed MFT data size: %u bytes\n", decompressed_size);
+// Open a .dat file; with DAT_OPEN_LAZY only the header and MFT header are read here
+bool load_dat_file_ex(const char *file_path, DatFile *dat_file, uint32_t open_flags);
 
-        // Print the first 16 bytes of the MFT data (Hex) after decompression
-        printf("First 16 bytes of MFT data after decompression (Hex):\n");
-        for (size_t i = 0; i < 16 && i < decompressed_size; ++i)
-        {
-            printf("%02X ", compressed_data[i]);
-        }
-        printf("\n");
+// Free the MFT records and the id index, leaving the DatFile open with no entries; for a handle
+// whose tables were replaced by a live reload (see reload.h)
+void release_mft_tables(DatFile *dat_file);
 
-        // Print the first 16 bytes of the MFT data (ASCII) after decompression
-        printf("First 16 bytes of MFT data after decompression (ASCII):\n");
-        for (size_t i = 0; i < 16 && i < decompressed_size; ++i)
-        {
-            if (isprint(compressed_data[i]))
-            {
-                printf("%c", compressed_data[i]);
-            }
-            else
-            {
-                printf(".");
-            }
-        }
-        printf("\n");
-    }
+// Release everything owned by a DatFile opened with load_dat_file or load_dat_file_ex
+void close_dat_file(DatFile *dat_file);
 
-    return compressed_data; // Return the compressed data containing the MFT data
-}
+// Read and decompress an entry by file id or base id; returns a buffer to release with buffer_free, or NULL on failure
+uint8_t *extract_mft_data(const char *file_path, DatFile *dat_file, uint32_t number);
 
 #endif // DATFILE_H
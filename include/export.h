@@ -0,0 +1,40 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "batchread.h"
+#include "datfile.h"
+
+// Export entries to files. The destination is sized up front from the entry's stream header and,
+// where mmap is available, mapped so the decoder writes straight into the page cache: no heap
+// buffer the size of the entry and no second pass through fwrite. Stored entries are read from
+// the archive directly into the mapping. Entries under EXPORT_MAP_MIN_SIZE, and all entries where
+// there is no mmap, are decoded into a pooled buffer and written with fwrite instead.
+
+#define EXPORT_MAP_MIN_SIZE (256u << 10)
+
+typedef struct
+{
+    uint64_t entries;
+    uint64_t mapped_entries;   // written through a mapping rather than fwrite
+    uint64_t streamed_entries; // decoded and written a chunk at a time by export_batch
+    uint64_t bytes;
+    uint64_t nanoseconds;
+} ExportStats;
+
+// Write one entry, read from archive at mft_entry->offset, to output_path. io_mutex, if not NULL, is
+// held while archive is read. stats may be NULL.
+bool export_mft_entry(FILE *archive, mtx_t *io_mutex, const MFTData *mft_entry, const char *output_path, ExportStats *stats);
+
+// Look up a file id or base id and export it; the counterpart of extract_mft_data
+bool export_mft_data(DatFile *dat_file, uint32_t number, const char *output_path, ExportStats *stats);
+
+// Export ids to output_dir/<id>.bin through the batch reader, so reads and decoding overlap across
+// workers. Each entry is written as export_mft_entry writes it, through a mapping where it qualifies.
+// With options->budget set the decoded bytes held at once stay within it, and entries too large for it
+// are decoded in chunks into their files instead. batch_stats may be NULL.
+bool export_batch(DatFile *dat_file, const uint32_t *ids, uint32_t count, const char *output_dir, const BatchReadOptions *options,
+                  ExportStats *stats, BatchReadStats *batch_stats);
+
+void print_export_report(const ExportStats *stats);
+
+#endif // EXPORT_H
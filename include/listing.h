@@ -0,0 +1,62 @@
+#ifndef LISTING_H
+#define LISTING_H
+
+#include "datfile.h"
+
+// Archive listing with real sizes without decompressing anything. The uncompressed size of a
+// compressed entry is the second word of its payload, so only those 8 bytes are needed per entry.
+// The probes are sorted by offset and neighbours are merged into one read while the hole between
+// them stays under the coalescing gap and the read under max_read; the reads are then shared out,
+// in offset order, to a few threads with a file handle each, so several are in flight at once.
+
+#define LIST_PROBE_SIZE 8
+#define LIST_DEFAULT_GAP (16u << 10)
+#define LIST_DEFAULT_MAX_READ (256u << 10)
+#define LIST_DEFAULT_THREADS 8 // the probes wait on the disk, so this is reads in flight more than CPUs
+#define LIST_MAX_THREADS 16
+
+#define LIST_FORMAT_TSV 0
+#define LIST_FORMAT_JSON 1
+
+typedef struct
+{
+    uint32_t threads;       // 0 for LIST_DEFAULT_THREADS, up to LIST_MAX_THREADS
+    uint32_t coalesce_gap;  // largest hole read through to merge two probes; 0 for LIST_DEFAULT_GAP
+    uint32_t max_read;      // largest merged read; 0 for LIST_DEFAULT_MAX_READ
+} ListOptions;
+
+// One row per index table entry
+typedef struct
+{
+    uint32_t file_id;
+    uint32_t base_id;           // the MFT slot
+    uint32_t compressed_size;   // the payload as stored
+    uint32_t uncompressed_size; // from the payload header; the stored size for uncompressed entries, 0 if unreadable
+    uint16_t compression_flag;
+    uint16_t entry_flag;
+} ListEntry;
+
+typedef struct
+{
+    uint32_t rows;
+    uint32_t slots;
+    uint64_t probes;     // payload headers looked up
+    uint64_t unreadable; // probes past the end of the file
+    uint64_t reads;
+    uint64_t read_bytes;
+    uint32_t threads;
+    uint64_t mft_nanoseconds; // reading the header, MFT and index table
+    uint64_t probe_nanoseconds;
+} ListStats;
+
+// List every id of the archive, sorted by file id. *entries is malloc'd, release it with free.
+// options and stats may be NULL.
+bool list_dat_entries(const char *file_path, const ListOptions *options, ListEntry **entries, uint32_t *count, ListStats *stats);
+
+// Write the rows as tab-separated values with a header line, or as a JSON array of objects
+bool write_list(FILE *output, const ListEntry *entries, uint32_t count, uint32_t format);
+
+// The report goes to stderr, so it stays out of a listing written to stdout
+void print_list_report(const ListStats *stats);
+
+#endif // LISTING_H
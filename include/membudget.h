@@ -0,0 +1,45 @@
+#ifndef MEMBUDGET_H
+#define MEMBUDGET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <threads.h>
+
+// A global byte budget shared by parallel decoders, as a weighted semaphore. A decoder peeks the size
+// an entry will decode to, acquires that many bytes before allocating anything and releases them once
+// the output is gone, so the decoded bytes in flight never exceed the capacity however many workers
+// run. Waiters are admitted strictly in arrival order, so a large request is not starved by a stream
+// of small ones that keep fitting in front of it.
+
+typedef struct
+{
+    uint64_t admissions;
+    uint64_t waits;   // admissions that had to wait for bytes to be released
+    uint64_t wait_nanoseconds;
+    uint64_t clamped; // requests larger than the whole budget, admitted as the whole budget
+    uint64_t peak_bytes;
+} MemoryBudgetStats;
+
+typedef struct
+{
+    uint64_t capacity;
+    uint64_t in_use;
+    uint64_t next_ticket; // handed to the next caller of memory_budget_acquire
+    uint64_t serving;     // the only ticket that may be admitted now
+    mtx_t mutex;
+    cnd_t released;
+    MemoryBudgetStats stats;
+} MemoryBudget;
+
+void init_memory_budget(MemoryBudget *budget, uint64_t capacity);
+void destroy_memory_budget(MemoryBudget *budget);
+
+// Block until bytes fit in the budget and charge them. A request above the capacity is charged as the
+// whole capacity, so it runs alone rather than never. Returns the bytes charged, to pass to release.
+uint64_t memory_budget_acquire(MemoryBudget *budget, uint64_t bytes);
+void memory_budget_release(MemoryBudget *budget, uint64_t bytes);
+
+void get_memory_budget_stats(MemoryBudget *budget, MemoryBudgetStats *stats);
+void print_memory_budget_report(MemoryBudget *budget);
+
+#endif // MEMBUDGET_H
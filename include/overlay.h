@@ -0,0 +1,55 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "datfile.h"
+
+// Several archives stacked in precedence order, e.g. patch snapshots over Local.dat over Gw2.dat,
+// behind one merged hash from file id / base id to (archive, MFT slot). A lookup is a single probe
+// however many archives are stacked; an id present in more than one archive resolves to the one
+// with the highest precedence. The archives are ordinary DatFiles and can still be used directly.
+
+#define OVERLAY_MAX_ARCHIVES 64
+
+typedef struct
+{
+    uint32_t key;
+    uint32_t mft_slot; // UINT32_MAX marks an empty slot
+    uint32_t archive;
+    uint32_t shadowed_by; // last archive counted as shadowed for this key, so each counts it once
+} OverlayIndexSlot;
+
+typedef struct
+{
+    uint32_t ids;      // ids that resolve to this archive
+    uint32_t shadowed; // ids also present here but taken by an archive with higher precedence
+} OverlayArchiveStats;
+
+typedef struct
+{
+    DatFile *archives; // archives[0] has the highest precedence
+    FILE **files;      // one read handle per archive, guarded by io_mutex
+    OverlayArchiveStats *archive_stats;
+    uint32_t archive_count;
+
+    OverlayIndexSlot *slots;
+    uint32_t mask;
+    uint32_t count;
+
+    mtx_t io_mutex;
+} DatOverlay;
+
+// Open paths[0..count) with paths[0] taking precedence over the rest, and merge their id indexes.
+// The archives' own indexes are loaded in the background, all at once, before the merge.
+bool open_dat_overlay(DatOverlay *overlay, const char *const *paths, uint32_t count);
+void close_dat_overlay(DatOverlay *overlay);
+
+// Resolve a file id or base id to the archive and MFT slot that provide it
+bool find_overlay_entry(const DatOverlay *overlay, uint32_t id, uint32_t *archive, uint32_t *mft_slot);
+
+// Read and decompress an entry from whichever archive provides it; returns a buffer to release with
+// buffer_free, or NULL on failure. archive may be NULL.
+uint8_t *extract_overlay_data(DatOverlay *overlay, uint32_t id, uint32_t *size, uint32_t *archive);
+
+void print_overlay_report(const DatOverlay *overlay);
+
+#endif // OVERLAY_H
@@ -0,0 +1,52 @@
+#ifndef PARDECODE_H
+#define PARDECODE_H
+
+#include "decompress.h"
+
+// Experimental intra-entry parallel decoding for very large compressed entries, in three phases:
+//
+//   1. scan:    one serial pass reads every block's tree descriptions and skips over its codes,
+//               recording where each block starts in the input and in the output, and how many
+//               matches it holds. Nothing is written.
+//   2. tokens:  workers decode whole blocks, each from its own start, as soon as the scan is past
+//               them. Literals are written straight to their final place in the output; matches
+//               become (position, offset, length) tokens in an array per block.
+//   3. resolve: workers copy each block's matches in order, putting off those that read from before
+//               the block's start and those that read what a match put off would write. The ones
+//               put off are then copied serially, block after block, once all history is final.
+//
+// The output is byte for byte what decompress_data produces, and input decompress_data refuses is
+// refused. The scan decodes every code, as the serial decoder does, so it bounds the speedup.
+
+#define PARALLEL_DECODE_DEFAULT_THRESHOLD (16u << 20) // decompressed bytes from which extractions go parallel
+#define PARALLEL_DECODE_MAX_THREADS 64
+
+typedef struct
+{
+    uint64_t entries;
+    uint64_t bytes;             // decompressed
+    uint32_t threads;           // workers that ran, the calling thread included (the most of any entry)
+    uint64_t blocks;
+    uint64_t matches;
+    uint64_t serial_matches;    // matches left to the serial part of the resolve phase
+    uint64_t scan_nanoseconds;
+    uint64_t token_nanoseconds;   // token decoding still to do once the scan ended
+    uint64_t resolve_nanoseconds;
+} ParallelDecodeStats;
+
+// Decode an entry on thread_count workers (0 uses one per online CPU). Returns a buffer_alloc
+// buffer, NULL on malformed input. stats may be NULL.
+uint8_t *decompress_data_parallel(uint8_t *compressed_data, uint32_t compressed_size, uint32_t *decompressed_size, uint32_t thread_count,
+                                  ParallelDecodeStats *stats);
+
+// Send extractions of entries that decode to at least threshold bytes (0 for the default) through
+// decompress_data_parallel on thread_count workers (0 for one per online CPU); 1 turns it off again
+void set_parallel_decode(uint32_t thread_count, uint32_t threshold);
+
+// Workers to decode this entry with under set_parallel_decode, or 0 if it goes to the serial decoder
+uint32_t parallel_decode_threads(const uint8_t *compressed_data, uint32_t compressed_size);
+
+void get_parallel_decode_stats(ParallelDecodeStats *stats);
+void print_parallel_decode_report(void);
+
+#endif // PARDECODE_H
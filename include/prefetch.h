@@ -0,0 +1,146 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "datfile.h"
+
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#endif
+
+#define PREFETCH_RECORD (1u << 0)      // record requested ids into an access trace
+#define PREFETCH_HINT (1u << 1)        // replay a trace as read-ahead hints for upcoming entries
+#define PREFETCH_SPECULATIVE (1u << 2) // also decompress upcoming entries into the cache on a worker thread
+
+#define PREFETCH_DEFAULT_DEPTH 8
+#define PREFETCH_QUEUE_SIZE 64
+#define ENTRY_CACHE_BUCKETS 1024
+#define ENTRY_CACHE_DEFAULT_BYTES (64u << 20)
+
+typedef struct EntryCacheNode
+{
+    uint32_t mft_slot;
+    uint32_t size;
+    uint8_t *data;
+    bool speculative;
+    uint32_t pins;  // readers using data in place, see entry_cache_pin
+    bool detached;  // evicted while pinned, freed by the last entry_cache_unpin
+    uint64_t record_offset; // the MFT record the data was decoded from, for caches that check it on a hit
+    uint32_t record_size;
+    uint32_t record_crc;
+    struct EntryCacheNode *prev; // LRU order, head is most recently used
+    struct EntryCacheNode *next;
+    struct EntryCacheNode *bucket_next;
+} EntryCacheNode;
+
+typedef struct
+{
+    EntryCacheNode *buckets[ENTRY_CACHE_BUCKETS];
+    EntryCacheNode *head;
+    EntryCacheNode *tail;
+    size_t bytes;
+    size_t max_bytes;
+} EntryCache;
+
+typedef struct
+{
+    uint32_t *ids;
+    uint32_t count;
+    uint32_t capacity;
+} AccessTrace;
+
+typedef struct
+{
+    uint64_t accesses;
+    uint64_t cache_hits;
+    uint64_t speculative_hits;
+    uint64_t hints_issued;
+    uint64_t speculative_decodes;
+    uint64_t hit_nanoseconds;
+    uint64_t miss_nanoseconds;
+} PrefetchStats;
+
+// An entry queued for speculative decompression
+typedef struct
+{
+    uint32_t mft_slot;
+    uint32_t generation; // of the prefetcher when queued
+    MFTData mft_entry;   // the record the hint saw, so the worker never reads the MFT itself
+} PrefetchRequest;
+
+typedef struct DatPrefetcher
+{
+    uint32_t flags;
+    uint32_t depth;
+    char *record_path;
+    AccessTrace recorded;
+    AccessTrace replay;
+    MFTIdIndex replay_positions; // id -> first position in the replay trace
+    uint32_t replay_cursor;
+    bool replay_cursor_valid;
+
+    EntryCache cache;
+    PrefetchStats stats;
+    FILE *file;
+
+    mtx_t mutex;
+    cnd_t wake;
+    thrd_t worker;
+    bool worker_running;
+    bool stop;
+    uint32_t generation; // bumped when slots are invalidated, so decodes started before are dropped
+    PrefetchRequest queue[PREFETCH_QUEUE_SIZE];
+    uint32_t queue_head;
+    uint32_t queue_count;
+} DatPrefetcher;
+
+uint64_t prefetch_now_nanoseconds(void);
+bool trace_append(AccessTrace *trace, uint32_t id);
+
+// Traces are plain text, one id per line
+bool save_access_trace(const AccessTrace *trace, const char *path);
+bool load_access_trace(AccessTrace *trace, const char *path);
+uint32_t entry_cache_bucket(uint32_t mft_slot);
+EntryCacheNode *entry_cache_find(EntryCache *cache, uint32_t mft_slot);
+void entry_cache_unlink(EntryCache *cache, EntryCacheNode *node);
+void entry_cache_push_front(EntryCache *cache, EntryCacheNode *node);
+void entry_cache_evict(EntryCache *cache, EntryCacheNode *node);
+
+// Takes ownership of data; entries larger than the whole budget are not cached
+bool entry_cache_insert(EntryCache *cache, uint32_t mft_slot, uint8_t *data, uint32_t size, bool speculative);
+void entry_cache_clear(EntryCache *cache);
+
+// Keep a node's data alive for use outside the cache lock, even if it gets evicted meanwhile.
+// Both are called with the cache lock held.
+void entry_cache_pin(EntryCache *cache, EntryCacheNode *node);
+void entry_cache_unpin(EntryCache *cache, EntryCacheNode *node);
+
+// Read and, if flagged, decompress one entry through an already open file; returns NULL on failure
+uint8_t *read_mft_payload(FILE *file, const MFTData *mft_entry, uint32_t *size);
+
+// Map each id to its first position in the trace
+bool build_trace_positions(MFTIdIndex *positions, const AccessTrace *trace);
+
+// Speculative decompression worker; argument is the DatPrefetcher
+int prefetch_worker_main(void *argument);
+
+// Attach a prefetcher to an open archive. replay_path and record_path may be NULL.
+bool enable_prefetcher(DatFile *dat_file, uint32_t flags, const char *replay_path, const char *record_path, size_t cache_bytes);
+void disable_prefetcher(DatFile *dat_file);
+
+// Ask the OS to start reading an entry's payload, and optionally queue it for speculative decompression
+void prefetch_hint_entry(DatFile *dat_file, uint32_t id);
+
+// Called by extract_mft_data once the slot is known: records the access, hints the ids that
+// followed it in the replay trace, and returns a private copy of the entry if it is cached
+uint8_t *prefetch_begin_access(DatFile *dat_file, uint32_t id, uint32_t mft_slot, uint32_t *size);
+
+// Called by extract_mft_data after a cache miss was served from disk
+void prefetch_end_access(DatFile *dat_file, uint32_t mft_slot, const uint8_t *data, uint32_t size, uint64_t start_nanoseconds, bool hit);
+void print_prefetch_report(const DatFile *dat_file);
+
+// Drop the cached entries of slots whose records changed, along with speculative decodes still
+// under way; returns how many entries were dropped
+uint32_t prefetch_invalidate_slots(DatFile *dat_file, const uint32_t *mft_slots, uint32_t count);
+
+#endif // PREFETCH_H
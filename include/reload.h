@@ -0,0 +1,68 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include "datfile.h"
+#include "seekindex.h"
+
+// Live reload of an open archive that the game client patches in place. A watcher thread waits
+// for writes to the file (inotify on Linux, a timer elsewhere) and, once they have been quiet for a
+// while, compares the header's mft_offset, mft_size and crc with the ones the tables were read
+// from. When they differ it reads the new MFT in full, keeps the id index if the index table's
+// record did not change, and swaps the new tables in with one pointer store.
+//
+// Readers bracket each use of the tables with reloader_enter and reloader_leave, which count them
+// against the parity of a global epoch. After the swap the reload bumps the epoch and waits until
+// no reader of the previous parity is left; only then are the old tables freed and the cached data
+// of slots whose offset, size or crc changed dropped: checkpoints in the seek index, entries in the
+// prefetch cache, and whatever the caller's callback keeps. Everything else stays warm. The
+// transcode cache needs nothing, it checks each record's crc and size on lookup.
+//
+// Readers that start while the old tables are being retired may still be handed a cached entry of
+// a changed slot; the window lasts until the reads that were running at the swap have finished.
+
+#define RELOAD_DEFAULT_QUIET_MS 500 // writes must stop this long before the header is checked
+#define RELOAD_POLL_MS 2000         // header check interval with no write seen, or without inotify
+
+// Called after a swap with the slots whose records changed or went away; returns how many cached
+// entries it dropped for them
+typedef uint32_t (*ReloadCallback)(void *context, const uint32_t *mft_slots, uint32_t count);
+
+typedef struct
+{
+    uint64_t checks;        // header comparisons
+    uint64_t reloads;       // new tables swapped in
+    uint64_t failures;      // changed headers whose tables could not be read, retried on the next check
+    uint64_t changed_slots; // records whose offset, size or crc changed, or that went away
+    uint64_t dropped;       // cached entries dropped for them
+    uint64_t index_reused;  // reloads that kept the id index
+    uint64_t last_reload_nanoseconds;
+} ReloadStats;
+
+typedef struct ArchiveReloader ArchiveReloader;
+
+// Serve dat_file, the tables readers get until the first reload. seek_index may be NULL. Only
+// reload_if_changed reloads until a watcher is started.
+ArchiveReloader *create_archive_reloader(DatFile *dat_file, SeekIndexStore *seek_index);
+
+// Watch the file and reload on changes; callback may be NULL. False if already watching or the
+// thread could not be started.
+bool start_reload_watcher(ArchiveReloader *reloader, uint32_t quiet_milliseconds, ReloadCallback callback, void *context);
+
+// True once the watcher runs or the tables have been swapped; from then on the caches of dat_file
+// are shared with later tables and cannot be attached
+bool reloader_started(ArchiveReloader *reloader);
+
+// Stop the watcher and free the tables of later reloads; dat_file itself is left to the caller
+void stop_archive_reloader(ArchiveReloader *reloader);
+
+// The tables to use until the matching reloader_leave
+DatFile *reloader_enter(ArchiveReloader *reloader, uint32_t *epoch);
+void reloader_leave(ArchiveReloader *reloader, uint32_t epoch);
+
+// Check the header now and reload if it changed; false if a reload was due and failed
+bool reload_if_changed(ArchiveReloader *reloader);
+
+void get_reload_stats(ArchiveReloader *reloader, ReloadStats *stats);
+void print_reload_report(const ReloadStats *stats);
+
+#endif // RELOAD_H
@@ -0,0 +1,73 @@
+#ifndef REPACK_H
+#define REPACK_H
+
+#include "datfile.h"
+#include "prefetch.h"
+
+// Rewrite an archive with its payloads laid out in the order they are read. Payloads are copied
+// verbatim (compressed entries stay compressed) and placed one after another, in first-access
+// order from an access trace followed by everything else by file id, or by file id alone. Space no
+// MFT record points at is dropped, and a payload shared by several records is copied once. The
+// header, index table (MFT entry MFT_ENTRY_INDEX_NUM) and MFT are rebuilt after the payloads, with
+// the same ids, slots, flags and crcs as before; only offsets change. The header's and the MFT's own
+// crc fields are carried over as they are.
+//
+// Payloads are read in output order with read-ahead hints for the next few and written through one
+// large buffer, so the output is produced by a sequence of big sequential writes.
+
+#define REPACK_ORDER_ID 0
+#define REPACK_ORDER_TRACE 1
+
+#define REPACK_DEFAULT_WRITE_BUFFER (8u << 20)
+#define REPACK_READ_AHEAD 32                    // payloads hinted to the OS ahead of the one being copied
+#define REPACK_SEQUENTIAL_GAP (128u << 10)      // a read this close after the previous one counts as sequential
+
+typedef struct
+{
+    uint32_t order;
+    const AccessTrace *trace;   // ids in access order, for REPACK_ORDER_TRACE
+    uint32_t write_buffer_size; // 0 for REPACK_DEFAULT_WRITE_BUFFER
+    uint32_t alignment;         // payload alignment, a power of two; 0 keeps the input's
+    bool timed;                 // also time reading the access sequence from a cold page cache
+} RepackOptions;
+
+// How scattered the reads of an access sequence are. The sequence is the trace when there is one,
+// otherwise every entry once in file id order.
+typedef struct
+{
+    uint64_t reads;
+    uint64_t sequential_reads; // started at most REPACK_SEQUENTIAL_GAP after the previous read ended
+    uint64_t seek_bytes;       // distances from the end of each read to the start of the next
+    uint64_t span_bytes;       // from the lowest to the highest byte read
+    uint64_t bytes;
+    uint64_t nanoseconds; // timed replay, 0 when not timed
+} ReadLocality;
+
+typedef struct
+{
+    uint32_t slots;
+    uint64_t payloads;      // payloads copied
+    uint64_t shared_slots;  // records pointing at a payload copied for another record
+    uint64_t traced;        // payloads placed by the trace
+    uint64_t input_bytes;
+    uint64_t output_bytes;
+    uint64_t payload_bytes;
+    uint64_t dropped_bytes; // input bytes no record pointed at
+    uint64_t padding_bytes;
+    uint32_t alignment;
+    uint64_t writes;
+    uint64_t nanoseconds;
+    ReadLocality before;
+    ReadLocality after;
+} RepackStats;
+
+// Measure how the reads of ids[0..count) fall in dat_file; with timed set, also read them in order
+// from a cold page cache (where the OS lets us drop it) and record how long that took
+bool measure_read_locality(DatFile *dat_file, const uint32_t *ids, uint32_t count, bool timed, ReadLocality *locality);
+
+// Write a repacked copy of input_path to output_path and measure read locality on both. stats may be NULL.
+bool repack_dat_file(const char *input_path, const char *output_path, const RepackOptions *options, RepackStats *stats);
+
+void print_repack_report(const RepackStats *stats);
+
+#endif // REPACK_H
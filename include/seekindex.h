@@ -0,0 +1,53 @@
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+#include "datfile.h"
+
+#define SEEK_INDEX_DEFAULT_INTERVAL (1u << 20)
+#define SEEK_INDEX_BUCKETS 1024
+#define SEEK_INDEX_DEFAULT_BYTES (64u << 20) // checkpoint windows kept before the least recently used go
+
+// Decode checkpoints recorded for one MFT entry. They do not change once the entry is in the store,
+// so range decodes use them outside the store's lock while they hold a pin.
+typedef struct SeekIndexEntry
+{
+    uint32_t mft_slot;
+    uint32_t pins; // range decodes using the checkpoints
+    bool detached; // removed while pinned, freed by the last unpin
+    size_t bytes;  // the checkpoints and their windows
+    DecodeCheckpointIndex checkpoints;
+    struct SeekIndexEntry *prev; // LRU order, head is most recently used
+    struct SeekIndexEntry *next;
+    struct SeekIndexEntry *bucket_next;
+} SeekIndexEntry;
+
+// Side index of checkpointed entries, filled in by the first range read of each entry and kept
+// under max_bytes by dropping the least recently read
+typedef struct
+{
+    SeekIndexEntry *buckets[SEEK_INDEX_BUCKETS];
+    SeekIndexEntry *head;
+    SeekIndexEntry *tail;
+    size_t bytes;
+    size_t max_bytes;
+    uint32_t interval; // output bytes between two checkpoints
+    mtx_t mutex;       // guards the entries; never held while decoding
+} SeekIndexStore;
+
+// interval and max_bytes may be 0 for the defaults
+void init_seek_index_store(SeekIndexStore *store, uint32_t interval, size_t max_bytes);
+void free_seek_index_store(SeekIndexStore *store);
+
+// Drop the checkpoints of an entry, if it has any; returns whether it had
+bool remove_seek_index_entry(SeekIndexStore *store, uint32_t mft_slot);
+
+// Copy bytes [offset, offset + length) of an entry's uncompressed contents into a new buffer.
+// The first read of a compressed entry decodes it fully and records its checkpoints; later reads
+// resume from the nearest checkpoint before offset. Returns NULL on failure.
+uint8_t *extract_mft_range(DatFile *dat_file, SeekIndexStore *store, uint32_t number, uint32_t offset, uint32_t length, uint32_t *range_length);
+
+// Same for an entry whose payload has already been read; takes ownership of compressed_data
+uint8_t *decode_mft_range(SeekIndexStore *store, uint32_t mft_slot, const MFTData *mft_entry, uint8_t *compressed_data,
+                          uint32_t offset, uint32_t length, uint32_t *range_length);
+
+#endif // SEEKINDEX_H
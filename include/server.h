@@ -0,0 +1,41 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "wacko_api.h"
+
+// Local asset server: opens an archive once and answers requests from other processes over a Unix
+// domain socket and/or loopback HTTP. Linux only (epoll, eventfd, signalfd, sendfile).
+//
+// Line protocol, one request per line:
+//   GET <id>                    whole entry
+//   GET <first>-<last>          every existing id in the range, as records
+//   READ <id> <offset> <length> bytes of an entry
+//   SNIFF <id> [length]         the first bytes of an entry (SERVER_DEFAULT_SNIFF_BYTES)
+//   QUIT
+// Replies are "OK <size>\n" followed by size bytes, or "ERR <message>\n".
+//
+// HTTP: GET /entry/<id>[?offset=N&length=M], GET /sniff/<id>[?length=N], GET /range/<first>-<last>
+//
+// An id range body is a sequence of records, each "<id> <size>\n" followed by size bytes.
+
+#define SERVER_DEFAULT_CACHE_BYTES (256u << 20)
+#define SERVER_DEFAULT_SNIFF_BYTES 64
+#define SERVER_MAX_REQUEST 4096
+#define SERVER_MAX_ID_RANGE 4096
+#define SERVER_MAX_RANGE_BYTES (64u << 20) // decoded bytes an id range reply may hold until it is sent
+#define SERVER_MAX_EVENTS 64
+
+typedef struct
+{
+    const char *socket_path;    // Unix domain socket path, NULL to disable
+    uint16_t http_port;         // loopback HTTP port, 0 to disable
+    uint32_t workers;           // decompression threads, 0 for one per CPU
+    size_t cache_bytes;         // shared cache of decompressed entries, 0 for SERVER_DEFAULT_CACHE_BYTES
+    const char *transcode_path; // persistent transcode cache (see transcode.h), NULL to disable
+    bool live_reload;           // pick up patches to the archive without a restart (see reload.h)
+} ServerOptions;
+
+// Serve entries of an archive until SIGINT or SIGTERM; returns 0 after a clean shutdown
+int run_server(const char *file_path, const ServerOptions *options);
+
+#endif // SERVER_H
@@ -0,0 +1,104 @@
+#ifndef TRANSCODE_H
+#define TRANSCODE_H
+
+#include "datfile.h"
+
+// Persistent transcoding cache: entries read often enough are re-encoded in a format that decodes
+// far faster than the archive's Huffman+LZ streams and appended to a cache file. Entries are keyed
+// by MFT slot, so a file id and its base id share one record. Later reads are served from it as long
+// as the MFT record still has the same offset, size and crc, so a patched archive simply misses. The file is compacted, coldest entries first, to stay under its
+// size budget.
+//
+// Cache file: a 16-byte header ("WTC1", version) followed by records, each a TRANSCODE_RECORD_SIZE
+// header (MFT slot, MFT crc and size, uncompressed size, stored size, codec, payload checksum,
+// original decode time, MFT offset) and the payload. All fields are little endian.
+
+#define TRANSCODE_DEFAULT_BYTES (512ull << 20)
+#define TRANSCODE_DEFAULT_ADMIT_READS 2 // reads of an id in this session before it is transcoded
+#define TRANSCODE_RECORD_SIZE 48
+#define TRANSCODE_REPORT_ENTRIES 16
+
+// Fast codec: LZ4-style sequences of a token byte (literal count << 4 | match length - 4), the
+// literal bytes and a 16-bit match offset; counts of 15 continue in following bytes.
+#define TRANSCODE_CODEC_RAW 0
+#define TRANSCODE_CODEC_FAST_LZ 1
+
+#define FAST_LZ_MIN_MATCH 4
+#define FAST_LZ_HASH_BITS 14
+#define FAST_LZ_MAX_OFFSET 65535
+
+// Worst case size of fast_lz_compress output
+#define FAST_LZ_BOUND(size) ((size) + (size) / 255 + 16)
+
+// Compress size bytes into output (FAST_LZ_BOUND(size) bytes); returns the compressed size
+uint32_t fast_lz_compress(const uint8_t *input, uint32_t size, uint8_t *output);
+
+// Decompress exactly output_size bytes; returns false on malformed input
+bool fast_lz_decompress(const uint8_t *input, uint32_t input_size, uint8_t *output, uint32_t output_size);
+
+typedef struct
+{
+    uint32_t mft_slot;
+    uint32_t crc;        // MFTData.crc when the entry was transcoded
+    uint32_t mft_size;   // MFTData.size, checked alongside the crc
+    uint64_t mft_offset; // MFTData.offset, likewise
+    uint32_t uncompressed_size;
+    uint32_t stored_size;
+    uint8_t codec;
+    uint64_t offset; // payload offset in the cache file
+    uint64_t original_decode_nanoseconds;
+
+    // This session only
+    bool used;
+    uint32_t reads; // admission counter before the entry is stored
+    bool stored;
+    uint32_t hits;
+    uint64_t hit_nanoseconds;
+    uint64_t last_used;
+} TranscodeEntry;
+
+typedef struct
+{
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t stale; // stored for an older version of the entry
+    uint64_t admissions;
+    uint64_t compactions;
+    uint64_t hit_nanoseconds;
+    uint64_t original_nanoseconds; // what the hits would have cost through the archive decoder
+} TranscodeStats;
+
+typedef struct TranscodeCache
+{
+    char *path;
+    FILE *file;
+    uint64_t file_bytes;
+    uint64_t max_bytes;
+    uint32_t admit_reads;
+    bool failed; // writes disabled after an I/O error
+
+    TranscodeEntry *entries; // open addressing on mft_slot
+    uint32_t mask;
+    uint32_t count;
+    uint64_t clock;
+
+    TranscodeStats stats;
+    mtx_t mutex;
+} TranscodeCache;
+
+// Open or create the cache file at path and attach it to the archive. max_bytes 0 uses
+// TRANSCODE_DEFAULT_BYTES and admit_reads 0 uses TRANSCODE_DEFAULT_ADMIT_READS.
+bool enable_transcode_cache(DatFile *dat_file, const char *path, uint64_t max_bytes, uint32_t admit_reads);
+void disable_transcode_cache(DatFile *dat_file);
+
+// Return the entry in mft_slot from the cache if it is stored for this version of the MFT record,
+// NULL otherwise. The result is released with buffer_free.
+uint8_t *transcode_cache_lookup(DatFile *dat_file, uint32_t mft_slot, const MFTData *mft_entry, uint32_t *size);
+
+// Report an entry decoded from the archive in decode_nanoseconds; stores it once it has been
+// read admit_reads times
+void transcode_cache_offer(DatFile *dat_file, uint32_t mft_slot, const MFTData *mft_entry, const uint8_t *data, uint32_t size, uint64_t decode_nanoseconds);
+
+void print_transcode_report(const DatFile *dat_file);
+
+#endif // TRANSCODE_H
@@ -1,4 +1,16 @@
 #if !defined(WACKO_H)
 #define WACKO_H
+#include "batchread.h"
 #include "datfile.h"
+#include "export.h"
+#include "listing.h"
+#include "membudget.h"
+#include "overlay.h"
+#include "pardecode.h"
+#include "prefetch.h"
+#include "reload.h"
+#include "repack.h"
+#include "seekindex.h"
+#include "transcode.h"
+#include "wacko_api.h"
 #endif // WACKO_H
@@ -0,0 +1,335 @@
+#ifndef WACKO_HPP
+#define WACKO_HPP
+
+// C++17 interface over wacko_api.h, header only. Archive owns a WackoArchive handle and closes it;
+// Buffer owns an entry buffer returned by the library and releases it with wacko_free. Both are
+// move-only, so an entry travels from the decoder to its last user without being copied, and
+// neither adds an allocation to the C calls underneath. Payload bytes are seen through ByteView,
+// std::span<const std::byte> under C++20 and a minimal stand-in before that.
+//
+// Failures other than a missing id throw wacko::Error carrying the WackoStatus; lookup reports a
+// missing id as an empty std::optional.
+
+extern "C"
+{
+#include "wacko_api.h"
+}
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+namespace wacko
+{
+
+#if defined(__cpp_lib_span)
+using ByteView = std::span<const std::byte>;
+#else
+// The part of std::span<const std::byte> the wrapper needs
+class ByteView
+{
+  public:
+    constexpr ByteView() noexcept = default;
+    constexpr ByteView(const std::byte *data, std::size_t size) noexcept : data_(data), size_(size)
+    {
+    }
+
+    constexpr const std::byte *data() const noexcept
+    {
+        return data_;
+    }
+    constexpr std::size_t size() const noexcept
+    {
+        return size_;
+    }
+    constexpr bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+    constexpr const std::byte *begin() const noexcept
+    {
+        return data_;
+    }
+    constexpr const std::byte *end() const noexcept
+    {
+        return data_ + size_;
+    }
+    constexpr const std::byte &operator[](std::size_t index) const noexcept
+    {
+        return data_[index];
+    }
+    constexpr ByteView subspan(std::size_t offset, std::size_t count) const noexcept
+    {
+        return ByteView(data_ + offset, count);
+    }
+
+  private:
+    const std::byte *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+#endif
+
+using EntryInfo = WackoEntryInfo;
+
+class Error : public std::runtime_error
+{
+  public:
+    explicit Error(WackoStatus status) : std::runtime_error(wacko_status_string(status)), status_(status)
+    {
+    }
+
+    WackoStatus status() const noexcept
+    {
+        return status_;
+    }
+
+  private:
+    WackoStatus status_;
+};
+
+inline void check(WackoStatus status)
+{
+    if (status != WACKO_OK)
+    {
+        throw Error(status);
+    }
+}
+
+// An entry buffer from the library: adopted as returned, released with wacko_free
+class Buffer
+{
+  public:
+    Buffer() noexcept = default;
+    Buffer(uint8_t *data, uint32_t size) noexcept : data_(data), size_(size)
+    {
+    }
+    Buffer(Buffer &&other) noexcept : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0))
+    {
+    }
+    Buffer &operator=(Buffer &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+    ~Buffer()
+    {
+        reset();
+    }
+
+    const std::byte *data() const noexcept
+    {
+        return reinterpret_cast<const std::byte *>(data_);
+    }
+    uint8_t *bytes() noexcept
+    {
+        return data_;
+    }
+    uint32_t size() const noexcept
+    {
+        return size_;
+    }
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+    explicit operator bool() const noexcept
+    {
+        return data_ != nullptr;
+    }
+    ByteView view() const noexcept
+    {
+        return ByteView(data(), size_);
+    }
+    operator ByteView() const noexcept
+    {
+        return view();
+    }
+
+    // Give the buffer back to C code, which releases it with wacko_free
+    uint8_t *release() noexcept
+    {
+        size_ = 0;
+        return std::exchange(data_, nullptr);
+    }
+    void reset() noexcept
+    {
+        wacko_free(std::exchange(data_, nullptr));
+        size_ = 0;
+    }
+
+  private:
+    uint8_t *data_ = nullptr;
+    uint32_t size_ = 0;
+};
+
+// Every MFT record from slot 1 on, read page by page as the walk reaches it
+class EntryIterator
+{
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = EntryInfo;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const EntryInfo *;
+    using reference = EntryInfo;
+
+    EntryIterator(WackoArchive *archive, uint32_t mft_slot) noexcept : archive_(archive), mft_slot_(mft_slot)
+    {
+    }
+
+    EntryInfo operator*() const
+    {
+        EntryInfo info;
+        check(wacko_entry_info(archive_, mft_slot_, &info));
+        return info;
+    }
+    EntryIterator &operator++() noexcept
+    {
+        ++mft_slot_;
+        return *this;
+    }
+    EntryIterator operator++(int) noexcept
+    {
+        EntryIterator previous = *this;
+        ++mft_slot_;
+        return previous;
+    }
+    bool operator==(const EntryIterator &other) const noexcept
+    {
+        return mft_slot_ == other.mft_slot_;
+    }
+    bool operator!=(const EntryIterator &other) const noexcept
+    {
+        return mft_slot_ != other.mft_slot_;
+    }
+
+  private:
+    WackoArchive *archive_;
+    uint32_t mft_slot_;
+};
+
+class Archive
+{
+  public:
+    explicit Archive(const char *file_path, uint32_t flags = WACKO_OPEN_LAZY | WACKO_OPEN_BACKGROUND_INDEX)
+    {
+        check(wacko_open(file_path, flags, &archive_));
+    }
+    Archive(Archive &&other) noexcept : archive_(std::exchange(other.archive_, nullptr))
+    {
+    }
+    Archive &operator=(Archive &&other) noexcept
+    {
+        if (this != &other)
+        {
+            wacko_close(archive_);
+            archive_ = std::exchange(other.archive_, nullptr);
+        }
+        return *this;
+    }
+    Archive(const Archive &) = delete;
+    Archive &operator=(const Archive &) = delete;
+    ~Archive()
+    {
+        wacko_close(archive_);
+    }
+
+    // The handle, for the parts of wacko_api.h not wrapped here
+    WackoArchive *native() const noexcept
+    {
+        return archive_;
+    }
+
+    uint32_t entry_count() const noexcept
+    {
+        return wacko_entry_count(archive_);
+    }
+
+    std::optional<EntryInfo> lookup(uint32_t id) const
+    {
+        EntryInfo info;
+        WackoStatus status = wacko_lookup(archive_, id, &info);
+        if (status == WACKO_ERROR_NOT_FOUND)
+        {
+            return std::nullopt;
+        }
+        check(status);
+        return info;
+    }
+
+    Buffer extract(uint32_t id) const
+    {
+        uint8_t *data = nullptr;
+        uint32_t size = 0;
+        check(wacko_extract(archive_, id, &data, &size));
+        return Buffer(data, size);
+    }
+
+    Buffer extract_range(uint32_t id, uint32_t offset, uint32_t length) const
+    {
+        uint8_t *data = nullptr;
+        uint32_t size = 0;
+        check(wacko_extract_range(archive_, id, offset, length, &data, &size));
+        return Buffer(data, size);
+    }
+
+    Buffer extract_prefix(uint32_t id, uint32_t length) const
+    {
+        uint8_t *data = nullptr;
+        uint32_t size = 0;
+        check(wacko_extract_prefix(archive_, id, length, &data, &size));
+        return Buffer(data, size);
+    }
+
+    void export_to(uint32_t id, const char *output_path) const
+    {
+        check(wacko_export(archive_, id, output_path));
+    }
+
+    // on_entry(id, Buffer) runs on the batch's decompression workers, several at a time, and must not
+    // throw. A Buffer that tests false means that entry could not be read or decoded.
+    template <typename Callback>
+    BatchReadStats read_batch(const uint32_t *ids, uint32_t count, Callback &&on_entry, const BatchReadOptions *options = nullptr) const
+    {
+        BatchReadStats stats;
+        check(wacko_read_batch(archive_, ids, count, options, &deliver<std::remove_reference_t<Callback>>, &on_entry, &stats));
+        return stats;
+    }
+
+    EntryIterator begin() const noexcept
+    {
+        return EntryIterator(archive_, 1);
+    }
+    EntryIterator end() const noexcept
+    {
+        uint32_t count = entry_count();
+        return EntryIterator(archive_, count > 1 ? count : 1);
+    }
+
+  private:
+    template <typename Callback>
+    static void deliver(void *context, uint32_t id, uint8_t *data, uint32_t size) noexcept
+    {
+        (*static_cast<Callback *>(context))(id, Buffer(data, size));
+    }
+
+    WackoArchive *archive_ = nullptr;
+};
+
+} // namespace wacko
+
+#endif // WACKO_HPP
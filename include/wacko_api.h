@@ -0,0 +1,103 @@
+#ifndef WACKO_API_H
+#define WACKO_API_H
+
+#include "batchread.h"
+#include "datfile.h"
+#include "prefetch.h"
+#include "reload.h"
+#include "seekindex.h"
+
+// Handle-based interface for long-running users of the library. No function here exits the
+// process; failures are reported as a WackoStatus and leave the archive, its id index and
+// its caches open and usable for the next call.
+
+typedef enum
+{
+    WACKO_OK = 0,
+    WACKO_ERROR_INVALID_ARGUMENT,
+    WACKO_ERROR_OPEN_FAILED,
+    WACKO_ERROR_BAD_FORMAT,
+    WACKO_ERROR_NOT_FOUND,
+    WACKO_ERROR_IO,
+    WACKO_ERROR_CORRUPT_DATA,
+    WACKO_ERROR_OUT_OF_MEMORY
+} WackoStatus;
+
+// Open flags for wacko_open
+#define WACKO_OPEN_LAZY DAT_OPEN_LAZY                         // read MFT pages on first use
+#define WACKO_OPEN_BACKGROUND_INDEX DAT_OPEN_BACKGROUND_INDEX // build the id index on a worker thread
+
+typedef struct
+{
+    uint32_t mft_slot;
+    uint64_t offset;
+    uint32_t size;
+    bool compressed;
+    uint32_t crc;
+} WackoEntryInfo;
+
+typedef struct WackoArchive
+{
+    DatFile dat_file;
+    SeekIndexStore seek_index;
+    FILE *file; // shared by all reads, guarded by io_mutex
+    mtx_t io_mutex;
+    ArchiveReloader *reloader; // hands out the current tables; dat_file is only the first of them
+} WackoArchive;
+
+const char *wacko_status_string(WackoStatus status);
+
+WackoStatus wacko_open(const char *file_path, uint32_t flags, WackoArchive **archive);
+void wacko_close(WackoArchive *archive);
+
+uint32_t wacko_entry_count(const WackoArchive *archive);
+
+// Resolve a file id or base id and describe its MFT record
+WackoStatus wacko_lookup(WackoArchive *archive, uint32_t id, WackoEntryInfo *info);
+
+// Describe the MFT record in a slot, 1 <= mft_slot < wacko_entry_count, for walking every record
+WackoStatus wacko_entry_info(WackoArchive *archive, uint32_t mft_slot, WackoEntryInfo *info);
+
+// Read and decompress a whole entry; on success *data must be released with wacko_free
+WackoStatus wacko_extract(WackoArchive *archive, uint32_t id, uint8_t **data, uint32_t *size);
+
+// wacko_extract that also fills info with the record the data was decoded from, so a cache kept by
+// the caller can compare it with a later wacko_lookup and notice a patched entry
+WackoStatus wacko_extract_with_info(WackoArchive *archive, uint32_t id, WackoEntryInfo *info, uint8_t **data, uint32_t *size);
+
+// Read bytes [offset, offset + length) of an entry's uncompressed contents, resuming from decode
+// checkpoints after the first call for that entry. *size may be less than length at the end.
+WackoStatus wacko_extract_range(WackoArchive *archive, uint32_t id, uint32_t offset, uint32_t length, uint8_t **data, uint32_t *size);
+
+// Read only the first length bytes of an entry, decoding no further than needed
+WackoStatus wacko_extract_prefix(WackoArchive *archive, uint32_t id, uint32_t length, uint8_t **data, uint32_t *size);
+
+// Write a whole entry to output_path, decoding straight into the mapped file where possible (see export.h)
+WackoStatus wacko_export(WackoArchive *archive, uint32_t id, const char *output_path);
+
+// Read many entries with several reads in flight and decode them on worker threads (see
+// batchread.h). callback may run on several threads at once; options and stats may be NULL.
+WackoStatus wacko_read_batch(WackoArchive *archive, const uint32_t *ids, uint32_t count, const BatchReadOptions *options,
+                             BatchEntryCallback callback, void *context, BatchReadStats *stats);
+
+// Attach access tracing, read-ahead and the entry cache (see prefetch.h)
+WackoStatus wacko_enable_prefetch(WackoArchive *archive, uint32_t prefetch_flags, const char *replay_path, const char *record_path, size_t cache_bytes);
+
+// Serve hot entries from a persistent cache file in a faster codec (see transcode.h). max_bytes
+// and admit_reads may be 0 for the defaults.
+WackoStatus wacko_enable_transcode_cache(WackoArchive *archive, const char *path, uint64_t max_bytes, uint32_t admit_reads);
+
+// Pick up patches written to the archive while it is open (see reload.h). Changed entries are
+// dropped from the seek index and the entry cache, and callback, which may be NULL, is told the
+// slots of any it keeps itself. Safe to call while other calls run. Enable the prefetcher and the
+// transcode cache first: neither can be attached once the watcher runs or wacko_reload has swapped
+// the tables. quiet_milliseconds may be 0 for the default.
+WackoStatus wacko_enable_live_reload(WackoArchive *archive, uint32_t quiet_milliseconds, ReloadCallback callback, void *context);
+
+// Check the header now and reload the tables if the archive changed, without a watcher thread.
+// Safe to call while other calls run.
+WackoStatus wacko_reload(WackoArchive *archive);
+
+void wacko_free(void *data);
+
+#endif // WACKO_API_H
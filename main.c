@@ -1,7 +1,244 @@
 #include "wacko.h"
+#if defined(__linux__)
+#include "server.h"
 
-int main()
+// wacko serve [--socket path] [--http port] [--workers n] [--cache-mb n] [--tcache path] [--live-reload] <path.dat>
+static int serve_main(int argc, char **argv)
 {
+    ServerOptions options;
+    memset(&options, 0, sizeof(ServerOptions));
+    const char *file_path = NULL;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+        {
+            options.socket_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--http") == 0 && i + 1 < argc)
+        {
+            options.http_port = (uint16_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+        {
+            options.workers = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc)
+        {
+            options.cache_bytes = (size_t)strtoul(argv[++i], NULL, 10) << 20;
+        }
+        else if (strcmp(argv[i], "--tcache") == 0 && i + 1 < argc)
+        {
+            options.transcode_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--live-reload") == 0)
+        {
+            options.live_reload = true;
+        }
+        else
+        {
+            file_path = argv[i];
+        }
+    }
+
+    if (file_path == NULL)
+    {
+        fprintf(stderr, "Usage: %s serve [--socket path] [--http port] [--workers n] [--cache-mb n] [--tcache path] [--live-reload] <path.dat>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.socket_path == NULL && options.http_port == 0)
+    {
+        options.socket_path = "wacko.sock";
+    }
+    return run_server(file_path, &options) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+// wacko repack [--trace path] [--write-mb n] [--align n] [--timed] <input.dat> <output.dat>
+static int repack_main(int argc, char **argv)
+{
+    RepackOptions options;
+    memset(&options, 0, sizeof(RepackOptions));
+    AccessTrace trace;
+    memset(&trace, 0, sizeof(AccessTrace));
+    const char *trace_path = NULL;
+    const char *paths[2] = {NULL, NULL};
+    int positional = 0;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--write-mb") == 0 && i + 1 < argc)
+        {
+            options.write_buffer_size = (uint32_t)strtoul(argv[++i], NULL, 10) << 20;
+        }
+        else if (strcmp(argv[i], "--align") == 0 && i + 1 < argc)
+        {
+            options.alignment = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--timed") == 0)
+        {
+            options.timed = true;
+        }
+        else if (positional < 2)
+        {
+            paths[positional++] = argv[i];
+        }
+    }
+
+    if (paths[1] == NULL)
+    {
+        fprintf(stderr, "Usage: %s repack [--trace path] [--write-mb n] [--align n] [--timed] <input.dat> <output.dat>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (trace_path != NULL)
+    {
+        if (!load_access_trace(&trace, trace_path))
+        {
+            return EXIT_FAILURE;
+        }
+        options.order = REPACK_ORDER_TRACE;
+        options.trace = &trace;
+    }
+
+    RepackStats stats;
+    bool ok = repack_dat_file(paths[0], paths[1], &options, &stats);
+    if (ok)
+    {
+        print_repack_report(&stats);
+    }
+    free(trace.ids);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// wacko list [--json] [--threads n] [--gap-kb n] [--output path] <path.dat>
+static int list_main(int argc, char **argv)
+{
+    ListOptions options;
+    memset(&options, 0, sizeof(ListOptions));
+    uint32_t format = LIST_FORMAT_TSV;
+    const char *output_path = NULL;
+    const char *file_path = NULL;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+        {
+            format = LIST_FORMAT_JSON;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            options.threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--gap-kb") == 0 && i + 1 < argc)
+        {
+            options.coalesce_gap = (uint32_t)strtoul(argv[++i], NULL, 10) << 10;
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else
+        {
+            file_path = argv[i];
+        }
+    }
+
+    if (file_path == NULL)
+    {
+        fprintf(stderr, "Usage: %s list [--json] [--threads n] [--gap-kb n] [--output path] <path.dat>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ListEntry *entries = NULL;
+    uint32_t count = 0;
+    ListStats stats;
+    if (!list_dat_entries(file_path, &options, &entries, &count, &stats))
+    {
+        return EXIT_FAILURE;
+    }
+
+    FILE *output = output_path != NULL ? fopen(output_path, "w") : stdout;
+    if (output == NULL)
+    {
+        perror(output_path);
+        free(entries);
+        return EXIT_FAILURE;
+    }
+    bool ok = write_list(output, entries, count, format);
+    if (output != stdout)
+    {
+        ok = fclose(output) == 0 && ok;
+    }
+    print_list_report(&stats);
+    free(entries);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void release_batch_entry(void *context, uint32_t id, uint8_t *data, uint32_t size)
+{
+    (void)context;
+    (void)size;
+    if (data == NULL)
+    {
+        fprintf(stderr, "Batch read of %u failed\n", id);
+    }
+    buffer_free(data);
+}
+
+static int overlay_main(const char *file_path, const char **overlay_paths, uint32_t num_overlays, const uint32_t *ids, uint32_t num_ids)
+{
+    // Highest precedence first: the last --overlay, down to the main archive
+    const char *paths[OVERLAY_MAX_ARCHIVES];
+    for (uint32_t i = 0; i < num_overlays; ++i)
+    {
+        paths[i] = overlay_paths[num_overlays - 1 - i];
+    }
+    paths[num_overlays] = file_path;
+
+    DatOverlay overlay;
+    if (!open_dat_overlay(&overlay, paths, num_overlays + 1))
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < num_ids; ++i)
+    {
+        uint32_t size = 0;
+        uint32_t archive = 0;
+        uint8_t *data = extract_overlay_data(&overlay, ids[i], &size, &archive);
+        if (data)
+        {
+            printf("File ID %u: %u bytes from %s\n", ids[i], size, paths[archive]);
+            buffer_free(data);
+        }
+    }
+
+    print_overlay_report(&overlay);
+    close_dat_overlay(&overlay);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+#if defined(__linux__)
+    if (argc > 1 && strcmp(argv[1], "serve") == 0)
+    {
+        return serve_main(argc, argv);
+    }
+#endif
+    if (argc > 1 && strcmp(argv[1], "repack") == 0)
+    {
+        return repack_main(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "list") == 0)
+    {
+        return list_main(argc, argv);
+    }
+
     DatFile dat_file;
     // Initialize dat_file (optionally, you can set it to default values)
     memset(&dat_file, 0, sizeof(DatFile));
@@ -9,27 +246,234 @@ int main()
     // Load the DAT file
     const char *file_path = "Local.dat"; // Change to your actual path if needed
     // const char *file_path = "C:\\Program Files (x86)\\Steam\\steamapps\\common\\Guild Wars 2\\Gw2.dat"; // Change to your actual path if needed
-    load_dat_file(file_path, &dat_file);
+
+    // Optional access tracing: --record <trace> writes the ids requested by this run,
+    // --replay <trace> uses a recorded trace as read-ahead hints, --speculative also decodes ahead
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    uint32_t prefetch_flags = 0;
+
+    // --pool <MB> keeps released entry buffers for reuse by the next extraction and prints allocation counts
+    bool report_buffers = false;
+
+    // --tcache <path> [--tcache-mb <MB>] serves entries from, and adds them to, a persistent transcode cache
+    const char *transcode_path = NULL;
+    uint64_t transcode_bytes = 0;
+
+    // --export <dir> writes each requested entry to <dir>/<id>.bin instead of extracting it to memory
+    const char *export_dir = NULL;
+    ExportStats export_stats;
+    memset(&export_stats, 0, sizeof(ExportStats));
+
+    // --batch <auto|uring|pread|sync> [--queue-depth n] reads all requested entries as one batch
+    bool batch = false;
+    BatchReadOptions batch_options;
+    memset(&batch_options, 0, sizeof(BatchReadOptions));
+
+    // --memory-mb <MB> caps the decoded bytes a batch holds at once; entries too large for it are streamed
+    uint64_t memory_budget_bytes = 0;
+    MemoryBudget memory_budget;
+
+    // --tree-cache <on|off> switches Huffman tree reuse and prints how much decode time tree building took
+    bool report_trees = false;
+
+    // --parallel-decode <n> [--parallel-mb MB] decodes entries of at least MB megabytes on n threads
+    uint32_t parallel_threads = 1;
+    uint32_t parallel_threshold = 0;
+
+    // --overlay <path> stacks another archive over the main one, later ones on top, and looks ids up
+    // through one merged index
+    const char *overlay_paths[OVERLAY_MAX_ARCHIVES];
+    uint32_t num_overlays = 0;
+
+    // Example: Extract MFT data based on file ID or base ID
+    uint32_t search_ids[256];
+    uint32_t num_search_ids = 0;
+
+    int positional = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            record_path = argv[++i];
+            prefetch_flags |= PREFETCH_RECORD;
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            replay_path = argv[++i];
+            prefetch_flags |= PREFETCH_HINT;
+        }
+        else if (strcmp(argv[i], "--speculative") == 0)
+        {
+            prefetch_flags |= PREFETCH_SPECULATIVE;
+        }
+        else if (strcmp(argv[i], "--pool") == 0 && i + 1 < argc)
+        {
+            set_buffer_pool_limit((size_t)strtoul(argv[++i], NULL, 10) << 20);
+            report_buffers = true;
+        }
+        else if (strcmp(argv[i], "--tcache") == 0 && i + 1 < argc)
+        {
+            transcode_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tcache-mb") == 0 && i + 1 < argc)
+        {
+            transcode_bytes = (uint64_t)strtoull(argv[++i], NULL, 10) << 20;
+        }
+        else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc)
+        {
+            export_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            if (!parse_batch_engine(argv[++i], &batch_options.engine))
+            {
+                fprintf(stderr, "Unknown batch engine %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            batch = true;
+        }
+        else if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc)
+        {
+            batch_options.queue_depth = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--memory-mb") == 0 && i + 1 < argc)
+        {
+            memory_budget_bytes = (uint64_t)strtoull(argv[++i], NULL, 10) << 20;
+        }
+        else if (strcmp(argv[i], "--tree-cache") == 0 && i + 1 < argc)
+        {
+            set_huffman_tree_cache_enabled(strcmp(argv[++i], "off") != 0);
+            report_trees = true;
+        }
+        else if (strcmp(argv[i], "--parallel-decode") == 0 && i + 1 < argc)
+        {
+            parallel_threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--parallel-mb") == 0 && i + 1 < argc)
+        {
+            parallel_threshold = (uint32_t)strtoul(argv[++i], NULL, 10) << 20;
+        }
+        else if (strcmp(argv[i], "--overlay") == 0 && i + 1 < argc)
+        {
+            if (num_overlays + 1 < OVERLAY_MAX_ARCHIVES)
+            {
+                overlay_paths[num_overlays++] = argv[++i];
+            }
+            else
+            {
+                ++i;
+            }
+        }
+        else if (positional++ == 0)
+        {
+            file_path = argv[i];
+        }
+        else if (num_search_ids < sizeof(search_ids) / sizeof(search_ids[0]))
+        {
+            search_ids[num_search_ids++] = (uint32_t)strtoul(argv[i], NULL, 10);
+        }
+    }
+
+    if (parallel_threads != 1)
+    {
+        set_parallel_decode(parallel_threads, parallel_threshold);
+    }
+
+    if (num_search_ids == 0)
+    {
+        search_ids[num_search_ids++] = 308; // Change this to the ID you want to search for
+    }
+
+    if (num_overlays > 0)
+    {
+        return overlay_main(file_path, overlay_paths, num_overlays, search_ids, num_search_ids);
+    }
+
+    // A single lookup only needs the headers up front; MFT pages and the id index are read on demand
+    if (!load_dat_file_ex(file_path, &dat_file, DAT_OPEN_LAZY | DAT_OPEN_BACKGROUND_INDEX))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (prefetch_flags != 0 && !enable_prefetcher(&dat_file, prefetch_flags, replay_path, record_path, 0))
+    {
+        fprintf(stderr, "Failed to set up prefetching\n");
+    }
+
+    // A one-shot run only sees each id once, so admit entries on their first read
+    if (transcode_path != NULL && !enable_transcode_cache(&dat_file, transcode_path, transcode_bytes, 1))
+    {
+        fprintf(stderr, "Failed to open the transcode cache\n");
+    }
 
     // Print out the parsed data for debugging purposes
     printf("\nDAT File Version: %d\n", dat_file.header.version);
     printf("MFT Header Identifier: %.4s\n", dat_file.mft_header.identifier);
     printf("Number of MFT Entries: %u\n\n", dat_file.mft_header.num_entries);
 
-    // Example: Extract MFT data based on file ID or base ID
-    uint32_t search_id = 308; // Change this to the ID you want to search for
+    for (uint32_t i = 0; export_dir != NULL && !batch && i < num_search_ids; ++i)
+    {
+        char output_path[4096];
+        snprintf(output_path, sizeof(output_path), "%s/%u.bin", export_dir, search_ids[i]);
+        export_mft_data(&dat_file, search_ids[i], output_path, &export_stats);
+    }
+
+    if (batch && memory_budget_bytes != 0)
+    {
+        init_memory_budget(&memory_budget, memory_budget_bytes);
+        batch_options.budget = &memory_budget;
+    }
+
+    BatchReadStats batch_stats;
+    if (batch && export_dir != NULL)
+    {
+        export_batch(&dat_file, search_ids, num_search_ids, export_dir, &batch_options, &export_stats, &batch_stats);
+        print_batch_report(&batch_stats);
+    }
+    else if (batch)
+    {
+        batch_read_entries(&dat_file, search_ids, num_search_ids, &batch_options, release_batch_entry, NULL, &batch_stats);
+        print_batch_report(&batch_stats);
+    }
+    if (batch_options.budget != NULL)
+    {
+        print_memory_budget_report(&memory_budget);
+        destroy_memory_budget(&memory_budget);
+    }
 
-    uint8_t *mft_data = extract_mft_data(file_path, &dat_file, search_id);
-    if (mft_data)
+    for (uint32_t i = 0; export_dir == NULL && !batch && i < num_search_ids; ++i)
+    {
+        uint8_t *mft_data = extract_mft_data(file_path, &dat_file, search_ids[i]);
+        if (mft_data)
+        {
+            // Successfully extracted data, use it as needed
+            // For example, do something with mft_data here
+            buffer_free(mft_data); // Free after use
+        }
+    }
+
+    print_prefetch_report(&dat_file);
+    print_transcode_report(&dat_file);
+    if (export_dir != NULL)
+    {
+        print_export_report(&export_stats);
+    }
+    if (report_buffers)
+    {
+        print_buffer_report();
+    }
+    if (report_trees)
+    {
+        print_huffman_cache_report();
+    }
+    if (parallel_threads != 1)
     {
-        // Successfully extracted data, use it as needed
-        // For example, do something with mft_data here
-        free(mft_data); // Free after use
+        print_parallel_decode_report();
     }
 
     // Clean up allocated memory
-    free(dat_file.mft_data);
-    free(dat_file.mft_index_data);
+    close_dat_file(&dat_file);
 
     return 0;
 }
@@ -0,0 +1,1013 @@
+#include "batchread.h"
+#include "prefetch.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BATCH_HAVE_PREAD 1
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#define BATCH_HAVE_URING 1
+#include <stdatomic.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#define BATCH_NO_SLOT UINT32_MAX
+
+typedef struct
+{
+    uint32_t id;
+    MFTData mft_entry;
+} BatchItem;
+
+// A finished read waiting for a decompression worker
+typedef struct
+{
+    uint32_t item;
+    uint32_t slot;
+    uint8_t *payload; // the slot's buffer, or a buffer of its own for payloads over slot_size
+    bool failed;
+} BatchJob;
+
+typedef struct
+{
+    const BatchItem *items;
+    uint32_t count;
+    BatchEntryCallback callback;
+    BatchChunkCallback chunk_callback;
+    BatchPayloadCallback payload_callback;
+    void *context;
+    bool raw;
+    MemoryBudget *budget;
+    uint32_t stream_threshold; // outputs above this go to chunk_callback
+    int fd;
+
+    uint8_t *arena; // slot_count buffers of slot_size bytes
+    bool arena_in_kernel; // io_uring reads into it could not be drained, so it must not be freed
+    uint32_t slot_size;
+    uint32_t slot_count;
+
+    mtx_t mutex;
+    cnd_t job_ready;
+    cnd_t slot_free;
+    BatchJob *jobs; // ring of slot_count pending jobs, one per slot at most
+    uint32_t job_head;
+    uint32_t job_count;
+    uint32_t *free_slots;
+    uint32_t free_count;
+    uint32_t next_item; // pread engine: next item to read
+    bool done;          // no more jobs will be queued
+
+    BatchReadStats *stats; // updated under mutex
+} BatchRun;
+
+const char *batch_engine_name(uint32_t engine)
+{
+    switch (engine)
+    {
+    case BATCH_ENGINE_URING:
+        return "io_uring";
+    case BATCH_ENGINE_PREAD:
+        return "pread";
+    case BATCH_ENGINE_SYNC:
+        return "sync";
+    default:
+        return "auto";
+    }
+}
+
+bool parse_batch_engine(const char *name, uint32_t *engine)
+{
+    static const char *const names[] = {"auto", "uring", "pread", "sync"};
+    for (uint32_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            *engine = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int compare_batch_offset(const void *a, const void *b)
+{
+    uint64_t left = ((const BatchItem *)a)->mft_entry.offset;
+    uint64_t right = ((const BatchItem *)b)->mft_entry.offset;
+    return left < right ? -1 : left > right;
+}
+
+// Turn a complete payload into what the callback receives. owned says whether payload is a buffer
+// of its own, which is then reused or released, or a slot that must be copied out of.
+static uint8_t *batch_finish_entry(const BatchRun *run, const BatchItem *item, uint8_t *payload, bool owned, uint32_t *size)
+{
+    const MFTData *mft_entry = &item->mft_entry;
+    if (run->raw || mft_entry->compression_flag == 0)
+    {
+        *size = mft_entry->size;
+        if (owned)
+        {
+            return payload;
+        }
+        uint8_t *copy = (uint8_t *)buffer_alloc(mft_entry->size ? mft_entry->size : 1);
+        if (copy != NULL)
+        {
+            memcpy(copy, payload, mft_entry->size);
+        }
+        return copy;
+    }
+
+    *size = peek_decompressed_size(payload, mft_entry->size);
+    uint8_t *output = (uint8_t *)buffer_alloc(*size ? *size : 1);
+    if (output != NULL && !decompress_data_into(payload, mft_entry->size, output, *size))
+    {
+        buffer_free(output);
+        output = NULL;
+    }
+    if (owned)
+    {
+        buffer_free(payload);
+    }
+    return output;
+}
+
+static void batch_report_entry(BatchRun *run, uint32_t id, uint8_t *data, uint32_t size)
+{
+    mtx_lock(&run->mutex);
+    ++run->stats->entries;
+    if (data != NULL)
+    {
+        run->stats->bytes_output += size;
+    }
+    else
+    {
+        ++run->stats->failures;
+    }
+    mtx_unlock(&run->mutex);
+    run->callback(run->context, id, data, data != NULL ? size : 0);
+}
+
+// --- Slots and the worker queue ---
+
+static uint8_t *batch_slot_buffer(const BatchRun *run, uint32_t slot)
+{
+    return run->arena + (size_t)slot * run->slot_size;
+}
+
+static void batch_release_slot(BatchRun *run, uint32_t slot)
+{
+    if (slot == BATCH_NO_SLOT)
+    {
+        return;
+    }
+    mtx_lock(&run->mutex);
+    run->free_slots[run->free_count++] = slot;
+    cnd_signal(&run->slot_free);
+    mtx_unlock(&run->mutex);
+}
+
+// Decode a large entry a chunk at a time into chunk_callback, holding one stream buffer however big it is
+static void batch_stream_entry(BatchRun *run, const BatchItem *item, uint8_t *payload)
+{
+    DecodeStream stream;
+    bool ok = begin_decode_stream(&stream, payload, item->mft_entry.size, 0);
+    uint32_t offset = 0;
+    while (ok)
+    {
+        const uint8_t *chunk = NULL;
+        uint32_t chunk_size = 0;
+        ok = decode_stream_next(&stream, &chunk, &chunk_size);
+        if (!ok || chunk_size == 0)
+        {
+            break;
+        }
+        run->chunk_callback(run->context, item->id, chunk, chunk_size, offset, stream.decompressed_size);
+        offset += chunk_size;
+    }
+    if (!ok)
+    {
+        run->chunk_callback(run->context, item->id, NULL, 0, offset, stream.decompressed_size);
+    }
+    end_decode_stream(&stream);
+
+    mtx_lock(&run->mutex);
+    ++run->stats->entries;
+    ++run->stats->streamed;
+    if (ok)
+    {
+        run->stats->bytes_output += offset;
+    }
+    else
+    {
+        ++run->stats->failures;
+    }
+    mtx_unlock(&run->mutex);
+}
+
+// Everything that happens to a read payload: admission against the budget, decoding whole or streamed,
+// handing the slot back and reporting. owned says whether payload is a buffer of its own rather than
+// slot's; slot is BATCH_NO_SLOT when there is none to hand back.
+static void batch_process_entry(BatchRun *run, const BatchItem *item, uint8_t *payload, bool owned, bool failed, uint32_t slot)
+{
+    if (failed)
+    {
+        if (owned)
+        {
+            buffer_free(payload);
+        }
+        batch_release_slot(run, slot);
+        batch_report_entry(run, item->id, NULL, 0);
+        return;
+    }
+
+    // Peek the decoded size before allocating anything for it
+    const MFTData *mft_entry = &item->mft_entry;
+    bool decode = !run->raw && mft_entry->compression_flag != 0;
+    uint32_t output_size = decode ? peek_decompressed_size(payload, mft_entry->size) : mft_entry->size;
+    bool stream = decode && run->chunk_callback != NULL && output_size > run->stream_threshold;
+
+    uint64_t charged = 0;
+    if (run->budget != NULL)
+    {
+        uint64_t bytes = stream ? decode_stream_buffer_size(0) : output_size;
+        charged = memory_budget_acquire(run->budget, decode && owned ? bytes + mft_entry->size : bytes);
+    }
+
+    if (stream)
+    {
+        batch_stream_entry(run, item, payload);
+        if (owned)
+        {
+            buffer_free(payload);
+        }
+        batch_release_slot(run, slot);
+    }
+    else if (run->payload_callback != NULL && !run->raw)
+    {
+        // The payload stays in its slot until the callback has decoded it
+        bool written = run->payload_callback(run->context, item->id, mft_entry, payload, output_size);
+        if (owned)
+        {
+            buffer_free(payload);
+        }
+        batch_release_slot(run, slot);
+
+        mtx_lock(&run->mutex);
+        ++run->stats->entries;
+        if (written)
+        {
+            run->stats->bytes_output += output_size;
+        }
+        else
+        {
+            ++run->stats->failures;
+        }
+        mtx_unlock(&run->mutex);
+    }
+    else
+    {
+        uint32_t size = 0;
+        uint8_t *data = batch_finish_entry(run, item, payload, owned, &size);
+
+        // Hand the slot back before the callback runs so the next read can start meanwhile
+        batch_release_slot(run, slot);
+        batch_report_entry(run, item->id, data, size);
+    }
+
+    if (run->budget != NULL)
+    {
+        memory_budget_release(run->budget, charged);
+    }
+}
+
+// Take a free slot, waiting for a worker to release one if wait is set; BATCH_NO_SLOT if there is none
+static uint32_t batch_take_slot(BatchRun *run, bool wait)
+{
+    mtx_lock(&run->mutex);
+    if (run->free_count == 0 && wait)
+    {
+        uint64_t start = prefetch_now_nanoseconds();
+        while (run->free_count == 0)
+        {
+            cnd_wait(&run->slot_free, &run->mutex);
+        }
+        run->stats->worker_wait_nanoseconds += prefetch_now_nanoseconds() - start;
+    }
+    uint32_t slot = run->free_count > 0 ? run->free_slots[--run->free_count] : BATCH_NO_SLOT;
+    mtx_unlock(&run->mutex);
+    return slot;
+}
+
+static void batch_queue_job(BatchRun *run, uint32_t item, uint32_t slot, uint8_t *payload, bool failed)
+{
+    mtx_lock(&run->mutex);
+    BatchJob *job = &run->jobs[(run->job_head + run->job_count) % run->slot_count];
+    job->item = item;
+    job->slot = slot;
+    job->payload = payload;
+    job->failed = failed;
+    ++run->job_count;
+    cnd_signal(&run->job_ready);
+    mtx_unlock(&run->mutex);
+}
+
+static int batch_worker_main(void *argument)
+{
+    BatchRun *run = (BatchRun *)argument;
+
+    mtx_lock(&run->mutex);
+    for (;;)
+    {
+        while (run->job_count == 0 && !run->done)
+        {
+            cnd_wait(&run->job_ready, &run->mutex);
+        }
+        if (run->job_count == 0)
+        {
+            break;
+        }
+
+        BatchJob job = run->jobs[run->job_head];
+        run->job_head = (run->job_head + 1) % run->slot_count;
+        --run->job_count;
+        mtx_unlock(&run->mutex);
+
+        bool owned = job.payload != batch_slot_buffer(run, job.slot);
+        batch_process_entry(run, &run->items[job.item], job.payload, owned, job.failed, job.slot);
+        mtx_lock(&run->mutex);
+    }
+    mtx_unlock(&run->mutex);
+    return thrd_success;
+}
+
+// Buffer to read an item into: the slot, or a buffer of its own when the payload does not fit
+static uint8_t *batch_read_target(BatchRun *run, uint32_t item, uint32_t slot)
+{
+    uint32_t size = run->items[item].mft_entry.size;
+    return size <= run->slot_size ? batch_slot_buffer(run, slot) : (uint8_t *)buffer_alloc(size);
+}
+
+// --- pread engine ---
+
+#if defined(BATCH_HAVE_PREAD)
+
+static int batch_pread_main(void *argument)
+{
+    BatchRun *run = (BatchRun *)argument;
+    for (;;)
+    {
+        mtx_lock(&run->mutex);
+        uint32_t item = run->next_item < run->count ? run->next_item++ : BATCH_NO_SLOT;
+        mtx_unlock(&run->mutex);
+        if (item == BATCH_NO_SLOT)
+        {
+            break;
+        }
+
+        uint32_t slot = batch_take_slot(run, true);
+        const MFTData *mft_entry = &run->items[item].mft_entry;
+        uint8_t *payload = batch_read_target(run, item, slot);
+        uint64_t start = prefetch_now_nanoseconds();
+        uint32_t done = 0;
+        uint64_t calls = 0;
+        while (payload != NULL && done < mft_entry->size)
+        {
+            ssize_t result = pread(run->fd, payload + done, mft_entry->size - done, (off_t)(mft_entry->offset + done));
+            ++calls;
+            if (result < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (result <= 0)
+            {
+                break;
+            }
+            done += (uint32_t)result;
+        }
+
+        mtx_lock(&run->mutex);
+        run->stats->io_wait_nanoseconds += prefetch_now_nanoseconds() - start;
+        run->stats->system_calls += calls;
+        run->stats->reads += calls;
+        run->stats->bytes_read += done;
+        mtx_unlock(&run->mutex);
+
+        if (payload == NULL)
+        {
+            payload = batch_slot_buffer(run, slot);
+            done = 0;
+        }
+        batch_queue_job(run, item, slot, payload, done != mft_entry->size);
+    }
+    return thrd_success;
+}
+
+static bool batch_run_pread(BatchRun *run, uint32_t queue_depth)
+{
+    uint32_t thread_count = queue_depth < BATCH_MAX_PREAD_THREADS ? queue_depth : BATCH_MAX_PREAD_THREADS;
+    thrd_t *threads = (thrd_t *)calloc(thread_count, sizeof(thrd_t));
+    if (threads == NULL)
+    {
+        return false;
+    }
+
+    uint32_t started = 0;
+    while (started < thread_count && thrd_create(&threads[started], batch_pread_main, run) == thrd_success)
+    {
+        ++started;
+    }
+    if (started == 0)
+    {
+        // Nothing else will claim the items, so read them from this thread
+        batch_pread_main(run);
+    }
+    for (uint32_t i = 0; i < started; ++i)
+    {
+        thrd_join(threads[i], NULL);
+    }
+    free(threads);
+    return true;
+}
+
+#endif
+
+// --- io_uring engine ---
+
+#if defined(BATCH_HAVE_URING)
+
+typedef struct
+{
+    int fd;
+    uint8_t *sq_ring;
+    size_t sq_ring_size;
+    uint8_t *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    _Atomic uint32_t *sq_head;
+    _Atomic uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    _Atomic uint32_t *cq_head;
+    _Atomic uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_cqe *cqes;
+} BatchRing;
+
+// Per slot state of a read in flight
+typedef struct
+{
+    uint32_t item;
+    uint8_t *payload;
+    uint32_t done;
+    bool in_flight;
+} BatchRequest;
+
+static void batch_ring_close(BatchRing *ring)
+{
+    if (ring->sqes != NULL)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+}
+
+static void *batch_ring_map(int fd, size_t size, off_t offset)
+{
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return mapping == MAP_FAILED ? NULL : mapping;
+}
+
+// Set up a ring with at least entries submission slots; false if the kernel has no io_uring or refuses it
+static bool batch_ring_open(BatchRing *ring, uint32_t entries)
+{
+    memset(ring, 0, sizeof(BatchRing));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+    {
+        return false;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+        {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->sq_ring = (uint8_t *)batch_ring_map(ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+        ring->cq_ring = ring->sq_ring;
+    }
+    else
+    {
+        ring->sq_ring = (uint8_t *)batch_ring_map(ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+        ring->cq_ring = (uint8_t *)batch_ring_map(ring->fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)batch_ring_map(ring->fd, ring->sqes_size, IORING_OFF_SQES);
+    if (ring->sq_ring == NULL || ring->cq_ring == NULL || ring->sqes == NULL)
+    {
+        batch_ring_close(ring);
+        return false;
+    }
+
+    ring->sq_head = (_Atomic uint32_t *)(ring->sq_ring + params.sq_off.head);
+    ring->sq_tail = (_Atomic uint32_t *)(ring->sq_ring + params.sq_off.tail);
+    ring->sq_mask = (uint32_t *)(ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (uint32_t *)(ring->sq_ring + params.sq_off.array);
+    ring->cq_head = (_Atomic uint32_t *)(ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (_Atomic uint32_t *)(ring->cq_ring + params.cq_off.tail);
+    ring->cq_mask = (uint32_t *)(ring->cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(ring->cq_ring + params.cq_off.cqes);
+    return true;
+}
+
+// Kernels before 5.6 have io_uring but no IORING_OP_READ, nor the probe to ask about it
+static bool batch_ring_supports_reads(const BatchRing *ring)
+{
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, probe_size);
+    if (probe == NULL)
+    {
+        return false;
+    }
+    bool supported = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+                     probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0 &&
+                     (probe->ops[IORING_OP_READ_FIXED].flags & IO_URING_OP_SUPPORTED) != 0;
+    free(probe);
+    return supported;
+}
+
+// Queue a read of length bytes at offset; fixed_index is the registered buffer holding buffer, or -1
+static void batch_ring_prepare_read(BatchRing *ring, int fd, uint8_t *buffer, uint32_t length, uint64_t offset, int fixed_index, uint64_t user_data)
+{
+    uint32_t tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+    uint32_t index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = fixed_index >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->buf_index = (uint16_t)(fixed_index >= 0 ? fixed_index : 0);
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    atomic_store_explicit(ring->sq_tail, tail + 1, memory_order_release);
+}
+
+static void batch_ring_submit_request(BatchRing *ring, BatchRun *run, BatchRequest *request, uint32_t slot, bool registered)
+{
+    const MFTData *mft_entry = &run->items[request->item].mft_entry;
+    bool fixed = registered && request->payload == batch_slot_buffer(run, slot);
+    batch_ring_prepare_read(ring, run->fd, request->payload + request->done, mft_entry->size - request->done, mft_entry->offset + request->done,
+                            fixed ? (int)slot : -1, slot);
+}
+
+// Wait for the reads the kernel has taken from the submission queue, failing their items, so none
+// of them writes into a buffer after it is freed; false if the ring stopped answering
+static bool batch_ring_drain(BatchRing *ring, BatchRun *run, BatchRequest *requests, uint32_t in_flight)
+{
+    // Entries still in the submission queue were never seen by the kernel
+    uint32_t unconsumed = atomic_load_explicit(ring->sq_tail, memory_order_relaxed) - atomic_load_explicit(ring->sq_head, memory_order_acquire);
+    uint32_t pending = in_flight - unconsumed;
+    while (pending > 0)
+    {
+        uint32_t head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(ring->cq_tail, memory_order_acquire);
+        for (; head != tail && pending > 0; ++head)
+        {
+            uint32_t slot = (uint32_t)ring->cqes[head & *ring->cq_mask].user_data;
+            requests[slot].in_flight = false;
+            batch_queue_job(run, requests[slot].item, slot, requests[slot].payload, true);
+            --pending;
+        }
+        atomic_store_explicit(ring->cq_head, head, memory_order_release);
+        if (pending > 0 && syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR &&
+            errno != EAGAIN && errno != EBUSY)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool batch_run_uring(BatchRun *run, uint32_t queue_depth)
+{
+    BatchRing ring;
+    if (!batch_ring_open(&ring, queue_depth))
+    {
+        return false;
+    }
+    if (!batch_ring_supports_reads(&ring))
+    {
+        batch_ring_close(&ring);
+        return false;
+    }
+    BatchRequest *requests = (BatchRequest *)calloc(run->slot_count, sizeof(BatchRequest));
+    struct iovec *vectors = (struct iovec *)calloc(run->slot_count, sizeof(struct iovec));
+    if (requests == NULL || vectors == NULL)
+    {
+        free(requests);
+        free(vectors);
+        batch_ring_close(&ring);
+        return false;
+    }
+
+    // Registered buffers save the kernel pinning and unpinning the slot pages on every read
+    for (uint32_t i = 0; i < run->slot_count; ++i)
+    {
+        vectors[i].iov_base = batch_slot_buffer(run, i);
+        vectors[i].iov_len = run->slot_size;
+    }
+    bool registered = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, vectors, run->slot_count) == 0;
+    run->stats->registered_buffers = registered;
+    free(vectors);
+
+    BatchReadStats *stats = run->stats;
+    uint32_t next = 0;
+    uint32_t in_flight = 0;
+    uint32_t to_submit = 0;
+    while (next < run->count || in_flight > 0)
+    {
+        // Fill every free slot; only block for one when nothing is in flight to wait on instead
+        while (next < run->count)
+        {
+            uint32_t slot = batch_take_slot(run, in_flight == 0);
+            if (slot == BATCH_NO_SLOT)
+            {
+                break;
+            }
+            BatchRequest *request = &requests[slot];
+            request->item = next++;
+            request->done = 0;
+            request->payload = batch_read_target(run, request->item, slot);
+            if (request->payload == NULL)
+            {
+                batch_queue_job(run, request->item, slot, batch_slot_buffer(run, slot), true);
+                continue;
+            }
+            if (run->items[request->item].mft_entry.size == 0)
+            {
+                batch_queue_job(run, request->item, slot, request->payload, false);
+                continue;
+            }
+            batch_ring_submit_request(&ring, run, request, slot, registered);
+            request->in_flight = true;
+            ++in_flight;
+            ++to_submit;
+        }
+        if (in_flight == 0)
+        {
+            continue;
+        }
+
+        uint64_t start = prefetch_now_nanoseconds();
+        int submitted = (int)syscall(__NR_io_uring_enter, ring.fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        stats->io_wait_nanoseconds += prefetch_now_nanoseconds() - start;
+        ++stats->system_calls;
+        if (submitted < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            {
+                continue;
+            }
+            perror("io_uring_enter");
+            break;
+        }
+        to_submit -= (uint32_t)submitted < to_submit ? (uint32_t)submitted : to_submit;
+
+        uint32_t head = atomic_load_explicit(ring.cq_head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(ring.cq_tail, memory_order_acquire);
+        for (; head != tail; ++head)
+        {
+            const struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            uint32_t slot = (uint32_t)cqe->user_data;
+            BatchRequest *request = &requests[slot];
+            uint32_t size = run->items[request->item].mft_entry.size;
+            ++stats->reads;
+            if (cqe->res > 0)
+            {
+                request->done += (uint32_t)cqe->res;
+                stats->bytes_read += (uint32_t)cqe->res;
+                if (request->done < size)
+                {
+                    // Short read: ask for the rest
+                    batch_ring_submit_request(&ring, run, request, slot, registered);
+                    ++to_submit;
+                    continue;
+                }
+            }
+            --in_flight;
+            request->in_flight = false;
+            batch_queue_job(run, request->item, slot, request->payload, request->done != size);
+        }
+        atomic_store_explicit(ring.cq_head, head, memory_order_release);
+    }
+
+    // Only left with reads in flight if io_uring_enter failed outright. Closing the ring does not
+    // stop the kernel writing into their buffers, so wait for them first; if even that fails, their
+    // buffers and the arena are left allocated rather than freed under the kernel.
+    bool drained = in_flight == 0 || batch_ring_drain(&ring, run, requests, in_flight);
+    batch_ring_close(&ring);
+    for (uint32_t i = 0; i < run->slot_count && in_flight > 0; ++i)
+    {
+        if (requests[i].in_flight && drained)
+        {
+            batch_queue_job(run, requests[i].item, i, requests[i].payload, true);
+        }
+        else if (requests[i].in_flight)
+        {
+            batch_report_entry(run, run->items[requests[i].item].id, NULL, 0);
+        }
+    }
+    run->arena_in_kernel = !drained;
+    while (next < run->count)
+    {
+        batch_report_entry(run, run->items[next++].id, NULL, 0);
+    }
+    free(requests);
+    return true;
+}
+
+#endif
+
+// --- Synchronous engine ---
+
+static void batch_run_sync(BatchRun *run, FILE *file)
+{
+    for (uint32_t i = 0; i < run->count; ++i)
+    {
+        const MFTData *mft_entry = &run->items[i].mft_entry;
+        uint8_t *payload = (uint8_t *)buffer_alloc(mft_entry->size ? mft_entry->size : 1);
+        uint64_t start = prefetch_now_nanoseconds();
+        bool read = payload != NULL && dat_fseek(file, (int64_t)mft_entry->offset, SEEK_SET) == 0 &&
+                    fread(payload, 1, mft_entry->size, file) == mft_entry->size;
+        clearerr(file);
+        run->stats->io_wait_nanoseconds += prefetch_now_nanoseconds() - start;
+        ++run->stats->system_calls;
+        ++run->stats->reads;
+
+        if (read)
+        {
+            run->stats->bytes_read += mft_entry->size;
+        }
+        batch_process_entry(run, &run->items[i], payload, true, !read, BATCH_NO_SLOT);
+    }
+}
+
+// --- Batch driver ---
+
+static uint32_t batch_default_workers(void)
+{
+#if defined(BATCH_HAVE_PREAD)
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (uint32_t)(cpus < 64 ? cpus : 64) : 1;
+#else
+    return 1;
+#endif
+}
+
+// Allocate the slots and start the workers for an asynchronous engine
+static bool batch_start_workers(BatchRun *run, const BatchItem *items, uint32_t queue_depth, thrd_t *workers, uint32_t *worker_count)
+{
+    uint32_t largest = 0;
+    for (uint32_t i = 0; i < run->count; ++i)
+    {
+        largest = items[i].mft_entry.size > largest ? items[i].mft_entry.size : largest;
+    }
+    // No point in slots larger than the largest payload; round to whole pages for the fixed buffers
+    run->slot_size = ((largest < BATCH_SLOT_SIZE ? largest : BATCH_SLOT_SIZE) + 4095u) & ~4095u;
+    run->slot_size = run->slot_size ? run->slot_size : 4096u;
+    run->slot_count = queue_depth;
+    run->arena = (uint8_t *)malloc((size_t)run->slot_size * run->slot_count);
+    run->jobs = (BatchJob *)calloc(run->slot_count, sizeof(BatchJob));
+    run->free_slots = (uint32_t *)calloc(run->slot_count, sizeof(uint32_t));
+    if (run->arena == NULL || run->jobs == NULL || run->free_slots == NULL)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < run->slot_count; ++i)
+    {
+        run->free_slots[i] = run->slot_count - 1 - i;
+    }
+    run->free_count = run->slot_count;
+
+    uint32_t requested = *worker_count;
+    *worker_count = 0;
+    while (*worker_count < requested && thrd_create(&workers[*worker_count], batch_worker_main, run) == thrd_success)
+    {
+        ++*worker_count;
+    }
+    return *worker_count > 0;
+}
+
+static void batch_stop_workers(BatchRun *run, thrd_t *workers, uint32_t worker_count)
+{
+    mtx_lock(&run->mutex);
+    run->done = true;
+    cnd_broadcast(&run->job_ready);
+    mtx_unlock(&run->mutex);
+    for (uint32_t i = 0; i < worker_count; ++i)
+    {
+        thrd_join(workers[i], NULL);
+    }
+}
+
+static bool batch_run_async(BatchRun *run, const BatchItem *items, const char *file_path, uint32_t engine, uint32_t queue_depth, uint32_t workers)
+{
+#if defined(BATCH_HAVE_PREAD)
+    run->fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (run->fd < 0)
+    {
+        perror(file_path);
+        return false;
+    }
+    // The reads are issued in offset order, which is also what kernel read-ahead is tuned for
+    posix_fadvise(run->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    thrd_t *worker_threads = (thrd_t *)calloc(workers, sizeof(thrd_t));
+    uint32_t worker_count = workers;
+    bool ok = worker_threads != NULL && batch_start_workers(run, items, queue_depth, worker_threads, &worker_count);
+    run->stats->workers = worker_count;
+
+    bool ran = false;
+#if defined(BATCH_HAVE_URING)
+    if (ok && engine == BATCH_ENGINE_URING)
+    {
+        ran = batch_run_uring(run, queue_depth);
+        if (!ran)
+        {
+            engine = BATCH_ENGINE_PREAD;
+        }
+    }
+#else
+    engine = BATCH_ENGINE_PREAD;
+#endif
+    if (ok && !ran && engine == BATCH_ENGINE_PREAD)
+    {
+        ran = batch_run_pread(run, queue_depth);
+    }
+    run->stats->engine = engine;
+
+    if (worker_threads != NULL)
+    {
+        batch_stop_workers(run, worker_threads, worker_count);
+    }
+    free(worker_threads);
+    close(run->fd);
+    return ran;
+#else
+    (void)run;
+    (void)items;
+    (void)file_path;
+    (void)engine;
+    (void)queue_depth;
+    (void)workers;
+    return false;
+#endif
+}
+
+bool batch_read_entries(DatFile *dat_file, const uint32_t *ids, uint32_t count, const BatchReadOptions *options,
+                        BatchEntryCallback callback, void *context, BatchReadStats *stats)
+{
+    BatchReadOptions defaults;
+    memset(&defaults, 0, sizeof(BatchReadOptions));
+    options = options != NULL ? options : &defaults;
+    BatchReadStats local_stats;
+    stats = stats != NULL ? stats : &local_stats;
+    memset(stats, 0, sizeof(BatchReadStats));
+    uint64_t start = prefetch_now_nanoseconds();
+
+    uint32_t queue_depth = options->queue_depth ? options->queue_depth : BATCH_DEFAULT_QUEUE_DEPTH;
+    queue_depth = queue_depth < BATCH_MAX_QUEUE_DEPTH ? queue_depth : BATCH_MAX_QUEUE_DEPTH;
+    uint32_t workers = options->workers ? options->workers : batch_default_workers();
+    uint32_t engine = options->engine;
+    if (engine == BATCH_ENGINE_AUTO)
+    {
+#if defined(BATCH_HAVE_URING)
+        engine = BATCH_ENGINE_URING;
+#elif defined(BATCH_HAVE_PREAD)
+        engine = BATCH_ENGINE_PREAD;
+#else
+        engine = BATCH_ENGINE_SYNC;
+#endif
+    }
+
+    BatchRun run;
+    memset(&run, 0, sizeof(BatchRun));
+    run.callback = callback;
+    run.chunk_callback = options->chunk_callback;
+    run.payload_callback = options->payload_callback;
+    run.context = context;
+    run.raw = options->raw;
+    run.budget = options->budget;
+    run.stream_threshold = options->stream_threshold;
+    if (run.stream_threshold == 0)
+    {
+        uint64_t quarter_budget = options->budget != NULL ? options->budget->capacity / 4 : UINT32_MAX;
+        run.stream_threshold = (uint32_t)(quarter_budget < UINT32_MAX ? quarter_budget : UINT32_MAX);
+    }
+    run.stats = stats;
+    run.fd = -1;
+    mtx_init(&run.mutex, mtx_plain);
+    cnd_init(&run.job_ready);
+    cnd_init(&run.slot_free);
+
+    // Resolve every id up front; ids that do not resolve fail straight away
+    BatchItem *items = (BatchItem *)malloc((count ? count : 1) * sizeof(BatchItem));
+    if (items == NULL)
+    {
+        mtx_destroy(&run.mutex);
+        cnd_destroy(&run.job_ready);
+        cnd_destroy(&run.slot_free);
+        return false;
+    }
+    run.items = items;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t mft_slot = 0;
+        MFTData *mft_entry = find_mft_slot(dat_file, ids[i], &mft_slot) ? get_mft_entry(dat_file, mft_slot) : NULL;
+        if (mft_entry == NULL)
+        {
+            batch_report_entry(&run, ids[i], NULL, 0);
+            continue;
+        }
+        items[run.count].id = ids[i];
+        items[run.count].mft_entry = *mft_entry;
+        ++run.count;
+    }
+    qsort(items, run.count, sizeof(BatchItem), compare_batch_offset);
+
+    bool ok = true;
+    if (engine != BATCH_ENGINE_SYNC)
+    {
+        stats->queue_depth = queue_depth;
+        ok = batch_run_async(&run, items, dat_file->file_path, engine, queue_depth, workers);
+    }
+    else
+    {
+        stats->engine = BATCH_ENGINE_SYNC;
+        stats->queue_depth = 1;
+        FILE *file = fopen(dat_file->file_path, "rb");
+        ok = file != NULL;
+        if (ok)
+        {
+            batch_run_sync(&run, file);
+            fclose(file);
+        }
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Batch read with the %s engine failed\n", batch_engine_name(engine));
+    }
+
+    if (!run.arena_in_kernel)
+    {
+        free(run.arena);
+    }
+    free(run.jobs);
+    free(run.free_slots);
+    free(items);
+    mtx_destroy(&run.mutex);
+    cnd_destroy(&run.job_ready);
+    cnd_destroy(&run.slot_free);
+    stats->nanoseconds = prefetch_now_nanoseconds() - start;
+    return ok;
+}
+
+void print_batch_report(const BatchReadStats *stats)
+{
+    double seconds = stats->nanoseconds / 1e9;
+    printf("Batch Read Report:\n");
+    printf("  Engine:              %s, queue depth %u, %u workers%s\n", batch_engine_name(stats->engine), stats->queue_depth, stats->workers,
+           stats->registered_buffers ? ", registered buffers" : "");
+    printf("  Entries:             %llu (%llu failed, %llu streamed) in %.3f s\n", (unsigned long long)stats->entries,
+           (unsigned long long)stats->failures, (unsigned long long)stats->streamed, seconds);
+    printf("  Reads:               %llu (%.0f IOPS), %llu system calls\n", (unsigned long long)stats->reads,
+           seconds > 0 ? stats->reads / seconds : 0.0, (unsigned long long)stats->system_calls);
+    printf("  Read:                %.1f MB (%.1f MB/s)\n", stats->bytes_read / 1048576.0, seconds > 0 ? stats->bytes_read / 1048576.0 / seconds : 0.0);
+    printf("  Output:              %.1f MB (%.1f MB/s)\n", stats->bytes_output / 1048576.0,
+           seconds > 0 ? stats->bytes_output / 1048576.0 / seconds : 0.0);
+    printf("  Waiting on reads:    %.3f s\n", stats->io_wait_nanoseconds / 1e9);
+    printf("  Waiting on workers:  %.3f s\n", stats->worker_wait_nanoseconds / 1e9);
+}
@@ -0,0 +1,272 @@
+#include "bufferpool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <threads.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// Stored in front of every buffer handed out by buffer_alloc
+typedef struct
+{
+    uint64_t capacity;   // usable bytes after the header
+    uint32_t size_class; // BUFFER_POOL_CLASSES for buffers that are never pooled
+    uint32_t magic;
+} BufferHeader;
+
+#define BUFFER_HEADER_MAGIC 0x4C4F4F50u // "POOL"
+
+// Idle buffers of one thread, linked through their first bytes
+typedef struct
+{
+    void *free_lists[BUFFER_POOL_CLASSES];
+    size_t pooled_bytes;
+} BufferPool;
+
+static void *default_allocate(size_t size, void *user_data)
+{
+    (void)user_data;
+    return malloc(size);
+}
+
+static void default_release(void *pointer, size_t size, void *user_data)
+{
+    (void)size;
+    (void)user_data;
+    free(pointer);
+}
+
+static BufferAllocator buffer_allocator = {default_allocate, default_release, NULL};
+static atomic_size_t buffer_pool_limit;
+
+static atomic_uint_least64_t stat_allocator_calls;
+static atomic_uint_least64_t stat_allocator_releases;
+static atomic_uint_least64_t stat_pool_hits;
+static atomic_uint_least64_t stat_buffer_allocs;
+static atomic_uint_least64_t stat_bytes_allocated;
+static atomic_uint_least64_t stat_peak_bytes_allocated;
+static atomic_uint_least64_t stat_bytes_pooled;
+
+static once_flag buffer_pool_once = ONCE_FLAG_INIT;
+static tss_t buffer_pool_key;
+static bool buffer_pool_key_valid;
+
+void set_buffer_allocator(const BufferAllocator *allocator)
+{
+    if (allocator == NULL)
+    {
+        buffer_allocator.allocate = default_allocate;
+        buffer_allocator.release = default_release;
+        buffer_allocator.user_data = NULL;
+    }
+    else
+    {
+        buffer_allocator = *allocator;
+    }
+}
+
+void set_buffer_pool_limit(size_t max_pooled_bytes)
+{
+    atomic_store(&buffer_pool_limit, max_pooled_bytes);
+}
+
+// Round size up to its class: one class up to BUFFER_POOL_MIN_SIZE, then four per power of two,
+// so a pooled buffer is never more than 25% larger than requested
+static uint32_t buffer_size_class(size_t size, size_t *capacity)
+{
+    if (size <= BUFFER_POOL_MIN_SIZE)
+    {
+        *capacity = BUFFER_POOL_MIN_SIZE;
+        return 0;
+    }
+    if (size > BUFFER_POOL_MAX_SIZE)
+    {
+        *capacity = size;
+        return BUFFER_POOL_CLASSES;
+    }
+
+    // 2^exponent < size <= 2^(exponent + 1)
+    uint32_t exponent = 12;
+    while (((size_t)2 << exponent) < size)
+    {
+        ++exponent;
+    }
+    size_t step = (size_t)1 << (exponent - 2);
+    *capacity = (size + step - 1) & ~(step - 1);
+    return 1 + (exponent - 12) * 4 + (uint32_t)(*capacity >> (exponent - 2)) - 5;
+}
+
+static void release_to_allocator(BufferHeader *header)
+{
+    atomic_fetch_add(&stat_allocator_releases, 1);
+    atomic_fetch_sub(&stat_bytes_allocated, header->capacity + sizeof(BufferHeader));
+    buffer_allocator.release(header, header->capacity + sizeof(BufferHeader), buffer_allocator.user_data);
+}
+
+static void release_pool(BufferPool *pool)
+{
+    for (uint32_t i = 0; i < BUFFER_POOL_CLASSES; ++i)
+    {
+        while (pool->free_lists[i] != NULL)
+        {
+            void *pointer = pool->free_lists[i];
+            memcpy(&pool->free_lists[i], pointer, sizeof(void *));
+            BufferHeader *header = (BufferHeader *)pointer - 1;
+            atomic_fetch_sub(&stat_bytes_pooled, header->capacity);
+            release_to_allocator(header);
+        }
+    }
+    pool->pooled_bytes = 0;
+}
+
+static void destroy_pool(void *pool)
+{
+    release_pool((BufferPool *)pool);
+    free(pool);
+}
+
+static void create_pool_key(void)
+{
+    buffer_pool_key_valid = tss_create(&buffer_pool_key, destroy_pool) == thrd_success;
+}
+
+// The calling thread's pool, created on first use and released when the thread exits
+static BufferPool *current_pool(bool create)
+{
+    call_once(&buffer_pool_once, create_pool_key);
+    if (!buffer_pool_key_valid)
+    {
+        return NULL;
+    }
+
+    BufferPool *pool = (BufferPool *)tss_get(buffer_pool_key);
+    if (pool == NULL && create)
+    {
+        pool = (BufferPool *)calloc(1, sizeof(BufferPool));
+        if (pool != NULL && tss_set(buffer_pool_key, pool) != thrd_success)
+        {
+            free(pool);
+            pool = NULL;
+        }
+    }
+    return pool;
+}
+
+void *buffer_alloc(size_t size)
+{
+    atomic_fetch_add(&stat_buffer_allocs, 1);
+
+    size_t capacity = 0;
+    uint32_t size_class = buffer_size_class(size, &capacity);
+
+    if (size_class < BUFFER_POOL_CLASSES && atomic_load(&buffer_pool_limit) != 0)
+    {
+        BufferPool *pool = current_pool(false);
+        if (pool != NULL && pool->free_lists[size_class] != NULL)
+        {
+            void *pointer = pool->free_lists[size_class];
+            memcpy(&pool->free_lists[size_class], pointer, sizeof(void *));
+            pool->pooled_bytes -= capacity;
+            atomic_fetch_sub(&stat_bytes_pooled, capacity);
+            atomic_fetch_add(&stat_pool_hits, 1);
+            return pointer;
+        }
+    }
+
+    BufferHeader *header = (BufferHeader *)buffer_allocator.allocate(capacity + sizeof(BufferHeader), buffer_allocator.user_data);
+    if (header == NULL)
+    {
+        return NULL;
+    }
+    header->capacity = capacity;
+    header->size_class = size_class;
+    header->magic = BUFFER_HEADER_MAGIC;
+
+    atomic_fetch_add(&stat_allocator_calls, 1);
+    uint64_t allocated = atomic_fetch_add(&stat_bytes_allocated, capacity + sizeof(BufferHeader)) + capacity + sizeof(BufferHeader);
+    uint64_t peak = atomic_load(&stat_peak_bytes_allocated);
+    while (allocated > peak && !atomic_compare_exchange_weak(&stat_peak_bytes_allocated, &peak, allocated))
+    {
+    }
+    return header + 1;
+}
+
+void buffer_free(void *pointer)
+{
+    if (pointer == NULL)
+    {
+        return;
+    }
+
+    BufferHeader *header = (BufferHeader *)pointer - 1;
+    if (header->magic != BUFFER_HEADER_MAGIC)
+    {
+        fprintf(stderr, "buffer_free: pointer was not allocated by buffer_alloc\n");
+        return;
+    }
+
+    size_t limit = atomic_load(&buffer_pool_limit);
+    if (header->size_class < BUFFER_POOL_CLASSES && limit != 0)
+    {
+        BufferPool *pool = current_pool(true);
+        if (pool != NULL && pool->pooled_bytes + header->capacity <= limit)
+        {
+            memcpy(pointer, &pool->free_lists[header->size_class], sizeof(void *));
+            pool->free_lists[header->size_class] = pointer;
+            pool->pooled_bytes += header->capacity;
+            atomic_fetch_add(&stat_bytes_pooled, header->capacity);
+            return;
+        }
+    }
+
+    release_to_allocator(header);
+}
+
+void trim_buffer_pool(void)
+{
+    BufferPool *pool = current_pool(false);
+    if (pool != NULL)
+    {
+        release_pool(pool);
+    }
+}
+
+void get_buffer_stats(BufferStats *stats)
+{
+    stats->allocator_calls = atomic_load(&stat_allocator_calls);
+    stats->allocator_releases = atomic_load(&stat_allocator_releases);
+    stats->pool_hits = atomic_load(&stat_pool_hits);
+    stats->buffer_allocs = atomic_load(&stat_buffer_allocs);
+    stats->bytes_allocated = atomic_load(&stat_bytes_allocated);
+    stats->peak_bytes_allocated = atomic_load(&stat_peak_bytes_allocated);
+    stats->bytes_pooled = atomic_load(&stat_bytes_pooled);
+}
+
+void print_buffer_report(void)
+{
+    BufferStats stats;
+    get_buffer_stats(&stats);
+
+    printf("Buffer Report:\n");
+    printf("  Buffer Allocations:  %llu\n", (unsigned long long)stats.buffer_allocs);
+    printf("  Served From Pool:    %llu (%.1f%%)\n", (unsigned long long)stats.pool_hits,
+           stats.buffer_allocs ? 100.0 * stats.pool_hits / stats.buffer_allocs : 0.0);
+    printf("  Allocator Calls:     %llu allocated, %llu released\n", (unsigned long long)stats.allocator_calls,
+           (unsigned long long)stats.allocator_releases);
+    printf("  Buffer Bytes:        %.1f MB held, %.1f MB peak, %.1f MB pooled\n", stats.bytes_allocated / 1048576.0,
+           stats.peak_bytes_allocated / 1048576.0, stats.bytes_pooled / 1048576.0);
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+#if defined(__APPLE__)
+        printf("  Peak RSS:            %.1f MB\n", usage.ru_maxrss / 1048576.0);
+#else
+        printf("  Peak RSS:            %.1f MB\n", usage.ru_maxrss / 1024.0);
+#endif
+    }
+#endif
+}
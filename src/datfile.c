@@ -0,0 +1,715 @@
+#include "datfile.h"
+#include "pardecode.h"
+#include "prefetch.h"
+#include "transcode.h"
+
+uint16_t read_uint16_le(FILE *file)
+{
+    uint16_t value;
+    fread(&value, sizeof(value), 1, file);
+    return value;
+}
+
+uint32_t read_uint32_le(FILE *file)
+{
+    uint32_t value;
+    fread(&value, sizeof(value), 1, file);
+    return value;
+}
+
+int32_t read_int32_le(FILE *file)
+{
+    int32_t value;
+    fread(&value, sizeof(value), 1, file);
+    return value;
+}
+
+uint64_t read_uint64_le(FILE *file)
+{
+    uint64_t value;
+    fread(&value, sizeof(value), 1, file);
+    return value;
+}
+
+void debug_print_header(const DatHeader *header)
+{
+    printf("Header Debug Info:\n");
+    printf("  Header Size:       %d bytes\n", header->header_size); // Unsigned integer
+    printf("  Unknown Field:     %d \n", header->unknown_field);    // 32-bit hex
+    printf("  Chunk Size:        %d bytes\n", header->chunk_size);  // Unsigned integer
+    printf("  CRC:               %d \n", header->crc);              // 32-bit hex
+    printf("  Unknown Field 2:   %d \n", header->unknown_field_2);  // 32-bit hex
+    printf("  MFT Offset:        %llu \n", header->mft_offset);     // 64-bit hex
+    printf("  MFT Size:          %d bytes\n", header->mft_size);    // Unsigned integer
+    printf("  Flags:             %d \n", header->flags);            // 32-bit hex
+}
+
+void debug_print_mft_header(const MFTHeader *header)
+{
+    printf("MFT Header Debug Info:\n");
+    printf("  Unknown:           %llu\n", header->unknown);       // 64-bit hex
+    printf("  Number of Entries: %d\n", header->num_entries);     // Unsigned integer
+    printf("  Unknown Field 2:   %d\n", header->unknown_field_2); // 32-bit hex
+    printf("  Unknown Field 3:   %d\n", header->unknown_field_3); // 32-bit hex
+}
+
+void debug_print_mft_data(const MFTData *data, uint32_t index)
+{
+    printf("MFTData[%d] Debug Info:\n", index);
+    printf("  Offset:            %llu\n", data->offset);         // 64-bit hex
+    printf("  Size:              %d bytes\n", data->size);       // Unsigned integer
+    printf("  Compression Flag:  %d\n", data->compression_flag); // 16-bit hex
+    printf("  Entry Flag:        %d\n", data->entry_flag);       // 16-bit hex
+    printf("  Counter:           %d\n", data->counter);          // Unsigned integer
+    printf("  CRC:               %d\n", data->crc);              // 32-bit hex
+}
+
+void debug_print_mft_index_data(const MFTIndexData *data, uint32_t index)
+{
+    printf("MFTIndexData[%d] Debug Info:\n", index);
+    printf("  File ID:           %d\n", data->file_id); // Unsigned integer
+    printf("  Base ID:           %d\n", data->base_id); // Unsigned integer
+}
+
+void read_dat_header(FILE *file, DatHeader *header)
+{
+    fread(&header->version, sizeof(uint8_t), 1, file);
+    fread(header->identifier, sizeof(uint8_t), DAT_MAGIC_NUMBER, file);
+    header->header_size = read_uint32_le(file);
+    header->unknown_field = read_uint32_le(file);
+    header->chunk_size = read_uint32_le(file);
+    header->crc = read_uint32_le(file);
+    header->unknown_field_2 = read_uint32_le(file);
+    header->mft_offset = read_uint64_le(file);
+    header->mft_size = read_uint32_le(file);
+    header->flags = read_uint32_le(file);
+}
+
+void read_mft_header(FILE *file, MFTHeader *header)
+{
+    fread(header->identifier, sizeof(uint8_t), MFT_MAGIC_NUMBER, file);
+    header->unknown = read_uint64_le(file);
+    header->num_entries = read_uint32_le(file);
+    header->unknown_field_2 = read_uint32_le(file);
+    header->unknown_field_3 = read_uint32_le(file);
+}
+
+// Read count (file_id, base_id) pairs of the index table from the current position; false on a short read
+static bool read_mft_index_table(FILE *file, MFTIndexData *index_data, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        index_data[i].file_id = read_uint32_le(file);
+        index_data[i].base_id = read_uint32_le(file);
+    }
+    return !feof(file) && !ferror(file);
+}
+
+void parse_mft_record(const uint8_t *raw, MFTData *data)
+{
+    memcpy(&data->offset, raw, sizeof(uint64_t));
+    memcpy(&data->size, raw + 8, sizeof(uint32_t));
+    memcpy(&data->compression_flag, raw + 12, sizeof(uint16_t));
+    memcpy(&data->entry_flag, raw + 14, sizeof(uint16_t));
+    memcpy(&data->counter, raw + 16, sizeof(uint32_t));
+    memcpy(&data->crc, raw + 20, sizeof(uint32_t));
+}
+
+void format_mft_record(const MFTData *data, uint8_t *raw)
+{
+    memcpy(raw, &data->offset, sizeof(uint64_t));
+    memcpy(raw + 8, &data->size, sizeof(uint32_t));
+    memcpy(raw + 12, &data->compression_flag, sizeof(uint16_t));
+    memcpy(raw + 14, &data->entry_flag, sizeof(uint16_t));
+    memcpy(raw + 16, &data->counter, sizeof(uint32_t));
+    memcpy(raw + 20, &data->crc, sizeof(uint32_t));
+}
+
+bool load_dat_file(const char *file_path, DatFile *dat_file)
+{
+    if (!strstr(file_path, ".dat"))
+    {
+        fprintf(stderr, "Invalid file extension. Expected '.dat'.\n");
+        return false;
+    }
+
+    FILE *file = fopen(file_path, "rb");
+    if (!file)
+    {
+        perror("Error opening file");
+        return false;
+    }
+
+    read_dat_header(file, &dat_file->header);
+    debug_print_header(&dat_file->header);
+
+    dat_fseek(file, dat_file->header.mft_offset, SEEK_SET);
+    read_mft_header(file, &dat_file->mft_header);
+    debug_print_mft_header(&dat_file->mft_header);
+    if (memcmp(dat_file->mft_header.identifier, (uint8_t[]){0x4D, 0x66, 0x74, 0x1A}, MFT_MAGIC_NUMBER) != 0)
+    {
+        fprintf(stderr, "Not a MFT file: invalid header magic\n");
+        fclose(file);
+        return false;
+    }
+    if (dat_file->mft_header.num_entries <= MFT_ENTRY_INDEX_NUM)
+    {
+        fprintf(stderr, "MFT has no index entry\n");
+        fclose(file);
+        return false;
+    }
+
+    dat_file->mft_data = (MFTData *)malloc(dat_file->mft_header.num_entries * sizeof(MFTData));
+    if (dat_file->mft_data == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for MFTData\n");
+        fclose(file);
+        return false;
+    }
+
+    for (uint32_t i = 1; i < dat_file->mft_header.num_entries; ++i)
+    {
+        dat_file->mft_data[i].offset = read_uint64_le(file);
+        dat_file->mft_data[i].size = read_uint32_le(file);
+        dat_file->mft_data[i].compression_flag = read_uint16_le(file);
+        dat_file->mft_data[i].entry_flag = read_uint16_le(file);
+        dat_file->mft_data[i].counter = read_uint32_le(file);
+        dat_file->mft_data[i].crc = read_uint32_le(file);
+    }
+    uint32_t mft_data_index = 16;
+    debug_print_mft_data(&dat_file->mft_data[mft_data_index], mft_data_index); // Print MFTData for each entry
+
+    uint32_t num_index_entries = dat_file->mft_data[MFT_ENTRY_INDEX_NUM].size / sizeof(MFTIndexData);
+    dat_file->mft_index_data = (MFTIndexData *)malloc(num_index_entries * sizeof(MFTIndexData));
+    if (dat_file->mft_index_data == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for MFTIndexData\n");
+        free(dat_file->mft_data); // Cleanup previous allocation
+        dat_file->mft_data = NULL;
+        fclose(file);
+        return false;
+    }
+
+    dat_fseek(file, dat_file->mft_data[MFT_ENTRY_INDEX_NUM].offset, SEEK_SET);
+    if (!read_mft_index_table(file, dat_file->mft_index_data, num_index_entries))
+    {
+        fprintf(stderr, "Short read on MFT index table\n");
+        free(dat_file->mft_index_data);
+        free(dat_file->mft_data);
+        dat_file->mft_index_data = NULL;
+        dat_file->mft_data = NULL;
+        fclose(file);
+        return false;
+    }
+
+    uint32_t mft_index_data_num = num_index_entries - 1;
+    debug_print_mft_index_data(&dat_file->mft_index_data[mft_index_data_num], mft_index_data_num); // Print MFTIndexData for each entry
+
+    fclose(file);
+
+    dat_file->file_path = strdup(file_path);
+    dat_file->open_flags = DAT_OPEN_EAGER;
+    dat_file->num_index_entries = num_index_entries;
+    dat_file->mft_page_loaded = NULL;
+    dat_file->mft_index_loaded = true;
+    dat_file->id_index.slots = NULL;
+    dat_file->id_index.mask = 0;
+    dat_file->id_index.count = 0;
+    dat_file->index_thread_running = false;
+    dat_file->index_thread_failed = false;
+    dat_file->prefetcher = NULL;
+    dat_file->transcode_cache = NULL;
+    mtx_init(&dat_file->page_mutex, mtx_plain);
+    mtx_init(&dat_file->index_mutex, mtx_plain);
+    return true;
+}
+
+uint32_t hash_mft_id(uint32_t key)
+{
+    key *= 0x9E3779B1u;
+    return key ^ (key >> 16);
+}
+
+void insert_mft_id(MFTIdIndex *id_index, uint32_t key, uint32_t mft_slot)
+{
+    uint32_t position = hash_mft_id(key) & id_index->mask;
+    while (id_index->slots[position].mft_slot != UINT32_MAX)
+    {
+        if (id_index->slots[position].key == key)
+        {
+            return;
+        }
+        position = (position + 1) & id_index->mask;
+    }
+    id_index->slots[position].key = key;
+    id_index->slots[position].mft_slot = mft_slot;
+    ++id_index->count;
+}
+
+bool build_mft_id_index(MFTIdIndex *id_index, const MFTIndexData *index_data, uint32_t num_index_entries)
+{
+    // Every entry contributes a file id and a base id; keep the load factor at or below one half
+    uint32_t capacity = 16;
+    while (capacity < (uint64_t)num_index_entries * 4)
+    {
+        capacity <<= 1;
+    }
+
+    id_index->slots = (MFTIdIndexSlot *)malloc(capacity * sizeof(MFTIdIndexSlot));
+    if (id_index->slots == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for MFT id index\n");
+        return false;
+    }
+    memset(id_index->slots, 0xFF, capacity * sizeof(MFTIdIndexSlot));
+    id_index->mask = capacity - 1;
+    id_index->count = 0;
+
+    for (uint32_t i = 0; i < num_index_entries; ++i)
+    {
+        insert_mft_id(id_index, index_data[i].file_id, index_data[i].base_id);
+        insert_mft_id(id_index, index_data[i].base_id, index_data[i].base_id);
+    }
+    return true;
+}
+
+bool find_mft_id(const MFTIdIndex *id_index, uint32_t key, uint32_t *mft_slot)
+{
+    uint32_t position = hash_mft_id(key) & id_index->mask;
+    while (id_index->slots[position].mft_slot != UINT32_MAX)
+    {
+        if (id_index->slots[position].key == key)
+        {
+            *mft_slot = id_index->slots[position].mft_slot;
+            return true;
+        }
+        position = (position + 1) & id_index->mask;
+    }
+    return false;
+}
+
+bool load_mft_page(DatFile *dat_file, uint32_t page)
+{
+    uint32_t first_entry = page * MFT_PAGE_ENTRIES;
+    uint32_t num_entries = dat_file->mft_header.num_entries - first_entry;
+    if (num_entries > MFT_PAGE_ENTRIES)
+    {
+        num_entries = MFT_PAGE_ENTRIES;
+    }
+
+    FILE *file = fopen(dat_file->file_path, "rb");
+    if (!file)
+    {
+        perror("Error opening file");
+        return false;
+    }
+
+    uint8_t *raw = (uint8_t *)malloc((size_t)num_entries * MFT_ENTRY_SIZE);
+    if (raw == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for MFT page\n");
+        fclose(file);
+        return false;
+    }
+
+    dat_fseek(file, dat_file->header.mft_offset + (uint64_t)first_entry * MFT_ENTRY_SIZE, SEEK_SET);
+    size_t read_entries = fread(raw, MFT_ENTRY_SIZE, num_entries, file);
+    fclose(file);
+    if (read_entries != num_entries)
+    {
+        fprintf(stderr, "Short read on MFT page %u\n", page);
+        free(raw);
+        return false;
+    }
+
+    // Slot 0 overlaps the MFT header and is left zeroed, as in the eager loader
+    for (uint32_t i = (first_entry == 0) ? 1 : 0; i < num_entries; ++i)
+    {
+        parse_mft_record(raw + (size_t)i * MFT_ENTRY_SIZE, &dat_file->mft_data[first_entry + i]);
+    }
+    free(raw);
+
+    dat_file->mft_page_loaded[page] = 1;
+    return true;
+}
+
+MFTData *get_mft_entry(DatFile *dat_file, uint32_t mft_slot)
+{
+    if (mft_slot == 0 || mft_slot >= dat_file->mft_header.num_entries)
+    {
+        return NULL;
+    }
+
+    if (dat_file->open_flags & DAT_OPEN_LAZY)
+    {
+        uint32_t page = mft_slot / MFT_PAGE_ENTRIES;
+        bool loaded = true;
+        mtx_lock(&dat_file->page_mutex);
+        if (!dat_file->mft_page_loaded[page])
+        {
+            loaded = load_mft_page(dat_file, page);
+        }
+        mtx_unlock(&dat_file->page_mutex);
+        if (!loaded)
+        {
+            return NULL;
+        }
+    }
+
+    return &dat_file->mft_data[mft_slot];
+}
+
+bool load_mft_index(DatFile *dat_file)
+{
+    MFTData *index_entry = get_mft_entry(dat_file, MFT_ENTRY_INDEX_NUM);
+    if (index_entry == NULL)
+    {
+        return false;
+    }
+
+    uint32_t num_index_entries = index_entry->size / sizeof(MFTIndexData);
+    MFTIndexData *index_data = (MFTIndexData *)malloc(num_index_entries * sizeof(MFTIndexData));
+    if (index_data == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for MFTIndexData\n");
+        return false;
+    }
+
+    FILE *file = fopen(dat_file->file_path, "rb");
+    if (!file)
+    {
+        perror("Error opening file");
+        free(index_data);
+        return false;
+    }
+
+    // The table is stored as packed little-endian (file_id, base_id) pairs, decoded as the eager loader does
+    dat_fseek(file, index_entry->offset, SEEK_SET);
+    bool read = read_mft_index_table(file, index_data, num_index_entries);
+    fclose(file);
+    if (!read)
+    {
+        fprintf(stderr, "Short read on MFT index table\n");
+        free(index_data);
+        return false;
+    }
+
+    if (!build_mft_id_index(&dat_file->id_index, index_data, num_index_entries))
+    {
+        free(index_data);
+        return false;
+    }
+
+    dat_file->mft_index_data = index_data;
+    dat_file->num_index_entries = num_index_entries;
+    dat_file->mft_index_loaded = true;
+    return true;
+}
+
+int mft_index_thread_main(void *argument)
+{
+    DatFile *dat_file = (DatFile *)argument;
+    if (!load_mft_index(dat_file))
+    {
+        dat_file->index_thread_failed = true;
+        return thrd_error;
+    }
+    return thrd_success;
+}
+
+bool ensure_mft_index(DatFile *dat_file)
+{
+    bool ready = false;
+    mtx_lock(&dat_file->index_mutex);
+    if (dat_file->index_thread_running)
+    {
+        thrd_join(dat_file->index_thread, NULL);
+        dat_file->index_thread_running = false;
+    }
+
+    if (!dat_file->mft_index_loaded)
+    {
+        load_mft_index(dat_file);
+    }
+    else if (dat_file->id_index.slots == NULL)
+    {
+        build_mft_id_index(&dat_file->id_index, dat_file->mft_index_data, dat_file->num_index_entries);
+    }
+
+    ready = dat_file->id_index.slots != NULL;
+    mtx_unlock(&dat_file->index_mutex);
+    return ready;
+}
+
+bool find_mft_slot(DatFile *dat_file, uint32_t number, uint32_t *mft_slot)
+{
+    if (!ensure_mft_index(dat_file))
+    {
+        return false;
+    }
+    return find_mft_id(&dat_file->id_index, number, mft_slot);
+}
+
+bool load_dat_file_ex(const char *file_path, DatFile *dat_file, uint32_t open_flags)
+{
+    if (!(open_flags & DAT_OPEN_LAZY))
+    {
+        return load_dat_file(file_path, dat_file);
+    }
+
+    if (!strstr(file_path, ".dat"))
+    {
+        fprintf(stderr, "Invalid file extension. Expected '.dat'.\n");
+        return false;
+    }
+
+    FILE *file = fopen(file_path, "rb");
+    if (!file)
+    {
+        perror("Error opening file");
+        return false;
+    }
+
+    read_dat_header(file, &dat_file->header);
+    dat_fseek(file, dat_file->header.mft_offset, SEEK_SET);
+    read_mft_header(file, &dat_file->mft_header);
+    fclose(file);
+
+    if (memcmp(dat_file->mft_header.identifier, (uint8_t[]){0x4D, 0x66, 0x74, 0x1A}, MFT_MAGIC_NUMBER) != 0)
+    {
+        fprintf(stderr, "Not a MFT file: invalid header magic\n");
+        return false;
+    }
+    if (dat_file->mft_header.num_entries <= MFT_ENTRY_INDEX_NUM)
+    {
+        fprintf(stderr, "MFT has no index entry\n");
+        return false;
+    }
+
+    uint32_t num_pages = (dat_file->mft_header.num_entries + MFT_PAGE_ENTRIES - 1) / MFT_PAGE_ENTRIES;
+    dat_file->mft_data = (MFTData *)calloc(dat_file->mft_header.num_entries, sizeof(MFTData));
+    dat_file->mft_page_loaded = (uint8_t *)calloc(num_pages, sizeof(uint8_t));
+    dat_file->file_path = strdup(file_path);
+    if (dat_file->mft_data == NULL || dat_file->mft_page_loaded == NULL || dat_file->file_path == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for MFTData\n");
+        free(dat_file->mft_data);
+        free(dat_file->mft_page_loaded);
+        free(dat_file->file_path);
+        dat_file->mft_data = NULL;
+        dat_file->mft_page_loaded = NULL;
+        dat_file->file_path = NULL;
+        return false;
+    }
+
+    dat_file->open_flags = open_flags;
+    dat_file->mft_index_data = NULL;
+    dat_file->num_index_entries = 0;
+    dat_file->mft_index_loaded = false;
+    dat_file->id_index.slots = NULL;
+    dat_file->id_index.mask = 0;
+    dat_file->id_index.count = 0;
+    dat_file->index_thread_running = false;
+    dat_file->index_thread_failed = false;
+    dat_file->prefetcher = NULL;
+    dat_file->transcode_cache = NULL;
+    mtx_init(&dat_file->page_mutex, mtx_plain);
+    mtx_init(&dat_file->index_mutex, mtx_plain);
+
+    if (open_flags & DAT_OPEN_BACKGROUND_INDEX)
+    {
+        dat_file->index_thread_running = thrd_create(&dat_file->index_thread, mft_index_thread_main, dat_file) == thrd_success;
+    }
+    return true;
+}
+
+void release_mft_tables(DatFile *dat_file)
+{
+    if (dat_file->index_thread_running)
+    {
+        thrd_join(dat_file->index_thread, NULL);
+        dat_file->index_thread_running = false;
+    }
+
+    free(dat_file->mft_data);
+    free(dat_file->mft_index_data);
+    free(dat_file->id_index.slots);
+    free(dat_file->mft_page_loaded);
+    dat_file->mft_data = NULL;
+    dat_file->mft_index_data = NULL;
+    dat_file->id_index.slots = NULL;
+    dat_file->mft_page_loaded = NULL;
+    dat_file->mft_header.num_entries = 0;
+    dat_file->num_index_entries = 0;
+    dat_file->mft_index_loaded = false;
+}
+
+void close_dat_file(DatFile *dat_file)
+{
+    disable_prefetcher(dat_file);
+    disable_transcode_cache(dat_file);
+
+    release_mft_tables(dat_file);
+    free(dat_file->file_path);
+    mtx_destroy(&dat_file->page_mutex);
+    mtx_destroy(&dat_file->index_mutex);
+    memset(dat_file, 0, sizeof(DatFile));
+}
+
+uint8_t *extract_mft_data(const char *file_path, DatFile *dat_file, uint32_t number)
+{
+    // Find the corresponding MFT entry
+    uint32_t index_number = 0;
+    if (!find_mft_slot(dat_file, number, &index_number))
+    {
+        fprintf(stderr, "MFT entry not found!\n");
+        return NULL;
+    }
+    printf("Found!\n");
+    printf("File ID: %u\n", number);
+    printf("MFT Slot: %u\n", index_number);
+
+    // Get the MFT data corresponding to the found index
+    MFTData *mft_entry = get_mft_entry(dat_file, index_number);
+    if (mft_entry == NULL)
+    {
+        fprintf(stderr, "MFT slot %u is out of range!\n", index_number);
+        return NULL;
+    }
+
+    uint64_t access_start = prefetch_now_nanoseconds();
+    if (dat_file->prefetcher != NULL)
+    {
+        uint32_t cached_size = 0;
+        uint8_t *cached_data = prefetch_begin_access(dat_file, number, index_number, &cached_size);
+        if (cached_data != NULL)
+        {
+            printf("Served %u bytes from the entry cache\n", cached_size);
+            prefetch_end_access(dat_file, index_number, cached_data, cached_size, access_start, true);
+            return cached_data;
+        }
+    }
+
+    // Check if the file is compressed
+    if (mft_entry->compression_flag != 0)
+    {
+        printf("File is compressed!\n");
+
+        uint32_t transcoded_size = 0;
+        uint8_t *transcoded_data = transcode_cache_lookup(dat_file, index_number, mft_entry, &transcoded_size);
+        if (transcoded_data != NULL)
+        {
+            printf("Served %u bytes from the transcode cache\n", transcoded_size);
+            if (dat_file->prefetcher != NULL)
+            {
+                prefetch_end_access(dat_file, index_number, transcoded_data, transcoded_size, access_start, false);
+            }
+            return transcoded_data;
+        }
+    }
+
+    // Allocate buffer for MFT data
+    uint8_t *compressed_data = (uint8_t *)buffer_alloc(mft_entry->size);
+    if (compressed_data == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for compressed data\n");
+        return NULL;
+    }
+
+    // Open the file to read data
+    FILE *file = fopen(file_path, "rb"); // Open the file again to read data
+    if (!file)
+    {
+        perror("Error opening file");
+        buffer_free(compressed_data);
+        return NULL;
+    }
+
+    dat_fseek(file, mft_entry->offset, SEEK_SET);
+    size_t read_size = fread(compressed_data, 1, mft_entry->size, file);
+    fclose(file);
+    if (read_size != mft_entry->size)
+    {
+        fprintf(stderr, "Short read of MFT slot %u\n", index_number);
+        buffer_free(compressed_data);
+        return NULL;
+    }
+
+    // Print the first 16 bytes of the MFT data (Hex) before decompression
+    printf("First 16 bytes of MFT data before decompression (Hex):\n");
+    for (size_t i = 0; i < 16 && i < mft_entry->size; ++i)
+    {
+        printf("%02X ", compressed_data[i]);
+    }
+    printf("\n");
+
+    // Print the first 16 bytes of the MFT data (ASCII) before decompression
+    printf("First 16 bytes of MFT data before decompression (ASCII):\n");
+    for (size_t i = 0; i < 16 && i < mft_entry->size; ++i)
+    {
+        if (isprint(compressed_data[i]))
+        {
+            printf("%c", compressed_data[i]);
+        }
+        else
+        {
+            printf(".");
+        }
+    }
+    printf("\n");
+
+    // Decompress if the file is compressed
+    if (mft_entry->compression_flag != 0)
+    {
+        uint32_t decompressed_size = 0;
+        uint64_t decode_start = prefetch_now_nanoseconds();
+        uint32_t parallel_threads = parallel_decode_threads(compressed_data, mft_entry->size);
+        uint8_t *decompressed_data = parallel_threads ? decompress_data_parallel(compressed_data, mft_entry->size, &decompressed_size, parallel_threads, NULL)
+                                                      : decompress_data(compressed_data, mft_entry->size, &decompressed_size);
+        if (decompressed_data == NULL)
+        {
+            fprintf(stderr, "Decompression failed!\n");
+            buffer_free(compressed_data); // Free the original compressed data
+            return NULL;
+        }
+        transcode_cache_offer(dat_file, index_number, mft_entry, decompressed_data, decompressed_size, prefetch_now_nanoseconds() - decode_start);
+
+        buffer_free(compressed_data);               // Free the compressed compressed data
+        compressed_data = decompressed_data; // Update compressed data to point to decompressed data
+        printf("Decompressed MFT data size: %u bytes\n", decompressed_size);
+
+        // Print the first 16 bytes of the MFT data (Hex) after decompression
+        printf("First 16 bytes of MFT data after decompression (Hex):\n");
+        for (size_t i = 0; i < 16 && i < decompressed_size; ++i)
+        {
+            printf("%02X ", compressed_data[i]);
+        }
+        printf("\n");
+
+        // Print the first 16 bytes of the MFT data (ASCII) after decompression
+        printf("First 16 bytes of MFT data after decompression (ASCII):\n");
+        for (size_t i = 0; i < 16 && i < decompressed_size; ++i)
+        {
+            if (isprint(compressed_data[i]))
+            {
+                printf("%c", compressed_data[i]);
+            }
+            else
+            {
+                printf(".");
+            }
+        }
+        printf("\n");
+
+        if (dat_file->prefetcher != NULL)
+        {
+            prefetch_end_access(dat_file, index_number, compressed_data, decompressed_size, access_start, false);
+        }
+    }
+    else if (dat_file->prefetcher != NULL)
+    {
+        prefetch_end_access(dat_file, index_number, compressed_data, mft_entry->size, access_start, false);
+    }
+
+    return compressed_data; // Return the compressed data containing the MFT data
+}
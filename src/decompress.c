@@ -0,0 +1,1704 @@
+#include "decompress.h"
+
+#include <stdatomic.h>
+#include <threads.h>
+#include <time.h>
+
+void pull_byte(StateData* state_data, uint32_t* head_data, uint8_t* bits_available_data)
+{
+	if (state_data->bytes_available >= sizeof(uint32_t))
+	{
+		// Copy 4 bytes from the input buffer into head_data
+		memcpy(head_data, state_data->input_buffer + state_data->buffer_position_bytes, sizeof(uint32_t));
+
+		// Update state_data properties
+		state_data->bytes_available -= sizeof(uint32_t);
+		state_data->buffer_position_bytes += sizeof(uint32_t);
+
+		// Set the number of bits available
+		*bits_available_data = sizeof(uint32_t) * 8; // 32 bits
+	}
+	else
+	{
+		// Past the end of the input, or in a final word cut short, the stream reads as zero bits. The
+		// position still moves on so tell_bits stays exact and a checkpoint taken there resumes there.
+		*head_data = 0;
+		*bits_available_data = sizeof(uint32_t) * 8;
+		state_data->bytes_available = 0;
+		state_data->buffer_position_bytes += sizeof(uint32_t);
+	}
+}
+
+uint32_t read_bits(StateData* state_data, uint8_t bits_number)
+{
+	uint32_t value = state_data->head_data >> ((sizeof(uint32_t) * 8) - bits_number);
+
+	return value;
+}
+
+void drop_bits(StateData* state_data, uint8_t bits_number)
+{
+	if (state_data->bits_available_data < bits_number)
+	{
+
+		printf("Too much bits were asked to be dropped.\n");
+	}
+	uint8_t new_bits_available = 0;
+	new_bits_available = state_data->bits_available_data - bits_number;
+	if (new_bits_available >= (sizeof(uint32_t) * 8))
+	{
+		if (bits_number == (sizeof(uint32_t) * 8))
+		{
+			state_data->head_data = state_data->buffer_data;
+			state_data->buffer_data = 0;
+		}
+		else
+		{
+			state_data->head_data = (state_data->head_data << bits_number) | (state_data->buffer_data >> ((sizeof(uint32_t) * 8) - bits_number));
+			state_data->buffer_data = state_data->buffer_data << bits_number;
+		}
+		state_data->bits_available_data = new_bits_available;
+	}
+	else
+	{
+		uint32_t new_value = 0;
+		uint8_t pulled_bits = 0;
+		pull_byte(state_data, &new_value, &pulled_bits);
+
+		if (bits_number == (sizeof(uint32_t) * 8))
+		{
+			state_data->head_data = 0;
+		}
+		else
+		{
+			state_data->head_data = state_data->head_data << bits_number;
+		}
+		state_data->head_data |= (state_data->buffer_data >> ((sizeof(uint32_t) * 8) - bits_number)) | (new_value >> new_bits_available);
+
+		if (new_bits_available > 0)
+		{
+			state_data->buffer_data = new_value << ((sizeof(uint32_t) * 8) - new_bits_available);
+		}
+
+		state_data->bits_available_data = new_bits_available + pulled_bits;
+	}
+}
+
+bool read_code(const HuffmanTree* huffmantree_data, StateData* state_data, uint16_t* symbol_data)
+{
+	uint16_t entry = huffmantree_data->lookup_array[read_bits(state_data, MAX_BITS_HASH)];
+	if (entry != HUFFMAN_ENTRY_LONG)
+	{
+		*symbol_data = HUFFMAN_ENTRY_SYMBOL(entry);
+		drop_bits(state_data, HUFFMAN_ENTRY_BITS(entry));
+		return true;
+	}
+
+	uint32_t code = read_bits(state_data, 32);
+	const HuffmanLongCode* long_code = huffmantree_data->long_code_array;
+	while (code < long_code->code_comparison)
+	{
+		++long_code;
+	}
+	if (long_code->code_bits == 0)
+	{
+		return false;
+	}
+	int32_t symbol_index = long_code->symbol_offset - (int32_t)((code - long_code->code_comparison) >> (32 - long_code->code_bits));
+	if (symbol_index < 0)
+	{
+		return false;
+	}
+	*symbol_data = huffmantree_data->long_symbol_array[symbol_index];
+	drop_bits(state_data, long_code->code_bits);
+	return true;
+}
+
+uint8_t peek_short_literal(const HuffmanTree* huffmantree_data, uint32_t prefix, uint8_t prefix_bits, uint16_t* symbol_data)
+{
+	uint32_t hash_value = 0;
+	if (prefix_bits >= MAX_BITS_HASH)
+	{
+		hash_value = prefix >> (prefix_bits - MAX_BITS_HASH);
+	}
+	else
+	{
+		hash_value = prefix << (MAX_BITS_HASH - prefix_bits);
+	}
+
+	uint16_t entry = huffmantree_data->lookup_array[hash_value];
+	if (entry == HUFFMAN_ENTRY_LONG)
+	{
+		return 0;
+	}
+
+	uint8_t code_bits = HUFFMAN_ENTRY_BITS(entry);
+	uint16_t symbol = HUFFMAN_ENTRY_SYMBOL(entry);
+	if (code_bits > prefix_bits || symbol >= 0x100)
+	{
+		return 0;
+	}
+
+	*symbol_data = symbol;
+	return code_bits;
+}
+
+void build_literal_table(const HuffmanTree* huffmantree_data, HuffmanLiteralTable* literal_table)
+{
+	for (uint32_t index = 0; index < (1u << MAX_BITS_LITERAL_PAIR); ++index)
+	{
+		uint32_t entry = 0;
+		uint16_t first_symbol = 0;
+		uint8_t first_bits = peek_short_literal(huffmantree_data, index, MAX_BITS_LITERAL_PAIR, &first_symbol);
+		if (first_bits != 0)
+		{
+			entry = first_symbol | ((uint32_t)first_bits << 16) | (1u << 24);
+
+			// The bits after the first code may hold a second complete literal code
+			uint16_t second_symbol = 0;
+			uint8_t rest_bits = MAX_BITS_LITERAL_PAIR - first_bits;
+			uint32_t rest = index & ((1u << rest_bits) - 1);
+			uint8_t second_bits = (rest_bits != 0) ? peek_short_literal(huffmantree_data, rest, rest_bits, &second_symbol) : 0;
+			if (second_bits != 0)
+			{
+				entry = first_symbol | ((uint32_t)second_symbol << 8) | ((uint32_t)(first_bits + second_bits) << 16) | (2u << 24);
+			}
+		}
+		literal_table->entry_array[index] = entry;
+	}
+}
+
+void clear_huffmantree(HuffmanTree* huffmantree)
+{
+	// Every lookup slot HUFFMAN_ENTRY_LONG and every long code record the terminator
+	memset(huffmantree, 0, sizeof(HuffmanTree));
+}
+
+void clear_huffmantree_builder(HuffmanTreeBuilder* huffmantree_builder)
+{
+	for (int i = 0; i < MAX_CODE_BITS_LENGTH; i++)
+	{
+		huffmantree_builder->symbol_list_by_bits_head_existence_array[i] = false;
+		huffmantree_builder->symbol_list_by_bits_head_array[i] = 0;
+	}
+
+	for (int i = 0; i < MAX_SYMBOL_VALUE; i++)
+	{
+		huffmantree_builder->symbol_list_by_bits_body_existence_array[i] = false;
+		huffmantree_builder->symbol_list_by_bits_body_array[i] = 0;
+	}
+}
+
+void add_symbol(HuffmanTreeBuilder* huffmantree_builder, uint16_t symbol_data, uint8_t bits_data)
+{
+	if (huffmantree_builder->symbol_list_by_bits_head_existence_array[bits_data])
+	{
+		huffmantree_builder->symbol_list_by_bits_body_array[symbol_data] = huffmantree_builder->symbol_list_by_bits_head_array[bits_data];
+		huffmantree_builder->symbol_list_by_bits_body_existence_array[symbol_data] = true;
+		huffmantree_builder->symbol_list_by_bits_head_array[bits_data] = symbol_data;
+	}
+	else
+	{
+		huffmantree_builder->symbol_list_by_bits_head_array[bits_data] = symbol_data;
+		huffmantree_builder->symbol_list_by_bits_head_existence_array[bits_data] = true;
+	}
+}
+
+bool check_huffmantree_builder(HuffmanTreeBuilder* huffmantree_builder)
+{
+	// Check if all elements in symbol_list_by_bits_head_existence_array are false
+	for (int i = 0; i < MAX_CODE_BITS_LENGTH; i++)
+	{
+		if (huffmantree_builder->symbol_list_by_bits_head_existence_array[i] == true)
+		{
+			return false; // Return false if any element is true
+		}
+	}
+
+	return true; // Return true if all checks passed (i.e., all elements are false or 0)
+}
+
+bool build_huffmantree(HuffmanTree* huffmantree_data, HuffmanTreeBuilder* huffmantree_builder)
+{
+	if (check_huffmantree_builder(huffmantree_builder))
+	{
+		return false; // Return false if the builder is in an invalid state
+	}
+
+	clear_huffmantree(huffmantree_data); // Clear existing Huffman tree data
+
+	uint32_t code_data = 0;
+	uint8_t bits_data = 0;
+
+	// Loop through bits_data to build the tree
+	while (bits_data <= MAX_BITS_HASH)
+	{
+		bool existence = huffmantree_builder->symbol_list_by_bits_head_existence_array[bits_data];
+
+		if (existence)
+		{
+			uint16_t current_symbol = huffmantree_builder->symbol_list_by_bits_head_array[bits_data];
+
+			while (existence)
+			{
+				// More codes of this length than remain available: the code lengths are oversubscribed
+				if (code_data >= (1u << bits_data))
+				{
+					return false;
+				}
+
+				uint16_t hash_value = (uint16_t)(code_data << (MAX_BITS_HASH - bits_data));
+				uint16_t next_hash_value = (uint16_t)((code_data + 1) << (MAX_BITS_HASH - bits_data));
+
+				// Every lookup slot starting with this code resolves to it
+				uint16_t entry = HUFFMAN_ENTRY(current_symbol, bits_data);
+				while (hash_value < next_hash_value)
+				{
+					huffmantree_data->lookup_array[hash_value] = entry;
+					++hash_value;
+				}
+
+				// Move to the next symbol in the body array
+				existence = huffmantree_builder->symbol_list_by_bits_body_existence_array[current_symbol];
+				current_symbol = huffmantree_builder->symbol_list_by_bits_body_array[current_symbol];
+				--code_data;
+			}
+		}
+
+		// Shift code_data and increment bits_data
+		code_data = (code_data << 1) + 1;
+		++bits_data;
+	}
+
+	HuffmanLongCode* long_code = huffmantree_data->long_code_array;
+	uint16_t symbol_offset = 0;
+
+	// Continue building the tree for larger bit sizes
+	while (bits_data < MAX_CODE_BITS_LENGTH)
+	{
+		bool existence = huffmantree_builder->symbol_list_by_bits_head_existence_array[bits_data];
+		if (existence)
+		{
+			uint16_t current_symbol = huffmantree_builder->symbol_list_by_bits_head_array[bits_data];
+
+			while (existence)
+			{
+				if (code_data >= (1u << bits_data))
+				{
+					return false;
+				}
+
+				huffmantree_data->long_symbol_array[symbol_offset] = current_symbol;
+				++symbol_offset;
+
+				// Move to the next symbol in the body array
+				existence = huffmantree_builder->symbol_list_by_bits_body_existence_array[current_symbol];
+				current_symbol = huffmantree_builder->symbol_list_by_bits_body_array[current_symbol];
+				--code_data;
+			}
+
+			// One record for the codes of this length
+			long_code->code_comparison = (code_data + 1) << (32 - bits_data);
+			long_code->code_bits = bits_data;
+			long_code->symbol_offset = symbol_offset - 1;
+			++long_code;
+		}
+
+		// Shift code_data and increment bits_data
+		code_data = (code_data << 1) + 1;
+		++bits_data;
+	}
+
+	return true; // Return true if the Huffman tree was successfully built
+}
+
+bool read_huffmantree_description(StateData* state_data, HuffmanTreeDescription* description, const HuffmanTree* huffmantree_static)
+{
+	uint16_t number_of_symbols = 0;
+	number_of_symbols = (uint16_t)read_bits(state_data, 16); // Read number of symbols
+	drop_bits(state_data, 16);                               // Drop the 16 bits read for the number of symbols
+
+	if (number_of_symbols > MAX_SYMBOL_VALUE)
+	{
+
+		printf("Too many symbols to decode.\n");
+		return false; // Return false if there are too many symbols
+	}
+
+	description->number_of_symbols = number_of_symbols;
+	memset(description->bits_array, 0, number_of_symbols);
+
+	int16_t remaining_symbols = number_of_symbols - 1; // Initialize remaining symbols to number_of_symbols - 1
+
+	while (remaining_symbols >= 0)
+	{
+		uint16_t code_data = 0;
+		if (!read_code(huffmantree_static, state_data, &code_data)) // Read the Huffman code
+		{
+			return false;
+		}
+
+		uint8_t code_number_of_bits = code_data & 0x1F;         // Extract number of bits
+		uint16_t code_number_of_symbols = (code_data >> 5) + 1; // Extract number of symbols
+
+		if (code_number_of_bits == 0)
+		{
+			remaining_symbols -= code_number_of_symbols; // If code_number_of_bits is 0, decrement remaining_symbols
+		}
+		else
+		{
+			if (code_number_of_symbols > remaining_symbols + 1)
+			{
+				printf("Huffman tree description runs past its symbol count.\n");
+				return false;
+			}
+
+			while (code_number_of_symbols > 0)
+			{
+				description->bits_array[remaining_symbols] = code_number_of_bits;
+				--remaining_symbols;
+				--code_number_of_symbols;
+			}
+		}
+	}
+
+	// FNV-1a over the code lengths and the symbol count
+	uint64_t hash = 14695981039346656037ull ^ number_of_symbols;
+	for (uint16_t i = 0; i < number_of_symbols; ++i)
+	{
+		hash = (hash ^ description->bits_array[i]) * 1099511628211ull;
+	}
+	description->hash = hash;
+	return true;
+}
+
+bool build_huffmantree_from_description(HuffmanTree* huffmantree_data, HuffmanTreeBuilder* huffmantree_builder, const HuffmanTreeDescription* description)
+{
+	clear_huffmantree_builder(huffmantree_builder); // Clear the builder
+
+	// Symbols are added from the highest down, the order the description lists them in
+	for (int32_t symbol = (int32_t)description->number_of_symbols - 1; symbol >= 0; --symbol)
+	{
+		if (description->bits_array[symbol] != 0)
+		{
+			add_symbol(huffmantree_builder, (uint16_t)symbol, description->bits_array[symbol]);
+		}
+	}
+
+	return build_huffmantree(huffmantree_data, huffmantree_builder);
+}
+
+bool parse_huffmantree(StateData* state_data, HuffmanTree* huffmantree_data, HuffmanTreeBuilder* huffmantree_builder, const HuffmanTree* huffmantree_static)
+{
+	HuffmanTreeDescription description;
+	return read_huffmantree_description(state_data, &description, huffmantree_static) &&
+		   build_huffmantree_from_description(huffmantree_data, huffmantree_builder, &description);
+}
+
+void initialize_static_huffmantree(HuffmanTree* huffmantree_static)
+{
+	HuffmanTreeBuilder huffmantree_builder;
+	clear_huffmantree_builder(&huffmantree_builder);
+
+	add_symbol(&huffmantree_builder, 0x0A, 3);
+	add_symbol(&huffmantree_builder, 0x09, 3);
+	add_symbol(&huffmantree_builder, 0x08, 3);
+
+	add_symbol(&huffmantree_builder, 0x0C, 4);
+	add_symbol(&huffmantree_builder, 0x0B, 4);
+	add_symbol(&huffmantree_builder, 0x07, 4);
+	add_symbol(&huffmantree_builder, 0x00, 4);
+
+	add_symbol(&huffmantree_builder, 0xE0, 5);
+	add_symbol(&huffmantree_builder, 0x2A, 5);
+	add_symbol(&huffmantree_builder, 0x29, 5);
+	add_symbol(&huffmantree_builder, 0x06, 5);
+
+	add_symbol(&huffmantree_builder, 0x4A, 6);
+	add_symbol(&huffmantree_builder, 0x40, 6);
+	add_symbol(&huffmantree_builder, 0x2C, 6);
+	add_symbol(&huffmantree_builder, 0x2B, 6);
+	add_symbol(&huffmantree_builder, 0x28, 6);
+	add_symbol(&huffmantree_builder, 0x20, 6);
+	add_symbol(&huffmantree_builder, 0x05, 6);
+	add_symbol(&huffmantree_builder, 0x04, 6);
+
+	add_symbol(&huffmantree_builder, 0x49, 7);
+	add_symbol(&huffmantree_builder, 0x48, 7);
+	add_symbol(&huffmantree_builder, 0x27, 7);
+	add_symbol(&huffmantree_builder, 0x26, 7);
+	add_symbol(&huffmantree_builder, 0x25, 7);
+	add_symbol(&huffmantree_builder, 0x0D, 7);
+	add_symbol(&huffmantree_builder, 0x03, 7);
+
+	add_symbol(&huffmantree_builder, 0x6A, 8);
+	add_symbol(&huffmantree_builder, 0x69, 8);
+	add_symbol(&huffmantree_builder, 0x4C, 8);
+	add_symbol(&huffmantree_builder, 0x4B, 8);
+	add_symbol(&huffmantree_builder, 0x47, 8);
+	add_symbol(&huffmantree_builder, 0x24, 8);
+
+	add_symbol(&huffmantree_builder, 0xE8, 9);
+	add_symbol(&huffmantree_builder, 0xA0, 9);
+	add_symbol(&huffmantree_builder, 0x89, 9);
+	add_symbol(&huffmantree_builder, 0x88, 9);
+	add_symbol(&huffmantree_builder, 0x68, 9);
+	add_symbol(&huffmantree_builder, 0x67, 9);
+	add_symbol(&huffmantree_builder, 0x63, 9);
+	add_symbol(&huffmantree_builder, 0x60, 9);
+	add_symbol(&huffmantree_builder, 0x46, 9);
+	add_symbol(&huffmantree_builder, 0x23, 9);
+
+	add_symbol(&huffmantree_builder, 0xE9, 10);
+	add_symbol(&huffmantree_builder, 0xC9, 10);
+	add_symbol(&huffmantree_builder, 0xC0, 10);
+	add_symbol(&huffmantree_builder, 0xA9, 10);
+	add_symbol(&huffmantree_builder, 0xA8, 10);
+	add_symbol(&huffmantree_builder, 0x8A, 10);
+	add_symbol(&huffmantree_builder, 0x87, 10);
+	add_symbol(&huffmantree_builder, 0x80, 10);
+	add_symbol(&huffmantree_builder, 0x66, 10);
+	add_symbol(&huffmantree_builder, 0x65, 10);
+	add_symbol(&huffmantree_builder, 0x45, 10);
+	add_symbol(&huffmantree_builder, 0x44, 10);
+	add_symbol(&huffmantree_builder, 0x43, 10);
+	add_symbol(&huffmantree_builder, 0x2D, 10);
+	add_symbol(&huffmantree_builder, 0x02, 10);
+	add_symbol(&huffmantree_builder, 0x01, 10);
+
+	add_symbol(&huffmantree_builder, 0xE5, 11);
+	add_symbol(&huffmantree_builder, 0xC8, 11);
+	add_symbol(&huffmantree_builder, 0xAA, 11);
+	add_symbol(&huffmantree_builder, 0xA5, 11);
+	add_symbol(&huffmantree_builder, 0xA4, 11);
+	add_symbol(&huffmantree_builder, 0x8B, 11);
+	add_symbol(&huffmantree_builder, 0x85, 11);
+	add_symbol(&huffmantree_builder, 0x84, 11);
+	add_symbol(&huffmantree_builder, 0x6C, 11);
+	add_symbol(&huffmantree_builder, 0x6B, 11);
+	add_symbol(&huffmantree_builder, 0x64, 11);
+	add_symbol(&huffmantree_builder, 0x4D, 11);
+	add_symbol(&huffmantree_builder, 0x0E, 11);
+
+	add_symbol(&huffmantree_builder, 0xE7, 12);
+	add_symbol(&huffmantree_builder, 0xCA, 12);
+	add_symbol(&huffmantree_builder, 0xC7, 12);
+	add_symbol(&huffmantree_builder, 0xA7, 12);
+	add_symbol(&huffmantree_builder, 0xA6, 12);
+	add_symbol(&huffmantree_builder, 0x86, 12);
+	add_symbol(&huffmantree_builder, 0x83, 12);
+
+	add_symbol(&huffmantree_builder, 0xE6, 13);
+	add_symbol(&huffmantree_builder, 0xE4, 13);
+	add_symbol(&huffmantree_builder, 0xC4, 13);
+	add_symbol(&huffmantree_builder, 0x8C, 13);
+	add_symbol(&huffmantree_builder, 0x2E, 13);
+	add_symbol(&huffmantree_builder, 0x22, 13);
+
+	add_symbol(&huffmantree_builder, 0xEC, 14);
+	add_symbol(&huffmantree_builder, 0xC6, 14);
+	add_symbol(&huffmantree_builder, 0x6D, 14);
+	add_symbol(&huffmantree_builder, 0x4E, 14);
+
+	add_symbol(&huffmantree_builder, 0xEA, 15);
+	add_symbol(&huffmantree_builder, 0xCC, 15);
+	add_symbol(&huffmantree_builder, 0xAC, 15);
+	add_symbol(&huffmantree_builder, 0xAB, 15);
+	add_symbol(&huffmantree_builder, 0x8D, 15);
+	add_symbol(&huffmantree_builder, 0x11, 15);
+	add_symbol(&huffmantree_builder, 0x10, 15);
+	add_symbol(&huffmantree_builder, 0x0F, 15);
+
+	add_symbol(&huffmantree_builder, 0xFF, 16);
+	add_symbol(&huffmantree_builder, 0xFE, 16);
+	add_symbol(&huffmantree_builder, 0xFD, 16);
+	add_symbol(&huffmantree_builder, 0xFC, 16);
+	add_symbol(&huffmantree_builder, 0xFB, 16);
+	add_symbol(&huffmantree_builder, 0xFA, 16);
+	add_symbol(&huffmantree_builder, 0xF9, 16);
+	add_symbol(&huffmantree_builder, 0xF8, 16);
+	add_symbol(&huffmantree_builder, 0xF7, 16);
+	add_symbol(&huffmantree_builder, 0xF6, 16);
+	add_symbol(&huffmantree_builder, 0xF5, 16);
+	add_symbol(&huffmantree_builder, 0xF4, 16);
+	add_symbol(&huffmantree_builder, 0xF3, 16);
+	add_symbol(&huffmantree_builder, 0xF2, 16);
+	add_symbol(&huffmantree_builder, 0xF1, 16);
+	add_symbol(&huffmantree_builder, 0xF0, 16);
+	add_symbol(&huffmantree_builder, 0xEF, 16);
+	add_symbol(&huffmantree_builder, 0xEE, 16);
+	add_symbol(&huffmantree_builder, 0xED, 16);
+	add_symbol(&huffmantree_builder, 0xEB, 16);
+	add_symbol(&huffmantree_builder, 0xE3, 16);
+	add_symbol(&huffmantree_builder, 0xE2, 16);
+	add_symbol(&huffmantree_builder, 0xE1, 16);
+	add_symbol(&huffmantree_builder, 0xDF, 16);
+	add_symbol(&huffmantree_builder, 0xDE, 16);
+	add_symbol(&huffmantree_builder, 0xDD, 16);
+	add_symbol(&huffmantree_builder, 0xDC, 16);
+	add_symbol(&huffmantree_builder, 0xDB, 16);
+	add_symbol(&huffmantree_builder, 0xDA, 16);
+	add_symbol(&huffmantree_builder, 0xD9, 16);
+	add_symbol(&huffmantree_builder, 0xD8, 16);
+	add_symbol(&huffmantree_builder, 0xD7, 16);
+	add_symbol(&huffmantree_builder, 0xD6, 16);
+	add_symbol(&huffmantree_builder, 0xD5, 16);
+	add_symbol(&huffmantree_builder, 0xD4, 16);
+	add_symbol(&huffmantree_builder, 0xD3, 16);
+	add_symbol(&huffmantree_builder, 0xD2, 16);
+	add_symbol(&huffmantree_builder, 0xD1, 16);
+	add_symbol(&huffmantree_builder, 0xD0, 16);
+	add_symbol(&huffmantree_builder, 0xCF, 16);
+	add_symbol(&huffmantree_builder, 0xCE, 16);
+	add_symbol(&huffmantree_builder, 0xCD, 16);
+	add_symbol(&huffmantree_builder, 0xCB, 16);
+	add_symbol(&huffmantree_builder, 0xC5, 16);
+	add_symbol(&huffmantree_builder, 0xC3, 16);
+	add_symbol(&huffmantree_builder, 0xC2, 16);
+	add_symbol(&huffmantree_builder, 0xC1, 16);
+	add_symbol(&huffmantree_builder, 0xBF, 16);
+	add_symbol(&huffmantree_builder, 0xBE, 16);
+	add_symbol(&huffmantree_builder, 0xBD, 16);
+	add_symbol(&huffmantree_builder, 0xBC, 16);
+	add_symbol(&huffmantree_builder, 0xBB, 16);
+	add_symbol(&huffmantree_builder, 0xBA, 16);
+	add_symbol(&huffmantree_builder, 0xB9, 16);
+	add_symbol(&huffmantree_builder, 0xB8, 16);
+	add_symbol(&huffmantree_builder, 0xB7, 16);
+	add_symbol(&huffmantree_builder, 0xB6, 16);
+	add_symbol(&huffmantree_builder, 0xB5, 16);
+	add_symbol(&huffmantree_builder, 0xB4, 16);
+	add_symbol(&huffmantree_builder, 0xB3, 16);
+	add_symbol(&huffmantree_builder, 0xB2, 16);
+	add_symbol(&huffmantree_builder, 0xB1, 16);
+	add_symbol(&huffmantree_builder, 0xB0, 16);
+	add_symbol(&huffmantree_builder, 0xAF, 16);
+	add_symbol(&huffmantree_builder, 0xAE, 16);
+	add_symbol(&huffmantree_builder, 0xAD, 16);
+	add_symbol(&huffmantree_builder, 0xA3, 16);
+	add_symbol(&huffmantree_builder, 0xA2, 16);
+	add_symbol(&huffmantree_builder, 0xA1, 16);
+	add_symbol(&huffmantree_builder, 0x9F, 16);
+	add_symbol(&huffmantree_builder, 0x9E, 16);
+	add_symbol(&huffmantree_builder, 0x9D, 16);
+	add_symbol(&huffmantree_builder, 0x9C, 16);
+	add_symbol(&huffmantree_builder, 0x9B, 16);
+	add_symbol(&huffmantree_builder, 0x9A, 16);
+	add_symbol(&huffmantree_builder, 0x99, 16);
+	add_symbol(&huffmantree_builder, 0x98, 16);
+	add_symbol(&huffmantree_builder, 0x97, 16);
+	add_symbol(&huffmantree_builder, 0x96, 16);
+	add_symbol(&huffmantree_builder, 0x95, 16);
+	add_symbol(&huffmantree_builder, 0x94, 16);
+	add_symbol(&huffmantree_builder, 0x93, 16);
+	add_symbol(&huffmantree_builder, 0x92, 16);
+	add_symbol(&huffmantree_builder, 0x91, 16);
+	add_symbol(&huffmantree_builder, 0x90, 16);
+	add_symbol(&huffmantree_builder, 0x8F, 16);
+	add_symbol(&huffmantree_builder, 0x8E, 16);
+	add_symbol(&huffmantree_builder, 0x82, 16);
+	add_symbol(&huffmantree_builder, 0x81, 16);
+	add_symbol(&huffmantree_builder, 0x7F, 16);
+	add_symbol(&huffmantree_builder, 0x7E, 16);
+	add_symbol(&huffmantree_builder, 0x7D, 16);
+	add_symbol(&huffmantree_builder, 0x7C, 16);
+	add_symbol(&huffmantree_builder, 0x7B, 16);
+	add_symbol(&huffmantree_builder, 0x7A, 16);
+	add_symbol(&huffmantree_builder, 0x79, 16);
+	add_symbol(&huffmantree_builder, 0x78, 16);
+	add_symbol(&huffmantree_builder, 0x77, 16);
+	add_symbol(&huffmantree_builder, 0x76, 16);
+	add_symbol(&huffmantree_builder, 0x75, 16);
+	add_symbol(&huffmantree_builder, 0x74, 16);
+	add_symbol(&huffmantree_builder, 0x73, 16);
+	add_symbol(&huffmantree_builder, 0x72, 16);
+	add_symbol(&huffmantree_builder, 0x71, 16);
+	add_symbol(&huffmantree_builder, 0x70, 16);
+	add_symbol(&huffmantree_builder, 0x6F, 16);
+	add_symbol(&huffmantree_builder, 0x6E, 16);
+	add_symbol(&huffmantree_builder, 0x62, 16);
+	add_symbol(&huffmantree_builder, 0x61, 16);
+	add_symbol(&huffmantree_builder, 0x5F, 16);
+	add_symbol(&huffmantree_builder, 0x5E, 16);
+	add_symbol(&huffmantree_builder, 0x5D, 16);
+	add_symbol(&huffmantree_builder, 0x5C, 16);
+	add_symbol(&huffmantree_builder, 0x5B, 16);
+	add_symbol(&huffmantree_builder, 0x5A, 16);
+	add_symbol(&huffmantree_builder, 0x59, 16);
+	add_symbol(&huffmantree_builder, 0x58, 16);
+	add_symbol(&huffmantree_builder, 0x57, 16);
+	add_symbol(&huffmantree_builder, 0x56, 16);
+	add_symbol(&huffmantree_builder, 0x55, 16);
+	add_symbol(&huffmantree_builder, 0x54, 16);
+	add_symbol(&huffmantree_builder, 0x53, 16);
+	add_symbol(&huffmantree_builder, 0x52, 16);
+	add_symbol(&huffmantree_builder, 0x51, 16);
+	add_symbol(&huffmantree_builder, 0x50, 16);
+	add_symbol(&huffmantree_builder, 0x4F, 16);
+	add_symbol(&huffmantree_builder, 0x42, 16);
+	add_symbol(&huffmantree_builder, 0x41, 16);
+	add_symbol(&huffmantree_builder, 0x3F, 16);
+	add_symbol(&huffmantree_builder, 0x3E, 16);
+	add_symbol(&huffmantree_builder, 0x3D, 16);
+	add_symbol(&huffmantree_builder, 0x3C, 16);
+	add_symbol(&huffmantree_builder, 0x3B, 16);
+	add_symbol(&huffmantree_builder, 0x3A, 16);
+	add_symbol(&huffmantree_builder, 0x39, 16);
+	add_symbol(&huffmantree_builder, 0x38, 16);
+	add_symbol(&huffmantree_builder, 0x37, 16);
+	add_symbol(&huffmantree_builder, 0x36, 16);
+	add_symbol(&huffmantree_builder, 0x35, 16);
+	add_symbol(&huffmantree_builder, 0x34, 16);
+	add_symbol(&huffmantree_builder, 0x33, 16);
+	add_symbol(&huffmantree_builder, 0x32, 16);
+	add_symbol(&huffmantree_builder, 0x31, 16);
+	add_symbol(&huffmantree_builder, 0x30, 16);
+	add_symbol(&huffmantree_builder, 0x2F, 16);
+	add_symbol(&huffmantree_builder, 0x21, 16);
+	add_symbol(&huffmantree_builder, 0x1F, 16);
+	add_symbol(&huffmantree_builder, 0x1E, 16);
+	add_symbol(&huffmantree_builder, 0x1D, 16);
+	add_symbol(&huffmantree_builder, 0x1C, 16);
+	add_symbol(&huffmantree_builder, 0x1B, 16);
+	add_symbol(&huffmantree_builder, 0x1A, 16);
+	add_symbol(&huffmantree_builder, 0x19, 16);
+	add_symbol(&huffmantree_builder, 0x18, 16);
+	add_symbol(&huffmantree_builder, 0x17, 16);
+	add_symbol(&huffmantree_builder, 0x16, 16);
+	add_symbol(&huffmantree_builder, 0x15, 16);
+	add_symbol(&huffmantree_builder, 0x14, 16);
+	add_symbol(&huffmantree_builder, 0x13, 16);
+	add_symbol(&huffmantree_builder, 0x12, 16);
+
+	build_huffmantree(huffmantree_static, &huffmantree_builder);
+}
+
+static atomic_bool huffman_cache_disabled;
+static atomic_uint_least64_t stat_tree_lookups;
+static atomic_uint_least64_t stat_tree_hits;
+static atomic_uint_least64_t stat_tree_build_nanoseconds;
+static atomic_uint_least64_t stat_decode_nanoseconds;
+
+static once_flag huffman_cache_once = ONCE_FLAG_INIT;
+static tss_t huffman_cache_key;
+static bool huffman_cache_key_valid;
+
+static uint64_t decode_now_nanoseconds(void)
+{
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static void create_huffman_cache_key(void)
+{
+	huffman_cache_key_valid = tss_create(&huffman_cache_key, free) == thrd_success;
+}
+
+// The calling thread's cache, created on first use and released when the thread exits. NULL if
+// thread-specific storage is unavailable, in which case the caller brings its own.
+static HuffmanTreeCache* current_huffman_cache(void)
+{
+	call_once(&huffman_cache_once, create_huffman_cache_key);
+	if (!huffman_cache_key_valid)
+	{
+		return NULL;
+	}
+
+	HuffmanTreeCache* cache = (HuffmanTreeCache*)tss_get(huffman_cache_key);
+	if (cache == NULL)
+	{
+		cache = (HuffmanTreeCache*)calloc(1, sizeof(HuffmanTreeCache));
+		if (cache != NULL && tss_set(huffman_cache_key, cache) != thrd_success)
+		{
+			free(cache);
+			cache = NULL;
+		}
+	}
+	return cache;
+}
+
+void set_huffman_tree_cache_enabled(bool enabled)
+{
+	atomic_store(&huffman_cache_disabled, !enabled);
+}
+
+const HuffmanCacheEntry* lookup_huffmantree(HuffmanTreeCache* cache, const HuffmanTreeDescription* description, bool with_literal_table)
+{
+	bool enabled = !atomic_load_explicit(&huffman_cache_disabled, memory_order_relaxed);
+	HuffmanCacheEntry* victim = &cache->entries[0];
+	for (uint32_t i = 0; i < HUFFMAN_CACHE_ENTRIES; ++i)
+	{
+		HuffmanCacheEntry* entry = &cache->entries[i];
+		if (enabled && entry->valid && entry->description.hash == description->hash &&
+			entry->description.number_of_symbols == description->number_of_symbols &&
+			memcmp(entry->description.bits_array, description->bits_array, description->number_of_symbols) == 0)
+		{
+			entry->last_used = ++cache->clock;
+			if (with_literal_table && !entry->has_literal_table)
+			{
+				build_literal_table(&entry->tree, &entry->literal_table);
+				entry->has_literal_table = true;
+			}
+			atomic_fetch_add_explicit(&stat_tree_hits, 1, memory_order_relaxed);
+			return entry;
+		}
+		if (!entry->valid || (victim->valid && entry->last_used < victim->last_used))
+		{
+			victim = entry;
+		}
+	}
+
+	victim->valid = false;
+	victim->has_literal_table = false;
+	if (!build_huffmantree_from_description(&victim->tree, &cache->huffmantree_builder, description))
+	{
+		return NULL;
+	}
+	memcpy(&victim->description, description, sizeof(HuffmanTreeDescription));
+	victim->literals_only = true;
+	for (uint16_t symbol = 0x100; symbol < description->number_of_symbols; ++symbol)
+	{
+		if (description->bits_array[symbol] != 0)
+		{
+			victim->literals_only = false;
+			break;
+		}
+	}
+	victim->valid = true;
+	victim->last_used = ++cache->clock;
+	if (with_literal_table)
+	{
+		build_literal_table(&victim->tree, &victim->literal_table);
+		victim->has_literal_table = true;
+	}
+	return victim;
+}
+
+void get_huffman_cache_stats(HuffmanCacheStats* stats)
+{
+	stats->lookups = atomic_load(&stat_tree_lookups);
+	stats->hits = atomic_load(&stat_tree_hits);
+	stats->build_nanoseconds = atomic_load(&stat_tree_build_nanoseconds);
+	stats->decode_nanoseconds = atomic_load(&stat_decode_nanoseconds);
+}
+
+void print_huffman_cache_report(void)
+{
+	HuffmanCacheStats stats;
+	get_huffman_cache_stats(&stats);
+	printf("Huffman Tree Report:\n");
+	printf("  Cache:               %s, %u entries per thread\n", atomic_load(&huffman_cache_disabled) ? "disabled" : "enabled", HUFFMAN_CACHE_ENTRIES);
+	printf("  Tree lookups:        %llu (%llu hits, %.1f%%)\n", (unsigned long long)stats.lookups, (unsigned long long)stats.hits,
+		   stats.lookups ? 100.0 * stats.hits / stats.lookups : 0.0);
+	printf("  Tree building:       %.3f ms of %.3f ms decoding (%.1f%%)\n", stats.build_nanoseconds / 1e6, stats.decode_nanoseconds / 1e6,
+		   stats.decode_nanoseconds ? 100.0 * stats.build_nanoseconds / stats.decode_nanoseconds : 0.0);
+}
+
+void fast_reader_load(FastBitReader* reader, const StateData* state_data)
+{
+	reader->bit_buffer = ((uint64_t)state_data->head_data << 32) | state_data->buffer_data;
+	reader->bits_available = state_data->bits_available_data;
+	reader->input_position = state_data->input_buffer + state_data->buffer_position_bytes;
+}
+
+void fast_reader_store(const FastBitReader* reader, StateData* state_data)
+{
+	uint32_t consumed = (uint32_t)(reader->input_position - (state_data->input_buffer + state_data->buffer_position_bytes));
+	state_data->bytes_available -= consumed;
+	state_data->buffer_position_bytes += consumed;
+	state_data->head_data = (uint32_t)(reader->bit_buffer >> 32);
+	state_data->buffer_data = (uint32_t)reader->bit_buffer;
+	state_data->bits_available_data = (uint8_t)reader->bits_available;
+}
+
+uint32_t fast_read_bits(const FastBitReader* reader, uint8_t bits_number)
+{
+	return (uint32_t)(reader->bit_buffer >> (64 - bits_number));
+}
+
+uint32_t fast_read_extra_bits(const FastBitReader* reader, uint8_t bits_number)
+{
+	return (uint32_t)((reader->bit_buffer >> 1) >> (63 - bits_number));
+}
+
+void fast_drop_bits(FastBitReader* reader, uint8_t bits_number)
+{
+	reader->bit_buffer <<= bits_number;
+	reader->bits_available -= bits_number;
+	if (reader->bits_available < 32)
+	{
+		uint32_t new_value = 0;
+		memcpy(&new_value, reader->input_position, sizeof(uint32_t));
+		reader->input_position += sizeof(uint32_t);
+		reader->bit_buffer |= (uint64_t)new_value << (32 - reader->bits_available);
+		reader->bits_available += 32;
+	}
+}
+
+bool fast_read_code(const HuffmanTree* huffmantree_data, FastBitReader* reader, uint16_t* symbol_data)
+{
+	uint16_t entry = huffmantree_data->lookup_array[fast_read_bits(reader, MAX_BITS_HASH)];
+	if (entry != HUFFMAN_ENTRY_LONG)
+	{
+		*symbol_data = HUFFMAN_ENTRY_SYMBOL(entry);
+		fast_drop_bits(reader, HUFFMAN_ENTRY_BITS(entry));
+		return true;
+	}
+
+	uint32_t code = fast_read_bits(reader, 32);
+	const HuffmanLongCode* long_code = huffmantree_data->long_code_array;
+	while (code < long_code->code_comparison)
+	{
+		++long_code;
+	}
+	if (long_code->code_bits == 0)
+	{
+		return false;
+	}
+	int32_t symbol_index = long_code->symbol_offset - (int32_t)((code - long_code->code_comparison) >> (32 - long_code->code_bits));
+	if (symbol_index < 0)
+	{
+		return false;
+	}
+	*symbol_data = huffmantree_data->long_symbol_array[symbol_index];
+	fast_drop_bits(reader, long_code->code_bits);
+	return true;
+}
+
+uint32_t fast_symbol_budget(const StateData* state_data, uint32_t codes_left, uint32_t output_left)
+{
+	if (output_left <= FAST_LOOP_OUTPUT_MARGIN || state_data->bytes_available <= sizeof(uint32_t) || state_data->bits_available_data < 32)
+	{
+		return 0;
+	}
+
+	uint32_t budget = codes_left;
+	uint32_t output_budget = (output_left - FAST_LOOP_OUTPUT_MARGIN) / FAST_LOOP_MAX_SYMBOL_OUTPUT;
+	uint32_t input_budget = (state_data->bytes_available - sizeof(uint32_t)) / FAST_LOOP_MAX_SYMBOL_INPUT;
+	if (output_budget < budget)
+	{
+		budget = output_budget;
+	}
+	if (input_budget < budget)
+	{
+		budget = input_budget;
+	}
+	return budget;
+}
+
+// Codes 0-3 are the write size itself; from there each group of four codes doubles the step and
+// takes one more extra bit. Code 28 is 0xFF with none.
+static const uint16_t write_size_base[WRITE_SIZE_CODES] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 16, 20, 24, 28, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 255,
+};
+static const uint8_t write_size_bits[WRITE_SIZE_CODES] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+
+// Codes 0-1 are the offset itself; from there each pair of codes doubles the step and takes one
+// more extra bit. The entry past the last code stands for every invalid one.
+static const uint32_t write_offset_base[WRITE_OFFSET_CODES + 1] = {
+	0, 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072,
+	4096, 6144, 8192, 12288, 16384, 24576, 32768, 49152, 65536, 98304, WRITE_OFFSET_INVALID,
+};
+static const uint8_t write_offset_bits[WRITE_OFFSET_CODES + 1] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 0,
+};
+
+bool decode_write_size_code(uint16_t code, uint32_t* write_size, uint8_t* extra_bits)
+{
+	if (code >= WRITE_SIZE_CODES)
+	{
+		printf("Invalid value for write size code!\n");
+		return false;
+	}
+	*write_size = write_size_base[code];
+	*extra_bits = write_size_bits[code];
+	return true;
+}
+
+bool decode_write_offset_code(uint16_t code, uint32_t* write_offset, uint8_t* extra_bits)
+{
+	if (code >= WRITE_OFFSET_CODES)
+	{
+		printf("Invalid value for write offset code!\n");
+		return false;
+	}
+	*write_offset = write_offset_base[code];
+	*extra_bits = write_offset_bits[code];
+	return true;
+}
+
+uint64_t tell_bits(const StateData* state_data)
+{
+	return state_data->buffer_position_bytes * 8 - state_data->bits_available_data;
+}
+
+void seek_bits(StateData* state_data, uint64_t bit_position, uint32_t compressed_size)
+{
+	uint64_t word_position = (bit_position / 32) * sizeof(uint32_t);
+	state_data->buffer_position_bytes = word_position;
+	state_data->bytes_available = word_position < compressed_size ? compressed_size - (uint32_t)word_position : 0;
+	state_data->buffer_data = 0;
+	pull_byte(state_data, &state_data->head_data, &state_data->bits_available_data);
+	if (bit_position % 32 != 0)
+	{
+		drop_bits(state_data, (uint8_t)(bit_position % 32));
+	}
+}
+
+bool record_checkpoint(DecodeCheckpointIndex* checkpoint_index, const StateData* state_data, const uint8_t* decompressed_data,
+					   uint32_t output_position, uint64_t block_bit_position, uint32_t codes_read)
+{
+	if (checkpoint_index->count == checkpoint_index->capacity)
+	{
+		uint32_t capacity = checkpoint_index->capacity ? checkpoint_index->capacity * 2 : 16;
+		DecodeCheckpoint* checkpoints = (DecodeCheckpoint*)realloc(checkpoint_index->checkpoints, capacity * sizeof(DecodeCheckpoint));
+		if (checkpoints == NULL)
+		{
+			return false;
+		}
+		checkpoint_index->checkpoints = checkpoints;
+		checkpoint_index->capacity = capacity;
+	}
+
+	DecodeCheckpoint* checkpoint = &checkpoint_index->checkpoints[checkpoint_index->count];
+	checkpoint->output_position = output_position;
+	checkpoint->bit_position = tell_bits(state_data);
+	checkpoint->block_bit_position = block_bit_position;
+	checkpoint->codes_read = codes_read;
+	checkpoint->window_size = output_position < DECODE_WINDOW_SIZE ? output_position : DECODE_WINDOW_SIZE;
+	checkpoint->window = (uint8_t*)malloc(checkpoint->window_size ? checkpoint->window_size : 1);
+	if (checkpoint->window == NULL)
+	{
+		return false;
+	}
+	memcpy(checkpoint->window, decompressed_data + output_position - checkpoint->window_size, checkpoint->window_size);
+
+	++checkpoint_index->count;
+	checkpoint_index->next_output_position = output_position + checkpoint_index->interval;
+	return true;
+}
+
+void free_checkpoint_index(DecodeCheckpointIndex* checkpoint_index)
+{
+	for (uint32_t i = 0; i < checkpoint_index->count; ++i)
+	{
+		free(checkpoint_index->checkpoints[i].window);
+	}
+	free(checkpoint_index->checkpoints);
+	memset(checkpoint_index, 0, sizeof(DecodeCheckpointIndex));
+}
+
+// Capture the position of the next code so a later call can resume there; the window is left to the caller
+static void save_stop_state(DecodeCheckpoint* stop_state, const StateData* state_data, uint32_t output_position,
+							uint64_t block_bit_position, uint32_t codes_read)
+{
+	stop_state->output_position = output_position;
+	stop_state->bit_position = tell_bits(state_data);
+	stop_state->block_bit_position = block_bit_position;
+	stop_state->codes_read = codes_read;
+	stop_state->window_size = 0;
+	stop_state->window = NULL;
+}
+
+// Fast-phase loop for blocks whose symbol tree has no length codes: literals only, no match handling.
+// Decodes while two codes of the batch remain and updates the reader, position and codes left.
+static bool decode_fast_literals(const HuffmanLiteralTable* literal_table, const HuffmanTree* huffmantree_symbol, FastBitReader* reader_data,
+								 uint8_t* decompressed_data, uint32_t* output_position_data, uint32_t* codes_left_data)
+{
+	FastBitReader reader = *reader_data;
+	uint32_t output_position = *output_position_data;
+	uint32_t codes_left = *codes_left_data;
+	bool decoded = true;
+	while (codes_left >= 2)
+	{
+		uint32_t literal_entry = literal_table->entry_array[fast_read_bits(&reader, MAX_BITS_LITERAL_PAIR)];
+		uint32_t literal_count = literal_entry >> 24;
+		if (literal_count != 0)
+		{
+			decompressed_data[output_position] = (uint8_t)literal_entry;
+			decompressed_data[output_position + 1] = (uint8_t)(literal_entry >> 8);
+			output_position += literal_count;
+			codes_left -= literal_count;
+			fast_drop_bits(&reader, (uint8_t)(literal_entry >> 16));
+			continue;
+		}
+
+		uint16_t symbol_data = 0;
+		if (!fast_read_code(huffmantree_symbol, &reader, &symbol_data))
+		{
+			printf("Invalid symbol code!\n");
+			decoded = false;
+			break;
+		}
+		decompressed_data[output_position] = (uint8_t)symbol_data;
+		++output_position;
+		--codes_left;
+	}
+
+	*reader_data = reader;
+	*output_position_data = output_position;
+	*codes_left_data = codes_left;
+	return decoded;
+}
+
+// Fast-phase loop for blocks with matches. Length and offset codes go through the base and extra-bit
+// tables with no test on the extra-bit count; invalid offset codes map to an offset no position can
+// reach, so the one bound check refuses them.
+static bool decode_fast_codes(const HuffmanLiteralTable* literal_table, const HuffmanTree* huffmantree_symbol, const HuffmanTree* huffmantree_copy,
+							  const uint16_t* write_size_table, FastBitReader* reader_data, uint8_t* decompressed_data,
+							  uint32_t* output_position_data, uint32_t* codes_left_data)
+{
+	FastBitReader reader = *reader_data;
+	uint32_t output_position = *output_position_data;
+	uint32_t codes_left = *codes_left_data;
+	bool decoded = true;
+	while (codes_left >= 2)
+	{
+		uint32_t literal_entry = literal_table->entry_array[fast_read_bits(&reader, MAX_BITS_LITERAL_PAIR)];
+		uint32_t literal_count = literal_entry >> 24;
+		if (literal_count != 0)
+		{
+			decompressed_data[output_position] = (uint8_t)literal_entry;
+			decompressed_data[output_position + 1] = (uint8_t)(literal_entry >> 8);
+			output_position += literal_count;
+			codes_left -= literal_count;
+			fast_drop_bits(&reader, (uint8_t)(literal_entry >> 16));
+			continue;
+		}
+
+		--codes_left;
+
+		uint16_t symbol_data = 0;
+		if (!fast_read_code(huffmantree_symbol, &reader, &symbol_data))
+		{
+			printf("Invalid symbol code!\n");
+			decoded = false;
+			break;
+		}
+		if (symbol_data < 0x100)
+		{
+			decompressed_data[output_position] = (uint8_t)symbol_data;
+			++output_position;
+			continue;
+		}
+
+		// Symbols stop below MAX_SYMBOL_VALUE, so every length code is in the tables
+		uint16_t size_code = symbol_data - 0x100;
+		uint32_t write_size = write_size_table[size_code] + fast_read_extra_bits(&reader, write_size_bits[size_code]);
+		fast_drop_bits(&reader, write_size_bits[size_code]);
+
+		if (!fast_read_code(huffmantree_copy, &reader, &symbol_data))
+		{
+			decoded = false;
+			break;
+		}
+		uint16_t offset_code = symbol_data < WRITE_OFFSET_CODES ? symbol_data : WRITE_OFFSET_CODES;
+		uint32_t write_offset = write_offset_base[offset_code] + fast_read_extra_bits(&reader, write_offset_bits[offset_code]) + 1;
+		fast_drop_bits(&reader, write_offset_bits[offset_code]);
+
+		if (write_offset > output_position)
+		{
+			printf("Invalid write offset: %u bytes back at position %u!\n", write_offset, output_position);
+			decoded = false;
+			break;
+		}
+
+		uint8_t* destination = decompressed_data + output_position;
+		const uint8_t* source = destination - write_offset;
+		if (write_offset >= 8)
+		{
+			for (uint32_t copied = 0; copied < write_size; copied += 8)
+			{
+				memcpy(destination + copied, source + copied, 8);
+			}
+		}
+		else
+		{
+			for (uint32_t copied = 0; copied < write_size; ++copied)
+			{
+				destination[copied] = source[copied];
+			}
+		}
+		output_position += write_size;
+	}
+
+	*reader_data = reader;
+	*output_position_data = output_position;
+	*codes_left_data = codes_left;
+	return decoded;
+}
+
+// decompress_blocks with the trees taken from cache; adds its tree lookups and the time spent reading
+// tree descriptions and building trees to the counters. With stop_state set, decoding also ends at the
+// first code boundary at or past stop_position, which is saved to stop_state; its output_position
+// stays UINT32_MAX if decoding reached decompressed_size instead.
+static bool decode_blocks(StateData* state_data, uint32_t compressed_size, uint16_t write_size_const_add,
+						  uint8_t* decompressed_data, uint32_t output_position, uint32_t decompressed_size,
+						  const DecodeCheckpoint* resume, DecodeCheckpointIndex* checkpoint_index,
+						  uint32_t stop_position, DecodeCheckpoint* stop_state,
+						  HuffmanTreeCache* cache, uint64_t* lookups, uint64_t* build_nanoseconds)
+{
+	if (stop_state != NULL)
+	{
+		stop_state->output_position = UINT32_MAX;
+	}
+
+	if (resume != NULL)
+	{
+		seek_bits(state_data, resume->block_bit_position, compressed_size);
+	}
+
+	// Write sizes by length code with the entry's constant add already in
+	uint16_t write_size_table[WRITE_SIZE_CODES];
+	for (uint32_t code = 0; code < WRITE_SIZE_CODES; ++code)
+	{
+		write_size_table[code] = (uint16_t)(write_size_base[code] + write_size_const_add);
+	}
+
+	// Start decompressing while we have data to process
+	while (output_position < decompressed_size)
+	{
+		uint64_t block_bit_position = tell_bits(state_data);
+
+		// Read the descriptions of the symbol and copy trees and look both up, building them on a miss
+		uint64_t build_start = decode_now_nanoseconds();
+		HuffmanTreeDescription description;
+		const HuffmanCacheEntry* symbol_entry = NULL;
+		const HuffmanCacheEntry* copy_entry = NULL;
+		if (read_huffmantree_description(state_data, &description, &cache->huffmantree_static))
+		{
+			symbol_entry = lookup_huffmantree(cache, &description, true);
+		}
+		if (symbol_entry != NULL && read_huffmantree_description(state_data, &description, &cache->huffmantree_static))
+		{
+			copy_entry = lookup_huffmantree(cache, &description, false);
+		}
+		*lookups += 2;
+		*build_nanoseconds += decode_now_nanoseconds() - build_start;
+		if (copy_entry == NULL)
+		{
+			printf("Error: Failed to parse Huffman tree.\n");
+			return false;
+		}
+		const HuffmanTree* huffmantree_symbol = &symbol_entry->tree;
+		const HuffmanTree* huffmantree_copy = &copy_entry->tree;
+		const HuffmanLiteralTable* literal_table = &symbol_entry->literal_table;
+		bool literals_only = symbol_entry->literals_only;
+
+		// Read the max count value
+
+		uint32_t max_count = 0;
+		max_count = read_bits(state_data, 4);
+		max_count = (max_count + 1) << 12;
+		drop_bits(state_data, 4); // Drop the remaining 4 bits
+
+		uint32_t current_code_read_count = 0;
+		if (resume != NULL)
+		{
+			seek_bits(state_data, resume->bit_position, compressed_size);
+			current_code_read_count = resume->codes_read;
+			resume = NULL;
+		}
+
+		// Fast phase: decode batches of codes that cannot reach the end of the input, the output or
+		// the block, so no per-symbol bound checks are needed
+		uint32_t budget = 0;
+		while ((budget = fast_symbol_budget(state_data, max_count - current_code_read_count, decompressed_size - output_position)) >= 2)
+		{
+			if (stop_state != NULL && output_position >= stop_position)
+			{
+				save_stop_state(stop_state, state_data, output_position, block_bit_position, current_code_read_count);
+				return true;
+			}
+			if (checkpoint_index != NULL && output_position >= checkpoint_index->next_output_position &&
+				!record_checkpoint(checkpoint_index, state_data, decompressed_data, output_position, block_bit_position, current_code_read_count))
+			{
+				return false;
+			}
+
+			FastBitReader reader;
+			fast_reader_load(&reader, state_data);
+
+			uint32_t codes_left = budget;
+			bool decoded = literals_only
+				? decode_fast_literals(literal_table, huffmantree_symbol, &reader, decompressed_data, &output_position, &codes_left)
+				: decode_fast_codes(literal_table, huffmantree_symbol, huffmantree_copy, write_size_table, &reader, decompressed_data,
+									&output_position, &codes_left);
+			if (!decoded)
+			{
+				return false;
+			}
+
+			current_code_read_count += budget - codes_left;
+			fast_reader_store(&reader, state_data);
+		}
+
+		// Checked tail: process each remaining symbol until we reach max_count or decompressed_size
+		while (current_code_read_count < max_count && output_position < decompressed_size)
+		{
+			if (stop_state != NULL && output_position >= stop_position)
+			{
+				save_stop_state(stop_state, state_data, output_position, block_bit_position, current_code_read_count);
+				return true;
+			}
+
+			// Short literal codes are decoded one or two at a time through the literal table
+			uint32_t literal_entry = literal_table->entry_array[read_bits(state_data, MAX_BITS_LITERAL_PAIR)];
+			uint32_t literal_count = literal_entry >> 24;
+			if (literal_count != 0 && output_position + 1 < decompressed_size && current_code_read_count + 1 < max_count)
+			{
+				decompressed_data[output_position] = (uint8_t)literal_entry;
+				if (literal_count == 2)
+				{
+					decompressed_data[output_position + 1] = (uint8_t)(literal_entry >> 8);
+				}
+				output_position += literal_count;
+				current_code_read_count += literal_count;
+				drop_bits(state_data, (uint8_t)(literal_entry >> 16));
+				continue;
+			}
+
+			++current_code_read_count;
+
+			// Read the next symbol from the bitstream
+			uint16_t symbol_data = 0;
+			if (!read_code(huffmantree_symbol, state_data, &symbol_data))
+			{
+				printf("Invalid symbol code!\n");
+				return false;
+			}
+
+			if (symbol_data < 0x100)
+			{
+				decompressed_data[output_position] = (uint8_t)symbol_data;
+				++output_position;
+				continue;
+			}
+
+			uint16_t size_code = symbol_data - 0x100;
+			uint32_t write_size = write_size_table[size_code];
+			if (write_size_bits[size_code] > 0)
+			{
+				write_size += read_bits(state_data, write_size_bits[size_code]);
+				drop_bits(state_data, write_size_bits[size_code]);
+			}
+
+			if (!read_code(huffmantree_copy, state_data, &symbol_data))
+			{
+				return false;
+			}
+			uint16_t offset_code = symbol_data < WRITE_OFFSET_CODES ? symbol_data : WRITE_OFFSET_CODES;
+			uint32_t write_offset = write_offset_base[offset_code] + 1;
+			if (write_offset_bits[offset_code] > 0)
+			{
+				write_offset += read_bits(state_data, write_offset_bits[offset_code]);
+				drop_bits(state_data, write_offset_bits[offset_code]);
+			}
+
+			if (write_offset > output_position)
+			{
+				printf("Invalid write offset: %u bytes back at position %u!\n", write_offset, output_position);
+				return false;
+			}
+
+			uint32_t already_written = 0;
+			while ((already_written < write_size) && (output_position < decompressed_size))
+			{
+				decompressed_data[output_position] = decompressed_data[output_position - write_offset];
+				++output_position;
+				++already_written;
+			}
+		}
+	}
+
+	return true;
+}
+
+// decode_blocks on this thread's tree cache, with the decode time and tree statistics accounted
+static bool decode_blocks_cached(StateData* state_data, uint32_t compressed_size, uint16_t write_size_const_add,
+								 uint8_t* decompressed_data, uint32_t output_position, uint32_t decompressed_size,
+								 const DecodeCheckpoint* resume, DecodeCheckpointIndex* checkpoint_index,
+								 uint32_t stop_position, DecodeCheckpoint* stop_state)
+{
+	uint64_t decode_start = decode_now_nanoseconds();
+
+	// Trees come from this thread's cache, which also keeps the static tree built
+	HuffmanTreeCache* private_cache = NULL;
+	HuffmanTreeCache* cache = current_huffman_cache();
+	if (cache == NULL)
+	{
+		cache = private_cache = (HuffmanTreeCache*)calloc(1, sizeof(HuffmanTreeCache));
+		if (cache == NULL)
+		{
+			printf("Memory allocation failed!\n");
+			return false;
+		}
+	}
+	if (!cache->static_ready)
+	{
+		initialize_static_huffmantree(&cache->huffmantree_static);
+		cache->static_ready = true;
+	}
+
+	uint64_t lookups = 0;
+	uint64_t build_nanoseconds = 0;
+	bool ok = decode_blocks(state_data, compressed_size, write_size_const_add, decompressed_data, output_position, decompressed_size,
+							resume, checkpoint_index, stop_position, stop_state, cache, &lookups, &build_nanoseconds);
+	free(private_cache);
+
+	atomic_fetch_add_explicit(&stat_tree_lookups, lookups, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stat_tree_build_nanoseconds, build_nanoseconds, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stat_decode_nanoseconds, decode_now_nanoseconds() - decode_start, memory_order_relaxed);
+	return ok;
+}
+
+bool decompress_blocks(StateData* state_data, uint32_t compressed_size, uint16_t write_size_const_add,
+					   uint8_t* decompressed_data, uint32_t output_position, uint32_t decompressed_size,
+					   const DecodeCheckpoint* resume, DecodeCheckpointIndex* checkpoint_index)
+{
+	return decode_blocks_cached(state_data, compressed_size, write_size_const_add, decompressed_data, output_position, decompressed_size,
+								resume, checkpoint_index, 0, NULL);
+}
+
+bool decompress(StateData* state_data, uint32_t decompressed_size, uint8_t* decompressed_data)
+{
+	drop_bits(state_data, 4);
+
+	// Read the constant add size
+	uint16_t write_size_const_add = 0;
+	write_size_const_add = read_bits(state_data, 4);
+	write_size_const_add += 1;
+	drop_bits(state_data, 4);
+
+	printf("Write size const add: %d\n", write_size_const_add);
+
+	return decompress_blocks(state_data, (uint32_t)(state_data->buffer_position_bytes + state_data->bytes_available), write_size_const_add,
+							 decompressed_data, 0, decompressed_size, NULL, NULL);
+}
+
+uint32_t begin_decompression(StateData* state_data, uint8_t* compressed_data, uint32_t compressed_size, uint16_t* write_size_const_add)
+{
+	state_data->bytes_available = compressed_size;
+	state_data->input_buffer = compressed_data;
+	state_data->buffer_position_bytes = 0;
+	state_data->buffer_data = 0;
+	pull_byte(state_data, &state_data->head_data, &state_data->bits_available_data);
+
+	drop_bits(state_data, 32);
+	uint32_t uncompressed_size = read_bits(state_data, 32);
+	drop_bits(state_data, 32);
+
+	drop_bits(state_data, 4);
+	*write_size_const_add = (uint16_t)(read_bits(state_data, 4) + 1);
+	drop_bits(state_data, 4);
+	return uncompressed_size;
+}
+
+uint8_t* decompress_data_indexed(uint8_t* compressed_data, uint32_t compressed_size, uint32_t* decompressed_size,
+								 uint32_t interval, DecodeCheckpointIndex* checkpoint_index)
+{
+	StateData state_data;
+	uint16_t write_size_const_add = 0;
+	uint32_t uncompressed_size = begin_decompression(&state_data, compressed_data, compressed_size, &write_size_const_add);
+
+	uint8_t* decompressed_data = (uint8_t*)buffer_alloc(uncompressed_size);
+	if (decompressed_data == NULL)
+	{
+		printf("Memory allocation failed!\n");
+		return NULL;
+	}
+
+	if (checkpoint_index != NULL)
+	{
+		memset(checkpoint_index, 0, sizeof(DecodeCheckpointIndex));
+		checkpoint_index->interval = interval ? interval : DECODE_WINDOW_SIZE;
+		checkpoint_index->decompressed_size = uncompressed_size;
+		checkpoint_index->write_size_const_add = write_size_const_add;
+		checkpoint_index->next_output_position = checkpoint_index->interval;
+	}
+
+	if (!decompress_blocks(&state_data, compressed_size, write_size_const_add, decompressed_data, 0, uncompressed_size, NULL, checkpoint_index))
+	{
+		printf("Decompression stopped on malformed input!\n");
+		if (checkpoint_index != NULL)
+		{
+			free_checkpoint_index(checkpoint_index);
+		}
+		buffer_free(decompressed_data);
+		return NULL;
+	}
+
+	if (decompressed_size != NULL)
+	{
+		*decompressed_size = uncompressed_size;
+	}
+	return decompressed_data;
+}
+
+uint32_t peek_decompressed_size(const uint8_t* compressed_data, uint32_t compressed_size)
+{
+	// The first word is skipped; the second holds the size
+	if (compressed_data == NULL || compressed_size < 2 * sizeof(uint32_t))
+	{
+		return 0;
+	}
+	uint32_t uncompressed_size = 0;
+	memcpy(&uncompressed_size, compressed_data + sizeof(uint32_t), sizeof(uint32_t));
+	return uncompressed_size;
+}
+
+bool decompress_data_into(uint8_t* compressed_data, uint32_t compressed_size, uint8_t* output, uint32_t output_size)
+{
+	StateData state_data;
+	uint16_t write_size_const_add = 0;
+	uint32_t uncompressed_size = begin_decompression(&state_data, compressed_data, compressed_size, &write_size_const_add);
+	if (uncompressed_size != output_size)
+	{
+		printf("Output buffer does not match the uncompressed size!\n");
+		return false;
+	}
+
+	if (!decompress_blocks(&state_data, compressed_size, write_size_const_add, output, 0, uncompressed_size, NULL, NULL))
+	{
+		printf("Decompression stopped on malformed input!\n");
+		return false;
+	}
+	return true;
+}
+
+uint8_t* decompress_data_prefix(uint8_t* compressed_data, uint32_t compressed_size, uint32_t length, uint32_t* prefix_size)
+{
+	StateData state_data;
+	uint16_t write_size_const_add = 0;
+	uint32_t uncompressed_size = begin_decompression(&state_data, compressed_data, compressed_size, &write_size_const_add);
+	if (length > uncompressed_size)
+	{
+		length = uncompressed_size;
+	}
+
+	uint8_t* decompressed_data = (uint8_t*)buffer_alloc(length);
+	if (decompressed_data == NULL)
+	{
+		printf("Memory allocation failed!\n");
+		return NULL;
+	}
+
+	if (!decompress_blocks(&state_data, compressed_size, write_size_const_add, decompressed_data, 0, length, NULL, NULL))
+	{
+		printf("Decompression stopped on malformed input!\n");
+		buffer_free(decompressed_data);
+		return NULL;
+	}
+
+	*prefix_size = length;
+	return decompressed_data;
+}
+
+bool decompress_range(uint8_t* compressed_data, uint32_t compressed_size, const DecodeCheckpointIndex* checkpoint_index,
+					  uint32_t offset, uint32_t length, uint8_t* output)
+{
+	if (offset > checkpoint_index->decompressed_size || length > checkpoint_index->decompressed_size - offset)
+	{
+		printf("Requested range is outside the entry!\n");
+		return false;
+	}
+
+	// Binary search for the last checkpoint not past offset
+	const DecodeCheckpoint* checkpoint = NULL;
+	uint32_t low = 0;
+	uint32_t high = checkpoint_index->count;
+	while (low < high)
+	{
+		uint32_t middle = (low + high) / 2;
+		if (checkpoint_index->checkpoints[middle].output_position <= offset)
+		{
+			checkpoint = &checkpoint_index->checkpoints[middle];
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	StateData state_data;
+	uint16_t write_size_const_add = 0;
+	begin_decompression(&state_data, compressed_data, compressed_size, &write_size_const_add);
+
+	// The work buffer holds the checkpoint's history window followed by the decoded bytes
+	uint32_t start_position = checkpoint ? checkpoint->output_position : 0;
+	uint32_t window_size = checkpoint ? checkpoint->window_size : 0;
+	uint32_t buffer_size = window_size + (offset - start_position) + length;
+	uint8_t* buffer = (uint8_t*)buffer_alloc(buffer_size);
+	if (buffer == NULL)
+	{
+		printf("Memory allocation failed!\n");
+		return false;
+	}
+	if (checkpoint != NULL)
+	{
+		memcpy(buffer, checkpoint->window, window_size);
+	}
+
+	bool decoded = decompress_blocks(&state_data, compressed_size, write_size_const_add, buffer, window_size, buffer_size, checkpoint, NULL);
+	if (decoded)
+	{
+		memcpy(output, buffer + window_size + (offset - start_position), length);
+	}
+	buffer_free(buffer);
+	return decoded;
+}
+
+static uint32_t decode_stream_chunk_size(uint32_t chunk_size)
+{
+	if (chunk_size == 0)
+	{
+		return DECODE_STREAM_DEFAULT_CHUNK;
+	}
+	return chunk_size < DECODE_STREAM_MIN_CHUNK ? DECODE_STREAM_MIN_CHUNK : chunk_size;
+}
+
+uint32_t decode_stream_buffer_size(uint32_t chunk_size)
+{
+	// A chunk ends at the first code boundary past chunk_size, so a quarter chunk of slack both absorbs
+	// that last code and keeps the fast loop's batches long near the end of the chunk
+	chunk_size = decode_stream_chunk_size(chunk_size);
+	return DECODE_WINDOW_SIZE + chunk_size + chunk_size / 4;
+}
+
+bool begin_decode_stream(DecodeStream* stream, uint8_t* compressed_data, uint32_t compressed_size, uint32_t chunk_size)
+{
+	memset(stream, 0, sizeof(DecodeStream));
+	stream->compressed_data = compressed_data;
+	stream->compressed_size = compressed_size;
+	stream->chunk_size = decode_stream_chunk_size(chunk_size);
+	stream->buffer_size = decode_stream_buffer_size(chunk_size);
+
+	StateData state_data;
+	stream->decompressed_size = begin_decompression(&state_data, compressed_data, compressed_size, &stream->write_size_const_add);
+
+	stream->buffer = (uint8_t*)buffer_alloc(stream->buffer_size);
+	if (stream->buffer == NULL)
+	{
+		printf("Memory allocation failed!\n");
+		return false;
+	}
+	return true;
+}
+
+bool decode_stream_next(DecodeStream* stream, const uint8_t** chunk, uint32_t* chunk_size)
+{
+	*chunk = NULL;
+	*chunk_size = 0;
+	if (stream->produced == stream->decompressed_size)
+	{
+		return true;
+	}
+
+	// Slide the history the next chunk's matches may reach back into to the front of the buffer
+	if (stream->buffer_end > 0)
+	{
+		uint32_t keep = stream->buffer_end < DECODE_WINDOW_SIZE ? stream->buffer_end : DECODE_WINDOW_SIZE;
+		memmove(stream->buffer, stream->buffer + stream->buffer_end - keep, keep);
+		stream->window_fill = keep;
+	}
+
+	uint32_t remaining = stream->decompressed_size - stream->produced;
+	bool last = remaining <= stream->buffer_size - stream->window_fill;
+	uint32_t end = last ? stream->window_fill + remaining : stream->buffer_size;
+
+	StateData state_data;
+	uint16_t write_size_const_add = 0;
+	begin_decompression(&state_data, stream->compressed_data, stream->compressed_size, &write_size_const_add);
+
+	DecodeCheckpoint stop_state;
+	if (!decode_blocks_cached(&state_data, stream->compressed_size, write_size_const_add, stream->buffer, stream->window_fill, end,
+							  stream->resuming ? &stream->resume : NULL, NULL, stream->window_fill + stream->chunk_size, &stop_state))
+	{
+		printf("Decompression stopped on malformed input!\n");
+		return false;
+	}
+
+	uint32_t reached = end;
+	if (stop_state.output_position != UINT32_MAX)
+	{
+		reached = stop_state.output_position;
+		stream->resume = stop_state;
+		stream->resuming = true;
+	}
+	else if (!last)
+	{
+		printf("Decompression ran out of stream buffer!\n");
+		return false;
+	}
+
+	*chunk = stream->buffer + stream->window_fill;
+	*chunk_size = reached - stream->window_fill;
+	stream->produced += *chunk_size;
+	stream->buffer_end = reached;
+	return true;
+}
+
+void end_decode_stream(DecodeStream* stream)
+{
+	buffer_free(stream->buffer);
+	memset(stream, 0, sizeof(DecodeStream));
+}
+
+uint8_t* decompress_data(uint8_t* compressed_data, uint32_t compressed_size, uint32_t* decompressed_size)
+{
+	if (compressed_data == NULL)
+	{
+		printf("There is no compressed data!\n");
+		return NULL; // Return NULL to indicate an error
+	}
+
+	StateData state_data;
+	state_data.bytes_available = compressed_size;
+	state_data.input_buffer = compressed_data;
+	state_data.buffer_position_bytes = 0;
+	state_data.buffer_data = 0;
+	uint32_t temp_head_data = 0;
+	uint8_t temp_bytes_available_data = 0;
+
+	pull_byte(&state_data, &temp_head_data, &temp_bytes_available_data);
+
+	state_data.head_data = temp_head_data;
+	state_data.bits_available_data = temp_bytes_available_data;
+
+	uint32_t uncompressed_size = 0;
+
+	drop_bits(&state_data, 32);
+
+	uncompressed_size = read_bits(&state_data, 32);
+	drop_bits(&state_data, 32);
+
+	printf("Compressed size : %d \n", compressed_size);
+	printf("Decompressed size : %d \n", uncompressed_size);
+
+	// If the caller provided a pointer for decompressed size, store the size there
+	if (decompressed_size != 0)
+	{
+		*decompressed_size = uncompressed_size;
+	}
+
+	// Allocate memory for decompressed data
+	uint8_t* decompressed_data = (uint8_t*)buffer_alloc(sizeof(uint8_t) * uncompressed_size);
+	if (decompressed_data == NULL)
+	{
+		printf("Memory allocation failed!\n");
+		return NULL; // Return NULL if allocation fails
+	}
+
+	if (!decompress(&state_data, uncompressed_size, decompressed_data))
+	{
+		printf("Decompression stopped on malformed input!\n");
+		buffer_free(decompressed_data);
+		return NULL;
+	}
+
+	return decompressed_data; // Return the filled buffer
+}
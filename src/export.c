@@ -0,0 +1,412 @@
+#include "export.h"
+#include "prefetch.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define EXPORT_USE_MMAP 1
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// Read size bytes at offset into output, holding io_mutex if there is one
+static bool read_archive(FILE *archive, mtx_t *io_mutex, uint64_t offset, uint8_t *output, uint32_t size)
+{
+    if (io_mutex != NULL)
+    {
+        mtx_lock(io_mutex);
+    }
+    bool read = dat_fseek(archive, (int64_t)offset, SEEK_SET) == 0 && fread(output, 1, size, archive) == size;
+    clearerr(archive);
+    if (io_mutex != NULL)
+    {
+        mtx_unlock(io_mutex);
+    }
+    return read;
+}
+
+// Fill output with the entry: decoded from payload if it is compressed, copied from payload if it is
+// stored, or read from the archive when there is no payload
+static bool fill_output(FILE *archive, mtx_t *io_mutex, const MFTData *mft_entry, uint8_t *payload, uint8_t *output, uint32_t output_size)
+{
+    if (payload == NULL)
+    {
+        return read_archive(archive, io_mutex, mft_entry->offset, output, output_size);
+    }
+    if (mft_entry->compression_flag != 0)
+    {
+        return decompress_data_into(payload, mft_entry->size, output, output_size);
+    }
+    memcpy(output, payload, output_size);
+    return true;
+}
+
+#if defined(EXPORT_USE_MMAP)
+
+// Create output_path with size bytes reserved and map it for writing
+static uint8_t *map_output_file(const char *output_path, uint32_t size, int *fd)
+{
+    *fd = open(output_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (*fd < 0)
+    {
+        perror(output_path);
+        return NULL;
+    }
+    if (size == 0)
+    {
+        return NULL;
+    }
+
+    // Reserve the blocks now so a full disk fails here instead of faulting in the decoder
+#if defined(__linux__)
+    int result = posix_fallocate(*fd, 0, size);
+    if (result != 0 && result != EINVAL && result != EOPNOTSUPP)
+    {
+        fprintf(stderr, "%s: %s\n", output_path, strerror(result));
+        close(*fd);
+        *fd = -1;
+        return NULL;
+    }
+#endif
+    if (ftruncate(*fd, size) != 0)
+    {
+        perror(output_path);
+        close(*fd);
+        *fd = -1;
+        return NULL;
+    }
+
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        perror("mmap");
+        close(*fd);
+        *fd = -1;
+        return NULL;
+    }
+    return (uint8_t *)mapping;
+}
+
+// Write the entry through a mapping of the output file, which it is decoded or copied straight into
+static bool write_mapped(FILE *archive, mtx_t *io_mutex, const MFTData *mft_entry, uint8_t *payload, const char *output_path, uint32_t output_size)
+{
+    int fd = -1;
+    uint8_t *mapping = map_output_file(output_path, output_size, &fd);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool ok = true;
+    if (mapping != NULL)
+    {
+        ok = fill_output(archive, io_mutex, mft_entry, payload, mapping, output_size);
+        ok = munmap(mapping, output_size) == 0 && ok;
+    }
+    return close(fd) == 0 && ok;
+}
+
+#endif
+
+static bool write_buffered(FILE *archive, mtx_t *io_mutex, const MFTData *mft_entry, uint8_t *payload, const char *output_path, uint32_t output_size)
+{
+    uint8_t *data = (uint8_t *)buffer_alloc(output_size ? output_size : 1);
+    if (data == NULL)
+    {
+        return false;
+    }
+
+    bool ok = fill_output(archive, io_mutex, mft_entry, payload, data, output_size);
+    FILE *output = ok ? fopen(output_path, "wb") : NULL;
+    ok = output != NULL && fwrite(data, 1, output_size, output) == output_size;
+    ok = output != NULL && fclose(output) == 0 && ok;
+    buffer_free(data);
+    return ok;
+}
+
+// Write the entry through a mapping if it is large enough and mmap is available, with fwrite otherwise.
+// A failed output is removed rather than left truncated.
+static bool write_entry(FILE *archive, mtx_t *io_mutex, const MFTData *mft_entry, uint8_t *payload, const char *output_path,
+                        uint32_t output_size, bool *mapped)
+{
+    *mapped = false;
+#if defined(EXPORT_USE_MMAP)
+    *mapped = output_size >= EXPORT_MAP_MIN_SIZE;
+#endif
+    bool ok = false;
+    if (*mapped)
+    {
+#if defined(EXPORT_USE_MMAP)
+        ok = write_mapped(archive, io_mutex, mft_entry, payload, output_path, output_size);
+#endif
+    }
+    else
+    {
+        ok = write_buffered(archive, io_mutex, mft_entry, payload, output_path, output_size);
+    }
+
+    if (!ok)
+    {
+        fprintf(stderr, "Export to %s failed\n", output_path);
+        remove(output_path);
+    }
+    return ok;
+}
+
+bool export_mft_entry(FILE *archive, mtx_t *io_mutex, const MFTData *mft_entry, const char *output_path, ExportStats *stats)
+{
+    uint64_t start = prefetch_now_nanoseconds();
+
+    // Only the compressed stream is held in memory; its header gives the output size
+    uint8_t *payload = NULL;
+    uint32_t output_size = mft_entry->size;
+    if (mft_entry->compression_flag != 0)
+    {
+        payload = (uint8_t *)buffer_alloc(mft_entry->size);
+        if (payload == NULL || !read_archive(archive, io_mutex, mft_entry->offset, payload, mft_entry->size))
+        {
+            fprintf(stderr, "Cannot read compressed entry\n");
+            buffer_free(payload);
+            return false;
+        }
+        output_size = peek_decompressed_size(payload, mft_entry->size);
+    }
+
+    bool mapped = false;
+    bool ok = write_entry(archive, io_mutex, mft_entry, payload, output_path, output_size, &mapped);
+    buffer_free(payload);
+    if (!ok)
+    {
+        return false;
+    }
+
+    if (stats != NULL)
+    {
+        ++stats->entries;
+        stats->mapped_entries += mapped;
+        stats->bytes += output_size;
+        stats->nanoseconds += prefetch_now_nanoseconds() - start;
+    }
+    return true;
+}
+
+bool export_mft_data(DatFile *dat_file, uint32_t number, const char *output_path, ExportStats *stats)
+{
+    uint32_t index_number = 0;
+    if (!find_mft_slot(dat_file, number, &index_number))
+    {
+        fprintf(stderr, "MFT entry not found!\n");
+        return false;
+    }
+
+    MFTData *mft_entry = get_mft_entry(dat_file, index_number);
+    if (mft_entry == NULL)
+    {
+        fprintf(stderr, "MFT slot %u is out of range!\n", index_number);
+        return false;
+    }
+
+    FILE *file = fopen(dat_file->file_path, "rb");
+    if (!file)
+    {
+        perror("Error opening file");
+        return false;
+    }
+    bool ok = export_mft_entry(file, NULL, mft_entry, output_path, stats);
+    fclose(file);
+
+    if (ok)
+    {
+        printf("Exported file %u to %s\n", number, output_path);
+    }
+    return ok;
+}
+
+// An entry being streamed to its file; a worker streams one entry at a time, so it is found by worker
+typedef struct ExportStream
+{
+    thrd_t worker;
+    FILE *output; // NULL once opening or writing it has failed
+    struct ExportStream *next;
+} ExportStream;
+
+typedef struct
+{
+    const char *output_dir;
+    ExportStats *stats;
+    ExportStream *streams;
+    mtx_t mutex; // guards stats and streams
+} ExportBatch;
+
+static void export_batch_path(const ExportBatch *batch, uint32_t id, char *output_path, size_t size)
+{
+    snprintf(output_path, size, "%s/%u.bin", batch->output_dir, id);
+}
+
+static void export_batch_count(ExportBatch *batch, uint64_t bytes, bool mapped, bool streamed)
+{
+    mtx_lock(&batch->mutex);
+    ++batch->stats->entries;
+    batch->stats->mapped_entries += mapped;
+    batch->stats->streamed_entries += streamed;
+    batch->stats->bytes += bytes;
+    mtx_unlock(&batch->mutex);
+}
+
+// With export_batch_payload in place the reader only calls this for entries it could not read
+static void export_batch_entry(void *context, uint32_t id, uint8_t *data, uint32_t size)
+{
+    (void)context;
+    (void)size;
+    fprintf(stderr, "Export of %u failed\n", id);
+    buffer_free(data);
+}
+
+// Entries that fit in memory are written the way export_mft_entry writes them, decoded straight
+// into a mapping of the output where that is possible
+static bool export_batch_payload(void *context, uint32_t id, const MFTData *mft_entry, uint8_t *payload, uint32_t output_size)
+{
+    ExportBatch *batch = (ExportBatch *)context;
+    char output_path[4096];
+    export_batch_path(batch, id, output_path, sizeof(output_path));
+
+    bool mapped = false;
+    if (!write_entry(NULL, NULL, mft_entry, payload, output_path, output_size, &mapped))
+    {
+        return false;
+    }
+    export_batch_count(batch, output_size, mapped, false);
+    return true;
+}
+
+static ExportStream *export_begin_stream(ExportBatch *batch, const char *output_path)
+{
+    ExportStream *stream = (ExportStream *)calloc(1, sizeof(ExportStream));
+    if (stream == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for export stream\n");
+        return NULL;
+    }
+    stream->worker = thrd_current();
+    stream->output = fopen(output_path, "wb");
+    if (stream->output == NULL)
+    {
+        perror(output_path);
+    }
+
+    mtx_lock(&batch->mutex);
+    stream->next = batch->streams;
+    batch->streams = stream;
+    mtx_unlock(&batch->mutex);
+    return stream;
+}
+
+static ExportStream *export_find_stream(ExportBatch *batch)
+{
+    thrd_t worker = thrd_current();
+    mtx_lock(&batch->mutex);
+    ExportStream *stream = batch->streams;
+    while (stream != NULL && !thrd_equal(stream->worker, worker))
+    {
+        stream = stream->next;
+    }
+    mtx_unlock(&batch->mutex);
+    return stream;
+}
+
+// Unlink the calling worker's stream and close its file; false if it failed at any point
+static bool export_end_stream(ExportBatch *batch)
+{
+    thrd_t worker = thrd_current();
+    mtx_lock(&batch->mutex);
+    ExportStream **link = &batch->streams;
+    while (*link != NULL && !thrd_equal((*link)->worker, worker))
+    {
+        link = &(*link)->next;
+    }
+    ExportStream *stream = *link;
+    if (stream != NULL)
+    {
+        *link = stream->next;
+    }
+    mtx_unlock(&batch->mutex);
+
+    bool ok = stream != NULL && stream->output != NULL;
+    ok = ok && fclose(stream->output) == 0;
+    free(stream);
+    return ok;
+}
+
+// Chunks of one entry arrive in order on one worker: the first opens the file, each is appended to
+// it, and the last one (or a failure) closes it
+static void export_batch_chunk(void *context, uint32_t id, const uint8_t *chunk, uint32_t chunk_size, uint32_t offset, uint32_t total_size)
+{
+    ExportBatch *batch = (ExportBatch *)context;
+    char output_path[4096];
+    export_batch_path(batch, id, output_path, sizeof(output_path));
+    if (chunk == NULL)
+    {
+        fprintf(stderr, "Export of %u failed after %u bytes\n", id, offset);
+        export_end_stream(batch);
+        remove(output_path);
+        return;
+    }
+
+    ExportStream *stream = offset == 0 ? export_begin_stream(batch, output_path) : export_find_stream(batch);
+    if (stream != NULL && stream->output != NULL && fwrite(chunk, 1, chunk_size, stream->output) != chunk_size)
+    {
+        perror(output_path);
+        fclose(stream->output);
+        stream->output = NULL;
+    }
+    if (offset + chunk_size < total_size)
+    {
+        return;
+    }
+    if (export_end_stream(batch))
+    {
+        export_batch_count(batch, total_size, false, true);
+    }
+    else
+    {
+        fprintf(stderr, "Export to %s failed\n", output_path);
+        remove(output_path);
+    }
+}
+
+bool export_batch(DatFile *dat_file, const uint32_t *ids, uint32_t count, const char *output_dir, const BatchReadOptions *options,
+                  ExportStats *stats, BatchReadStats *batch_stats)
+{
+    BatchReadOptions batch_options;
+    memset(&batch_options, 0, sizeof(BatchReadOptions));
+    if (options != NULL)
+    {
+        batch_options = *options;
+    }
+    batch_options.raw = false;
+    batch_options.chunk_callback = export_batch_chunk;
+    batch_options.payload_callback = export_batch_payload;
+
+    ExportBatch batch;
+    batch.output_dir = output_dir;
+    batch.stats = stats;
+    batch.streams = NULL;
+    mtx_init(&batch.mutex, mtx_plain);
+
+    BatchReadStats local_stats;
+    batch_stats = batch_stats != NULL ? batch_stats : &local_stats;
+    bool ok = batch_read_entries(dat_file, ids, count, &batch_options, export_batch_entry, &batch, batch_stats);
+    stats->nanoseconds += batch_stats->nanoseconds;
+    mtx_destroy(&batch.mutex);
+    return ok;
+}
+
+void print_export_report(const ExportStats *stats)
+{
+    double seconds = stats->nanoseconds / 1e9;
+    printf("Export Report:\n");
+    printf("  Entries:             %llu (%llu mapped, %llu streamed)\n", (unsigned long long)stats->entries,
+           (unsigned long long)stats->mapped_entries, (unsigned long long)stats->streamed_entries);
+    printf("  Bytes:               %.1f MB in %.3f s (%.1f MB/s)\n", stats->bytes / 1048576.0, seconds,
+           seconds > 0 ? stats->bytes / 1048576.0 / seconds : 0.0);
+}
@@ -0,0 +1,349 @@
+#include "listing.h"
+
+#include <stdatomic.h>
+#include <time.h>
+
+typedef struct
+{
+    uint64_t offset;
+    uint32_t slot;
+} ListProbe;
+
+// Probes [first, first + count) in one read
+typedef struct
+{
+    uint32_t first;
+    uint32_t count;
+} ListRead;
+
+typedef struct
+{
+    const char *file_path;
+    const ListProbe *probes;
+    const ListRead *reads;
+    uint32_t read_count;
+    uint32_t max_read;
+    uint32_t *uncompressed_sizes; // per slot; each slot has one probe, so workers never share an element
+    atomic_uint next_read;
+    atomic_uint_least64_t read_bytes;
+    atomic_uint_least64_t unreadable;
+    atomic_bool failed;
+} ListRun;
+
+static uint64_t list_now_nanoseconds(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static int compare_probe(const void *left, const void *right)
+{
+    const ListProbe *a = (const ListProbe *)left;
+    const ListProbe *b = (const ListProbe *)right;
+    if (a->offset != b->offset)
+    {
+        return a->offset < b->offset ? -1 : 1;
+    }
+    return (a->slot > b->slot) - (a->slot < b->slot);
+}
+
+static int compare_list_entry(const void *left, const void *right)
+{
+    const ListEntry *a = (const ListEntry *)left;
+    const ListEntry *b = (const ListEntry *)right;
+    if (a->file_id != b->file_id)
+    {
+        return a->file_id < b->file_id ? -1 : 1;
+    }
+    return (a->base_id > b->base_id) - (a->base_id < b->base_id);
+}
+
+// Merge offset-sorted probes into reads; returns the number of reads
+static uint32_t plan_list_reads(const ListProbe *probes, uint32_t probe_count, uint32_t coalesce_gap, uint32_t max_read, ListRead *reads)
+{
+    uint32_t read_count = 0;
+    uint32_t i = 0;
+    while (i < probe_count)
+    {
+        uint64_t start = probes[i].offset;
+        uint64_t end = start + LIST_PROBE_SIZE;
+        uint32_t first = i++;
+        while (i < probe_count && probes[i].offset <= end + coalesce_gap && probes[i].offset + LIST_PROBE_SIZE - start <= max_read)
+        {
+            uint64_t probe_end = probes[i].offset + LIST_PROBE_SIZE;
+            end = probe_end > end ? probe_end : end;
+            ++i;
+        }
+        reads[read_count].first = first;
+        reads[read_count].count = i - first;
+        ++read_count;
+    }
+    return read_count;
+}
+
+// Take reads in offset order until none are left, each through this worker's own file handle
+static int list_worker_main(void *argument)
+{
+    ListRun *run = (ListRun *)argument;
+    FILE *file = fopen(run->file_path, "rb");
+    uint8_t *buffer = (uint8_t *)malloc(run->max_read);
+    if (file == NULL || buffer == NULL)
+    {
+        fprintf(stderr, "%s: cannot open for probing\n", run->file_path);
+        atomic_store(&run->failed, true);
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+        free(buffer);
+        return thrd_error;
+    }
+    // Reads are already as large as they should be; stdio buffering would only add a copy
+    setvbuf(file, NULL, _IONBF, 0);
+
+    uint64_t read_bytes = 0;
+    uint64_t unreadable = 0;
+    for (;;)
+    {
+        uint32_t index = atomic_fetch_add_explicit(&run->next_read, 1, memory_order_relaxed);
+        if (index >= run->read_count)
+        {
+            break;
+        }
+        const ListRead *read = &run->reads[index];
+        const ListProbe *first = &run->probes[read->first];
+        uint64_t length = 0;
+        for (uint32_t i = 0; i < read->count; ++i)
+        {
+            uint64_t probe_end = first[i].offset - first->offset + LIST_PROBE_SIZE;
+            length = probe_end > length ? probe_end : length;
+        }
+
+        size_t got = 0;
+        if (dat_fseek(file, (int64_t)first->offset, SEEK_SET) == 0)
+        {
+            got = fread(buffer, 1, (size_t)length, file);
+        }
+        clearerr(file);
+        read_bytes += got;
+
+        for (uint32_t i = 0; i < read->count; ++i)
+        {
+            uint64_t at = first[i].offset - first->offset;
+            if (at + LIST_PROBE_SIZE > got)
+            {
+                ++unreadable;
+                continue;
+            }
+            run->uncompressed_sizes[first[i].slot] = peek_decompressed_size(buffer + at, LIST_PROBE_SIZE);
+        }
+    }
+
+    atomic_fetch_add(&run->read_bytes, read_bytes);
+    atomic_fetch_add(&run->unreadable, unreadable);
+    fclose(file);
+    free(buffer);
+    return thrd_success;
+}
+
+// Run the reads on thread_count threads, the calling one included
+static bool run_list_probes(ListRun *run, uint32_t thread_count)
+{
+    thrd_t workers[LIST_MAX_THREADS];
+    uint32_t started = 0;
+    for (uint32_t i = 1; i < thread_count; ++i)
+    {
+        if (thrd_create(&workers[started], list_worker_main, run) != thrd_success)
+        {
+            break;
+        }
+        ++started;
+    }
+    list_worker_main(run);
+    for (uint32_t i = 0; i < started; ++i)
+    {
+        thrd_join(workers[i], NULL);
+    }
+    return !atomic_load(&run->failed);
+}
+
+bool list_dat_entries(const char *file_path, const ListOptions *options, ListEntry **entries, uint32_t *count, ListStats *stats)
+{
+    ListStats local_stats;
+    stats = stats != NULL ? stats : &local_stats;
+    memset(stats, 0, sizeof(ListStats));
+    *entries = NULL;
+    *count = 0;
+
+    uint32_t thread_count = options != NULL && options->threads ? options->threads : LIST_DEFAULT_THREADS;
+    uint32_t coalesce_gap = options != NULL && options->coalesce_gap ? options->coalesce_gap : LIST_DEFAULT_GAP;
+    uint32_t max_read = options != NULL && options->max_read ? options->max_read : LIST_DEFAULT_MAX_READ;
+    thread_count = thread_count < LIST_MAX_THREADS ? thread_count : LIST_MAX_THREADS;
+    max_read = max_read > LIST_PROBE_SIZE ? max_read : LIST_PROBE_SIZE;
+
+    uint64_t start = list_now_nanoseconds();
+    DatFile dat_file;
+    memset(&dat_file, 0, sizeof(DatFile));
+    if (!load_dat_file_ex(file_path, &dat_file, DAT_OPEN_LAZY))
+    {
+        return false;
+    }
+    if (!ensure_mft_index(&dat_file))
+    {
+        close_dat_file(&dat_file);
+        return false;
+    }
+
+    uint32_t slots = dat_file.mft_header.num_entries;
+    uint32_t num_index_entries = dat_file.num_index_entries;
+    MFTData *records = (MFTData *)calloc(slots ? slots : 1, sizeof(MFTData));
+    uint32_t *uncompressed_sizes = (uint32_t *)calloc(slots ? slots : 1, sizeof(uint32_t));
+    uint8_t *referenced = (uint8_t *)calloc(slots ? slots : 1, 1);
+    ListEntry *rows = (ListEntry *)malloc((num_index_entries ? num_index_entries : 1) * sizeof(ListEntry));
+    ListProbe *probes = (ListProbe *)malloc((slots ? slots : 1) * sizeof(ListProbe));
+    ListRead *reads = (ListRead *)malloc((slots ? slots : 1) * sizeof(ListRead));
+    bool ok = records != NULL && uncompressed_sizes != NULL && referenced != NULL && rows != NULL && probes != NULL && reads != NULL;
+    if (!ok)
+    {
+        fprintf(stderr, "Memory allocation failed for the listing\n");
+    }
+
+    // Copy the records out in slot order, so lazy MFT pages are read front to back
+    for (uint32_t slot = 0; ok && slot < slots; ++slot)
+    {
+        MFTData *mft_entry = get_mft_entry(&dat_file, slot);
+        if (mft_entry != NULL)
+        {
+            records[slot] = *mft_entry;
+        }
+    }
+
+    // Ids resolve to slots through the index table; only slots some id reaches are probed
+    uint32_t row_count = 0;
+    for (uint32_t i = 0; ok && i < num_index_entries; ++i)
+    {
+        const MFTIndexData *index_entry = &dat_file.mft_index_data[i];
+        if (index_entry->base_id >= slots)
+        {
+            continue;
+        }
+        referenced[index_entry->base_id] = 1;
+        ListEntry *row = &rows[row_count++];
+        row->file_id = index_entry->file_id;
+        row->base_id = index_entry->base_id;
+    }
+    close_dat_file(&dat_file);
+
+    uint32_t probe_count = 0;
+    for (uint32_t slot = 0; ok && slot < slots; ++slot)
+    {
+        if (referenced[slot] && records[slot].compression_flag != 0 && records[slot].size >= LIST_PROBE_SIZE)
+        {
+            probes[probe_count].offset = records[slot].offset;
+            probes[probe_count].slot = slot;
+            ++probe_count;
+        }
+    }
+    stats->mft_nanoseconds = list_now_nanoseconds() - start;
+
+    if (ok)
+    {
+        start = list_now_nanoseconds();
+        qsort(probes, probe_count, sizeof(ListProbe), compare_probe);
+
+        ListRun run;
+        memset(&run, 0, sizeof(ListRun));
+        run.file_path = file_path;
+        run.probes = probes;
+        run.reads = reads;
+        run.read_count = plan_list_reads(probes, probe_count, coalesce_gap, max_read, reads);
+        run.max_read = max_read;
+        run.uncompressed_sizes = uncompressed_sizes;
+        atomic_init(&run.next_read, 0);
+        atomic_init(&run.read_bytes, 0);
+        atomic_init(&run.unreadable, 0);
+        atomic_init(&run.failed, false);
+
+        // No more threads than reads to hand them
+        thread_count = thread_count < run.read_count ? thread_count : run.read_count;
+        thread_count = thread_count ? thread_count : 1;
+        ok = run_list_probes(&run, thread_count);
+        stats->probe_nanoseconds = list_now_nanoseconds() - start;
+        stats->probes = probe_count;
+        stats->unreadable = atomic_load(&run.unreadable);
+        stats->reads = run.read_count;
+        stats->read_bytes = atomic_load(&run.read_bytes);
+        stats->threads = thread_count;
+    }
+
+    for (uint32_t i = 0; ok && i < row_count; ++i)
+    {
+        ListEntry *row = &rows[i];
+        const MFTData *record = &records[row->base_id];
+        row->compressed_size = record->size;
+        row->uncompressed_size = record->compression_flag != 0 ? uncompressed_sizes[row->base_id] : record->size;
+        row->compression_flag = record->compression_flag;
+        row->entry_flag = record->entry_flag;
+    }
+    if (ok)
+    {
+        qsort(rows, row_count, sizeof(ListEntry), compare_list_entry);
+        stats->rows = row_count;
+        stats->slots = slots;
+        *entries = rows;
+        *count = row_count;
+    }
+    else
+    {
+        free(rows);
+    }
+
+    free(records);
+    free(uncompressed_sizes);
+    free(referenced);
+    free(probes);
+    free(reads);
+    return ok;
+}
+
+bool write_list(FILE *output, const ListEntry *entries, uint32_t count, uint32_t format)
+{
+    if (format == LIST_FORMAT_JSON)
+    {
+        fputs("[\n", output);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const ListEntry *entry = &entries[i];
+            fprintf(output,
+                    "  {\"id\": %u, \"base_id\": %u, \"compressed_size\": %u, \"uncompressed_size\": %u, \"compression_flag\": %u, "
+                    "\"entry_flag\": %u}%s\n",
+                    entry->file_id, entry->base_id, entry->compressed_size, entry->uncompressed_size, entry->compression_flag,
+                    entry->entry_flag, i + 1 < count ? "," : "");
+        }
+        fputs("]\n", output);
+    }
+    else
+    {
+        fputs("id\tbase_id\tcompressed_size\tuncompressed_size\tcompression_flag\tentry_flag\n", output);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const ListEntry *entry = &entries[i];
+            fprintf(output, "%u\t%u\t%u\t%u\t%u\t%u\n", entry->file_id, entry->base_id, entry->compressed_size, entry->uncompressed_size,
+                    entry->compression_flag, entry->entry_flag);
+        }
+    }
+    return fflush(output) == 0 && !ferror(output);
+}
+
+void print_list_report(const ListStats *stats)
+{
+    fprintf(stderr, "List Report:\n");
+    fprintf(stderr, "  Rows:                %u ids over %u MFT slots\n", stats->rows, stats->slots);
+    fprintf(stderr, "  Header probes:       %llu (%llu past the end of the file)\n", (unsigned long long)stats->probes,
+            (unsigned long long)stats->unreadable);
+    fprintf(stderr, "  Reads:               %llu (%.1f probes each, %.1f MB) on %u threads\n", (unsigned long long)stats->reads,
+            stats->reads ? (double)stats->probes / stats->reads : 0.0, stats->read_bytes / 1048576.0, stats->threads);
+    fprintf(stderr, "  Time:                %.1f ms MFT and index, %.1f ms probes\n", stats->mft_nanoseconds / 1e6,
+            stats->probe_nanoseconds / 1e6);
+}
@@ -0,0 +1,88 @@
+#include "membudget.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t budget_now_nanoseconds(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+void init_memory_budget(MemoryBudget *budget, uint64_t capacity)
+{
+    memset(budget, 0, sizeof(MemoryBudget));
+    budget->capacity = capacity ? capacity : 1;
+    mtx_init(&budget->mutex, mtx_plain);
+    cnd_init(&budget->released);
+}
+
+void destroy_memory_budget(MemoryBudget *budget)
+{
+    mtx_destroy(&budget->mutex);
+    cnd_destroy(&budget->released);
+}
+
+uint64_t memory_budget_acquire(MemoryBudget *budget, uint64_t bytes)
+{
+    mtx_lock(&budget->mutex);
+    if (bytes > budget->capacity)
+    {
+        bytes = budget->capacity;
+        ++budget->stats.clamped;
+    }
+
+    uint64_t ticket = budget->next_ticket++;
+    if (ticket != budget->serving || budget->in_use + bytes > budget->capacity)
+    {
+        uint64_t start = budget_now_nanoseconds();
+        while (ticket != budget->serving || budget->in_use + bytes > budget->capacity)
+        {
+            cnd_wait(&budget->released, &budget->mutex);
+        }
+        budget->stats.wait_nanoseconds += budget_now_nanoseconds() - start;
+        ++budget->stats.waits;
+    }
+
+    budget->in_use += bytes;
+    if (budget->in_use > budget->stats.peak_bytes)
+    {
+        budget->stats.peak_bytes = budget->in_use;
+    }
+    ++budget->stats.admissions;
+    ++budget->serving;
+
+    // The next ticket in line may fit in what is left
+    cnd_broadcast(&budget->released);
+    mtx_unlock(&budget->mutex);
+    return bytes;
+}
+
+void memory_budget_release(MemoryBudget *budget, uint64_t bytes)
+{
+    mtx_lock(&budget->mutex);
+    budget->in_use -= bytes < budget->in_use ? bytes : budget->in_use;
+    cnd_broadcast(&budget->released);
+    mtx_unlock(&budget->mutex);
+}
+
+void get_memory_budget_stats(MemoryBudget *budget, MemoryBudgetStats *stats)
+{
+    mtx_lock(&budget->mutex);
+    *stats = budget->stats;
+    mtx_unlock(&budget->mutex);
+}
+
+void print_memory_budget_report(MemoryBudget *budget)
+{
+    MemoryBudgetStats stats;
+    get_memory_budget_stats(budget, &stats);
+    printf("Memory Budget Report:\n");
+    printf("  Capacity:            %.1f MB\n", budget->capacity / 1048576.0);
+    printf("  Peak charged:        %.1f MB (%.1f%%)\n", stats.peak_bytes / 1048576.0, 100.0 * stats.peak_bytes / budget->capacity);
+    printf("  Admissions:          %llu (%llu waited, %llu over the whole budget)\n", (unsigned long long)stats.admissions,
+           (unsigned long long)stats.waits, (unsigned long long)stats.clamped);
+    printf("  Waiting for memory:  %.3f s\n", stats.wait_nanoseconds / 1e9);
+}
@@ -0,0 +1,211 @@
+#include "overlay.h"
+
+// Insert key for archive unless an archive with higher precedence, or this one, already has it
+static void insert_overlay_id(DatOverlay *overlay, uint32_t key, uint32_t archive, uint32_t mft_slot)
+{
+    uint32_t position = hash_mft_id(key) & overlay->mask;
+    while (overlay->slots[position].mft_slot != UINT32_MAX)
+    {
+        if (overlay->slots[position].key == key)
+        {
+            // An archive may list the same id more than once; archives arrive in order, so only
+            // the last one counted needs remembering
+            if (overlay->slots[position].archive != archive && overlay->slots[position].shadowed_by != archive)
+            {
+                overlay->slots[position].shadowed_by = archive;
+                ++overlay->archive_stats[archive].shadowed;
+            }
+            return;
+        }
+        position = (position + 1) & overlay->mask;
+    }
+    overlay->slots[position].key = key;
+    overlay->slots[position].mft_slot = mft_slot;
+    overlay->slots[position].archive = archive;
+    ++overlay->count;
+    ++overlay->archive_stats[archive].ids;
+}
+
+static bool build_overlay_index(DatOverlay *overlay)
+{
+    // Same load factor as a single archive's index, over the ids of all of them
+    uint64_t total_entries = 0;
+    for (uint32_t i = 0; i < overlay->archive_count; ++i)
+    {
+        total_entries += overlay->archives[i].num_index_entries;
+    }
+    uint64_t capacity = 16;
+    while (capacity < total_entries * 4)
+    {
+        capacity <<= 1;
+    }
+    if (capacity > (uint64_t)UINT32_MAX + 1 || capacity > SIZE_MAX / sizeof(OverlayIndexSlot))
+    {
+        fprintf(stderr, "Too many ids to merge into one overlay index\n");
+        return false;
+    }
+
+    overlay->slots = (OverlayIndexSlot *)malloc((size_t)capacity * sizeof(OverlayIndexSlot));
+    if (overlay->slots == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for overlay index\n");
+        return false;
+    }
+    memset(overlay->slots, 0xFF, (size_t)capacity * sizeof(OverlayIndexSlot));
+    overlay->mask = (uint32_t)(capacity - 1);
+    overlay->count = 0;
+
+    // Archives in precedence order, so the first to claim an id keeps it
+    for (uint32_t archive = 0; archive < overlay->archive_count; ++archive)
+    {
+        const DatFile *dat_file = &overlay->archives[archive];
+        for (uint32_t i = 0; i < dat_file->num_index_entries; ++i)
+        {
+            const MFTIndexData *index_data = &dat_file->mft_index_data[i];
+            insert_overlay_id(overlay, index_data->file_id, archive, index_data->base_id);
+            insert_overlay_id(overlay, index_data->base_id, archive, index_data->base_id);
+        }
+    }
+    return true;
+}
+
+bool open_dat_overlay(DatOverlay *overlay, const char *const *paths, uint32_t count)
+{
+    memset(overlay, 0, sizeof(DatOverlay));
+    if (count == 0 || count > OVERLAY_MAX_ARCHIVES)
+    {
+        fprintf(stderr, "An overlay takes between 1 and %u archives\n", OVERLAY_MAX_ARCHIVES);
+        return false;
+    }
+
+    overlay->archives = (DatFile *)calloc(count, sizeof(DatFile));
+    overlay->files = (FILE **)calloc(count, sizeof(FILE *));
+    overlay->archive_stats = (OverlayArchiveStats *)calloc(count, sizeof(OverlayArchiveStats));
+    mtx_init(&overlay->io_mutex, mtx_plain);
+    if (overlay->archives == NULL || overlay->files == NULL || overlay->archive_stats == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for overlay\n");
+        close_dat_overlay(overlay);
+        return false;
+    }
+
+    // Start every archive's index build before waiting on any of them
+    bool ok = true;
+    for (uint32_t i = 0; i < count && ok; ++i)
+    {
+        ok = load_dat_file_ex(paths[i], &overlay->archives[i], DAT_OPEN_LAZY | DAT_OPEN_BACKGROUND_INDEX);
+        if (ok)
+        {
+            overlay->archive_count = i + 1;
+            overlay->files[i] = fopen(paths[i], "rb");
+            ok = overlay->files[i] != NULL;
+        }
+    }
+    for (uint32_t i = 0; i < overlay->archive_count && ok; ++i)
+    {
+        ok = ensure_mft_index(&overlay->archives[i]);
+    }
+
+    if (!ok || !build_overlay_index(overlay))
+    {
+        fprintf(stderr, "Cannot open overlay archive\n");
+        close_dat_overlay(overlay);
+        return false;
+    }
+    return true;
+}
+
+void close_dat_overlay(DatOverlay *overlay)
+{
+    for (uint32_t i = 0; i < overlay->archive_count; ++i)
+    {
+        if (overlay->files[i] != NULL)
+        {
+            fclose(overlay->files[i]);
+        }
+        close_dat_file(&overlay->archives[i]);
+    }
+    free(overlay->archives);
+    free(overlay->files);
+    free(overlay->archive_stats);
+    free(overlay->slots);
+    mtx_destroy(&overlay->io_mutex);
+    memset(overlay, 0, sizeof(DatOverlay));
+}
+
+bool find_overlay_entry(const DatOverlay *overlay, uint32_t id, uint32_t *archive, uint32_t *mft_slot)
+{
+    uint32_t position = hash_mft_id(id) & overlay->mask;
+    while (overlay->slots[position].mft_slot != UINT32_MAX)
+    {
+        if (overlay->slots[position].key == id)
+        {
+            *archive = overlay->slots[position].archive;
+            *mft_slot = overlay->slots[position].mft_slot;
+            return true;
+        }
+        position = (position + 1) & overlay->mask;
+    }
+    return false;
+}
+
+uint8_t *extract_overlay_data(DatOverlay *overlay, uint32_t id, uint32_t *size, uint32_t *archive)
+{
+    uint32_t found_archive = 0;
+    uint32_t mft_slot = 0;
+    if (!find_overlay_entry(overlay, id, &found_archive, &mft_slot))
+    {
+        fprintf(stderr, "MFT entry not found!\n");
+        return NULL;
+    }
+    if (archive != NULL)
+    {
+        *archive = found_archive;
+    }
+
+    MFTData *mft_entry = get_mft_entry(&overlay->archives[found_archive], mft_slot);
+    if (mft_entry == NULL)
+    {
+        fprintf(stderr, "MFT slot %u is out of range!\n", mft_slot);
+        return NULL;
+    }
+
+    uint8_t *payload = (uint8_t *)buffer_alloc(mft_entry->size ? mft_entry->size : 1);
+    if (payload == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for compressed data\n");
+        return NULL;
+    }
+
+    FILE *file = overlay->files[found_archive];
+    mtx_lock(&overlay->io_mutex);
+    bool read = dat_fseek(file, (int64_t)mft_entry->offset, SEEK_SET) == 0 && fread(payload, 1, mft_entry->size, file) == mft_entry->size;
+    clearerr(file);
+    mtx_unlock(&overlay->io_mutex);
+    if (!read)
+    {
+        fprintf(stderr, "Short read of MFT slot %u\n", mft_slot);
+        buffer_free(payload);
+        return NULL;
+    }
+
+    if (mft_entry->compression_flag == 0)
+    {
+        *size = mft_entry->size;
+        return payload;
+    }
+    uint8_t *data = decompress_data_indexed(payload, mft_entry->size, size, 0, NULL);
+    buffer_free(payload);
+    return data;
+}
+
+void print_overlay_report(const DatOverlay *overlay)
+{
+    printf("Overlay Report:\n");
+    printf("  Archives:            %u\n", overlay->archive_count);
+    printf("  Merged ids:          %u (index of %u slots)\n", overlay->count, overlay->mask + 1);
+    for (uint32_t i = 0; i < overlay->archive_count; ++i)
+    {
+        printf("  %2u %-40s %8u ids, %8u shadowed\n", i, overlay->archives[i].file_path, overlay->archive_stats[i].ids, overlay->archive_stats[i].shadowed);
+    }
+}
@@ -0,0 +1,785 @@
+#include "pardecode.h"
+
+#include <stdatomic.h>
+#include <threads.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+// A match token: output position in the high word, distance and length in the low one. Distances
+// reach 1 << 17 and lengths stay under 512, so both fit in 32 bits.
+#define PARALLEL_TOKEN(position, offset, length) (((uint64_t)(position) << 32) | ((uint64_t)(offset) << 9) | (length))
+#define PARALLEL_TOKEN_POSITION(token) ((uint32_t)((token) >> 32))
+#define PARALLEL_TOKEN_OFFSET(token) ((uint32_t)(token) >> 9)
+#define PARALLEL_TOKEN_LENGTH(token) ((uint32_t)(token) & 0x1FFu)
+
+// Every block but the last holds at least 4096 codes of at least one output byte each
+#define PARALLEL_MIN_BLOCK_OUTPUT 4096u
+
+typedef struct
+{
+    uint64_t bit_position;    // the block's tree descriptions
+    uint32_t output_position;
+    uint32_t output_end;
+    uint32_t match_count;
+    uint32_t deferred;        // tokens left to the serial part of the resolve phase, moved to the front
+    uint64_t *tokens;
+} ParallelBlock;
+
+typedef struct
+{
+    uint8_t *compressed_data;
+    uint32_t compressed_size;
+    uint16_t write_size_const_add;
+    uint8_t *output;
+    uint32_t decompressed_size;
+    ParallelBlock *blocks;
+    uint32_t block_capacity;
+    uint32_t block_count;
+    uint32_t largest_block; // output bytes
+    atomic_uint next_block;
+    atomic_bool failed;
+
+    // Token workers start on a block as soon as the scan is past it
+    mtx_t mutex;
+    cnd_t block_scanned;
+    uint32_t scanned;
+    bool scan_done;
+} ParallelDecode;
+
+static atomic_uint parallel_thread_count = 1;
+static atomic_uint parallel_threshold = PARALLEL_DECODE_DEFAULT_THRESHOLD;
+
+static atomic_uint_least64_t stat_entries;
+static atomic_uint_least64_t stat_bytes;
+static atomic_uint stat_threads;
+static atomic_uint_least64_t stat_blocks;
+static atomic_uint_least64_t stat_matches;
+static atomic_uint_least64_t stat_serial_matches;
+static atomic_uint_least64_t stat_scan_nanoseconds;
+static atomic_uint_least64_t stat_token_nanoseconds;
+static atomic_uint_least64_t stat_resolve_nanoseconds;
+
+static uint64_t parallel_now_nanoseconds(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static uint32_t parallel_default_threads(void)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (uint32_t)(cpus < PARALLEL_DECODE_MAX_THREADS ? cpus : PARALLEL_DECODE_MAX_THREADS) : 1;
+#else
+    return 1;
+#endif
+}
+
+static HuffmanTreeCache *create_tree_cache(void)
+{
+    HuffmanTreeCache *cache = (HuffmanTreeCache *)calloc(1, sizeof(HuffmanTreeCache));
+    if (cache != NULL)
+    {
+        initialize_static_huffmantree(&cache->huffmantree_static);
+        cache->static_ready = true;
+    }
+    return cache;
+}
+
+// Read a block's tree descriptions and code count, leaving the reader on its first code
+static bool read_block_trees(StateData *state_data, HuffmanTreeCache *cache, const HuffmanCacheEntry **symbol_entry,
+                             const HuffmanCacheEntry **copy_entry, uint32_t *max_count)
+{
+    HuffmanTreeDescription description;
+    *symbol_entry = NULL;
+    *copy_entry = NULL;
+    if (read_huffmantree_description(state_data, &description, &cache->huffmantree_static))
+    {
+        *symbol_entry = lookup_huffmantree(cache, &description, true);
+    }
+    if (*symbol_entry != NULL && read_huffmantree_description(state_data, &description, &cache->huffmantree_static))
+    {
+        *copy_entry = lookup_huffmantree(cache, &description, false);
+    }
+    if (*copy_entry == NULL)
+    {
+        printf("Error: Failed to parse Huffman tree.\n");
+        return false;
+    }
+
+    *max_count = (read_bits(state_data, 4) + 1) << 12;
+    drop_bits(state_data, 4);
+    return true;
+}
+
+// Length and distance of a match whose symbol was just read, through the unchecked reader
+static bool fast_read_match(const HuffmanTree *huffmantree_copy, FastBitReader *reader, uint16_t symbol_data, uint16_t write_size_const_add,
+                            uint32_t *write_size, uint32_t *write_offset)
+{
+    uint8_t add_bits = 0;
+    if (!decode_write_size_code(symbol_data - 0x100, write_size, &add_bits))
+    {
+        return false;
+    }
+    if (add_bits > 0)
+    {
+        *write_size |= fast_read_bits(reader, add_bits);
+        fast_drop_bits(reader, add_bits);
+    }
+    *write_size += write_size_const_add;
+
+    if (!fast_read_code(huffmantree_copy, reader, &symbol_data) || !decode_write_offset_code(symbol_data, write_offset, &add_bits))
+    {
+        return false;
+    }
+    if (add_bits > 0)
+    {
+        *write_offset |= fast_read_bits(reader, add_bits);
+        fast_drop_bits(reader, add_bits);
+    }
+    *write_offset += 1;
+    return true;
+}
+
+// fast_read_match through the checked reader
+static bool read_match(const HuffmanTree *huffmantree_copy, StateData *state_data, uint16_t symbol_data, uint16_t write_size_const_add,
+                       uint32_t *write_size, uint32_t *write_offset)
+{
+    uint8_t add_bits = 0;
+    if (!decode_write_size_code(symbol_data - 0x100, write_size, &add_bits))
+    {
+        return false;
+    }
+    if (add_bits > 0)
+    {
+        *write_size |= read_bits(state_data, add_bits);
+        drop_bits(state_data, add_bits);
+    }
+    *write_size += write_size_const_add;
+
+    if (!read_code(huffmantree_copy, state_data, &symbol_data) || !decode_write_offset_code(symbol_data, write_offset, &add_bits))
+    {
+        return false;
+    }
+    if (add_bits > 0)
+    {
+        *write_offset |= read_bits(state_data, add_bits);
+        drop_bits(state_data, add_bits);
+    }
+    *write_offset += 1;
+    return true;
+}
+
+// Hand the blocks scanned so far to the token workers
+static void publish_scanned(ParallelDecode *decode, bool scan_done)
+{
+    mtx_lock(&decode->mutex);
+    decode->scanned = decode->block_count;
+    decode->scan_done = scan_done;
+    cnd_broadcast(&decode->block_scanned);
+    mtx_unlock(&decode->mutex);
+}
+
+// Phase 1: walk the codes of every block without producing output, as decompress_blocks would read
+// them, and note where each block starts and ends; its token array is sized to its matches
+static bool scan_blocks(ParallelDecode *decode, StateData *state_data, HuffmanTreeCache *cache, uint64_t *matches)
+{
+    uint32_t output_position = 0;
+    uint32_t decompressed_size = decode->decompressed_size;
+    *matches = 0;
+    while (output_position < decompressed_size)
+    {
+        if (decode->block_count == decode->block_capacity)
+        {
+            printf("Error: More blocks than the entry size allows.\n");
+            return false;
+        }
+        ParallelBlock *block = &decode->blocks[decode->block_count];
+        block->bit_position = tell_bits(state_data);
+        block->output_position = output_position;
+
+        const HuffmanCacheEntry *symbol_entry = NULL;
+        const HuffmanCacheEntry *copy_entry = NULL;
+        uint32_t max_count = 0;
+        if (!read_block_trees(state_data, cache, &symbol_entry, &copy_entry, &max_count))
+        {
+            return false;
+        }
+        const HuffmanTree *huffmantree_symbol = &symbol_entry->tree;
+        const HuffmanTree *huffmantree_copy = &copy_entry->tree;
+        const HuffmanLiteralTable *literal_table = &symbol_entry->literal_table;
+
+        uint32_t match_count = 0;
+        uint32_t current_code_read_count = 0;
+        uint32_t budget = 0;
+        while ((budget = fast_symbol_budget(state_data, max_count - current_code_read_count, decompressed_size - output_position)) >= 2)
+        {
+            FastBitReader reader;
+            fast_reader_load(&reader, state_data);
+
+            uint32_t codes_left = budget;
+            while (codes_left >= 2)
+            {
+                uint32_t literal_entry = literal_table->entry_array[fast_read_bits(&reader, MAX_BITS_LITERAL_PAIR)];
+                uint32_t literal_count = literal_entry >> 24;
+                if (literal_count != 0)
+                {
+                    output_position += literal_count;
+                    codes_left -= literal_count;
+                    fast_drop_bits(&reader, (uint8_t)(literal_entry >> 16));
+                    continue;
+                }
+
+                --codes_left;
+
+                uint16_t symbol_data = 0;
+                if (!fast_read_code(huffmantree_symbol, &reader, &symbol_data))
+                {
+                    printf("Invalid symbol code!\n");
+                    return false;
+                }
+                if (symbol_data < 0x100)
+                {
+                    ++output_position;
+                    continue;
+                }
+
+                uint32_t write_size = 0;
+                uint32_t write_offset = 0;
+                if (!fast_read_match(huffmantree_copy, &reader, symbol_data, decode->write_size_const_add, &write_size, &write_offset))
+                {
+                    return false;
+                }
+                output_position += write_size;
+                ++match_count;
+            }
+
+            current_code_read_count += budget - codes_left;
+            fast_reader_store(&reader, state_data);
+        }
+
+        while (current_code_read_count < max_count && output_position < decompressed_size)
+        {
+            ++current_code_read_count;
+
+            uint16_t symbol_data = 0;
+            if (!read_code(huffmantree_symbol, state_data, &symbol_data))
+            {
+                printf("Invalid symbol code!\n");
+                return false;
+            }
+            if (symbol_data < 0x100)
+            {
+                ++output_position;
+                continue;
+            }
+
+            uint32_t write_size = 0;
+            uint32_t write_offset = 0;
+            if (!read_match(huffmantree_copy, state_data, symbol_data, decode->write_size_const_add, &write_size, &write_offset))
+            {
+                return false;
+            }
+            // The last match of an entry is cut at its end
+            output_position += write_size < decompressed_size - output_position ? write_size : decompressed_size - output_position;
+            ++match_count;
+        }
+
+        block->output_end = output_position;
+        block->match_count = match_count;
+        block->tokens = (uint64_t *)malloc((match_count ? match_count : 1) * sizeof(uint64_t));
+        if (block->tokens == NULL)
+        {
+            printf("Memory allocation failed!\n");
+            return false;
+        }
+        *matches += match_count;
+        ++decode->block_count;
+        publish_scanned(decode, false);
+    }
+    return true;
+}
+
+// Phase 2: decode one block from its own start. Literals go to their final place in the output and
+// matches to the block's tokens; a match reaching before the start of the entry is refused here.
+static bool decode_block_tokens(ParallelDecode *decode, HuffmanTreeCache *cache, const ParallelBlock *block)
+{
+    StateData state_data;
+    state_data.input_buffer = decode->compressed_data;
+    seek_bits(&state_data, block->bit_position, decode->compressed_size);
+
+    const HuffmanCacheEntry *symbol_entry = NULL;
+    const HuffmanCacheEntry *copy_entry = NULL;
+    uint32_t max_count = 0;
+    if (!read_block_trees(&state_data, cache, &symbol_entry, &copy_entry, &max_count))
+    {
+        return false;
+    }
+    const HuffmanTree *huffmantree_symbol = &symbol_entry->tree;
+    const HuffmanTree *huffmantree_copy = &copy_entry->tree;
+    const HuffmanLiteralTable *literal_table = &symbol_entry->literal_table;
+
+    uint8_t *output = decode->output;
+    uint32_t output_position = block->output_position;
+    uint32_t output_end = block->output_end;
+    uint64_t *token = block->tokens;
+    const uint64_t *token_end = token + block->match_count;
+
+    uint32_t current_code_read_count = 0;
+    uint32_t budget = 0;
+    while ((budget = fast_symbol_budget(&state_data, max_count - current_code_read_count, output_end - output_position)) >= 2)
+    {
+        FastBitReader reader;
+        fast_reader_load(&reader, &state_data);
+
+        uint32_t codes_left = budget;
+        while (codes_left >= 2)
+        {
+            // At least one more code of this block follows, so the second byte stays inside the block
+            uint32_t literal_entry = literal_table->entry_array[fast_read_bits(&reader, MAX_BITS_LITERAL_PAIR)];
+            uint32_t literal_count = literal_entry >> 24;
+            if (literal_count != 0)
+            {
+                output[output_position] = (uint8_t)literal_entry;
+                output[output_position + 1] = (uint8_t)(literal_entry >> 8);
+                output_position += literal_count;
+                codes_left -= literal_count;
+                fast_drop_bits(&reader, (uint8_t)(literal_entry >> 16));
+                continue;
+            }
+
+            --codes_left;
+
+            uint16_t symbol_data = 0;
+            if (!fast_read_code(huffmantree_symbol, &reader, &symbol_data))
+            {
+                printf("Invalid symbol code!\n");
+                return false;
+            }
+            if (symbol_data < 0x100)
+            {
+                output[output_position] = (uint8_t)symbol_data;
+                ++output_position;
+                continue;
+            }
+
+            uint32_t write_size = 0;
+            uint32_t write_offset = 0;
+            if (!fast_read_match(huffmantree_copy, &reader, symbol_data, decode->write_size_const_add, &write_size, &write_offset))
+            {
+                return false;
+            }
+            if (write_offset > output_position)
+            {
+                printf("Invalid write offset: %u bytes back at position %u!\n", write_offset, output_position);
+                return false;
+            }
+            if (token == token_end)
+            {
+                return false;
+            }
+            *token++ = PARALLEL_TOKEN(output_position, write_offset, write_size);
+            output_position += write_size;
+        }
+
+        current_code_read_count += budget - codes_left;
+        fast_reader_store(&reader, &state_data);
+    }
+
+    while (current_code_read_count < max_count && output_position < output_end)
+    {
+        ++current_code_read_count;
+
+        uint16_t symbol_data = 0;
+        if (!read_code(huffmantree_symbol, &state_data, &symbol_data))
+        {
+            printf("Invalid symbol code!\n");
+            return false;
+        }
+        if (symbol_data < 0x100)
+        {
+            output[output_position] = (uint8_t)symbol_data;
+            ++output_position;
+            continue;
+        }
+
+        uint32_t write_size = 0;
+        uint32_t write_offset = 0;
+        if (!read_match(huffmantree_copy, &state_data, symbol_data, decode->write_size_const_add, &write_size, &write_offset))
+        {
+            return false;
+        }
+        if (write_offset > output_position)
+        {
+            printf("Invalid write offset: %u bytes back at position %u!\n", write_offset, output_position);
+            return false;
+        }
+        if (write_size > output_end - output_position)
+        {
+            write_size = output_end - output_position;
+        }
+        if (token == token_end)
+        {
+            return false;
+        }
+        *token++ = PARALLEL_TOKEN(output_position, write_offset, write_size);
+        output_position += write_size;
+    }
+
+    // The scan saw this block end at the same place with the same number of matches
+    return output_position == output_end && token == token_end;
+}
+
+// Copy one match exactly, as the bytes after it may already hold literals. With the source eight
+// or more bytes back, whole words are copied and a last word overlapping the one before ends it;
+// closer sources repeat their first offset bytes and go byte by byte.
+static void copy_match(uint8_t *output, uint64_t token)
+{
+    uint32_t write_offset = PARALLEL_TOKEN_OFFSET(token);
+    uint32_t write_size = PARALLEL_TOKEN_LENGTH(token);
+    uint8_t *destination = output + PARALLEL_TOKEN_POSITION(token);
+    const uint8_t *source = destination - write_offset;
+    if (write_offset >= 8 && write_size >= 8)
+    {
+        uint32_t copied = 0;
+        for (; copied + 8 <= write_size; copied += 8)
+        {
+            memcpy(destination + copied, source + copied, 8);
+        }
+        if (copied < write_size)
+        {
+            memcpy(destination + write_size - 8, source + write_size - 8, 8);
+        }
+    }
+    else if (write_offset == 1)
+    {
+        memset(destination, *source, write_size);
+    }
+    else
+    {
+        for (uint32_t copied = 0; copied < write_size; ++copied)
+        {
+            destination[copied] = source[copied];
+        }
+    }
+}
+
+// Whether any of bytes [first, end) of a block is marked in bits, one bit per output byte
+static bool reads_deferred(const uint64_t *bits, uint32_t first, uint32_t end)
+{
+    for (uint32_t word = first / 64; word <= (end - 1) / 64; ++word)
+    {
+        uint64_t mask = ~0ull;
+        if (word == first / 64)
+        {
+            mask &= ~0ull << (first % 64);
+        }
+        if (word == (end - 1) / 64)
+        {
+            mask &= ~0ull >> (63 - (end - 1) % 64);
+        }
+        if (bits[word] & mask)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void mark_deferred(uint64_t *bits, uint32_t first, uint32_t end)
+{
+    for (uint32_t byte = first; byte < end; ++byte)
+    {
+        bits[byte / 64] |= 1ull << (byte % 64);
+    }
+}
+
+// Phase 3, parallel part: copy a block's matches in order, except those reading from before the
+// block, whose bytes may not be final yet, and those reading bytes a match already put off writes,
+// which bits tracks. The ones put off are moved to the front of the block's tokens for the serial
+// part; without bits they all are.
+static void resolve_block_local(ParallelDecode *decode, ParallelBlock *block, uint64_t *bits)
+{
+    if (bits == NULL)
+    {
+        block->deferred = block->match_count;
+        return;
+    }
+    memset(bits, 0, ((block->output_end - block->output_position) / 64 + 1) * sizeof(uint64_t));
+
+    uint64_t *tokens = block->tokens;
+    uint32_t deferred = 0;
+    for (uint32_t i = 0; i < block->match_count; ++i)
+    {
+        uint64_t token = tokens[i];
+        uint32_t position = PARALLEL_TOKEN_POSITION(token) - block->output_position;
+        uint32_t write_offset = PARALLEL_TOKEN_OFFSET(token);
+        uint32_t write_size = PARALLEL_TOKEN_LENGTH(token);
+        if (write_offset > position || reads_deferred(bits, position - write_offset, position - write_offset + write_size))
+        {
+            mark_deferred(bits, position, position + write_size);
+            tokens[deferred++] = token;
+            continue;
+        }
+        copy_match(decode->output, token);
+    }
+    block->deferred = deferred;
+}
+
+// Phase 2 worker: decode blocks in the order the scan finds them, waiting for it when caught up
+static int token_worker_main(void *argument)
+{
+    ParallelDecode *decode = (ParallelDecode *)argument;
+    HuffmanTreeCache *cache = create_tree_cache();
+    if (cache == NULL)
+    {
+        atomic_store(&decode->failed, true);
+        return 0;
+    }
+
+    while (!atomic_load_explicit(&decode->failed, memory_order_relaxed))
+    {
+        uint32_t index = atomic_fetch_add_explicit(&decode->next_block, 1, memory_order_relaxed);
+        mtx_lock(&decode->mutex);
+        while (index >= decode->scanned && !decode->scan_done)
+        {
+            cnd_wait(&decode->block_scanned, &decode->mutex);
+        }
+        bool scanned = index < decode->scanned;
+        mtx_unlock(&decode->mutex);
+        if (!scanned)
+        {
+            break;
+        }
+        if (!decode_block_tokens(decode, cache, &decode->blocks[index]))
+        {
+            atomic_store(&decode->failed, true);
+        }
+    }
+    free(cache);
+    return 0;
+}
+
+static int resolve_worker_main(void *argument)
+{
+    ParallelDecode *decode = (ParallelDecode *)argument;
+    uint64_t *bits = (uint64_t *)malloc((decode->largest_block / 64 + 1) * sizeof(uint64_t));
+    uint32_t index = 0;
+    while ((index = atomic_fetch_add_explicit(&decode->next_block, 1, memory_order_relaxed)) < decode->block_count)
+    {
+        resolve_block_local(decode, &decode->blocks[index], bits);
+    }
+    free(bits);
+    return 0;
+}
+
+static uint32_t start_parallel_workers(ParallelDecode *decode, thrd_start_t worker_main, thrd_t *threads, uint32_t count)
+{
+    atomic_store(&decode->next_block, 0);
+    uint32_t started = 0;
+    while (started < count && thrd_create(&threads[started], worker_main, decode) == thrd_success)
+    {
+        ++started;
+    }
+    return started;
+}
+
+static void join_parallel_workers(thrd_t *threads, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        thrd_join(threads[i], NULL);
+    }
+}
+
+static void record_parallel_stats(const ParallelDecodeStats *stats)
+{
+    atomic_fetch_add_explicit(&stat_entries, stats->entries, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_bytes, stats->bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_blocks, stats->blocks, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_matches, stats->matches, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_serial_matches, stats->serial_matches, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_scan_nanoseconds, stats->scan_nanoseconds, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_token_nanoseconds, stats->token_nanoseconds, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_resolve_nanoseconds, stats->resolve_nanoseconds, memory_order_relaxed);
+    uint32_t threads = atomic_load(&stat_threads);
+    while (stats->threads > threads && !atomic_compare_exchange_weak(&stat_threads, &threads, stats->threads))
+    {
+    }
+}
+
+uint8_t *decompress_data_parallel(uint8_t *compressed_data, uint32_t compressed_size, uint32_t *decompressed_size, uint32_t thread_count,
+                                  ParallelDecodeStats *stats)
+{
+    if (compressed_data == NULL)
+    {
+        printf("There is no compressed data!\n");
+        return NULL;
+    }
+    if (thread_count == 0)
+    {
+        thread_count = parallel_default_threads();
+    }
+    if (thread_count > PARALLEL_DECODE_MAX_THREADS)
+    {
+        thread_count = PARALLEL_DECODE_MAX_THREADS;
+    }
+
+    ParallelDecodeStats local_stats;
+    memset(&local_stats, 0, sizeof(ParallelDecodeStats));
+
+    ParallelDecode decode;
+    memset(&decode, 0, sizeof(ParallelDecode));
+    decode.compressed_data = compressed_data;
+    decode.compressed_size = compressed_size;
+    atomic_init(&decode.next_block, 0);
+    atomic_init(&decode.failed, false);
+    if (mtx_init(&decode.mutex, mtx_plain) != thrd_success)
+    {
+        return NULL;
+    }
+    if (cnd_init(&decode.block_scanned) != thrd_success)
+    {
+        mtx_destroy(&decode.mutex);
+        return NULL;
+    }
+
+    StateData state_data;
+    decode.decompressed_size = begin_decompression(&state_data, compressed_data, compressed_size, &decode.write_size_const_add);
+    decode.block_capacity = decode.decompressed_size / PARALLEL_MIN_BLOCK_OUTPUT + 1;
+
+    decode.output = (uint8_t *)buffer_alloc(decode.decompressed_size);
+    decode.blocks = (ParallelBlock *)calloc(decode.block_capacity, sizeof(ParallelBlock));
+    HuffmanTreeCache *cache = create_tree_cache();
+    bool ok = decode.output != NULL && decode.blocks != NULL && cache != NULL;
+    if (!ok)
+    {
+        printf("Memory allocation failed!\n");
+    }
+
+    // Phases 1 and 2 overlap: the calling thread scans while the other workers decode the blocks it
+    // has passed, then joins them
+    thrd_t threads[PARALLEL_DECODE_MAX_THREADS];
+    uint32_t started = ok ? start_parallel_workers(&decode, token_worker_main, threads, thread_count - 1) : 0;
+    uint64_t phase_start = parallel_now_nanoseconds();
+    uint64_t matches = 0;
+    if (ok && !scan_blocks(&decode, &state_data, cache, &matches))
+    {
+        atomic_store(&decode.failed, true);
+    }
+    free(cache);
+    publish_scanned(&decode, true);
+    uint64_t scan_end = parallel_now_nanoseconds();
+    local_stats.scan_nanoseconds = scan_end - phase_start;
+    if (ok)
+    {
+        token_worker_main(&decode);
+    }
+    join_parallel_workers(threads, started);
+    ok = ok && !atomic_load(&decode.failed);
+    local_stats.threads = started + 1;
+    local_stats.token_nanoseconds = parallel_now_nanoseconds() - scan_end;
+
+    if (ok)
+    {
+        phase_start = parallel_now_nanoseconds();
+        for (uint32_t i = 0; i < decode.block_count; ++i)
+        {
+            uint32_t block_size = decode.blocks[i].output_end - decode.blocks[i].output_position;
+            decode.largest_block = block_size > decode.largest_block ? block_size : decode.largest_block;
+        }
+        uint32_t wanted = thread_count - 1 < decode.block_count ? thread_count - 1 : decode.block_count;
+        started = start_parallel_workers(&decode, resolve_worker_main, threads, wanted);
+        resolve_worker_main(&decode);
+        join_parallel_workers(threads, started);
+        for (uint32_t i = 0; i < decode.block_count; ++i)
+        {
+            const ParallelBlock *block = &decode.blocks[i];
+            for (uint32_t j = 0; j < block->deferred; ++j)
+            {
+                copy_match(decode.output, block->tokens[j]);
+            }
+            local_stats.serial_matches += block->deferred;
+        }
+        local_stats.resolve_nanoseconds = parallel_now_nanoseconds() - phase_start;
+    }
+
+    for (uint32_t i = 0; decode.blocks != NULL && i < decode.block_count; ++i)
+    {
+        free(decode.blocks[i].tokens);
+    }
+    free(decode.blocks);
+    cnd_destroy(&decode.block_scanned);
+    mtx_destroy(&decode.mutex);
+    if (!ok)
+    {
+        printf("Decompression stopped on malformed input!\n");
+        buffer_free(decode.output);
+        return NULL;
+    }
+
+    local_stats.entries = 1;
+    local_stats.bytes = decode.decompressed_size;
+    local_stats.blocks = decode.block_count;
+    local_stats.matches = matches;
+    record_parallel_stats(&local_stats);
+    if (stats != NULL)
+    {
+        *stats = local_stats;
+    }
+    if (decompressed_size != NULL)
+    {
+        *decompressed_size = decode.decompressed_size;
+    }
+    return decode.output;
+}
+
+void set_parallel_decode(uint32_t thread_count, uint32_t threshold)
+{
+    atomic_store(&parallel_threshold, threshold ? threshold : PARALLEL_DECODE_DEFAULT_THRESHOLD);
+    atomic_store(&parallel_thread_count, thread_count ? thread_count : parallel_default_threads());
+}
+
+uint32_t parallel_decode_threads(const uint8_t *compressed_data, uint32_t compressed_size)
+{
+    uint32_t thread_count = atomic_load_explicit(&parallel_thread_count, memory_order_relaxed);
+    if (thread_count <= 1 || peek_decompressed_size(compressed_data, compressed_size) < atomic_load_explicit(&parallel_threshold, memory_order_relaxed))
+    {
+        return 0;
+    }
+    return thread_count;
+}
+
+void get_parallel_decode_stats(ParallelDecodeStats *stats)
+{
+    stats->entries = atomic_load(&stat_entries);
+    stats->bytes = atomic_load(&stat_bytes);
+    stats->threads = atomic_load(&stat_threads);
+    stats->blocks = atomic_load(&stat_blocks);
+    stats->matches = atomic_load(&stat_matches);
+    stats->serial_matches = atomic_load(&stat_serial_matches);
+    stats->scan_nanoseconds = atomic_load(&stat_scan_nanoseconds);
+    stats->token_nanoseconds = atomic_load(&stat_token_nanoseconds);
+    stats->resolve_nanoseconds = atomic_load(&stat_resolve_nanoseconds);
+}
+
+void print_parallel_decode_report(void)
+{
+    ParallelDecodeStats stats;
+    get_parallel_decode_stats(&stats);
+    uint64_t total = stats.scan_nanoseconds + stats.token_nanoseconds + stats.resolve_nanoseconds;
+    printf("Parallel Decode Report:\n");
+    printf("  Entries:             %llu (%.2f MB), threshold %.2f MB, %u threads\n", (unsigned long long)stats.entries, stats.bytes / 1048576.0,
+           atomic_load(&parallel_threshold) / 1048576.0, stats.threads);
+    printf("  Blocks:              %llu\n", (unsigned long long)stats.blocks);
+    printf("  Matches:             %llu (%llu resolved serially, %.1f%%)\n", (unsigned long long)stats.matches,
+           (unsigned long long)stats.serial_matches, stats.matches ? 100.0 * stats.serial_matches / stats.matches : 0.0);
+    printf("  Scan:                %.3f ms (%.1f%%)\n", stats.scan_nanoseconds / 1e6, total ? 100.0 * stats.scan_nanoseconds / total : 0.0);
+    printf("  Tokens:              %.3f ms (%.1f%%)\n", stats.token_nanoseconds / 1e6, total ? 100.0 * stats.token_nanoseconds / total : 0.0);
+    printf("  Resolve:             %.3f ms (%.1f%%)\n", stats.resolve_nanoseconds / 1e6, total ? 100.0 * stats.resolve_nanoseconds / total : 0.0);
+    printf("  Throughput:          %.1f MB/s\n", total ? stats.bytes / 1048576.0 / (total / 1e9) : 0.0);
+}
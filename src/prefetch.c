@@ -0,0 +1,542 @@
+#include "prefetch.h"
+
+uint64_t prefetch_now_nanoseconds(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+bool trace_append(AccessTrace *trace, uint32_t id)
+{
+    if (trace->count == trace->capacity)
+    {
+        uint32_t capacity = trace->capacity ? trace->capacity * 2 : 256;
+        uint32_t *ids = (uint32_t *)realloc(trace->ids, capacity * sizeof(uint32_t));
+        if (ids == NULL)
+        {
+            return false;
+        }
+        trace->ids = ids;
+        trace->capacity = capacity;
+    }
+    trace->ids[trace->count++] = id;
+    return true;
+}
+
+bool save_access_trace(const AccessTrace *trace, const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        perror("Error opening trace file");
+        return false;
+    }
+    for (uint32_t i = 0; i < trace->count; ++i)
+    {
+        fprintf(file, "%u\n", trace->ids[i]);
+    }
+    fclose(file);
+    return true;
+}
+
+bool load_access_trace(AccessTrace *trace, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror("Error opening trace file");
+        return false;
+    }
+    unsigned int id = 0;
+    while (fscanf(file, "%u", &id) == 1)
+    {
+        if (!trace_append(trace, id))
+        {
+            fclose(file);
+            return false;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+uint32_t entry_cache_bucket(uint32_t mft_slot)
+{
+    return hash_mft_id(mft_slot) & (ENTRY_CACHE_BUCKETS - 1);
+}
+
+EntryCacheNode *entry_cache_find(EntryCache *cache, uint32_t mft_slot)
+{
+    EntryCacheNode *node = cache->buckets[entry_cache_bucket(mft_slot)];
+    while (node != NULL && node->mft_slot != mft_slot)
+    {
+        node = node->bucket_next;
+    }
+    return node;
+}
+
+void entry_cache_unlink(EntryCache *cache, EntryCacheNode *node)
+{
+    if (node->prev)
+    {
+        node->prev->next = node->next;
+    }
+    else
+    {
+        cache->head = node->next;
+    }
+
+    if (node->next)
+    {
+        node->next->prev = node->prev;
+    }
+    else
+    {
+        cache->tail = node->prev;
+    }
+    node->prev = node->next = NULL;
+}
+
+void entry_cache_push_front(EntryCache *cache, EntryCacheNode *node)
+{
+    node->prev = NULL;
+    node->next = cache->head;
+    if (cache->head)
+    {
+        cache->head->prev = node;
+    }
+    cache->head = node;
+    if (cache->tail == NULL)
+    {
+        cache->tail = node;
+    }
+}
+
+void entry_cache_evict(EntryCache *cache, EntryCacheNode *node)
+{
+    EntryCacheNode **link = &cache->buckets[entry_cache_bucket(node->mft_slot)];
+    while (*link != node)
+    {
+        link = &(*link)->bucket_next;
+    }
+    *link = node->bucket_next;
+    entry_cache_unlink(cache, node);
+    cache->bytes -= node->size;
+    if (node->pins > 0)
+    {
+        node->detached = true;
+        return;
+    }
+    buffer_free(node->data);
+    free(node);
+}
+
+bool entry_cache_insert(EntryCache *cache, uint32_t mft_slot, uint8_t *data, uint32_t size, bool speculative)
+{
+    if (size > cache->max_bytes || entry_cache_find(cache, mft_slot) != NULL)
+    {
+        buffer_free(data);
+        return false;
+    }
+
+    EntryCacheNode *node = (EntryCacheNode *)calloc(1, sizeof(EntryCacheNode));
+    if (node == NULL)
+    {
+        buffer_free(data);
+        return false;
+    }
+
+    while (cache->tail != NULL && cache->bytes + size > cache->max_bytes)
+    {
+        entry_cache_evict(cache, cache->tail);
+    }
+
+    node->mft_slot = mft_slot;
+    node->size = size;
+    node->data = data;
+    node->speculative = speculative;
+    uint32_t bucket = entry_cache_bucket(mft_slot);
+    node->bucket_next = cache->buckets[bucket];
+    cache->buckets[bucket] = node;
+    entry_cache_push_front(cache, node);
+    cache->bytes += size;
+    return true;
+}
+
+void entry_cache_clear(EntryCache *cache)
+{
+    while (cache->head != NULL)
+    {
+        entry_cache_evict(cache, cache->head);
+    }
+}
+
+void entry_cache_pin(EntryCache *cache, EntryCacheNode *node)
+{
+    ++node->pins;
+    if (!node->detached)
+    {
+        entry_cache_unlink(cache, node);
+        entry_cache_push_front(cache, node);
+    }
+}
+
+void entry_cache_unpin(EntryCache *cache, EntryCacheNode *node)
+{
+    (void)cache;
+    if (--node->pins == 0 && node->detached)
+    {
+        buffer_free(node->data);
+        free(node);
+    }
+}
+
+uint8_t *read_mft_payload(FILE *file, const MFTData *mft_entry, uint32_t *size)
+{
+    uint8_t *compressed_data = (uint8_t *)buffer_alloc(mft_entry->size);
+    if (compressed_data == NULL)
+    {
+        return NULL;
+    }
+
+    dat_fseek(file, mft_entry->offset, SEEK_SET);
+    if (fread(compressed_data, 1, mft_entry->size, file) != mft_entry->size)
+    {
+        buffer_free(compressed_data);
+        return NULL;
+    }
+
+    if (mft_entry->compression_flag == 0)
+    {
+        *size = mft_entry->size;
+        return compressed_data;
+    }
+
+    uint8_t *decompressed_data = decompress_data_indexed(compressed_data, mft_entry->size, size, 0, NULL);
+    buffer_free(compressed_data);
+    return decompressed_data;
+}
+
+bool build_trace_positions(MFTIdIndex *positions, const AccessTrace *trace)
+{
+    uint32_t capacity = 16;
+    while (capacity < (uint64_t)trace->count * 2)
+    {
+        capacity <<= 1;
+    }
+
+    positions->slots = (MFTIdIndexSlot *)malloc(capacity * sizeof(MFTIdIndexSlot));
+    if (positions->slots == NULL)
+    {
+        return false;
+    }
+    memset(positions->slots, 0xFF, capacity * sizeof(MFTIdIndexSlot));
+    positions->mask = capacity - 1;
+    positions->count = 0;
+
+    for (uint32_t i = 0; i < trace->count; ++i)
+    {
+        insert_mft_id(positions, trace->ids[i], i);
+    }
+    return true;
+}
+
+int prefetch_worker_main(void *argument)
+{
+    DatPrefetcher *prefetcher = (DatPrefetcher *)argument;
+
+    mtx_lock(&prefetcher->mutex);
+    while (!prefetcher->stop)
+    {
+        if (prefetcher->queue_count == 0)
+        {
+            cnd_wait(&prefetcher->wake, &prefetcher->mutex);
+            continue;
+        }
+
+        PrefetchRequest request = prefetcher->queue[prefetcher->queue_head];
+        prefetcher->queue_head = (prefetcher->queue_head + 1) % PREFETCH_QUEUE_SIZE;
+        --prefetcher->queue_count;
+        if (entry_cache_find(&prefetcher->cache, request.mft_slot) != NULL)
+        {
+            continue;
+        }
+        mtx_unlock(&prefetcher->mutex);
+
+        uint32_t size = 0;
+        uint8_t *data = read_mft_payload(prefetcher->file, &request.mft_entry, &size);
+
+        mtx_lock(&prefetcher->mutex);
+        if (data != NULL && request.generation != prefetcher->generation)
+        {
+            // The record may have changed under a reload while the entry was decoded
+            buffer_free(data);
+        }
+        else if (data != NULL && entry_cache_insert(&prefetcher->cache, request.mft_slot, data, size, true))
+        {
+            ++prefetcher->stats.speculative_decodes;
+        }
+    }
+    mtx_unlock(&prefetcher->mutex);
+    return thrd_success;
+}
+
+bool enable_prefetcher(DatFile *dat_file, uint32_t flags, const char *replay_path, const char *record_path, size_t cache_bytes)
+{
+    DatPrefetcher *prefetcher = (DatPrefetcher *)calloc(1, sizeof(DatPrefetcher));
+    if (prefetcher == NULL)
+    {
+        return false;
+    }
+
+    prefetcher->flags = flags;
+    prefetcher->depth = PREFETCH_DEFAULT_DEPTH;
+    prefetcher->cache.max_bytes = cache_bytes ? cache_bytes : ENTRY_CACHE_DEFAULT_BYTES;
+    prefetcher->file = fopen(dat_file->file_path, "rb");
+    if (!prefetcher->file)
+    {
+        perror("Error opening file");
+        free(prefetcher);
+        return false;
+    }
+
+    if (record_path != NULL)
+    {
+        prefetcher->record_path = strdup(record_path);
+    }
+
+    if (replay_path != NULL &&
+        (!load_access_trace(&prefetcher->replay, replay_path) || !build_trace_positions(&prefetcher->replay_positions, &prefetcher->replay)))
+    {
+        fclose(prefetcher->file);
+        free(prefetcher->replay.ids);
+        free(prefetcher->record_path);
+        free(prefetcher);
+        return false;
+    }
+
+    mtx_init(&prefetcher->mutex, mtx_plain);
+    cnd_init(&prefetcher->wake);
+    dat_file->prefetcher = prefetcher;
+
+    if (flags & PREFETCH_SPECULATIVE)
+    {
+        prefetcher->worker_running = thrd_create(&prefetcher->worker, prefetch_worker_main, prefetcher) == thrd_success;
+    }
+    return true;
+}
+
+void disable_prefetcher(DatFile *dat_file)
+{
+    DatPrefetcher *prefetcher = dat_file->prefetcher;
+    if (prefetcher == NULL)
+    {
+        return;
+    }
+
+    if (prefetcher->worker_running)
+    {
+        mtx_lock(&prefetcher->mutex);
+        prefetcher->stop = true;
+        cnd_signal(&prefetcher->wake);
+        mtx_unlock(&prefetcher->mutex);
+        thrd_join(prefetcher->worker, NULL);
+    }
+
+    if (prefetcher->record_path != NULL)
+    {
+        save_access_trace(&prefetcher->recorded, prefetcher->record_path);
+    }
+
+    entry_cache_clear(&prefetcher->cache);
+    fclose(prefetcher->file);
+    free(prefetcher->recorded.ids);
+    free(prefetcher->replay.ids);
+    free(prefetcher->replay_positions.slots);
+    free(prefetcher->record_path);
+    mtx_destroy(&prefetcher->mutex);
+    cnd_destroy(&prefetcher->wake);
+    free(prefetcher);
+    dat_file->prefetcher = NULL;
+}
+
+void prefetch_hint_entry(DatFile *dat_file, uint32_t id)
+{
+    DatPrefetcher *prefetcher = dat_file->prefetcher;
+    uint32_t mft_slot = 0;
+    if (!find_mft_slot(dat_file, id, &mft_slot))
+    {
+        return;
+    }
+    MFTData *mft_entry = get_mft_entry(dat_file, mft_slot);
+    if (mft_entry == NULL)
+    {
+        return;
+    }
+
+#if defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fileno(prefetcher->file), (off_t)mft_entry->offset, (off_t)mft_entry->size, POSIX_FADV_WILLNEED);
+#endif
+
+    mtx_lock(&prefetcher->mutex);
+    ++prefetcher->stats.hints_issued;
+    if (prefetcher->worker_running && prefetcher->queue_count < PREFETCH_QUEUE_SIZE && entry_cache_find(&prefetcher->cache, mft_slot) == NULL)
+    {
+        PrefetchRequest *request = &prefetcher->queue[(prefetcher->queue_head + prefetcher->queue_count) % PREFETCH_QUEUE_SIZE];
+        request->mft_slot = mft_slot;
+        request->generation = prefetcher->generation;
+        request->mft_entry = *mft_entry;
+        ++prefetcher->queue_count;
+        cnd_signal(&prefetcher->wake);
+    }
+    mtx_unlock(&prefetcher->mutex);
+}
+
+uint8_t *prefetch_begin_access(DatFile *dat_file, uint32_t id, uint32_t mft_slot, uint32_t *size)
+{
+    DatPrefetcher *prefetcher = dat_file->prefetcher;
+
+    // Any number of threads get here at once: the trace, the cursor and the counters are shared.
+    // The hints themselves go out after the lock is released, since they may wait for the id index.
+    uint32_t first_hint = 0;
+    uint32_t last_hint = 0;
+    mtx_lock(&prefetcher->mutex);
+    ++prefetcher->stats.accesses;
+    if (prefetcher->flags & PREFETCH_RECORD)
+    {
+        trace_append(&prefetcher->recorded, id);
+    }
+
+    if ((prefetcher->flags & PREFETCH_HINT) && prefetcher->replay.count > 0)
+    {
+        // Follow the trace while accesses match it, otherwise jump to the id's first occurrence
+        uint32_t position = 0;
+        bool sequential = prefetcher->replay_cursor_valid && prefetcher->replay_cursor + 1 < prefetcher->replay.count &&
+                          prefetcher->replay.ids[prefetcher->replay_cursor + 1] == id;
+        bool found = sequential;
+        if (sequential)
+        {
+            position = prefetcher->replay_cursor + 1;
+        }
+        else
+        {
+            found = find_mft_id(&prefetcher->replay_positions, id, &position);
+        }
+
+        if (found)
+        {
+            // On a sequential step only the id newly entering the window needs a hint
+            first_hint = sequential ? position + prefetcher->depth : position + 1;
+            last_hint = position + prefetcher->depth + 1;
+            last_hint = last_hint < prefetcher->replay.count ? last_hint : prefetcher->replay.count;
+            prefetcher->replay_cursor = position;
+        }
+        prefetcher->replay_cursor_valid = found;
+    }
+    mtx_unlock(&prefetcher->mutex);
+
+    // The replay trace is not changed after enable_prefetcher
+    for (uint32_t i = first_hint; i < last_hint; ++i)
+    {
+        prefetch_hint_entry(dat_file, prefetcher->replay.ids[i]);
+    }
+
+    uint8_t *copy = NULL;
+    mtx_lock(&prefetcher->mutex);
+    EntryCacheNode *node = entry_cache_find(&prefetcher->cache, mft_slot);
+    if (node != NULL)
+    {
+        copy = (uint8_t *)buffer_alloc(node->size);
+        if (copy != NULL)
+        {
+            memcpy(copy, node->data, node->size);
+            *size = node->size;
+            ++prefetcher->stats.cache_hits;
+            if (node->speculative)
+            {
+                ++prefetcher->stats.speculative_hits;
+                node->speculative = false;
+            }
+            entry_cache_unlink(&prefetcher->cache, node);
+            entry_cache_push_front(&prefetcher->cache, node);
+        }
+    }
+    mtx_unlock(&prefetcher->mutex);
+    return copy;
+}
+
+void prefetch_end_access(DatFile *dat_file, uint32_t mft_slot, const uint8_t *data, uint32_t size, uint64_t start_nanoseconds, bool hit)
+{
+    DatPrefetcher *prefetcher = dat_file->prefetcher;
+    uint64_t elapsed = prefetch_now_nanoseconds() - start_nanoseconds;
+    mtx_lock(&prefetcher->mutex);
+    if (hit)
+    {
+        prefetcher->stats.hit_nanoseconds += elapsed;
+    }
+    else
+    {
+        prefetcher->stats.miss_nanoseconds += elapsed;
+    }
+    mtx_unlock(&prefetcher->mutex);
+    if (hit)
+    {
+        return;
+    }
+
+    uint8_t *copy = (uint8_t *)buffer_alloc(size);
+    if (copy != NULL)
+    {
+        memcpy(copy, data, size);
+        mtx_lock(&prefetcher->mutex);
+        entry_cache_insert(&prefetcher->cache, mft_slot, copy, size, false);
+        mtx_unlock(&prefetcher->mutex);
+    }
+}
+
+void print_prefetch_report(const DatFile *dat_file)
+{
+    const DatPrefetcher *prefetcher = dat_file->prefetcher;
+    if (prefetcher == NULL)
+    {
+        return;
+    }
+
+    const PrefetchStats *stats = &prefetcher->stats;
+    uint64_t misses = stats->accesses - stats->cache_hits;
+    printf("Prefetch Report:\n");
+    printf("  Accesses:            %llu\n", (unsigned long long)stats->accesses);
+    printf("  Cache Hits:          %llu (%.1f%%)\n", (unsigned long long)stats->cache_hits,
+           stats->accesses ? 100.0 * stats->cache_hits / stats->accesses : 0.0);
+    printf("  Speculative Hits:    %llu of %llu decoded\n", (unsigned long long)stats->speculative_hits,
+           (unsigned long long)stats->speculative_decodes);
+    printf("  Read-ahead Hints:    %llu\n", (unsigned long long)stats->hints_issued);
+    printf("  Avg Hit Latency:     %.1f us\n", stats->cache_hits ? stats->hit_nanoseconds / 1000.0 / stats->cache_hits : 0.0);
+    printf("  Avg Miss Latency:    %.1f us\n", misses ? stats->miss_nanoseconds / 1000.0 / misses : 0.0);
+    printf("  Cached Bytes:        %zu of %zu\n", prefetcher->cache.bytes, prefetcher->cache.max_bytes);
+}
+
+uint32_t prefetch_invalidate_slots(DatFile *dat_file, const uint32_t *mft_slots, uint32_t count)
+{
+    DatPrefetcher *prefetcher = dat_file->prefetcher;
+    if (prefetcher == NULL)
+    {
+        return 0;
+    }
+
+    uint32_t dropped = 0;
+    mtx_lock(&prefetcher->mutex);
+    ++prefetcher->generation;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        EntryCacheNode *node = entry_cache_find(&prefetcher->cache, mft_slots[i]);
+        if (node != NULL)
+        {
+            entry_cache_evict(&prefetcher->cache, node);
+            ++dropped;
+        }
+    }
+    mtx_unlock(&prefetcher->mutex);
+    return dropped;
+}
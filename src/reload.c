@@ -0,0 +1,490 @@
+#include "reload.h"
+#include "prefetch.h"
+
+#include <stdatomic.h>
+#include <time.h>
+#if defined(__linux__)
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+struct ArchiveReloader
+{
+    _Atomic(DatFile *) current;
+    atomic_uint epoch;
+    atomic_uint readers[2]; // readers inside, by the parity of the epoch they entered at
+    DatFile *first;         // the caller's tables, which also own the caches; never freed here
+    SeekIndexStore *seek_index;
+    ReloadCallback callback;
+    void *context;
+    uint32_t quiet_milliseconds;
+
+    mtx_t reload_mutex; // one reload at a time; also guards stats
+    ReloadStats stats;
+
+    thrd_t watcher;
+    bool watcher_running;
+    mtx_t stop_mutex;
+    cnd_t stop_wake;
+    bool stop;
+#if defined(__linux__)
+    int inotify_fd;
+    int stop_fd;
+#endif
+};
+
+static uint64_t reload_now_nanoseconds(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// Read the header as the file holds it now
+static bool read_current_header(const char *file_path, DatHeader *header)
+{
+    FILE *file = fopen(file_path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    read_dat_header(file, header);
+    bool read = !ferror(file) && !feof(file);
+    fclose(file);
+    return read;
+}
+
+static bool same_header(const DatHeader *a, const DatHeader *b)
+{
+    return a->mft_offset == b->mft_offset && a->mft_size == b->mft_size && a->crc == b->crc;
+}
+
+static bool same_record(const MFTData *a, const MFTData *b)
+{
+    return a->offset == b->offset && a->size == b->size && a->crc == b->crc;
+}
+
+// Take over the id index of current when the index table's record is the same in fresh
+static bool reuse_mft_index(DatFile *current, DatFile *fresh)
+{
+    bool reused = false;
+    mtx_lock(&current->index_mutex);
+    if (current->index_thread_running)
+    {
+        thrd_join(current->index_thread, NULL);
+        current->index_thread_running = false;
+    }
+
+    // A loaded index means page 0, with the index table's record, was read too
+    if (current->mft_index_loaded && current->id_index.slots != NULL && fresh->mft_header.num_entries > MFT_ENTRY_INDEX_NUM &&
+        same_record(&current->mft_data[MFT_ENTRY_INDEX_NUM], &fresh->mft_data[MFT_ENTRY_INDEX_NUM]))
+    {
+        size_t index_bytes = (size_t)current->num_index_entries * sizeof(MFTIndexData);
+        size_t slot_bytes = ((size_t)current->id_index.mask + 1) * sizeof(MFTIdIndexSlot);
+        MFTIndexData *index_data = (MFTIndexData *)malloc(index_bytes ? index_bytes : 1);
+        MFTIdIndexSlot *slots = (MFTIdIndexSlot *)malloc(slot_bytes);
+        if (index_data != NULL && slots != NULL)
+        {
+            memcpy(index_data, current->mft_index_data, index_bytes);
+            memcpy(slots, current->id_index.slots, slot_bytes);
+            fresh->mft_index_data = index_data;
+            fresh->num_index_entries = current->num_index_entries;
+            fresh->id_index = current->id_index;
+            fresh->id_index.slots = slots;
+            fresh->mft_index_loaded = true;
+            reused = true;
+        }
+        else
+        {
+            free(index_data);
+            free(slots);
+        }
+    }
+    mtx_unlock(&current->index_mutex);
+    return reused;
+}
+
+// Open the archive again and read every MFT page and the index, so the new tables never go back to
+// the file once they are in use
+static DatFile *read_fresh_tables(DatFile *current, bool *index_reused)
+{
+    DatFile *fresh = (DatFile *)calloc(1, sizeof(DatFile));
+    if (fresh == NULL || !load_dat_file_ex(current->file_path, fresh, DAT_OPEN_LAZY))
+    {
+        free(fresh);
+        return NULL;
+    }
+
+    bool ok = true;
+    uint32_t num_pages = (fresh->mft_header.num_entries + MFT_PAGE_ENTRIES - 1) / MFT_PAGE_ENTRIES;
+    for (uint32_t page = 0; ok && page < num_pages; ++page)
+    {
+        ok = load_mft_page(fresh, page);
+    }
+    *index_reused = ok && reuse_mft_index(current, fresh);
+    if (ok && !*index_reused)
+    {
+        ok = load_mft_index(fresh);
+    }
+
+    // A patch still being written can leave the header ahead of the MFT; try again later then
+    DatHeader header;
+    if (ok && (!read_current_header(current->file_path, &header) || !same_header(&header, &fresh->header)))
+    {
+        ok = false;
+    }
+    if (!ok)
+    {
+        close_dat_file(fresh);
+        free(fresh);
+        return NULL;
+    }
+    return fresh;
+}
+
+// Slots of current whose records differ in fresh or are gone from it. Pages current never read are
+// skipped, since nothing can have been cached for their slots. NULL if out of memory.
+static uint32_t *diff_mft_tables(DatFile *current, const DatFile *fresh, uint32_t *count)
+{
+    uint32_t slots = current->mft_header.num_entries;
+    uint32_t *changed = (uint32_t *)malloc((slots ? slots : 1) * sizeof(uint32_t));
+    *count = 0;
+    if (changed == NULL)
+    {
+        return NULL;
+    }
+
+    bool lazy = (current->open_flags & DAT_OPEN_LAZY) != 0;
+    mtx_lock(&current->page_mutex);
+    for (uint32_t slot = 1; slot < slots; ++slot)
+    {
+        if (lazy && !current->mft_page_loaded[slot / MFT_PAGE_ENTRIES])
+        {
+            slot = (slot / MFT_PAGE_ENTRIES + 1) * MFT_PAGE_ENTRIES - 1;
+            continue;
+        }
+        if (slot >= fresh->mft_header.num_entries || !same_record(&current->mft_data[slot], &fresh->mft_data[slot]))
+        {
+            changed[(*count)++] = slot;
+        }
+    }
+    mtx_unlock(&current->page_mutex);
+    return changed;
+}
+
+// Start a new epoch and wait until no reader of the previous one is left
+static void wait_for_readers(ArchiveReloader *reloader)
+{
+    uint32_t epoch = atomic_fetch_add(&reloader->epoch, 1);
+    struct timespec pause = {0, 1000000};
+    while (atomic_load(&reloader->readers[epoch & 1]) != 0)
+    {
+        thrd_sleep(&pause, NULL);
+    }
+}
+
+static void retire_tables(ArchiveReloader *reloader, DatFile *tables)
+{
+    if (tables == reloader->first)
+    {
+        release_mft_tables(tables);
+        return;
+    }
+    // Later tables only borrow the caches from the first
+    tables->prefetcher = NULL;
+    tables->transcode_cache = NULL;
+    close_dat_file(tables);
+    free(tables);
+}
+
+// Called with reload_mutex held
+static bool reload_tables(ArchiveReloader *reloader)
+{
+    DatFile *current = atomic_load(&reloader->current);
+    ++reloader->stats.checks;
+    DatHeader header;
+    if (!read_current_header(current->file_path, &header) || same_header(&header, &current->header))
+    {
+        return true;
+    }
+
+    uint64_t start = reload_now_nanoseconds();
+    bool index_reused = false;
+    DatFile *fresh = read_fresh_tables(current, &index_reused);
+    uint32_t changed_count = 0;
+    uint32_t *changed = fresh != NULL ? diff_mft_tables(current, fresh, &changed_count) : NULL;
+    if (changed == NULL)
+    {
+        if (fresh != NULL)
+        {
+            close_dat_file(fresh);
+            free(fresh);
+        }
+        ++reloader->stats.failures;
+        return false;
+    }
+
+    fresh->prefetcher = current->prefetcher;
+    fresh->transcode_cache = current->transcode_cache;
+    atomic_store(&reloader->current, fresh);
+    wait_for_readers(reloader);
+
+    // No reader of the old records is left to cache what it decoded from them
+    uint32_t dropped = 0;
+    if (reloader->seek_index != NULL)
+    {
+        for (uint32_t i = 0; i < changed_count; ++i)
+        {
+            dropped += remove_seek_index_entry(reloader->seek_index, changed[i]) ? 1 : 0;
+        }
+    }
+    dropped += prefetch_invalidate_slots(fresh, changed, changed_count);
+    if (reloader->callback != NULL)
+    {
+        dropped += reloader->callback(reloader->context, changed, changed_count);
+    }
+    retire_tables(reloader, current);
+    free(changed);
+
+    ++reloader->stats.reloads;
+    reloader->stats.index_reused += index_reused ? 1 : 0;
+    reloader->stats.changed_slots += changed_count;
+    reloader->stats.dropped += dropped;
+    reloader->stats.last_reload_nanoseconds = reload_now_nanoseconds() - start;
+    return true;
+}
+
+bool reload_if_changed(ArchiveReloader *reloader)
+{
+    mtx_lock(&reloader->reload_mutex);
+    bool reloaded = reload_tables(reloader);
+    mtx_unlock(&reloader->reload_mutex);
+    return reloaded;
+}
+
+#if defined(__linux__)
+// Check the header once writes have been quiet for quiet_milliseconds, and every RELOAD_POLL_MS
+// in any case, until stop_fd is written
+static int reload_watcher_main(void *argument)
+{
+    ArchiveReloader *reloader = (ArchiveReloader *)argument;
+    bool pending = false;
+    for (;;)
+    {
+        struct pollfd fds[2] = {{reloader->stop_fd, POLLIN, 0}, {reloader->inotify_fd, POLLIN, 0}};
+        int ready = poll(fds, 2, pending ? (int)reloader->quiet_milliseconds : RELOAD_POLL_MS);
+        if (ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ready < 0 || (fds[0].revents & POLLIN))
+        {
+            break;
+        }
+        if (ready > 0 && (fds[1].revents & POLLIN))
+        {
+            // Every write starts the quiet period over
+            char events[4096];
+            while (read(reloader->inotify_fd, events, sizeof(events)) > 0)
+            {
+            }
+            pending = true;
+            continue;
+        }
+
+        reload_if_changed(reloader);
+        pending = false;
+    }
+    return thrd_success;
+}
+#else
+// Check the header every RELOAD_POLL_MS until stopped
+static int reload_watcher_main(void *argument)
+{
+    ArchiveReloader *reloader = (ArchiveReloader *)argument;
+    mtx_lock(&reloader->stop_mutex);
+    while (!reloader->stop)
+    {
+        struct timespec until;
+        timespec_get(&until, TIME_UTC);
+        until.tv_sec += RELOAD_POLL_MS / 1000;
+        until.tv_nsec += (RELOAD_POLL_MS % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L)
+        {
+            ++until.tv_sec;
+            until.tv_nsec -= 1000000000L;
+        }
+        if (cnd_timedwait(&reloader->stop_wake, &reloader->stop_mutex, &until) == thrd_timedout)
+        {
+            mtx_unlock(&reloader->stop_mutex);
+            reload_if_changed(reloader);
+            mtx_lock(&reloader->stop_mutex);
+        }
+    }
+    mtx_unlock(&reloader->stop_mutex);
+    return thrd_success;
+}
+#endif
+
+ArchiveReloader *create_archive_reloader(DatFile *dat_file, SeekIndexStore *seek_index)
+{
+    ArchiveReloader *reloader = (ArchiveReloader *)calloc(1, sizeof(ArchiveReloader));
+    if (reloader == NULL)
+    {
+        return NULL;
+    }
+
+    atomic_init(&reloader->current, dat_file);
+    atomic_init(&reloader->epoch, 0);
+    atomic_init(&reloader->readers[0], 0);
+    atomic_init(&reloader->readers[1], 0);
+    reloader->first = dat_file;
+    reloader->seek_index = seek_index;
+    reloader->quiet_milliseconds = RELOAD_DEFAULT_QUIET_MS;
+    mtx_init(&reloader->reload_mutex, mtx_plain);
+    mtx_init(&reloader->stop_mutex, mtx_plain);
+    cnd_init(&reloader->stop_wake);
+#if defined(__linux__)
+    reloader->inotify_fd = -1;
+    reloader->stop_fd = -1;
+#endif
+    return reloader;
+}
+
+bool start_reload_watcher(ArchiveReloader *reloader, uint32_t quiet_milliseconds, ReloadCallback callback, void *context)
+{
+    mtx_lock(&reloader->reload_mutex);
+    if (reloader->watcher_running)
+    {
+        mtx_unlock(&reloader->reload_mutex);
+        return false;
+    }
+    reloader->callback = callback;
+    reloader->context = context;
+    reloader->quiet_milliseconds = quiet_milliseconds ? quiet_milliseconds : RELOAD_DEFAULT_QUIET_MS;
+
+#if defined(__linux__)
+    reloader->stop_fd = eventfd(0, EFD_CLOEXEC);
+    reloader->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (reloader->inotify_fd >= 0 && inotify_add_watch(reloader->inotify_fd, reloader->first->file_path, IN_MODIFY | IN_CLOSE_WRITE) < 0)
+    {
+        // Without a watch the periodic header check still catches patches
+        perror("inotify_add_watch");
+        close(reloader->inotify_fd);
+        reloader->inotify_fd = -1;
+    }
+    reloader->watcher_running = reloader->stop_fd >= 0 && thrd_create(&reloader->watcher, reload_watcher_main, reloader) == thrd_success;
+    if (!reloader->watcher_running)
+    {
+        if (reloader->inotify_fd >= 0)
+        {
+            close(reloader->inotify_fd);
+        }
+        if (reloader->stop_fd >= 0)
+        {
+            close(reloader->stop_fd);
+        }
+        reloader->inotify_fd = -1;
+        reloader->stop_fd = -1;
+    }
+#else
+    reloader->watcher_running = thrd_create(&reloader->watcher, reload_watcher_main, reloader) == thrd_success;
+#endif
+    bool started = reloader->watcher_running;
+    mtx_unlock(&reloader->reload_mutex);
+    return started;
+}
+
+bool reloader_started(ArchiveReloader *reloader)
+{
+    mtx_lock(&reloader->reload_mutex);
+    bool started = reloader->watcher_running || atomic_load(&reloader->current) != reloader->first;
+    mtx_unlock(&reloader->reload_mutex);
+    return started;
+}
+
+void stop_archive_reloader(ArchiveReloader *reloader)
+{
+    if (reloader == NULL)
+    {
+        return;
+    }
+
+    if (reloader->watcher_running)
+    {
+#if defined(__linux__)
+        uint64_t one = 1;
+        if (write(reloader->stop_fd, &one, sizeof(one)) != sizeof(one))
+        {
+            perror("eventfd write");
+        }
+#else
+        mtx_lock(&reloader->stop_mutex);
+        reloader->stop = true;
+        cnd_signal(&reloader->stop_wake);
+        mtx_unlock(&reloader->stop_mutex);
+#endif
+        thrd_join(reloader->watcher, NULL);
+    }
+#if defined(__linux__)
+    if (reloader->inotify_fd >= 0)
+    {
+        close(reloader->inotify_fd);
+    }
+    if (reloader->stop_fd >= 0)
+    {
+        close(reloader->stop_fd);
+    }
+#endif
+
+    DatFile *current = atomic_load(&reloader->current);
+    if (current != reloader->first)
+    {
+        retire_tables(reloader, current);
+    }
+    mtx_destroy(&reloader->reload_mutex);
+    mtx_destroy(&reloader->stop_mutex);
+    cnd_destroy(&reloader->stop_wake);
+    free(reloader);
+}
+
+DatFile *reloader_enter(ArchiveReloader *reloader, uint32_t *epoch)
+{
+    for (;;)
+    {
+        uint32_t entered = atomic_load(&reloader->epoch);
+        atomic_fetch_add(&reloader->readers[entered & 1], 1);
+        // A reload that started a new epoch meanwhile may not wait for this reader; count it again
+        if (atomic_load(&reloader->epoch) == entered)
+        {
+            *epoch = entered;
+            return atomic_load(&reloader->current);
+        }
+        atomic_fetch_sub(&reloader->readers[entered & 1], 1);
+    }
+}
+
+void reloader_leave(ArchiveReloader *reloader, uint32_t epoch)
+{
+    atomic_fetch_sub(&reloader->readers[epoch & 1], 1);
+}
+
+void get_reload_stats(ArchiveReloader *reloader, ReloadStats *stats)
+{
+    mtx_lock(&reloader->reload_mutex);
+    *stats = reloader->stats;
+    mtx_unlock(&reloader->reload_mutex);
+}
+
+void print_reload_report(const ReloadStats *stats)
+{
+    printf("Reload Report:\n");
+    printf("  Header checks:       %llu\n", (unsigned long long)stats->checks);
+    printf("  Reloads:             %llu (%llu failed, %llu kept the id index), last took %.1f ms\n", (unsigned long long)stats->reloads,
+           (unsigned long long)stats->failures, (unsigned long long)stats->index_reused, stats->last_reload_nanoseconds / 1e6);
+    printf("  Changed slots:       %llu (%llu cached entries dropped)\n", (unsigned long long)stats->changed_slots,
+           (unsigned long long)stats->dropped);
+}
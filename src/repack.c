@@ -0,0 +1,728 @@
+#include "repack.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define REPACK_MIN_WRITE_BUFFER (64u << 10)
+#define REPACK_MAX_ALIGNMENT 4096u
+#define REPACK_DAT_HEADER_SIZE 40
+#define REPACK_HEADER_MFT_OFFSET 24 // byte offsets of mft_offset and mft_size in the archive header
+#define REPACK_HEADER_MFT_SIZE 32
+
+typedef struct
+{
+    uint32_t trace_position; // first access in the trace, UINT32_MAX if never accessed
+    uint32_t first_id;       // lowest file id resolving to the slot, UINT32_MAX if none
+    uint32_t slot;
+} RepackRank;
+
+typedef struct
+{
+    uint64_t offset;
+    uint32_t size;
+    uint32_t slot;
+} RepackSource;
+
+typedef struct
+{
+    uint32_t *order;       // slots whose payload is copied, in output order
+    uint32_t order_count;
+    uint64_t *new_offsets; // per slot
+    uint32_t header_size;
+    uint32_t alignment;
+    uint64_t index_offset;
+    uint32_t index_size;
+    uint64_t mft_offset;
+    uint32_t mft_size;
+    uint64_t output_size;
+} RepackPlan;
+
+typedef struct
+{
+    FILE *file;
+    uint8_t *buffer;
+    uint32_t capacity;
+    uint32_t used;
+    uint64_t position; // bytes produced so far, written or still buffered
+    uint64_t writes;
+} RepackWriter;
+
+static int compare_rank(const void *left, const void *right)
+{
+    const RepackRank *a = (const RepackRank *)left;
+    const RepackRank *b = (const RepackRank *)right;
+    if (a->trace_position != b->trace_position)
+    {
+        return a->trace_position < b->trace_position ? -1 : 1;
+    }
+    if (a->first_id != b->first_id)
+    {
+        return a->first_id < b->first_id ? -1 : 1;
+    }
+    return (a->slot > b->slot) - (a->slot < b->slot);
+}
+
+static int compare_source(const void *left, const void *right)
+{
+    const RepackSource *a = (const RepackSource *)left;
+    const RepackSource *b = (const RepackSource *)right;
+    if (a->offset != b->offset)
+    {
+        return a->offset < b->offset ? -1 : 1;
+    }
+    if (a->size != b->size)
+    {
+        return a->size < b->size ? -1 : 1;
+    }
+    return (a->slot > b->slot) - (a->slot < b->slot);
+}
+
+static int compare_id(const void *left, const void *right)
+{
+    uint32_t a = *(const uint32_t *)left;
+    uint32_t b = *(const uint32_t *)right;
+    return (a > b) - (a < b);
+}
+
+// Evict a file's cached pages so a timed replay starts from the device
+static void repack_drop_page_cache(const char *file_path)
+{
+#if defined(__linux__)
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+#else
+    (void)file_path;
+#endif
+}
+
+static uint64_t file_size_of(FILE *file)
+{
+    if (dat_fseek(file, 0, SEEK_END) != 0)
+    {
+        return 0;
+    }
+    int64_t size = dat_ftell(file);
+    return size > 0 ? (uint64_t)size : 0;
+}
+
+// The trace as given, or every entry once in file id order
+static bool collect_access_sequence(DatFile *dat_file, const AccessTrace *trace, uint32_t **ids, uint32_t *count)
+{
+    *count = 0;
+    if (trace != NULL)
+    {
+        *ids = (uint32_t *)malloc((trace->count ? trace->count : 1) * sizeof(uint32_t));
+        if (*ids == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed for access sequence\n");
+            return false;
+        }
+        memcpy(*ids, trace->ids, trace->count * sizeof(uint32_t));
+        *count = trace->count;
+        return true;
+    }
+
+    uint32_t entry_count = dat_file->mft_header.num_entries;
+    uint8_t *seen = (uint8_t *)calloc(entry_count ? entry_count : 1, 1);
+    *ids = (uint32_t *)malloc((dat_file->num_index_entries ? dat_file->num_index_entries : 1) * sizeof(uint32_t));
+    if (seen == NULL || *ids == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for access sequence\n");
+        free(seen);
+        free(*ids);
+        *ids = NULL;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < dat_file->num_index_entries; ++i)
+    {
+        (*ids)[i] = dat_file->mft_index_data[i].file_id;
+    }
+    qsort(*ids, dat_file->num_index_entries, sizeof(uint32_t), compare_id);
+
+    for (uint32_t i = 0; i < dat_file->num_index_entries; ++i)
+    {
+        uint32_t mft_slot = 0;
+        uint32_t id = (*ids)[i];
+        if (find_mft_slot(dat_file, id, &mft_slot) && mft_slot < entry_count && !seen[mft_slot])
+        {
+            seen[mft_slot] = 1;
+            (*ids)[(*count)++] = id;
+        }
+    }
+    free(seen);
+    return true;
+}
+
+bool measure_read_locality(DatFile *dat_file, const uint32_t *ids, uint32_t count, bool timed, ReadLocality *locality)
+{
+    memset(locality, 0, sizeof(ReadLocality));
+    RepackSource *reads = (RepackSource *)malloc((count ? count : 1) * sizeof(RepackSource));
+    if (reads == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for locality measurement\n");
+        return false;
+    }
+
+    // Resolve every id first so the timed pass only reads payloads
+    uint64_t previous_end = 0;
+    uint64_t lowest = UINT64_MAX;
+    uint64_t highest = 0;
+    uint32_t largest = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t mft_slot = 0;
+        MFTData *mft_entry = find_mft_slot(dat_file, ids[i], &mft_slot) ? get_mft_entry(dat_file, mft_slot) : NULL;
+        if (mft_entry == NULL || mft_entry->size == 0)
+        {
+            continue;
+        }
+
+        uint64_t offset = mft_entry->offset;
+        if (locality->reads > 0)
+        {
+            if (offset >= previous_end && offset - previous_end <= REPACK_SEQUENTIAL_GAP)
+            {
+                ++locality->sequential_reads;
+            }
+            locality->seek_bytes += offset >= previous_end ? offset - previous_end : previous_end - offset;
+        }
+        previous_end = offset + mft_entry->size;
+        lowest = offset < lowest ? offset : lowest;
+        highest = previous_end > highest ? previous_end : highest;
+        largest = mft_entry->size > largest ? mft_entry->size : largest;
+
+        reads[locality->reads].offset = offset;
+        reads[locality->reads].size = mft_entry->size;
+        ++locality->reads;
+        locality->bytes += mft_entry->size;
+    }
+    locality->span_bytes = locality->reads > 0 ? highest - lowest : 0;
+
+    bool ok = true;
+    if (timed && locality->reads > 0)
+    {
+        repack_drop_page_cache(dat_file->file_path);
+        FILE *file = fopen(dat_file->file_path, "rb");
+        uint8_t *buffer = (uint8_t *)malloc(largest);
+        ok = file != NULL && buffer != NULL;
+        if (ok)
+        {
+            setvbuf(file, NULL, _IONBF, 0);
+            uint64_t start = prefetch_now_nanoseconds();
+            for (uint64_t i = 0; i < locality->reads && ok; ++i)
+            {
+                ok = dat_fseek(file, (int64_t)reads[i].offset, SEEK_SET) == 0 && fread(buffer, 1, reads[i].size, file) == reads[i].size;
+            }
+            locality->nanoseconds = prefetch_now_nanoseconds() - start;
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "Timed replay of %s failed\n", dat_file->file_path);
+        }
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+        free(buffer);
+    }
+    free(reads);
+    return ok;
+}
+
+static void free_repack_plan(RepackPlan *plan)
+{
+    free(plan->order);
+    free(plan->new_offsets);
+    memset(plan, 0, sizeof(RepackPlan));
+}
+
+static bool is_payload_slot(const DatFile *dat_file, uint32_t slot, const MFTData *mft_entry)
+{
+    return slot != MFT_ENTRY_INDEX_NUM && mft_entry->size > 0 && mft_entry->offset != dat_file->header.mft_offset &&
+           mft_entry->offset >= dat_file->header.header_size;
+}
+
+// Decide where every payload goes: ranks payload slots by trace position then lowest file id, copies
+// a payload shared by several slots once, and puts the index and the MFT after the payloads
+static bool plan_repack(DatFile *dat_file, const RepackOptions *options, uint64_t input_bytes, RepackPlan *plan, RepackStats *stats)
+{
+    memset(plan, 0, sizeof(RepackPlan));
+    uint32_t entry_count = dat_file->mft_header.num_entries;
+    plan->header_size = dat_file->header.header_size;
+    if (plan->header_size < REPACK_DAT_HEADER_SIZE || plan->header_size > REPACK_MAX_ALIGNMENT)
+    {
+        fprintf(stderr, "Unexpected archive header size %u\n", plan->header_size);
+        return false;
+    }
+
+    MFTData *index_entry = get_mft_entry(dat_file, MFT_ENTRY_INDEX_NUM);
+    RepackRank *ranks = (RepackRank *)malloc(entry_count * sizeof(RepackRank));
+    RepackSource *sources = (RepackSource *)malloc(entry_count * sizeof(RepackSource));
+    uint32_t *groups = (uint32_t *)malloc(entry_count * sizeof(uint32_t));
+    uint8_t *placed = (uint8_t *)calloc(entry_count, 1);
+    plan->order = (uint32_t *)malloc(entry_count * sizeof(uint32_t));
+    plan->new_offsets = (uint64_t *)calloc(entry_count, sizeof(uint64_t));
+    bool ok = index_entry != NULL && ranks != NULL && sources != NULL && groups != NULL && placed != NULL && plan->order != NULL &&
+              plan->new_offsets != NULL;
+    if (index_entry != NULL && !ok)
+    {
+        fprintf(stderr, "Memory allocation failed for repack plan\n");
+    }
+
+    // Payload slots, checked against the input and grouped by the bytes they point at
+    uint32_t payload_count = 0;
+    uint32_t alignment = options->alignment ? options->alignment : REPACK_MAX_ALIGNMENT;
+    for (uint32_t slot = 1; ok && slot < entry_count; ++slot)
+    {
+        MFTData *mft_entry = get_mft_entry(dat_file, slot);
+        if (mft_entry == NULL)
+        {
+            ok = false;
+            break;
+        }
+        groups[slot] = slot;
+        if (!is_payload_slot(dat_file, slot, mft_entry))
+        {
+            // The header stays at the start; empty records point nowhere
+            plan->new_offsets[slot] = mft_entry->size > 0 && mft_entry->offset < plan->header_size ? mft_entry->offset : 0;
+            continue;
+        }
+        if (mft_entry->offset + mft_entry->size > input_bytes)
+        {
+            fprintf(stderr, "MFT slot %u lies outside the archive\n", slot);
+            ok = false;
+            break;
+        }
+        while (options->alignment == 0 && alignment > 1 && (mft_entry->offset & (alignment - 1)) != 0)
+        {
+            alignment >>= 1;
+        }
+        sources[payload_count].offset = mft_entry->offset;
+        sources[payload_count].size = mft_entry->size;
+        sources[payload_count].slot = slot;
+        ranks[payload_count].trace_position = UINT32_MAX;
+        ranks[payload_count].first_id = UINT32_MAX;
+        ranks[payload_count].slot = slot;
+        ++payload_count;
+    }
+    if (ok && (alignment & (alignment - 1)) != 0)
+    {
+        fprintf(stderr, "Alignment %u is not a power of two\n", alignment);
+        ok = false;
+    }
+    plan->alignment = alignment;
+
+    if (ok)
+    {
+        qsort(sources, payload_count, sizeof(RepackSource), compare_source);
+        for (uint32_t i = 1; i < payload_count; ++i)
+        {
+            if (sources[i].offset == sources[i - 1].offset && sources[i].size == sources[i - 1].size)
+            {
+                groups[sources[i].slot] = groups[sources[i - 1].slot];
+            }
+        }
+
+        // Slot -> rank position, borrowing the order array until the layout fills it
+        uint32_t *rank_of = plan->order;
+        memset(rank_of, 0xFF, entry_count * sizeof(uint32_t));
+        for (uint32_t i = 0; i < payload_count; ++i)
+        {
+            rank_of[ranks[i].slot] = i;
+        }
+        for (uint32_t i = 0; i < dat_file->num_index_entries; ++i)
+        {
+            const MFTIndexData *index_data = &dat_file->mft_index_data[i];
+            if (index_data->base_id < entry_count && rank_of[index_data->base_id] != UINT32_MAX)
+            {
+                RepackRank *rank = &ranks[rank_of[index_data->base_id]];
+                rank->first_id = index_data->file_id < rank->first_id ? index_data->file_id : rank->first_id;
+            }
+        }
+        for (uint32_t i = 0; options->order == REPACK_ORDER_TRACE && options->trace != NULL && i < options->trace->count; ++i)
+        {
+            uint32_t mft_slot = 0;
+            if (find_mft_slot(dat_file, options->trace->ids[i], &mft_slot) && mft_slot < entry_count && rank_of[mft_slot] != UINT32_MAX)
+            {
+                RepackRank *rank = &ranks[rank_of[mft_slot]];
+                rank->trace_position = i < rank->trace_position ? i : rank->trace_position;
+            }
+        }
+        qsort(ranks, payload_count, sizeof(RepackRank), compare_rank);
+
+        // Lay the payloads out in rank order, each shared payload where its first slot lands
+        uint64_t cursor = plan->header_size;
+        for (uint32_t i = 0; i < payload_count; ++i)
+        {
+            uint32_t slot = ranks[i].slot;
+            uint32_t group = groups[slot];
+            if (placed[group])
+            {
+                plan->new_offsets[slot] = plan->new_offsets[group];
+                ++stats->shared_slots;
+                continue;
+            }
+            uint64_t aligned = (cursor + alignment - 1) & ~(uint64_t)(alignment - 1);
+            stats->padding_bytes += aligned - cursor;
+            placed[group] = 1;
+            plan->new_offsets[group] = aligned;
+            plan->new_offsets[slot] = aligned;
+            plan->order[plan->order_count++] = slot;
+            stats->traced += ranks[i].trace_position != UINT32_MAX;
+            stats->payload_bytes += dat_file->mft_data[slot].size;
+            cursor = aligned + dat_file->mft_data[slot].size;
+        }
+        stats->payloads = plan->order_count;
+
+        uint64_t aligned = (cursor + alignment - 1) & ~(uint64_t)(alignment - 1);
+        stats->padding_bytes += aligned - cursor;
+        plan->index_offset = aligned;
+        plan->index_size = dat_file->num_index_entries * (uint32_t)sizeof(MFTIndexData);
+        cursor = plan->index_offset + plan->index_size;
+
+        aligned = (cursor + alignment - 1) & ~(uint64_t)(alignment - 1);
+        stats->padding_bytes += aligned - cursor;
+        plan->mft_offset = aligned;
+        plan->mft_size = entry_count * MFT_ENTRY_SIZE;
+        plan->output_size = plan->mft_offset + plan->mft_size;
+
+        uint64_t kept = plan->header_size + stats->payload_bytes + index_entry->size + (uint64_t)entry_count * MFT_ENTRY_SIZE;
+        stats->dropped_bytes = input_bytes > kept ? input_bytes - kept : 0;
+        stats->alignment = alignment;
+    }
+
+    free(ranks);
+    free(sources);
+    free(groups);
+    free(placed);
+    if (!ok)
+    {
+        free_repack_plan(plan);
+    }
+    return ok;
+}
+
+static bool repack_flush(RepackWriter *writer)
+{
+    if (writer->used == 0)
+    {
+        return true;
+    }
+    if (fwrite(writer->buffer, 1, writer->used, writer->file) != writer->used)
+    {
+        perror("Error writing repacked archive");
+        return false;
+    }
+    ++writer->writes;
+    writer->used = 0;
+    return true;
+}
+
+// Hand out size bytes (at most the buffer's capacity) at the end of the buffer, flushing first if they do not fit
+static uint8_t *repack_reserve(RepackWriter *writer, uint32_t size)
+{
+    if (writer->capacity - writer->used < size && !repack_flush(writer))
+    {
+        return NULL;
+    }
+    uint8_t *space = writer->buffer + writer->used;
+    writer->used += size;
+    writer->position += size;
+    return space;
+}
+
+static bool repack_write(RepackWriter *writer, const void *data, uint64_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    while (size > 0)
+    {
+        uint32_t piece = size < writer->capacity ? (uint32_t)size : writer->capacity;
+        uint8_t *space = repack_reserve(writer, piece);
+        if (space == NULL)
+        {
+            return false;
+        }
+        memcpy(space, bytes, piece);
+        bytes += piece;
+        size -= piece;
+    }
+    return true;
+}
+
+// Zero-fill up to position, which is less than one alignment ahead; an alignment can exceed the
+// buffer, so the zeros go in pieces the way repack_write copies
+static bool repack_pad(RepackWriter *writer, uint64_t position)
+{
+    while (writer->position < position)
+    {
+        uint64_t size = position - writer->position;
+        uint32_t piece = size < writer->capacity ? (uint32_t)size : writer->capacity;
+        uint8_t *space = repack_reserve(writer, piece);
+        if (space == NULL)
+        {
+            return false;
+        }
+        memset(space, 0, piece);
+    }
+    return true;
+}
+
+// Read a payload from the input straight into the write buffer
+static bool repack_copy(RepackWriter *writer, FILE *input, uint64_t offset, uint32_t size)
+{
+    if (dat_fseek(input, (int64_t)offset, SEEK_SET) != 0)
+    {
+        fprintf(stderr, "Cannot seek to offset %llu\n", (unsigned long long)offset);
+        return false;
+    }
+    while (size > 0)
+    {
+        uint32_t piece = size < writer->capacity ? size : writer->capacity;
+        uint8_t *space = repack_reserve(writer, piece);
+        if (space == NULL || fread(space, 1, piece, input) != piece)
+        {
+            fprintf(stderr, "Short read at offset %llu\n", (unsigned long long)offset);
+            return false;
+        }
+        size -= piece;
+    }
+    return true;
+}
+
+// Ask the OS to start reading a payload that will be copied shortly
+static void repack_hint(DatFile *dat_file, FILE *input, const RepackPlan *plan, uint32_t position)
+{
+#if defined(__linux__)
+    if (position < plan->order_count)
+    {
+        const MFTData *mft_entry = &dat_file->mft_data[plan->order[position]];
+        posix_fadvise(fileno(input), (off_t)mft_entry->offset, mft_entry->size, POSIX_FADV_WILLNEED);
+    }
+#else
+    (void)dat_file;
+    (void)input;
+    (void)plan;
+    (void)position;
+#endif
+}
+
+static bool write_repacked_archive(DatFile *dat_file, FILE *input, RepackWriter *writer, const RepackPlan *plan)
+{
+    // Header, pointing at the new MFT
+    uint8_t header[REPACK_MAX_ALIGNMENT];
+    if (dat_fseek(input, 0, SEEK_SET) != 0 || fread(header, 1, plan->header_size, input) != plan->header_size)
+    {
+        fprintf(stderr, "Short read on archive header\n");
+        return false;
+    }
+    memcpy(header + REPACK_HEADER_MFT_OFFSET, &plan->mft_offset, sizeof(uint64_t));
+    memcpy(header + REPACK_HEADER_MFT_SIZE, &plan->mft_size, sizeof(uint32_t));
+    if (!repack_write(writer, header, plan->header_size))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < REPACK_READ_AHEAD; ++i)
+    {
+        repack_hint(dat_file, input, plan, i);
+    }
+    for (uint32_t i = 0; i < plan->order_count; ++i)
+    {
+        uint32_t slot = plan->order[i];
+        repack_hint(dat_file, input, plan, i + REPACK_READ_AHEAD);
+        if (!repack_pad(writer, plan->new_offsets[slot]) ||
+            !repack_copy(writer, input, dat_file->mft_data[slot].offset, dat_file->mft_data[slot].size))
+        {
+            return false;
+        }
+    }
+
+    // The index table keeps its order, since the first entry for an id wins
+    if (!repack_pad(writer, plan->index_offset) || !repack_write(writer, dat_file->mft_index_data, plan->index_size))
+    {
+        return false;
+    }
+
+    // MFT: the original MFT header as record 0, then every record with its new offset
+    uint8_t mft_header[MFT_ENTRY_SIZE];
+    if (dat_fseek(input, (int64_t)dat_file->header.mft_offset, SEEK_SET) != 0 || fread(mft_header, 1, MFT_ENTRY_SIZE, input) != MFT_ENTRY_SIZE)
+    {
+        fprintf(stderr, "Short read on MFT header\n");
+        return false;
+    }
+    if (!repack_pad(writer, plan->mft_offset) || !repack_write(writer, mft_header, MFT_ENTRY_SIZE))
+    {
+        return false;
+    }
+    for (uint32_t slot = 1; slot < dat_file->mft_header.num_entries; ++slot)
+    {
+        MFTData record = dat_file->mft_data[slot];
+        if (slot == MFT_ENTRY_INDEX_NUM)
+        {
+            record.offset = plan->index_offset;
+            record.size = plan->index_size;
+        }
+        else if (record.size > 0 && record.offset == dat_file->header.mft_offset)
+        {
+            record.offset = plan->mft_offset;
+            record.size = plan->mft_size;
+        }
+        else
+        {
+            record.offset = plan->new_offsets[slot];
+        }
+        uint8_t *space = repack_reserve(writer, MFT_ENTRY_SIZE);
+        if (space == NULL)
+        {
+            return false;
+        }
+        format_mft_record(&record, space);
+    }
+    return repack_flush(writer);
+}
+
+static bool repack_to_file(DatFile *dat_file, const char *output_path, const RepackOptions *options, const RepackPlan *plan, RepackStats *stats)
+{
+    FILE *input = fopen(dat_file->file_path, "rb");
+    FILE *output = fopen(output_path, "wb");
+    RepackWriter writer;
+    memset(&writer, 0, sizeof(RepackWriter));
+    writer.file = output;
+    writer.capacity = options->write_buffer_size ? options->write_buffer_size : REPACK_DEFAULT_WRITE_BUFFER;
+    writer.capacity = writer.capacity < REPACK_MIN_WRITE_BUFFER ? REPACK_MIN_WRITE_BUFFER : writer.capacity;
+    writer.buffer = (uint8_t *)malloc(writer.capacity);
+
+    bool ok = input != NULL && output != NULL && writer.buffer != NULL;
+    if (!ok)
+    {
+        perror(input == NULL ? dat_file->file_path : output_path);
+    }
+    else
+    {
+        // Both sides go through our own buffer, and the whole output is reserved up front so the
+        // filesystem can lay it out in as few extents as it can
+        setvbuf(input, NULL, _IONBF, 0);
+        setvbuf(output, NULL, _IONBF, 0);
+#if defined(__linux__)
+        int result = posix_fallocate(fileno(output), 0, (off_t)plan->output_size);
+        if (result != 0 && result != EINVAL && result != EOPNOTSUPP)
+        {
+            fprintf(stderr, "%s: %s\n", output_path, strerror(result));
+            ok = false;
+        }
+#endif
+        ok = ok && write_repacked_archive(dat_file, input, &writer, plan);
+        if (ok && writer.position != plan->output_size)
+        {
+            fprintf(stderr, "Repacked archive came out at %llu bytes instead of %llu\n", (unsigned long long)writer.position,
+                    (unsigned long long)plan->output_size);
+            ok = false;
+        }
+    }
+
+    stats->writes = writer.writes;
+    stats->output_bytes = writer.position;
+    free(writer.buffer);
+    if (input != NULL)
+    {
+        fclose(input);
+    }
+    if (output != NULL && fclose(output) != 0)
+    {
+        perror(output_path);
+        ok = false;
+    }
+    if (!ok && output != NULL)
+    {
+        remove(output_path);
+    }
+    return ok;
+}
+
+bool repack_dat_file(const char *input_path, const char *output_path, const RepackOptions *options, RepackStats *stats)
+{
+    RepackStats local_stats;
+    if (stats == NULL)
+    {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(RepackStats));
+
+    DatFile input;
+    memset(&input, 0, sizeof(DatFile));
+    if (!load_dat_file_ex(input_path, &input, DAT_OPEN_LAZY))
+    {
+        return false;
+    }
+    FILE *file = fopen(input_path, "rb");
+    stats->input_bytes = file != NULL ? file_size_of(file) : 0;
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    stats->slots = input.mft_header.num_entries;
+
+    uint32_t *ids = NULL;
+    uint32_t count = 0;
+    const AccessTrace *trace = options->order == REPACK_ORDER_TRACE ? options->trace : NULL;
+    bool ok = input.mft_header.num_entries > MFT_ENTRY_INDEX_NUM && ensure_mft_index(&input) &&
+              collect_access_sequence(&input, trace, &ids, &count) && measure_read_locality(&input, ids, count, options->timed, &stats->before);
+
+    RepackPlan plan;
+    memset(&plan, 0, sizeof(RepackPlan));
+    uint64_t start = prefetch_now_nanoseconds();
+    ok = ok && plan_repack(&input, options, stats->input_bytes, &plan, stats) && repack_to_file(&input, output_path, options, &plan, stats);
+    stats->nanoseconds = prefetch_now_nanoseconds() - start;
+    free_repack_plan(&plan);
+    close_dat_file(&input);
+
+    // Read the result back through the normal loader and measure the same sequence on it
+    if (ok)
+    {
+        DatFile output;
+        memset(&output, 0, sizeof(DatFile));
+        ok = load_dat_file_ex(output_path, &output, DAT_OPEN_LAZY) && ensure_mft_index(&output) &&
+             measure_read_locality(&output, ids, count, options->timed, &stats->after);
+        close_dat_file(&output);
+    }
+    free(ids);
+    return ok;
+}
+
+static void print_locality_row(const char *label, const ReadLocality *locality)
+{
+    printf("  %-20s %llu reads, %.1f%% sequential, %.1f MB seeked, %.1f MB span", label, (unsigned long long)locality->reads,
+           locality->reads > 1 ? 100.0 * locality->sequential_reads / (locality->reads - 1) : 0.0, locality->seek_bytes / 1048576.0,
+           locality->span_bytes / 1048576.0);
+    if (locality->nanoseconds > 0)
+    {
+        printf(", cold read %.1f MB/s", locality->bytes / 1048576.0 / (locality->nanoseconds / 1e9));
+    }
+    printf("\n");
+}
+
+void print_repack_report(const RepackStats *stats)
+{
+    printf("Repack Report:\n");
+    printf("  MFT slots:           %u\n", stats->slots);
+    printf("  Payloads copied:     %llu (%.1f MB, %llu traced, %llu slots sharing one)\n", (unsigned long long)stats->payloads,
+           stats->payload_bytes / 1048576.0, (unsigned long long)stats->traced, (unsigned long long)stats->shared_slots);
+    printf("  Archive size:        %.1f MB -> %.1f MB (%.1f MB unreferenced dropped, %.1f KB padding at %u-byte alignment)\n",
+           stats->input_bytes / 1048576.0, stats->output_bytes / 1048576.0, stats->dropped_bytes / 1048576.0, stats->padding_bytes / 1024.0,
+           stats->alignment);
+    double seconds = stats->nanoseconds / 1e9;
+    printf("  Writes:              %llu (%.1f MB average), %.1f MB/s\n", (unsigned long long)stats->writes,
+           stats->writes ? stats->output_bytes / 1048576.0 / stats->writes : 0.0, seconds > 0 ? stats->output_bytes / 1048576.0 / seconds : 0.0);
+    print_locality_row("Locality before:", &stats->before);
+    print_locality_row("Locality after:", &stats->after);
+}
@@ -0,0 +1,261 @@
+#include "seekindex.h"
+
+void init_seek_index_store(SeekIndexStore *store, uint32_t interval, size_t max_bytes)
+{
+    memset(store, 0, sizeof(SeekIndexStore));
+    store->interval = interval ? interval : SEEK_INDEX_DEFAULT_INTERVAL;
+    store->max_bytes = max_bytes ? max_bytes : SEEK_INDEX_DEFAULT_BYTES;
+    mtx_init(&store->mutex, mtx_plain);
+}
+
+static void free_seek_index_entry(SeekIndexEntry *entry)
+{
+    free_checkpoint_index(&entry->checkpoints);
+    free(entry);
+}
+
+// The lookups and updates below are called with the store's mutex held
+
+static uint32_t seek_index_bucket(uint32_t mft_slot)
+{
+    return hash_mft_id(mft_slot) & (SEEK_INDEX_BUCKETS - 1);
+}
+
+static SeekIndexEntry *find_seek_index_entry(SeekIndexStore *store, uint32_t mft_slot)
+{
+    SeekIndexEntry *entry = store->buckets[seek_index_bucket(mft_slot)];
+    while (entry != NULL && entry->mft_slot != mft_slot)
+    {
+        entry = entry->bucket_next;
+    }
+    return entry;
+}
+
+static void unlink_seek_index_entry(SeekIndexStore *store, SeekIndexEntry *entry)
+{
+    if (entry->prev)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        store->head = entry->next;
+    }
+
+    if (entry->next)
+    {
+        entry->next->prev = entry->prev;
+    }
+    else
+    {
+        store->tail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
+
+static void push_seek_index_entry(SeekIndexStore *store, SeekIndexEntry *entry)
+{
+    entry->prev = NULL;
+    entry->next = store->head;
+    if (store->head)
+    {
+        store->head->prev = entry;
+    }
+    store->head = entry;
+    if (store->tail == NULL)
+    {
+        store->tail = entry;
+    }
+}
+
+// Take an entry out of the store; a pinned one is freed by its last unpin
+static void evict_seek_index_entry(SeekIndexStore *store, SeekIndexEntry *entry)
+{
+    SeekIndexEntry **link = &store->buckets[seek_index_bucket(entry->mft_slot)];
+    while (*link != entry)
+    {
+        link = &(*link)->bucket_next;
+    }
+    *link = entry->bucket_next;
+    unlink_seek_index_entry(store, entry);
+    store->bytes -= entry->bytes;
+    if (entry->pins > 0)
+    {
+        entry->detached = true;
+        return;
+    }
+    free_seek_index_entry(entry);
+}
+
+// Takes ownership of entry on success; entries larger than the whole budget are not kept
+static bool add_seek_index_entry(SeekIndexStore *store, SeekIndexEntry *entry)
+{
+    entry->bytes = sizeof(SeekIndexEntry) + (size_t)entry->checkpoints.capacity * sizeof(DecodeCheckpoint);
+    for (uint32_t i = 0; i < entry->checkpoints.count; ++i)
+    {
+        entry->bytes += entry->checkpoints.checkpoints[i].window_size;
+    }
+    if (entry->bytes > store->max_bytes)
+    {
+        return false;
+    }
+
+    while (store->tail != NULL && store->bytes + entry->bytes > store->max_bytes)
+    {
+        evict_seek_index_entry(store, store->tail);
+    }
+
+    uint32_t bucket = seek_index_bucket(entry->mft_slot);
+    entry->bucket_next = store->buckets[bucket];
+    store->buckets[bucket] = entry;
+    push_seek_index_entry(store, entry);
+    store->bytes += entry->bytes;
+    return true;
+}
+
+static void unpin_seek_index_entry(SeekIndexEntry *entry)
+{
+    if (--entry->pins == 0 && entry->detached)
+    {
+        free_seek_index_entry(entry);
+    }
+}
+
+void free_seek_index_store(SeekIndexStore *store)
+{
+    while (store->head != NULL)
+    {
+        evict_seek_index_entry(store, store->head);
+    }
+    mtx_destroy(&store->mutex);
+    memset(store, 0, sizeof(SeekIndexStore));
+}
+
+bool remove_seek_index_entry(SeekIndexStore *store, uint32_t mft_slot)
+{
+    mtx_lock(&store->mutex);
+    SeekIndexEntry *entry = find_seek_index_entry(store, mft_slot);
+    if (entry != NULL)
+    {
+        evict_seek_index_entry(store, entry);
+    }
+    mtx_unlock(&store->mutex);
+    return entry != NULL;
+}
+
+uint8_t *extract_mft_range(DatFile *dat_file, SeekIndexStore *store, uint32_t number, uint32_t offset, uint32_t length, uint32_t *range_length)
+{
+    uint32_t mft_slot = 0;
+    MFTData *mft_entry = NULL;
+    if (!find_mft_slot(dat_file, number, &mft_slot) || (mft_entry = get_mft_entry(dat_file, mft_slot)) == NULL)
+    {
+        fprintf(stderr, "MFT entry not found!\n");
+        return NULL;
+    }
+
+    uint8_t *compressed_data = (uint8_t *)buffer_alloc(mft_entry->size);
+    if (compressed_data == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for compressed data\n");
+        return NULL;
+    }
+
+    FILE *file = fopen(dat_file->file_path, "rb");
+    if (!file)
+    {
+        perror("Error opening file");
+        buffer_free(compressed_data);
+        return NULL;
+    }
+    dat_fseek(file, mft_entry->offset, SEEK_SET);
+    size_t read_size = fread(compressed_data, 1, mft_entry->size, file);
+    fclose(file);
+    if (read_size != mft_entry->size)
+    {
+        fprintf(stderr, "Short read of MFT slot %u\n", mft_slot);
+        buffer_free(compressed_data);
+        return NULL;
+    }
+
+    return decode_mft_range(store, mft_slot, mft_entry, compressed_data, offset, length, range_length);
+}
+
+uint8_t *decode_mft_range(SeekIndexStore *store, uint32_t mft_slot, const MFTData *mft_entry, uint8_t *compressed_data,
+                          uint32_t offset, uint32_t length, uint32_t *range_length)
+{
+    // Stored entries are sliced directly
+    if (mft_entry->compression_flag == 0)
+    {
+        uint32_t available = offset < mft_entry->size ? mft_entry->size - offset : 0;
+        *range_length = length < available ? length : available;
+        memmove(compressed_data, compressed_data + (available ? offset : 0), *range_length);
+        return compressed_data;
+    }
+
+    mtx_lock(&store->mutex);
+    SeekIndexEntry *entry = find_seek_index_entry(store, mft_slot);
+    if (entry != NULL)
+    {
+        ++entry->pins;
+        unlink_seek_index_entry(store, entry);
+        push_seek_index_entry(store, entry);
+    }
+    mtx_unlock(&store->mutex);
+
+    if (entry == NULL)
+    {
+        // Decode the whole entry without the lock, then publish its checkpoints unless another
+        // reader of the same entry got there first
+        entry = (SeekIndexEntry *)calloc(1, sizeof(SeekIndexEntry));
+        if (entry == NULL)
+        {
+            buffer_free(compressed_data);
+            return NULL;
+        }
+        entry->mft_slot = mft_slot;
+
+        uint8_t *decompressed_data = decompress_data_indexed(compressed_data, mft_entry->size, NULL, store->interval, &entry->checkpoints);
+        buffer_free(compressed_data);
+        if (decompressed_data == NULL)
+        {
+            free_seek_index_entry(entry);
+            return NULL;
+        }
+
+        // The full decode already has the range, no need to decode it again
+        uint32_t decompressed_size = entry->checkpoints.decompressed_size;
+        mtx_lock(&store->mutex);
+        if (find_seek_index_entry(store, mft_slot) == NULL && add_seek_index_entry(store, entry))
+        {
+            entry = NULL;
+        }
+        mtx_unlock(&store->mutex);
+        if (entry != NULL)
+        {
+            free_seek_index_entry(entry);
+        }
+
+        uint32_t available = offset < decompressed_size ? decompressed_size - offset : 0;
+        *range_length = length < available ? length : available;
+        memmove(decompressed_data, decompressed_data + (available ? offset : 0), *range_length);
+        return decompressed_data;
+    }
+
+    uint32_t decompressed_size = entry->checkpoints.decompressed_size;
+    uint32_t available = offset < decompressed_size ? decompressed_size - offset : 0;
+    *range_length = length < available ? length : available;
+
+    uint8_t *range_data = (uint8_t *)buffer_alloc(*range_length);
+    bool decoded = range_data != NULL &&
+                   decompress_range(compressed_data, mft_entry->size, &entry->checkpoints, available ? offset : 0, *range_length, range_data);
+    buffer_free(compressed_data);
+    mtx_lock(&store->mutex);
+    unpin_seek_index_entry(entry);
+    mtx_unlock(&store->mutex);
+    if (!decoded)
+    {
+        buffer_free(range_data);
+        return NULL;
+    }
+    return range_data;
+}
@@ -0,0 +1,1380 @@
+// accept4
+#define _GNU_SOURCE
+
+#include "server.h"
+#include "transcode.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef enum
+{
+    SOURCE_UNIX_LISTENER,
+    SOURCE_HTTP_LISTENER,
+    SOURCE_COMPLETIONS,
+    SOURCE_SIGNALS,
+    SOURCE_CONNECTION
+} EventSourceKind;
+
+// First member of everything registered with epoll
+typedef struct
+{
+    EventSourceKind kind;
+    int fd;
+} EventSource;
+
+typedef enum
+{
+    SEGMENT_BUFFER, // bytes in memory
+    SEGMENT_INLINE, // a short record header stored in the segment itself
+    SEGMENT_FILE    // bytes of the archive, sent with sendfile
+} ReplySegmentKind;
+
+typedef struct
+{
+    ReplySegmentKind kind;
+    const uint8_t *data;
+    uint64_t file_offset;
+    uint64_t size;
+    uint8_t *owned;          // released with buffer_free once sent
+    EntryCacheNode *pinned;  // unpinned once sent
+    char inline_data[32];
+} ReplySegment;
+
+typedef struct
+{
+    char header[256];
+    ReplySegment *segments;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t current; // segment being sent
+    uint64_t sent;    // bytes of the current segment already sent
+    bool close_after;
+} Reply;
+
+typedef enum
+{
+    PROTOCOL_LINE,
+    PROTOCOL_HTTP
+} Protocol;
+
+typedef enum
+{
+    REQUEST_ENTRY,
+    REQUEST_BYTES,
+    REQUEST_SNIFF,
+    REQUEST_ID_RANGE,
+    REQUEST_QUIT,
+    REQUEST_INVALID
+} RequestKind;
+
+typedef struct
+{
+    RequestKind kind;
+    Protocol protocol;
+    uint32_t id;
+    uint32_t last_id;
+    uint32_t offset;
+    uint32_t length;
+    bool close_after;
+} Request;
+
+typedef struct Connection
+{
+    EventSource source;
+    char input[SERVER_MAX_REQUEST];
+    uint32_t input_length;
+    bool busy;    // a worker owns the request, or its reply is being written
+    bool writing; // waiting for EPOLLOUT
+    bool closing; // the peer went away while a worker had the request
+    bool input_closed; // the peer shut down its side; answer what is buffered, then close
+    Request request;
+    Reply reply;
+    struct Connection *next; // job queue or completion list
+} Connection;
+
+typedef struct
+{
+    atomic_uint_least64_t connections;
+    atomic_uint_least64_t requests;
+    atomic_uint_least64_t errors;
+    atomic_uint_least64_t cache_hits;
+    atomic_uint_least64_t cache_misses;
+    atomic_uint_least64_t sendfile_bytes;
+    atomic_uint_least64_t buffer_bytes;
+} ServerStats;
+
+typedef struct
+{
+    WackoArchive *archive;
+    int dat_fd;
+    EntryCache cache;
+    mtx_t cache_mutex;
+    ServerStats stats;
+
+    int epoll_fd;
+    EventSource unix_listener;
+    EventSource http_listener;
+    EventSource completions; // eventfd written by workers
+    EventSource signals;
+    const char *socket_path;
+
+    mtx_t job_mutex;
+    cnd_t job_ready;
+    Connection *job_head;
+    Connection *job_tail;
+    bool stopping;
+    thrd_t *workers;
+    uint32_t worker_count;
+
+    mtx_t done_mutex;
+    Connection *done_head;
+} Server;
+
+// --- Replies ---
+
+static ReplySegment *reply_add_segment(Reply *reply, ReplySegmentKind kind)
+{
+    if (reply->count == reply->capacity)
+    {
+        uint32_t capacity = reply->capacity ? reply->capacity * 2 : 4;
+        ReplySegment *segments = (ReplySegment *)realloc(reply->segments, capacity * sizeof(ReplySegment));
+        if (segments == NULL)
+        {
+            return NULL;
+        }
+        reply->segments = segments;
+        reply->capacity = capacity;
+    }
+
+    ReplySegment *segment = &reply->segments[reply->count++];
+    memset(segment, 0, sizeof(ReplySegment));
+    segment->kind = kind;
+    return segment;
+}
+
+static uint64_t reply_body_size(const Reply *reply)
+{
+    uint64_t size = 0;
+    for (uint32_t i = 1; i < reply->count; ++i)
+    {
+        size += reply->segments[i].size;
+    }
+    return size;
+}
+
+// Release whatever the segments hold; the caller holds the cache lock for pinned nodes
+static void reply_release(Server *server, Reply *reply)
+{
+    bool pinned = false;
+    for (uint32_t i = 0; i < reply->count; ++i)
+    {
+        buffer_free(reply->segments[i].owned);
+        pinned |= reply->segments[i].pinned != NULL;
+    }
+
+    if (pinned)
+    {
+        mtx_lock(&server->cache_mutex);
+        for (uint32_t i = 0; i < reply->count; ++i)
+        {
+            if (reply->segments[i].pinned != NULL)
+            {
+                entry_cache_unpin(&server->cache, reply->segments[i].pinned);
+            }
+        }
+        mtx_unlock(&server->cache_mutex);
+    }
+
+    reply->count = 0;
+    reply->current = 0;
+    reply->sent = 0;
+}
+
+// Segment 0 is the status header, filled in once the body size is known
+static void reply_begin(Reply *reply, const Request *request)
+{
+    reply->count = 0;
+    reply->current = 0;
+    reply->sent = 0;
+    reply->close_after = request->close_after;
+    reply_add_segment(reply, SEGMENT_BUFFER);
+}
+
+static void reply_finish(Reply *reply, const Request *request)
+{
+    uint64_t size = reply_body_size(reply);
+    int length = 0;
+    if (request->protocol == PROTOCOL_HTTP)
+    {
+        length = snprintf(reply->header, sizeof(reply->header),
+                          "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %llu\r\n%s\r\n",
+                          (unsigned long long)size, reply->close_after ? "Connection: close\r\n" : "");
+    }
+    else
+    {
+        length = snprintf(reply->header, sizeof(reply->header), "OK %llu\n", (unsigned long long)size);
+    }
+    reply->segments[0].data = (const uint8_t *)reply->header;
+    reply->segments[0].size = (uint64_t)length;
+}
+
+// Replace whatever was built so far with an error
+static void reply_error(Server *server, Reply *reply, const Request *request, int http_status, const char *message)
+{
+    reply_release(server, reply);
+    reply_add_segment(reply, SEGMENT_BUFFER);
+    atomic_fetch_add(&server->stats.errors, 1);
+
+    int length = 0;
+    if (request->protocol == PROTOCOL_HTTP)
+    {
+        const char *reason = http_status == 404 ? "Not Found" : http_status == 400 ? "Bad Request" : "Internal Server Error";
+        length = snprintf(reply->header, sizeof(reply->header),
+                          "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n%s\r\n%s\n",
+                          http_status, reason, strlen(message) + 1, reply->close_after ? "Connection: close\r\n" : "", message);
+    }
+    else
+    {
+        length = snprintf(reply->header, sizeof(reply->header), "ERR %s\n", message);
+    }
+    reply->segments[0].data = (const uint8_t *)reply->header;
+    reply->segments[0].size = (uint64_t)length;
+}
+
+static int status_to_http(WackoStatus status)
+{
+    if (status == WACKO_ERROR_NOT_FOUND)
+    {
+        return 404;
+    }
+    return status == WACKO_ERROR_INVALID_ARGUMENT ? 400 : 500;
+}
+
+// --- Shared cache ---
+
+// A cached entry is only good for the record it was decoded from; after a patch a decode of the
+// old record can land in the cache once a reload has already evicted the slot
+static bool cached_record_matches(const EntryCacheNode *node, const WackoEntryInfo *info)
+{
+    return node->record_offset == info->offset && node->record_size == info->size && node->record_crc == info->crc;
+}
+
+// Return the decompressed entry pinned in the shared cache, decompressing it on a miss. Entries too
+// large for the cache come back in *uncached instead, owned by the caller.
+static WackoStatus acquire_entry(Server *server, uint32_t id, const WackoEntryInfo *info, EntryCacheNode **node, uint8_t **uncached,
+                                 uint32_t *uncached_size)
+{
+    *node = NULL;
+    *uncached = NULL;
+
+    mtx_lock(&server->cache_mutex);
+    EntryCacheNode *cached = entry_cache_find(&server->cache, info->mft_slot);
+    if (cached != NULL && cached_record_matches(cached, info))
+    {
+        entry_cache_pin(&server->cache, cached);
+        mtx_unlock(&server->cache_mutex);
+        atomic_fetch_add(&server->stats.cache_hits, 1);
+        *node = cached;
+        return WACKO_OK;
+    }
+    if (cached != NULL)
+    {
+        entry_cache_evict(&server->cache, cached);
+    }
+    mtx_unlock(&server->cache_mutex);
+    atomic_fetch_add(&server->stats.cache_misses, 1);
+
+    uint8_t *data = NULL;
+    uint32_t size = 0;
+    WackoEntryInfo decoded;
+    WackoStatus status = wacko_extract_with_info(server->archive, id, &decoded, &data, &size);
+    if (status != WACKO_OK)
+    {
+        return status;
+    }
+
+    mtx_lock(&server->cache_mutex);
+    if (size > server->cache.max_bytes || decoded.mft_slot != info->mft_slot)
+    {
+        mtx_unlock(&server->cache_mutex);
+        *uncached = data;
+        *uncached_size = size;
+        return WACKO_OK;
+    }
+
+    // Another worker may have inserted it meanwhile; keep its copy unless it is of another record
+    cached = entry_cache_find(&server->cache, info->mft_slot);
+    if (cached != NULL && !cached_record_matches(cached, &decoded))
+    {
+        entry_cache_evict(&server->cache, cached);
+        cached = NULL;
+    }
+    if (cached != NULL)
+    {
+        buffer_free(data);
+    }
+    else if (entry_cache_insert(&server->cache, info->mft_slot, data, size, false))
+    {
+        cached = entry_cache_find(&server->cache, info->mft_slot);
+        cached->record_offset = decoded.offset;
+        cached->record_size = decoded.size;
+        cached->record_crc = decoded.crc;
+    }
+    if (cached != NULL)
+    {
+        entry_cache_pin(&server->cache, cached);
+        *node = cached;
+    }
+    mtx_unlock(&server->cache_mutex);
+    return cached != NULL ? WACKO_OK : WACKO_ERROR_OUT_OF_MEMORY;
+}
+
+// Drop the cached copies of entries a live reload found changed; pinned ones go with their last reply
+static uint32_t evict_reloaded_entries(void *context, const uint32_t *mft_slots, uint32_t count)
+{
+    Server *server = (Server *)context;
+    uint32_t dropped = 0;
+    mtx_lock(&server->cache_mutex);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        EntryCacheNode *node = entry_cache_find(&server->cache, mft_slots[i]);
+        if (node != NULL)
+        {
+            entry_cache_evict(&server->cache, node);
+            ++dropped;
+        }
+    }
+    mtx_unlock(&server->cache_mutex);
+    return dropped;
+}
+
+// Append bytes [offset, offset + length) of an entry to the reply
+static WackoStatus append_entry(Server *server, Reply *reply, uint32_t id, const WackoEntryInfo *info, uint32_t offset, uint32_t length)
+{
+    // Stored entries go straight from the archive to the socket
+    if (!info->compressed)
+    {
+        uint32_t available = offset < info->size ? info->size - offset : 0;
+        ReplySegment *segment = reply_add_segment(reply, SEGMENT_FILE);
+        if (segment == NULL)
+        {
+            return WACKO_ERROR_OUT_OF_MEMORY;
+        }
+        segment->file_offset = info->offset + (available ? offset : 0);
+        segment->size = length < available ? length : available;
+        return WACKO_OK;
+    }
+
+    EntryCacheNode *node = NULL;
+    uint8_t *uncached = NULL;
+    uint32_t size = 0;
+    WackoStatus status = acquire_entry(server, id, info, &node, &uncached, &size);
+    if (status != WACKO_OK)
+    {
+        return status;
+    }
+
+    ReplySegment *segment = reply_add_segment(reply, SEGMENT_BUFFER);
+    if (segment == NULL)
+    {
+        buffer_free(uncached);
+        if (node != NULL)
+        {
+            mtx_lock(&server->cache_mutex);
+            entry_cache_unpin(&server->cache, node);
+            mtx_unlock(&server->cache_mutex);
+        }
+        return WACKO_ERROR_OUT_OF_MEMORY;
+    }
+
+    const uint8_t *data = node != NULL ? node->data : uncached;
+    size = node != NULL ? node->size : size;
+    uint32_t available = offset < size ? size - offset : 0;
+    segment->data = data + (available ? offset : 0);
+    segment->size = length < available ? length : available;
+    segment->pinned = node;
+    segment->owned = uncached;
+    return WACKO_OK;
+}
+
+// A sniff reads only the first bytes, from the cache if the entry is there
+static WackoStatus append_sniff(Server *server, Reply *reply, uint32_t id, const WackoEntryInfo *info, uint32_t length)
+{
+    if (info->compressed)
+    {
+        mtx_lock(&server->cache_mutex);
+        bool cached = entry_cache_find(&server->cache, info->mft_slot) != NULL;
+        mtx_unlock(&server->cache_mutex);
+        if (!cached)
+        {
+            uint8_t *data = NULL;
+            uint32_t size = 0;
+            WackoStatus status = wacko_extract_prefix(server->archive, id, length, &data, &size);
+            if (status != WACKO_OK)
+            {
+                return status;
+            }
+            ReplySegment *segment = reply_add_segment(reply, SEGMENT_BUFFER);
+            if (segment == NULL)
+            {
+                buffer_free(data);
+                return WACKO_ERROR_OUT_OF_MEMORY;
+            }
+            segment->data = data;
+            segment->size = size;
+            segment->owned = data;
+            return WACKO_OK;
+        }
+    }
+    return append_entry(server, reply, id, info, 0, length);
+}
+
+static void handle_request(Server *server, Connection *connection)
+{
+    const Request *request = &connection->request;
+    Reply *reply = &connection->reply;
+    reply_begin(reply, request);
+    atomic_fetch_add(&server->stats.requests, 1);
+
+    if (request->kind == REQUEST_INVALID)
+    {
+        reply_error(server, reply, request, 400, "bad request");
+        return;
+    }
+
+    if (request->kind == REQUEST_ID_RANGE)
+    {
+        if (request->last_id < request->id || request->last_id - request->id >= SERVER_MAX_ID_RANGE)
+        {
+            reply_error(server, reply, request, 400, "id range too large");
+            return;
+        }
+
+        // Decoded records stay pinned or owned until the reply is sent; stored ones go by sendfile
+        uint64_t held_bytes = 0;
+        for (uint64_t id = request->id; id <= request->last_id; ++id)
+        {
+            WackoEntryInfo info;
+            if (wacko_lookup(server->archive, (uint32_t)id, &info) != WACKO_OK)
+            {
+                continue;
+            }
+
+            ReplySegment *record = reply_add_segment(reply, SEGMENT_INLINE);
+            if (record == NULL)
+            {
+                reply_error(server, reply, request, 500, wacko_status_string(WACKO_ERROR_OUT_OF_MEMORY));
+                return;
+            }
+            uint32_t record_index = reply->count - 1;
+            WackoStatus status = append_entry(server, reply, (uint32_t)id, &info, 0, UINT32_MAX);
+            if (status != WACKO_OK)
+            {
+                reply_error(server, reply, request, status_to_http(status), wacko_status_string(status));
+                return;
+            }
+            record = &reply->segments[record_index];
+            const ReplySegment *body = &reply->segments[record_index + 1];
+            record->size = (uint64_t)snprintf(record->inline_data, sizeof(record->inline_data), "%u %llu\n", (uint32_t)id,
+                                              (unsigned long long)body->size);
+            held_bytes += body->kind == SEGMENT_BUFFER ? body->size : 0;
+            if (held_bytes > SERVER_MAX_RANGE_BYTES)
+            {
+                reply_error(server, reply, request, 400, "id range reply too large, ask for fewer ids");
+                return;
+            }
+        }
+        reply_finish(reply, request);
+        return;
+    }
+
+    WackoEntryInfo info;
+    WackoStatus status = wacko_lookup(server->archive, request->id, &info);
+    if (status == WACKO_OK)
+    {
+        if (request->kind == REQUEST_SNIFF)
+        {
+            status = append_sniff(server, reply, request->id, &info, request->length);
+        }
+        else
+        {
+            status = append_entry(server, reply, request->id, &info, request->offset, request->length);
+        }
+    }
+
+    if (status != WACKO_OK)
+    {
+        reply_error(server, reply, request, status_to_http(status), wacko_status_string(status));
+        return;
+    }
+    reply_finish(reply, request);
+}
+
+// --- Worker pool ---
+
+static int server_worker_main(void *argument)
+{
+    Server *server = (Server *)argument;
+
+    mtx_lock(&server->job_mutex);
+    for (;;)
+    {
+        while (server->job_head == NULL && !server->stopping)
+        {
+            cnd_wait(&server->job_ready, &server->job_mutex);
+        }
+        if (server->job_head == NULL)
+        {
+            break;
+        }
+
+        Connection *connection = server->job_head;
+        server->job_head = connection->next;
+        if (server->job_head == NULL)
+        {
+            server->job_tail = NULL;
+        }
+        mtx_unlock(&server->job_mutex);
+
+        handle_request(server, connection);
+
+        mtx_lock(&server->done_mutex);
+        connection->next = server->done_head;
+        server->done_head = connection;
+        mtx_unlock(&server->done_mutex);
+
+        uint64_t one = 1;
+        if (write(server->completions.fd, &one, sizeof(one)) < 0)
+        {
+            perror("eventfd write");
+        }
+
+        mtx_lock(&server->job_mutex);
+    }
+    mtx_unlock(&server->job_mutex);
+    return thrd_success;
+}
+
+static void queue_job(Server *server, Connection *connection)
+{
+    connection->next = NULL;
+    mtx_lock(&server->job_mutex);
+    if (server->job_tail != NULL)
+    {
+        server->job_tail->next = connection;
+    }
+    else
+    {
+        server->job_head = connection;
+    }
+    server->job_tail = connection;
+    cnd_signal(&server->job_ready);
+    mtx_unlock(&server->job_mutex);
+}
+
+// --- Request parsing ---
+
+// Parse "/entry/<id>?offset=N&length=M", "/sniff/<id>?length=N" or "/range/<first>-<last>"
+static void parse_http_target(const char *target, Request *request)
+{
+    const char *query = strchr(target, '?');
+    char *end = NULL;
+
+    if (strncmp(target, "/entry/", 7) == 0)
+    {
+        request->kind = REQUEST_ENTRY;
+        request->id = (uint32_t)strtoul(target + 7, &end, 10);
+    }
+    else if (strncmp(target, "/sniff/", 7) == 0)
+    {
+        request->kind = REQUEST_SNIFF;
+        request->id = (uint32_t)strtoul(target + 7, &end, 10);
+    }
+    else if (strncmp(target, "/range/", 7) == 0)
+    {
+        request->kind = REQUEST_ID_RANGE;
+        request->id = (uint32_t)strtoul(target + 7, &end, 10);
+        if (*end != '-')
+        {
+            request->kind = REQUEST_INVALID;
+            return;
+        }
+        request->last_id = (uint32_t)strtoul(end + 1, &end, 10);
+    }
+    else
+    {
+        request->kind = REQUEST_INVALID;
+        return;
+    }
+
+    if (end == target + 7 || (*end != '\0' && *end != '?'))
+    {
+        request->kind = REQUEST_INVALID;
+        return;
+    }
+
+    for (const char *parameter = query; parameter != NULL; parameter = strchr(parameter + 1, '&'))
+    {
+        if (strncmp(parameter + 1, "offset=", 7) == 0)
+        {
+            request->offset = (uint32_t)strtoul(parameter + 8, NULL, 10);
+            if (request->kind == REQUEST_ENTRY)
+            {
+                request->kind = REQUEST_BYTES;
+            }
+        }
+        else if (strncmp(parameter + 1, "length=", 7) == 0)
+        {
+            request->length = (uint32_t)strtoul(parameter + 8, NULL, 10);
+            if (request->kind == REQUEST_ENTRY)
+            {
+                request->kind = REQUEST_BYTES;
+            }
+        }
+    }
+}
+
+static void parse_line_request(const char *line, Request *request)
+{
+    char command[16];
+    unsigned long first = 0;
+    unsigned long second = 0;
+    unsigned long third = UINT32_MAX;
+    int consumed = 0;
+
+    if (sscanf(line, "%15s%n", command, &consumed) != 1)
+    {
+        request->kind = REQUEST_INVALID;
+        return;
+    }
+    line += consumed;
+
+    if (strcmp(command, "GET") == 0 && sscanf(line, " %lu-%lu", &first, &second) == 2)
+    {
+        request->kind = REQUEST_ID_RANGE;
+        request->id = (uint32_t)first;
+        request->last_id = (uint32_t)second;
+    }
+    else if (strcmp(command, "GET") == 0 && sscanf(line, " %lu", &first) == 1)
+    {
+        request->kind = REQUEST_ENTRY;
+        request->id = (uint32_t)first;
+    }
+    else if (strcmp(command, "READ") == 0 && sscanf(line, " %lu %lu %lu", &first, &second, &third) >= 2)
+    {
+        request->kind = REQUEST_BYTES;
+        request->id = (uint32_t)first;
+        request->offset = (uint32_t)second;
+        request->length = (uint32_t)third;
+    }
+    else if (strcmp(command, "SNIFF") == 0 && sscanf(line, " %lu %lu", &first, &second) >= 1)
+    {
+        request->kind = REQUEST_SNIFF;
+        request->id = (uint32_t)first;
+        if (second != 0)
+        {
+            request->length = (uint32_t)second;
+        }
+    }
+    else if (strcmp(command, "QUIT") == 0)
+    {
+        request->kind = REQUEST_QUIT;
+    }
+    else
+    {
+        request->kind = REQUEST_INVALID;
+    }
+}
+
+// Take one complete request off the front of the input buffer. Returns 1 if a request was parsed,
+// 0 if more input is needed and -1 if the request is too long.
+static int take_request(Connection *connection)
+{
+    char *input = connection->input;
+    char *line_end = memchr(input, '\n', connection->input_length);
+    if (line_end == NULL)
+    {
+        return connection->input_length == SERVER_MAX_REQUEST ? -1 : 0;
+    }
+
+    Request *request = &connection->request;
+    memset(request, 0, sizeof(Request));
+    request->length = UINT32_MAX;
+
+    uint32_t consumed = 0;
+    if (strncmp(input, "GET /", 5) == 0)
+    {
+        // HTTP: wait for the blank line that ends the headers
+        char *headers_end = NULL;
+        for (char *search = input; (search = memchr(search, '\n', connection->input_length - (uint32_t)(search - input))) != NULL; ++search)
+        {
+            uint32_t rest = connection->input_length - (uint32_t)(search - input);
+            if (rest >= 3 && search[1] == '\r' && search[2] == '\n')
+            {
+                headers_end = search + 3;
+                break;
+            }
+            if (rest >= 2 && search[1] == '\n')
+            {
+                headers_end = search + 2;
+                break;
+            }
+        }
+        if (headers_end == NULL)
+        {
+            return connection->input_length == SERVER_MAX_REQUEST ? -1 : 0;
+        }
+        consumed = (uint32_t)(headers_end - input);
+
+        request->protocol = PROTOCOL_HTTP;
+        char target[1024];
+        char version[16];
+        *line_end = '\0';
+        if (sscanf(input, "GET %1023s %15s", target, version) == 2)
+        {
+            parse_http_target(target, request);
+            request->close_after = strcmp(version, "HTTP/1.0") == 0;
+        }
+        else
+        {
+            request->kind = REQUEST_INVALID;
+        }
+
+        for (char *header = line_end + 1; header < headers_end; header = strchr(header, '\n') + 1)
+        {
+            if (strncasecmp(header, "Connection:", 11) == 0)
+            {
+                const char *value = header + 11;
+                while (*value == ' ')
+                {
+                    ++value;
+                }
+                request->close_after = strncasecmp(value, "close", 5) == 0 || (request->close_after && strncasecmp(value, "keep-alive", 10) != 0);
+            }
+        }
+        if (request->kind == REQUEST_SNIFF && request->length == UINT32_MAX)
+        {
+            request->length = SERVER_DEFAULT_SNIFF_BYTES;
+        }
+    }
+    else
+    {
+        consumed = (uint32_t)(line_end - input) + 1;
+        *line_end = '\0';
+        request->protocol = PROTOCOL_LINE;
+        parse_line_request(input, request);
+        if (request->kind == REQUEST_SNIFF && request->length == UINT32_MAX)
+        {
+            request->length = SERVER_DEFAULT_SNIFF_BYTES;
+        }
+    }
+
+    // Keep pipelined requests for later
+    memmove(input, input + consumed, connection->input_length - consumed);
+    connection->input_length -= consumed;
+    return 1;
+}
+
+// --- Event loop ---
+
+static void close_connection(Server *server, Connection *connection)
+{
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->source.fd, NULL);
+    close(connection->source.fd);
+    reply_release(server, &connection->reply);
+    free(connection->reply.segments);
+    free(connection);
+}
+
+static void watch_connection(Server *server, Connection *connection, uint32_t events)
+{
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = connection;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->source.fd, &event);
+}
+
+// Send as much of the reply as the socket takes. Returns 1 when done, 0 when the socket is full
+// and -1 on error.
+static int send_reply(Server *server, Connection *connection)
+{
+    Reply *reply = &connection->reply;
+    while (reply->current < reply->count)
+    {
+        ReplySegment *segment = &reply->segments[reply->current];
+        if (reply->sent == segment->size)
+        {
+            ++reply->current;
+            reply->sent = 0;
+            continue;
+        }
+
+        ssize_t written = 0;
+        uint64_t remaining = segment->size - reply->sent;
+        if (segment->kind == SEGMENT_FILE)
+        {
+            off_t offset = (off_t)(segment->file_offset + reply->sent);
+            written = sendfile(connection->source.fd, server->dat_fd, &offset, remaining < (1u << 30) ? remaining : (1u << 30));
+            if (written > 0)
+            {
+                atomic_fetch_add(&server->stats.sendfile_bytes, (uint64_t)written);
+            }
+        }
+        else
+        {
+            const uint8_t *data = segment->kind == SEGMENT_INLINE ? (const uint8_t *)segment->inline_data : segment->data;
+            // Hold back partial packets while more of the reply follows
+            int flags = MSG_NOSIGNAL | (reply->current + 1 < reply->count ? MSG_MORE : 0);
+            written = send(connection->source.fd, data + reply->sent, remaining, flags);
+            if (written > 0)
+            {
+                atomic_fetch_add(&server->stats.buffer_bytes, (uint64_t)written);
+            }
+        }
+
+        if (written < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return 0;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (written == 0)
+        {
+            return -1; // the archive is shorter than the MFT says
+        }
+        reply->sent += (uint64_t)written;
+    }
+    return 1;
+}
+
+static void process_input(Server *server, Connection *connection);
+
+// Called on the event loop thread once a worker has built the reply, and again on EPOLLOUT
+static void continue_reply(Server *server, Connection *connection)
+{
+    int result = send_reply(server, connection);
+    if (result < 0)
+    {
+        close_connection(server, connection);
+        return;
+    }
+    if (result == 0)
+    {
+        if (!connection->writing)
+        {
+            connection->writing = true;
+            watch_connection(server, connection, EPOLLOUT);
+        }
+        return;
+    }
+
+    reply_release(server, &connection->reply);
+    if (connection->reply.close_after)
+    {
+        close_connection(server, connection);
+        return;
+    }
+
+    connection->busy = false;
+    connection->writing = false;
+    watch_connection(server, connection, connection->input_closed ? 0 : EPOLLIN | EPOLLRDHUP);
+    process_input(server, connection);
+}
+
+// Hand the next buffered request to the worker pool, if there is a complete one
+static void process_input(Server *server, Connection *connection)
+{
+    if (connection->busy)
+    {
+        return;
+    }
+
+    int result = take_request(connection);
+    if (result < 0)
+    {
+        // Answer an overlong request with an error, then drop the connection
+        memset(&connection->request, 0, sizeof(Request));
+        connection->request.kind = REQUEST_INVALID;
+        connection->request.protocol = strncmp(connection->input, "GET /", 5) == 0 ? PROTOCOL_HTTP : PROTOCOL_LINE;
+        connection->request.close_after = true;
+        connection->input_length = 0;
+    }
+    else if (result == 0)
+    {
+        if (connection->input_closed)
+        {
+            close_connection(server, connection);
+        }
+        return;
+    }
+    if (connection->request.kind == REQUEST_QUIT)
+    {
+        close_connection(server, connection);
+        return;
+    }
+
+    // Stop reading until the reply is out; requests are answered in order. Hangups are still reported.
+    connection->busy = true;
+    watch_connection(server, connection, 0);
+    queue_job(server, connection);
+}
+
+static void read_connection(Server *server, Connection *connection)
+{
+    for (;;)
+    {
+        if (connection->input_length == SERVER_MAX_REQUEST)
+        {
+            break;
+        }
+        ssize_t received = recv(connection->source.fd, connection->input + connection->input_length,
+                                SERVER_MAX_REQUEST - connection->input_length, 0);
+        if (received > 0)
+        {
+            connection->input_length += (uint32_t)received;
+            continue;
+        }
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        if (received < 0)
+        {
+            close_connection(server, connection);
+            return;
+        }
+
+        connection->input_closed = true;
+        break;
+    }
+    process_input(server, connection);
+}
+
+static void accept_connections(Server *server, EventSource *listener)
+{
+    for (;;)
+    {
+        int fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                perror("accept");
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+
+        // The status header segment is always there, so replies never fail to start
+        Connection *connection = (Connection *)calloc(1, sizeof(Connection));
+        ReplySegment *segments = (ReplySegment *)calloc(4, sizeof(ReplySegment));
+        if (connection == NULL || segments == NULL)
+        {
+            free(connection);
+            free(segments);
+            close(fd);
+            continue;
+        }
+        connection->reply.segments = segments;
+        connection->reply.capacity = 4;
+        connection->source.kind = SOURCE_CONNECTION;
+        connection->source.fd = fd;
+        if (listener->kind == SOURCE_HTTP_LISTENER)
+        {
+            // Replies are written whole; waiting for delayed acks only adds latency
+            int no_delay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = connection;
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            free(segments);
+            free(connection);
+            continue;
+        }
+        atomic_fetch_add(&server->stats.connections, 1);
+    }
+}
+
+static void drain_completions(Server *server)
+{
+    uint64_t count = 0;
+    if (read(server->completions.fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    {
+        perror("eventfd read");
+    }
+
+    mtx_lock(&server->done_mutex);
+    Connection *connection = server->done_head;
+    server->done_head = NULL;
+    mtx_unlock(&server->done_mutex);
+
+    while (connection != NULL)
+    {
+        Connection *next = connection->next;
+        if (connection->closing)
+        {
+            close(connection->source.fd);
+            reply_release(server, &connection->reply);
+            free(connection->reply.segments);
+            free(connection);
+        }
+        else
+        {
+            continue_reply(server, connection);
+        }
+        connection = next;
+    }
+}
+
+static void handle_connection_event(Server *server, Connection *connection, uint32_t events)
+{
+    if (connection->busy && !connection->writing)
+    {
+        // A worker owns the connection; it is closed once the reply comes back
+        if (events & (EPOLLHUP | EPOLLERR))
+        {
+            connection->closing = true;
+            epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->source.fd, NULL);
+        }
+        return;
+    }
+
+    if (connection->writing)
+    {
+        if (events & (EPOLLHUP | EPOLLERR))
+        {
+            close_connection(server, connection);
+            return;
+        }
+        if (events & EPOLLOUT)
+        {
+            continue_reply(server, connection);
+        }
+        return;
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP))
+    {
+        read_connection(server, connection);
+    }
+}
+
+// --- Setup ---
+
+static int listen_unix(const char *path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        perror("Unix socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listen_loopback(uint16_t port)
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        perror("HTTP socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool watch_source(Server *server, EventSource *source)
+{
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = source;
+    return epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, source->fd, &event) == 0;
+}
+
+static void print_server_report(Server *server)
+{
+    ServerStats *stats = &server->stats;
+    uint64_t hits = atomic_load(&stats->cache_hits);
+    uint64_t misses = atomic_load(&stats->cache_misses);
+    printf("Server Report:\n");
+    printf("  Connections:         %llu\n", (unsigned long long)atomic_load(&stats->connections));
+    printf("  Requests:            %llu (%llu errors)\n", (unsigned long long)atomic_load(&stats->requests),
+           (unsigned long long)atomic_load(&stats->errors));
+    printf("  Cache Hits:          %llu of %llu (%.1f%%)\n", (unsigned long long)hits, (unsigned long long)(hits + misses),
+           hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+    printf("  Sent With sendfile:  %.1f MB\n", atomic_load(&stats->sendfile_bytes) / 1048576.0);
+    printf("  Sent From Memory:    %.1f MB\n", atomic_load(&stats->buffer_bytes) / 1048576.0);
+    printf("  Cached Bytes:        %zu of %zu\n", server->cache.bytes, server->cache.max_bytes);
+}
+
+int run_server(const char *file_path, const ServerOptions *options)
+{
+    if (options->socket_path == NULL && options->http_port == 0)
+    {
+        fprintf(stderr, "Nothing to listen on: give a socket path or an HTTP port\n");
+        return 1;
+    }
+
+    Server server;
+    memset(&server, 0, sizeof(Server));
+    server.unix_listener = (EventSource){SOURCE_UNIX_LISTENER, -1};
+    server.http_listener = (EventSource){SOURCE_HTTP_LISTENER, -1};
+    server.completions = (EventSource){SOURCE_COMPLETIONS, -1};
+    server.signals = (EventSource){SOURCE_SIGNALS, -1};
+    server.cache.max_bytes = options->cache_bytes ? options->cache_bytes : SERVER_DEFAULT_CACHE_BYTES;
+
+    // Signals arrive through the event loop; every thread, including the index builder, inherits the blocked mask
+    sigset_t signal_mask;
+    sigemptyset(&signal_mask);
+    sigaddset(&signal_mask, SIGINT);
+    sigaddset(&signal_mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signal_mask, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    WackoStatus status = wacko_open(file_path, WACKO_OPEN_LAZY | WACKO_OPEN_BACKGROUND_INDEX, &server.archive);
+    if (status != WACKO_OK)
+    {
+        fprintf(stderr, "%s: %s\n", file_path, wacko_status_string(status));
+        sigprocmask(SIG_UNBLOCK, &signal_mask, NULL);
+        return 1;
+    }
+    server.dat_fd = fileno(server.archive->file);
+    if (options->transcode_path != NULL && wacko_enable_transcode_cache(server.archive, options->transcode_path, 0, 0) != WACKO_OK)
+    {
+        fprintf(stderr, "Cannot open transcode cache %s\n", options->transcode_path);
+    }
+
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server.completions.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server.signals.fd = signalfd(-1, &signal_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (options->socket_path != NULL)
+    {
+        server.unix_listener.fd = listen_unix(options->socket_path);
+        server.socket_path = options->socket_path;
+    }
+    if (options->http_port != 0)
+    {
+        server.http_listener.fd = listen_loopback(options->http_port);
+    }
+
+    bool ready = server.epoll_fd >= 0 && server.completions.fd >= 0 && server.signals.fd >= 0 &&
+                 (options->socket_path == NULL || server.unix_listener.fd >= 0) &&
+                 (options->http_port == 0 || server.http_listener.fd >= 0) &&
+                 watch_source(&server, &server.completions) && watch_source(&server, &server.signals) &&
+                 (server.unix_listener.fd < 0 || watch_source(&server, &server.unix_listener)) &&
+                 (server.http_listener.fd < 0 || watch_source(&server, &server.http_listener));
+
+    mtx_init(&server.cache_mutex, mtx_plain);
+    if (ready && options->live_reload && wacko_enable_live_reload(server.archive, 0, evict_reloaded_entries, &server) != WACKO_OK)
+    {
+        fprintf(stderr, "Cannot watch %s for changes\n", file_path);
+    }
+    mtx_init(&server.job_mutex, mtx_plain);
+    mtx_init(&server.done_mutex, mtx_plain);
+    cnd_init(&server.job_ready);
+
+    uint32_t worker_count = options->workers;
+    if (worker_count == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    server.workers = (thrd_t *)calloc(worker_count, sizeof(thrd_t));
+    ready = ready && server.workers != NULL;
+    for (uint32_t i = 0; ready && i < worker_count; ++i)
+    {
+        if (thrd_create(&server.workers[i], server_worker_main, &server) != thrd_success)
+        {
+            break;
+        }
+        ++server.worker_count;
+    }
+    ready = ready && server.worker_count > 0;
+
+    if (ready)
+    {
+        printf("Serving %s with %u workers", file_path, server.worker_count);
+        if (options->socket_path != NULL)
+        {
+            printf(" on %s", options->socket_path);
+        }
+        if (options->http_port != 0)
+        {
+            printf(" on http://127.0.0.1:%u", options->http_port);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    bool running = ready;
+    while (running)
+    {
+        int count = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        // Finished replies are handled after the batch, since sending one can free a connection
+        // that still has an event further down the batch
+        bool completed = false;
+        for (int i = 0; i < count; ++i)
+        {
+            EventSource *source = (EventSource *)events[i].data.ptr;
+            switch (source->kind)
+            {
+            case SOURCE_UNIX_LISTENER:
+            case SOURCE_HTTP_LISTENER:
+                accept_connections(&server, source);
+                break;
+            case SOURCE_COMPLETIONS:
+                completed = true;
+                break;
+            case SOURCE_SIGNALS:
+            {
+                // Consume the signal so it is not delivered again once unblocked
+                struct signalfd_siginfo info;
+                if (read(server.signals.fd, &info, sizeof(info)) == sizeof(info))
+                {
+                    printf("Shutting down on signal %u\n", info.ssi_signo);
+                }
+                running = false;
+                break;
+            }
+            case SOURCE_CONNECTION:
+                handle_connection_event(&server, (Connection *)source, events[i].events);
+                break;
+            }
+        }
+        if (completed)
+        {
+            drain_completions(&server);
+        }
+    }
+
+    // Let the workers finish what they have; their connections are dropped afterwards
+    mtx_lock(&server.job_mutex);
+    server.stopping = true;
+    cnd_broadcast(&server.job_ready);
+    mtx_unlock(&server.job_mutex);
+    for (uint32_t i = 0; i < server.worker_count; ++i)
+    {
+        thrd_join(server.workers[i], NULL);
+    }
+    free(server.workers);
+
+    if (ready)
+    {
+        print_server_report(&server);
+        print_transcode_report(&server.archive->dat_file);
+        if (options->live_reload)
+        {
+            ReloadStats reload_stats;
+            get_reload_stats(server.archive->reloader, &reload_stats);
+            print_reload_report(&reload_stats);
+        }
+    }
+
+    // Connections still registered with epoll are leaked at exit; the process is going away
+    for (Connection *connection = server.done_head; connection != NULL;)
+    {
+        Connection *next = connection->next;
+        close(connection->source.fd);
+        reply_release(&server, &connection->reply);
+        free(connection->reply.segments);
+        free(connection);
+        connection = next;
+    }
+
+    if (server.unix_listener.fd >= 0)
+    {
+        close(server.unix_listener.fd);
+        unlink(server.socket_path);
+    }
+    if (server.http_listener.fd >= 0)
+    {
+        close(server.http_listener.fd);
+    }
+    close(server.completions.fd);
+    close(server.signals.fd);
+    close(server.epoll_fd);
+    sigprocmask(SIG_UNBLOCK, &signal_mask, NULL);
+
+    // Closing stops the reloader, whose callback uses the cache
+    wacko_close(server.archive);
+    entry_cache_clear(&server.cache);
+    mtx_destroy(&server.cache_mutex);
+    mtx_destroy(&server.job_mutex);
+    mtx_destroy(&server.done_mutex);
+    cnd_destroy(&server.job_ready);
+    return ready ? 0 : 1;
+}
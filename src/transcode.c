@@ -0,0 +1,762 @@
+#include "transcode.h"
+#include "prefetch.h"
+
+#define TRANSCODE_FILE_MAGIC 0x31435457u   // "WTC1"
+#define TRANSCODE_RECORD_MAGIC 0x43455254u // "TREC"
+#define TRANSCODE_FILE_VERSION 2
+#define TRANSCODE_HEADER_SIZE 16
+
+// --- Fast codec ---
+
+static uint8_t *fast_lz_write_count(uint8_t *out, uint32_t count)
+{
+    while (count >= 255)
+    {
+        *out++ = 255;
+        count -= 255;
+    }
+    *out++ = (uint8_t)count;
+    return out;
+}
+
+static uint8_t *fast_lz_write_sequence(uint8_t *out, const uint8_t *literals, uint32_t literal_count, uint32_t offset, uint32_t match_length)
+{
+    uint32_t match_code = match_length ? match_length - FAST_LZ_MIN_MATCH : 0;
+    *out++ = (uint8_t)(((literal_count < 15 ? literal_count : 15) << 4) | (match_code < 15 ? match_code : 15));
+    if (literal_count >= 15)
+    {
+        out = fast_lz_write_count(out, literal_count - 15);
+    }
+    memcpy(out, literals, literal_count);
+    out += literal_count;
+
+    if (match_length != 0)
+    {
+        *out++ = (uint8_t)offset;
+        *out++ = (uint8_t)(offset >> 8);
+        if (match_code >= 15)
+        {
+            out = fast_lz_write_count(out, match_code - 15);
+        }
+    }
+    return out;
+}
+
+uint32_t fast_lz_compress(const uint8_t *input, uint32_t size, uint8_t *output)
+{
+    // Positions + 1 of the last occurrence of each hashed 4-byte sequence
+    uint32_t *table = (uint32_t *)calloc(1u << FAST_LZ_HASH_BITS, sizeof(uint32_t));
+    if (table == NULL)
+    {
+        return fast_lz_write_sequence(output, input, size, 0, 0) - output;
+    }
+
+    uint8_t *out = output;
+    uint32_t anchor = 0;
+    uint32_t position = 0;
+    uint32_t misses = 0;
+    while (position + FAST_LZ_MIN_MATCH <= size)
+    {
+        uint32_t sequence;
+        memcpy(&sequence, input + position, sizeof(sequence));
+        uint32_t hash = (sequence * 2654435761u) >> (32 - FAST_LZ_HASH_BITS);
+        uint32_t candidate = table[hash];
+        table[hash] = position + 1;
+
+        if (candidate == 0 || position - (candidate - 1) > FAST_LZ_MAX_OFFSET || memcmp(input + candidate - 1, input + position, FAST_LZ_MIN_MATCH) != 0)
+        {
+            // Skip faster through data that does not compress
+            position += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+
+        uint32_t match = candidate - 1;
+        uint32_t length = FAST_LZ_MIN_MATCH;
+        while (position + length < size && input[match + length] == input[position + length])
+        {
+            ++length;
+        }
+
+        out = fast_lz_write_sequence(out, input + anchor, position - anchor, position - match, length);
+        position += length;
+        anchor = position;
+    }
+
+    if (anchor < size)
+    {
+        out = fast_lz_write_sequence(out, input + anchor, size - anchor, 0, 0);
+    }
+    free(table);
+    return (uint32_t)(out - output);
+}
+
+static bool fast_lz_read_count(const uint8_t **in, const uint8_t *in_end, uint32_t *count)
+{
+    uint8_t byte;
+    do
+    {
+        if (*in == in_end)
+        {
+            return false;
+        }
+        byte = *(*in)++;
+        *count += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool fast_lz_decompress(const uint8_t *input, uint32_t input_size, uint8_t *output, uint32_t output_size)
+{
+    const uint8_t *in = input;
+    const uint8_t *in_end = input + input_size;
+    uint8_t *out = output;
+    uint8_t *out_end = output + output_size;
+
+    while (in < in_end)
+    {
+        uint8_t token = *in++;
+
+        uint32_t literal_count = token >> 4;
+        if (literal_count == 15 && !fast_lz_read_count(&in, in_end, &literal_count))
+        {
+            return false;
+        }
+        if (literal_count > (size_t)(in_end - in) || literal_count > (size_t)(out_end - out))
+        {
+            return false;
+        }
+        if (literal_count <= 16 && in_end - in >= 16 && out_end - out >= 16)
+        {
+            memcpy(out, in, 16);
+        }
+        else
+        {
+            memcpy(out, in, literal_count);
+        }
+        in += literal_count;
+        out += literal_count;
+
+        // The last sequence has no match
+        if (in == in_end)
+        {
+            break;
+        }
+        if (in_end - in < 2)
+        {
+            return false;
+        }
+        uint32_t offset = in[0] | ((uint32_t)in[1] << 8);
+        in += 2;
+
+        uint32_t match_length = token & 15;
+        if (match_length == 15 && !fast_lz_read_count(&in, in_end, &match_length))
+        {
+            return false;
+        }
+        match_length += FAST_LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(out - output) || match_length > (size_t)(out_end - out))
+        {
+            return false;
+        }
+
+        const uint8_t *match = out - offset;
+        if ((size_t)(out_end - out) >= match_length + 16)
+        {
+            // Eight bytes at a time; may write past the match but never past the buffer. Short
+            // offsets repeat a pattern, so once one period of at least eight bytes is written the
+            // rest can be copied from that far back.
+            uint32_t copied = 0;
+            uint32_t distance = offset;
+            if (offset < 8)
+            {
+                distance = offset * ((8 + offset - 1) / offset);
+                for (; copied < distance; ++copied)
+                {
+                    out[copied] = match[copied];
+                }
+            }
+            for (; copied < match_length; copied += 8)
+            {
+                memcpy(out + copied, out + copied - distance, 8);
+            }
+        }
+        else
+        {
+            for (uint32_t i = 0; i < match_length; ++i)
+            {
+                out[i] = match[i];
+            }
+        }
+        out += match_length;
+    }
+    return out == out_end;
+}
+
+// --- Cache file ---
+
+static uint32_t transcode_checksum(const uint8_t *data, uint32_t size)
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+    uint32_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 0x100000001B3ull;
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static void put_uint32_le(uint8_t *out, uint32_t value)
+{
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t get_uint32_le(const uint8_t *in)
+{
+    return in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static TranscodeEntry *transcode_find(TranscodeCache *cache, uint32_t mft_slot, bool insert)
+{
+    if (insert && (cache->count + 1) * 2 > cache->mask + 1)
+    {
+        uint32_t capacity = (cache->mask + 1) * 2;
+        TranscodeEntry *entries = (TranscodeEntry *)calloc(capacity, sizeof(TranscodeEntry));
+        if (entries == NULL)
+        {
+            return NULL;
+        }
+        for (uint32_t i = 0; i <= cache->mask; ++i)
+        {
+            if (cache->entries[i].used)
+            {
+                uint32_t slot = hash_mft_id(cache->entries[i].mft_slot) & (capacity - 1);
+                while (entries[slot].used)
+                {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                entries[slot] = cache->entries[i];
+            }
+        }
+        free(cache->entries);
+        cache->entries = entries;
+        cache->mask = capacity - 1;
+    }
+
+    uint32_t slot = hash_mft_id(mft_slot) & cache->mask;
+    while (cache->entries[slot].used)
+    {
+        if (cache->entries[slot].mft_slot == mft_slot)
+        {
+            return &cache->entries[slot];
+        }
+        slot = (slot + 1) & cache->mask;
+    }
+    if (!insert)
+    {
+        return NULL;
+    }
+
+    TranscodeEntry *entry = &cache->entries[slot];
+    memset(entry, 0, sizeof(TranscodeEntry));
+    entry->used = true;
+    entry->mft_slot = mft_slot;
+    ++cache->count;
+    return entry;
+}
+
+// Whether entry was transcoded from this version of the MFT record
+static bool transcode_entry_matches(const TranscodeEntry *entry, const MFTData *mft_entry)
+{
+    return entry->mft_offset == mft_entry->offset && entry->mft_size == mft_entry->size && entry->crc == mft_entry->crc;
+}
+
+static bool write_file_header(FILE *file)
+{
+    uint8_t header[TRANSCODE_HEADER_SIZE] = {0};
+    put_uint32_le(header, TRANSCODE_FILE_MAGIC);
+    put_uint32_le(header + 4, TRANSCODE_FILE_VERSION);
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+static void encode_record(uint8_t *record, const TranscodeEntry *entry, uint32_t checksum)
+{
+    put_uint32_le(record, TRANSCODE_RECORD_MAGIC);
+    put_uint32_le(record + 4, entry->mft_slot);
+    put_uint32_le(record + 8, entry->crc);
+    put_uint32_le(record + 12, entry->mft_size);
+    put_uint32_le(record + 16, entry->uncompressed_size);
+    put_uint32_le(record + 20, entry->stored_size);
+    put_uint32_le(record + 24, entry->codec);
+    put_uint32_le(record + 28, checksum);
+    put_uint32_le(record + 32, (uint32_t)entry->original_decode_nanoseconds);
+    put_uint32_le(record + 36, (uint32_t)(entry->original_decode_nanoseconds >> 32));
+    put_uint32_le(record + 40, (uint32_t)entry->mft_offset);
+    put_uint32_le(record + 44, (uint32_t)(entry->mft_offset >> 32));
+}
+
+// Index every record of the file; a later record for the same slot replaces an earlier one. The scan
+// stops at the first damaged or truncated record, and new records are written from there.
+static bool scan_cache_file(TranscodeCache *cache)
+{
+    uint8_t header[TRANSCODE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), cache->file) != sizeof(header) || get_uint32_le(header) != TRANSCODE_FILE_MAGIC ||
+        get_uint32_le(header + 4) != TRANSCODE_FILE_VERSION)
+    {
+        return false;
+    }
+
+    dat_fseek(cache->file, 0, SEEK_END);
+    uint64_t file_size = (uint64_t)dat_ftell(cache->file);
+    uint64_t position = TRANSCODE_HEADER_SIZE;
+    dat_fseek(cache->file, (int64_t)position, SEEK_SET);
+
+    uint8_t record[TRANSCODE_RECORD_SIZE];
+    while (position + TRANSCODE_RECORD_SIZE <= file_size && fread(record, 1, sizeof(record), cache->file) == sizeof(record))
+    {
+        uint32_t stored_size = get_uint32_le(record + 20);
+        uint32_t codec = get_uint32_le(record + 24);
+        if (get_uint32_le(record) != TRANSCODE_RECORD_MAGIC || codec > TRANSCODE_CODEC_FAST_LZ ||
+            position + TRANSCODE_RECORD_SIZE + stored_size > file_size)
+        {
+            break;
+        }
+
+        TranscodeEntry *entry = transcode_find(cache, get_uint32_le(record + 4), true);
+        if (entry == NULL)
+        {
+            return false;
+        }
+        entry->crc = get_uint32_le(record + 8);
+        entry->mft_size = get_uint32_le(record + 12);
+        entry->uncompressed_size = get_uint32_le(record + 16);
+        entry->stored_size = stored_size;
+        entry->codec = (uint8_t)codec;
+        entry->offset = position + TRANSCODE_RECORD_SIZE;
+        entry->original_decode_nanoseconds = get_uint32_le(record + 32) | ((uint64_t)get_uint32_le(record + 36) << 32);
+        entry->mft_offset = get_uint32_le(record + 40) | ((uint64_t)get_uint32_le(record + 44) << 32);
+        entry->stored = true;
+
+        position += TRANSCODE_RECORD_SIZE + stored_size;
+        dat_fseek(cache->file, (int64_t)position, SEEK_SET);
+    }
+
+    cache->file_bytes = position;
+    return true;
+}
+
+static int compare_recency(const void *a, const void *b)
+{
+    const TranscodeEntry *left = *(const TranscodeEntry *const *)a;
+    const TranscodeEntry *right = *(const TranscodeEntry *const *)b;
+    if (left->last_used != right->last_used)
+    {
+        return left->last_used > right->last_used ? -1 : 1;
+    }
+    // Never used this session: keep the most recently written
+    return left->offset > right->offset ? -1 : left->offset < right->offset;
+}
+
+// Rewrite the file with the most recently used entries that fit in target_bytes
+static bool compact_cache_file(TranscodeCache *cache, uint64_t target_bytes)
+{
+    uint32_t stored = 0;
+    for (uint32_t i = 0; i <= cache->mask; ++i)
+    {
+        stored += cache->entries[i].used && cache->entries[i].stored;
+    }
+
+    TranscodeEntry **order = (TranscodeEntry **)malloc((stored ? stored : 1) * sizeof(TranscodeEntry *));
+    size_t path_length = strlen(cache->path);
+    char *temporary_path = (char *)malloc(path_length + 5);
+    if (order == NULL || temporary_path == NULL)
+    {
+        free(order);
+        free(temporary_path);
+        return false;
+    }
+    memcpy(temporary_path, cache->path, path_length);
+    memcpy(temporary_path + path_length, ".tmp", 5);
+
+    stored = 0;
+    for (uint32_t i = 0; i <= cache->mask; ++i)
+    {
+        if (cache->entries[i].used && cache->entries[i].stored)
+        {
+            order[stored++] = &cache->entries[i];
+        }
+    }
+    qsort(order, stored, sizeof(TranscodeEntry *), compare_recency);
+
+    FILE *compacted = fopen(temporary_path, "w+b");
+    bool ok = compacted != NULL && write_file_header(compacted);
+    uint64_t position = TRANSCODE_HEADER_SIZE;
+    for (uint32_t i = 0; ok && i < stored; ++i)
+    {
+        TranscodeEntry *entry = order[i];
+        uint64_t record_bytes = TRANSCODE_RECORD_SIZE + (uint64_t)entry->stored_size;
+        if (position + record_bytes > target_bytes)
+        {
+            entry->stored = false;
+            entry->reads = 0;
+            continue;
+        }
+
+        uint8_t record[TRANSCODE_RECORD_SIZE];
+        uint8_t *payload = (uint8_t *)buffer_alloc(entry->stored_size ? entry->stored_size : 1);
+        ok = payload != NULL && dat_fseek(cache->file, (int64_t)entry->offset - TRANSCODE_RECORD_SIZE, SEEK_SET) == 0 &&
+             fread(record, 1, sizeof(record), cache->file) == sizeof(record) &&
+             fread(payload, 1, entry->stored_size, cache->file) == entry->stored_size &&
+             fwrite(record, 1, sizeof(record), compacted) == sizeof(record) &&
+             fwrite(payload, 1, entry->stored_size, compacted) == entry->stored_size;
+        buffer_free(payload);
+        entry->offset = position + TRANSCODE_RECORD_SIZE;
+        position += record_bytes;
+    }
+    ok = ok && fflush(compacted) == 0;
+    free(order);
+
+    if (compacted != NULL)
+    {
+        fclose(compacted);
+    }
+    if (!ok)
+    {
+        remove(temporary_path);
+        free(temporary_path);
+        return false;
+    }
+
+    // rename cannot replace an open or existing file everywhere
+    fclose(cache->file);
+    remove(cache->path);
+    ok = rename(temporary_path, cache->path) == 0;
+    free(temporary_path);
+    cache->file = fopen(cache->path, "r+b");
+    if (!ok || cache->file == NULL)
+    {
+        return false;
+    }
+    cache->file_bytes = position;
+    ++cache->stats.compactions;
+    return true;
+}
+
+bool enable_transcode_cache(DatFile *dat_file, const char *path, uint64_t max_bytes, uint32_t admit_reads)
+{
+    if (dat_file->transcode_cache != NULL || path == NULL)
+    {
+        return false;
+    }
+
+    TranscodeCache *cache = (TranscodeCache *)calloc(1, sizeof(TranscodeCache));
+    if (cache == NULL)
+    {
+        return false;
+    }
+    cache->max_bytes = max_bytes ? max_bytes : TRANSCODE_DEFAULT_BYTES;
+    cache->admit_reads = admit_reads ? admit_reads : TRANSCODE_DEFAULT_ADMIT_READS;
+    cache->mask = 255;
+    cache->entries = (TranscodeEntry *)calloc(cache->mask + 1, sizeof(TranscodeEntry));
+    cache->path = (char *)malloc(strlen(path) + 1);
+    if (cache->entries == NULL || cache->path == NULL)
+    {
+        free(cache->entries);
+        free(cache->path);
+        free(cache);
+        return false;
+    }
+    strcpy(cache->path, path);
+
+    // Start over if the file is missing or was written by something else
+    cache->file = fopen(path, "r+b");
+    if (cache->file == NULL || !scan_cache_file(cache))
+    {
+        if (cache->file != NULL)
+        {
+            fclose(cache->file);
+            memset(cache->entries, 0, (cache->mask + 1) * sizeof(TranscodeEntry));
+            cache->count = 0;
+        }
+        cache->file = fopen(path, "w+b");
+        if (cache->file == NULL || !write_file_header(cache->file))
+        {
+            fprintf(stderr, "Cannot create transcode cache %s\n", path);
+            if (cache->file != NULL)
+            {
+                fclose(cache->file);
+            }
+            free(cache->entries);
+            free(cache->path);
+            free(cache);
+            return false;
+        }
+        cache->file_bytes = TRANSCODE_HEADER_SIZE;
+    }
+
+    mtx_init(&cache->mutex, mtx_plain);
+    dat_file->transcode_cache = cache;
+    return true;
+}
+
+void disable_transcode_cache(DatFile *dat_file)
+{
+    TranscodeCache *cache = dat_file->transcode_cache;
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    if (cache->file != NULL)
+    {
+        fclose(cache->file);
+    }
+    mtx_destroy(&cache->mutex);
+    free(cache->entries);
+    free(cache->path);
+    free(cache);
+    dat_file->transcode_cache = NULL;
+}
+
+uint8_t *transcode_cache_lookup(DatFile *dat_file, uint32_t mft_slot, const MFTData *mft_entry, uint32_t *size)
+{
+    TranscodeCache *cache = dat_file->transcode_cache;
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+
+    uint64_t start = prefetch_now_nanoseconds();
+    mtx_lock(&cache->mutex);
+    ++cache->stats.lookups;
+    TranscodeEntry *entry = transcode_find(cache, mft_slot, false);
+    if (entry == NULL || !entry->stored || cache->file == NULL)
+    {
+        mtx_unlock(&cache->mutex);
+        return NULL;
+    }
+    if (!transcode_entry_matches(entry, mft_entry))
+    {
+        ++cache->stats.stale;
+        mtx_unlock(&cache->mutex);
+        return NULL;
+    }
+
+    TranscodeEntry found = *entry;
+    uint8_t record[TRANSCODE_RECORD_SIZE];
+    uint8_t *payload = (uint8_t *)buffer_alloc(found.stored_size ? found.stored_size : 1);
+    bool read = payload != NULL && dat_fseek(cache->file, (int64_t)found.offset - TRANSCODE_RECORD_SIZE, SEEK_SET) == 0 &&
+                fread(record, 1, sizeof(record), cache->file) == sizeof(record) &&
+                fread(payload, 1, found.stored_size, cache->file) == found.stored_size;
+    clearerr(cache->file);
+    mtx_unlock(&cache->mutex);
+
+    uint8_t *data = NULL;
+    if (read && transcode_checksum(payload, found.stored_size) == get_uint32_le(record + 28))
+    {
+        if (found.codec == TRANSCODE_CODEC_RAW)
+        {
+            data = payload;
+            payload = NULL;
+        }
+        else
+        {
+            data = (uint8_t *)buffer_alloc(found.uncompressed_size ? found.uncompressed_size : 1);
+            if (data != NULL && !fast_lz_decompress(payload, found.stored_size, data, found.uncompressed_size))
+            {
+                buffer_free(data);
+                data = NULL;
+            }
+        }
+    }
+    buffer_free(payload);
+
+    uint64_t elapsed = prefetch_now_nanoseconds() - start;
+    mtx_lock(&cache->mutex);
+    entry = transcode_find(cache, mft_slot, false);
+    if (data == NULL)
+    {
+        // Damaged: let it be transcoded again
+        if (entry != NULL)
+        {
+            entry->stored = false;
+            entry->reads = 0;
+        }
+    }
+    else
+    {
+        ++cache->stats.hits;
+        cache->stats.hit_nanoseconds += elapsed;
+        cache->stats.original_nanoseconds += found.original_decode_nanoseconds;
+        if (entry != NULL)
+        {
+            ++entry->hits;
+            entry->hit_nanoseconds += elapsed;
+            entry->last_used = ++cache->clock;
+        }
+        *size = found.uncompressed_size;
+    }
+    mtx_unlock(&cache->mutex);
+    return data;
+}
+
+void transcode_cache_offer(DatFile *dat_file, uint32_t mft_slot, const MFTData *mft_entry, const uint8_t *data, uint32_t size, uint64_t decode_nanoseconds)
+{
+    TranscodeCache *cache = dat_file->transcode_cache;
+    if (cache == NULL || mft_entry->compression_flag == 0)
+    {
+        return;
+    }
+
+    mtx_lock(&cache->mutex);
+    TranscodeEntry *entry = transcode_find(cache, mft_slot, true);
+    bool admit = entry != NULL && !cache->failed && (uint64_t)size + TRANSCODE_RECORD_SIZE <= cache->max_bytes / 2;
+    if (admit)
+    {
+        entry->last_used = ++cache->clock;
+        admit = (!entry->stored || !transcode_entry_matches(entry, mft_entry)) &&
+                ++entry->reads >= cache->admit_reads;
+    }
+    mtx_unlock(&cache->mutex);
+    if (!admit)
+    {
+        return;
+    }
+
+    // Encode outside the lock; keep the entry raw if the fast codec saves less than an eighth
+    uint8_t *encoded = (uint8_t *)buffer_alloc(FAST_LZ_BOUND((size_t)size));
+    if (encoded == NULL)
+    {
+        return;
+    }
+    uint32_t encoded_size = fast_lz_compress(data, size, encoded);
+    uint8_t codec = TRANSCODE_CODEC_FAST_LZ;
+    const uint8_t *payload = encoded;
+    if (encoded_size > size - size / 8)
+    {
+        codec = TRANSCODE_CODEC_RAW;
+        payload = data;
+        encoded_size = size;
+    }
+    uint32_t checksum = transcode_checksum(payload, encoded_size);
+
+    mtx_lock(&cache->mutex);
+    uint64_t record_bytes = TRANSCODE_RECORD_SIZE + (uint64_t)encoded_size;
+    if (cache->file_bytes + record_bytes > cache->max_bytes && !compact_cache_file(cache, cache->max_bytes * 3 / 4 - record_bytes))
+    {
+        cache->failed = true;
+    }
+
+    entry = transcode_find(cache, mft_slot, true);
+    if (entry != NULL && !cache->failed && cache->file != NULL)
+    {
+        TranscodeEntry written = *entry;
+        written.crc = mft_entry->crc;
+        written.mft_size = mft_entry->size;
+        written.mft_offset = mft_entry->offset;
+        written.uncompressed_size = size;
+        written.stored_size = encoded_size;
+        written.codec = codec;
+        written.original_decode_nanoseconds = decode_nanoseconds;
+        written.offset = cache->file_bytes + TRANSCODE_RECORD_SIZE;
+
+        uint8_t record[TRANSCODE_RECORD_SIZE];
+        encode_record(record, &written, checksum);
+        bool ok = dat_fseek(cache->file, (int64_t)cache->file_bytes, SEEK_SET) == 0 &&
+                  fwrite(record, 1, sizeof(record), cache->file) == sizeof(record) &&
+                  fwrite(payload, 1, encoded_size, cache->file) == encoded_size && fflush(cache->file) == 0;
+        if (ok)
+        {
+            written.stored = true;
+            *entry = written;
+            cache->file_bytes += record_bytes;
+            ++cache->stats.admissions;
+        }
+        else
+        {
+            fprintf(stderr, "Transcode cache write failed, caching disabled\n");
+            cache->failed = true;
+        }
+    }
+    mtx_unlock(&cache->mutex);
+    buffer_free(encoded);
+}
+
+static int compare_hits(const void *a, const void *b)
+{
+    const TranscodeEntry *left = *(const TranscodeEntry *const *)a;
+    const TranscodeEntry *right = *(const TranscodeEntry *const *)b;
+    return left->hits > right->hits ? -1 : left->hits < right->hits;
+}
+
+void print_transcode_report(const DatFile *dat_file)
+{
+    TranscodeCache *cache = dat_file->transcode_cache;
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    mtx_lock(&cache->mutex);
+    const TranscodeStats *stats = &cache->stats;
+    printf("Transcode Cache Report:\n");
+    printf("  Lookups:             %llu\n", (unsigned long long)stats->lookups);
+    printf("  Hits:                %llu (%.1f%%), %llu stale\n", (unsigned long long)stats->hits,
+           stats->lookups ? 100.0 * stats->hits / stats->lookups : 0.0, (unsigned long long)stats->stale);
+    printf("  Transcoded:          %llu entries, %llu compactions\n", (unsigned long long)stats->admissions,
+           (unsigned long long)stats->compactions);
+    printf("  Hit Decode Time:     %.1f us (archive decoder: %.1f us)\n", stats->hit_nanoseconds / 1000.0,
+           stats->original_nanoseconds / 1000.0);
+    printf("  Cache File:          %.1f of %.1f MB\n", cache->file_bytes / 1048576.0, cache->max_bytes / 1048576.0);
+
+    // Per entry gains for the most used entries of this session
+    TranscodeEntry *hit[TRANSCODE_REPORT_ENTRIES];
+    uint32_t count = 0;
+    for (uint32_t i = 0; i <= cache->mask; ++i)
+    {
+        TranscodeEntry *entry = &cache->entries[i];
+        if (!entry->used || entry->hits == 0)
+        {
+            continue;
+        }
+        if (count < TRANSCODE_REPORT_ENTRIES)
+        {
+            hit[count++] = entry;
+        }
+        else if (entry->hits > hit[count - 1]->hits)
+        {
+            hit[count - 1] = entry;
+        }
+        else
+        {
+            continue;
+        }
+        qsort(hit, count, sizeof(TranscodeEntry *), compare_hits);
+    }
+
+    if (count > 0)
+    {
+        printf("  %10s %6s %10s %8s %12s %12s %8s\n", "MFT Slot", "Hits", "Size", "Codec", "Archive MB/s", "Cached MB/s", "Speedup");
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const TranscodeEntry *entry = hit[i];
+        double megabytes = entry->uncompressed_size / 1048576.0;
+        double cached_seconds = entry->hit_nanoseconds / 1e9 / entry->hits;
+        double original_seconds = entry->original_decode_nanoseconds / 1e9;
+        printf("  %10u %6u %10u %8s %12.1f %12.1f %7.1fx\n", entry->mft_slot, entry->hits, entry->uncompressed_size,
+               entry->codec == TRANSCODE_CODEC_RAW ? "raw" : "fast-lz", original_seconds > 0 ? megabytes / original_seconds : 0.0,
+               cached_seconds > 0 ? megabytes / cached_seconds : 0.0, cached_seconds > 0 ? original_seconds / cached_seconds : 0.0);
+    }
+    mtx_unlock(&cache->mutex);
+}
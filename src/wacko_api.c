@@ -0,0 +1,502 @@
+#include "wacko_api.h"
+#include "export.h"
+#include "pardecode.h"
+#include "transcode.h"
+
+const char *wacko_status_string(WackoStatus status)
+{
+    switch (status)
+    {
+    case WACKO_OK:
+        return "ok";
+    case WACKO_ERROR_INVALID_ARGUMENT:
+        return "invalid argument";
+    case WACKO_ERROR_OPEN_FAILED:
+        return "cannot open archive";
+    case WACKO_ERROR_BAD_FORMAT:
+        return "not a valid archive";
+    case WACKO_ERROR_NOT_FOUND:
+        return "entry not found";
+    case WACKO_ERROR_IO:
+        return "read error";
+    case WACKO_ERROR_CORRUPT_DATA:
+        return "corrupt entry data";
+    case WACKO_ERROR_OUT_OF_MEMORY:
+        return "out of memory";
+    }
+    return "unknown error";
+}
+
+WackoStatus wacko_open(const char *file_path, uint32_t flags, WackoArchive **archive)
+{
+    if (file_path == NULL || archive == NULL)
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+    *archive = NULL;
+
+    WackoArchive *opened = (WackoArchive *)calloc(1, sizeof(WackoArchive));
+    if (opened == NULL)
+    {
+        return WACKO_ERROR_OUT_OF_MEMORY;
+    }
+
+    opened->file = fopen(file_path, "rb");
+    if (opened->file == NULL)
+    {
+        free(opened);
+        return WACKO_ERROR_OPEN_FAILED;
+    }
+
+    // Always open through the quiet lazy path; an eager open just builds the id index right away
+    if (!load_dat_file_ex(file_path, &opened->dat_file, flags | DAT_OPEN_LAZY))
+    {
+        fclose(opened->file);
+        free(opened);
+        return WACKO_ERROR_BAD_FORMAT;
+    }
+    if (!(flags & WACKO_OPEN_LAZY) && !ensure_mft_index(&opened->dat_file))
+    {
+        close_dat_file(&opened->dat_file);
+        fclose(opened->file);
+        free(opened);
+        return WACKO_ERROR_BAD_FORMAT;
+    }
+
+    // Every call goes through the reloader from here on, so enabling live reload later needs no
+    // coordination with calls already running
+    opened->reloader = create_archive_reloader(&opened->dat_file, &opened->seek_index);
+    if (opened->reloader == NULL)
+    {
+        close_dat_file(&opened->dat_file);
+        fclose(opened->file);
+        free(opened);
+        return WACKO_ERROR_OUT_OF_MEMORY;
+    }
+
+    init_seek_index_store(&opened->seek_index, 0, 0);
+    mtx_init(&opened->io_mutex, mtx_plain);
+    *archive = opened;
+    return WACKO_OK;
+}
+
+void wacko_close(WackoArchive *archive)
+{
+    if (archive == NULL)
+    {
+        return;
+    }
+
+    stop_archive_reloader(archive->reloader);
+    close_dat_file(&archive->dat_file);
+    free_seek_index_store(&archive->seek_index);
+    fclose(archive->file);
+    mtx_destroy(&archive->io_mutex);
+    free(archive);
+}
+
+// The tables to use for one call; a live reload may swap in new ones between calls. The call
+// leaves through the reloader it entered by.
+static DatFile *wacko_enter(const WackoArchive *archive, ArchiveReloader **reloader, uint32_t *epoch)
+{
+    *reloader = archive->reloader;
+    return reloader_enter(*reloader, epoch);
+}
+
+static void wacko_leave(ArchiveReloader *reloader, uint32_t epoch)
+{
+    reloader_leave(reloader, epoch);
+}
+
+uint32_t wacko_entry_count(const WackoArchive *archive)
+{
+    if (archive == NULL)
+    {
+        return 0;
+    }
+    ArchiveReloader *reloader = NULL;
+    uint32_t epoch = 0;
+    uint32_t count = wacko_enter(archive, &reloader, &epoch)->mft_header.num_entries;
+    wacko_leave(reloader, epoch);
+    return count;
+}
+
+// Resolve an id to its slot and a copy of its MFT record
+static WackoStatus wacko_find_entry(DatFile *dat_file, uint32_t id, uint32_t *mft_slot, MFTData *mft_entry)
+{
+    if (!find_mft_slot(dat_file, id, mft_slot))
+    {
+        return dat_file->index_thread_failed ? WACKO_ERROR_IO : WACKO_ERROR_NOT_FOUND;
+    }
+
+    MFTData *entry = get_mft_entry(dat_file, *mft_slot);
+    if (entry == NULL)
+    {
+        return WACKO_ERROR_NOT_FOUND;
+    }
+    *mft_entry = *entry;
+    return WACKO_OK;
+}
+
+static void fill_entry_info(WackoEntryInfo *info, uint32_t mft_slot, const MFTData *mft_entry)
+{
+    info->mft_slot = mft_slot;
+    info->offset = mft_entry->offset;
+    info->size = mft_entry->size;
+    info->compressed = mft_entry->compression_flag != 0;
+    info->crc = mft_entry->crc;
+}
+
+// Read an entry's stored bytes through the shared file handle
+static WackoStatus wacko_read_payload(WackoArchive *archive, const MFTData *mft_entry, uint8_t **payload)
+{
+    *payload = (uint8_t *)buffer_alloc(mft_entry->size);
+    if (*payload == NULL)
+    {
+        return WACKO_ERROR_OUT_OF_MEMORY;
+    }
+
+    mtx_lock(&archive->io_mutex);
+    bool read = dat_fseek(archive->file, mft_entry->offset, SEEK_SET) == 0 &&
+                fread(*payload, 1, mft_entry->size, archive->file) == mft_entry->size;
+    clearerr(archive->file);
+    mtx_unlock(&archive->io_mutex);
+
+    if (!read)
+    {
+        buffer_free(*payload);
+        *payload = NULL;
+        return WACKO_ERROR_IO;
+    }
+    return WACKO_OK;
+}
+
+WackoStatus wacko_lookup(WackoArchive *archive, uint32_t id, WackoEntryInfo *info)
+{
+    if (archive == NULL || info == NULL)
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+
+    uint32_t mft_slot = 0;
+    MFTData mft_entry;
+    ArchiveReloader *reloader = NULL;
+    uint32_t epoch = 0;
+    WackoStatus status = wacko_find_entry(wacko_enter(archive, &reloader, &epoch), id, &mft_slot, &mft_entry);
+    wacko_leave(reloader, epoch);
+    if (status != WACKO_OK)
+    {
+        return status;
+    }
+    fill_entry_info(info, mft_slot, &mft_entry);
+    return WACKO_OK;
+}
+
+WackoStatus wacko_entry_info(WackoArchive *archive, uint32_t mft_slot, WackoEntryInfo *info)
+{
+    if (archive == NULL || info == NULL)
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+
+    ArchiveReloader *reloader = NULL;
+    uint32_t epoch = 0;
+    DatFile *dat_file = wacko_enter(archive, &reloader, &epoch);
+    WackoStatus status = WACKO_OK;
+    const MFTData *mft_entry = NULL;
+    if (mft_slot == 0 || mft_slot >= dat_file->mft_header.num_entries)
+    {
+        status = WACKO_ERROR_NOT_FOUND;
+    }
+    else if ((mft_entry = get_mft_entry(dat_file, mft_slot)) == NULL)
+    {
+        status = WACKO_ERROR_IO;
+    }
+    else
+    {
+        fill_entry_info(info, mft_slot, mft_entry);
+    }
+    wacko_leave(reloader, epoch);
+    return status;
+}
+
+// wacko_extract on one set of tables; caches filled here are invalidated by a reload only once the call is over.
+// info, if not NULL, gets the record that was decoded.
+static WackoStatus extract_entry(WackoArchive *archive, DatFile *dat_file, uint32_t id, WackoEntryInfo *info, uint8_t **data, uint32_t *size)
+{
+    uint32_t mft_slot = 0;
+    MFTData mft_entry;
+    WackoStatus status = wacko_find_entry(dat_file, id, &mft_slot, &mft_entry);
+    if (status != WACKO_OK)
+    {
+        return status;
+    }
+    if (info != NULL)
+    {
+        fill_entry_info(info, mft_slot, &mft_entry);
+    }
+
+    uint64_t access_start = prefetch_now_nanoseconds();
+    if (dat_file->prefetcher != NULL)
+    {
+        uint8_t *cached_data = prefetch_begin_access(dat_file, id, mft_slot, size);
+        if (cached_data != NULL)
+        {
+            prefetch_end_access(dat_file, mft_slot, cached_data, *size, access_start, true);
+            *data = cached_data;
+            return WACKO_OK;
+        }
+    }
+
+    // Hot compressed entries may be waiting in the transcode cache
+    if (mft_entry.compression_flag != 0)
+    {
+        *data = transcode_cache_lookup(dat_file, mft_slot, &mft_entry, size);
+    }
+
+    if (*data == NULL)
+    {
+        uint8_t *payload = NULL;
+        status = wacko_read_payload(archive, &mft_entry, &payload);
+        if (status != WACKO_OK)
+        {
+            return status;
+        }
+
+        if (mft_entry.compression_flag == 0)
+        {
+            *data = payload;
+            *size = mft_entry.size;
+        }
+        else
+        {
+            uint64_t decode_start = prefetch_now_nanoseconds();
+            uint32_t parallel_threads = parallel_decode_threads(payload, mft_entry.size);
+            *data = parallel_threads ? decompress_data_parallel(payload, mft_entry.size, size, parallel_threads, NULL)
+                                     : decompress_data_indexed(payload, mft_entry.size, size, 0, NULL);
+            buffer_free(payload);
+            if (*data == NULL)
+            {
+                *size = 0;
+                return WACKO_ERROR_CORRUPT_DATA;
+            }
+            transcode_cache_offer(dat_file, mft_slot, &mft_entry, *data, *size, prefetch_now_nanoseconds() - decode_start);
+        }
+    }
+
+    if (dat_file->prefetcher != NULL)
+    {
+        prefetch_end_access(dat_file, mft_slot, *data, *size, access_start, false);
+    }
+    return WACKO_OK;
+}
+
+WackoStatus wacko_extract(WackoArchive *archive, uint32_t id, uint8_t **data, uint32_t *size)
+{
+    if (archive == NULL || data == NULL || size == NULL)
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+    *data = NULL;
+    *size = 0;
+
+    ArchiveReloader *reloader = NULL;
+    uint32_t epoch = 0;
+    WackoStatus status = extract_entry(archive, wacko_enter(archive, &reloader, &epoch), id, NULL, data, size);
+    wacko_leave(reloader, epoch);
+    return status;
+}
+
+WackoStatus wacko_extract_with_info(WackoArchive *archive, uint32_t id, WackoEntryInfo *info, uint8_t **data, uint32_t *size)
+{
+    if (archive == NULL || info == NULL || data == NULL || size == NULL)
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+    *data = NULL;
+    *size = 0;
+
+    ArchiveReloader *reloader = NULL;
+    uint32_t epoch = 0;
+    WackoStatus status = extract_entry(archive, wacko_enter(archive, &reloader, &epoch), id, info, data, size);
+    wacko_leave(reloader, epoch);
+    return status;
+}
+
+// wacko_extract_range on one set of tables, so the checkpoints it records match them
+static WackoStatus extract_entry_range(WackoArchive *archive, DatFile *dat_file, uint32_t id, uint32_t offset, uint32_t length, uint8_t **data,
+                                       uint32_t *size)
+{
+    uint32_t mft_slot = 0;
+    MFTData mft_entry;
+    WackoStatus status = wacko_find_entry(dat_file, id, &mft_slot, &mft_entry);
+    if (status != WACKO_OK)
+    {
+        return status;
+    }
+
+    uint8_t *payload = NULL;
+    status = wacko_read_payload(archive, &mft_entry, &payload);
+    if (status != WACKO_OK)
+    {
+        return status;
+    }
+
+    // The seek index is shared by all callers and locks itself only to look up and publish checkpoints
+    *data = decode_mft_range(&archive->seek_index, mft_slot, &mft_entry, payload, offset, length, size);
+    if (*data == NULL)
+    {
+        *size = 0;
+        return WACKO_ERROR_CORRUPT_DATA;
+    }
+    return WACKO_OK;
+}
+
+WackoStatus wacko_extract_range(WackoArchive *archive, uint32_t id, uint32_t offset, uint32_t length, uint8_t **data, uint32_t *size)
+{
+    if (archive == NULL || data == NULL || size == NULL)
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+    *data = NULL;
+    *size = 0;
+
+    ArchiveReloader *reloader = NULL;
+    uint32_t epoch = 0;
+    WackoStatus status = extract_entry_range(archive, wacko_enter(archive, &reloader, &epoch), id, offset, length, data, size);
+    wacko_leave(reloader, epoch);
+    return status;
+}
+
+WackoStatus wacko_extract_prefix(WackoArchive *archive, uint32_t id, uint32_t length, uint8_t **data, uint32_t *size)
+{
+    if (archive == NULL || data == NULL || size == NULL)
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+    *data = NULL;
+    *size = 0;
+
+    uint32_t mft_slot = 0;
+    MFTData mft_entry;
+    ArchiveReloader *reloader = NULL;
+    uint32_t epoch = 0;
+    WackoStatus status = wacko_find_entry(wacko_enter(archive, &reloader, &epoch), id, &mft_slot, &mft_entry);
+    wacko_leave(reloader, epoch);
+    if (status != WACKO_OK)
+    {
+        return status;
+    }
+
+    // Stored entries only need their first bytes read
+    if (mft_entry.compression_flag == 0 && length < mft_entry.size)
+    {
+        mft_entry.size = length;
+    }
+
+    uint8_t *payload = NULL;
+    status = wacko_read_payload(archive, &mft_entry, &payload);
+    if (status != WACKO_OK)
+    {
+        return status;
+    }
+
+    if (mft_entry.compression_flag == 0)
+    {
+        *data = payload;
+        *size = mft_entry.size;
+        return WACKO_OK;
+    }
+
+    *data = decompress_data_prefix(payload, mft_entry.size, length, size);
+    buffer_free(payload);
+    if (*data == NULL)
+    {
+        *size = 0;
+        return WACKO_ERROR_CORRUPT_DATA;
+    }
+    return WACKO_OK;
+}
+
+WackoStatus wacko_export(WackoArchive *archive, uint32_t id, const char *output_path)
+{
+    if (archive == NULL || output_path == NULL)
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+
+    uint32_t mft_slot = 0;
+    MFTData mft_entry;
+    ArchiveReloader *reloader = NULL;
+    uint32_t epoch = 0;
+    WackoStatus status = wacko_find_entry(wacko_enter(archive, &reloader, &epoch), id, &mft_slot, &mft_entry);
+    wacko_leave(reloader, epoch);
+    if (status != WACKO_OK)
+    {
+        return status;
+    }
+    return export_mft_entry(archive->file, &archive->io_mutex, &mft_entry, output_path, NULL) ? WACKO_OK : WACKO_ERROR_IO;
+}
+
+WackoStatus wacko_read_batch(WackoArchive *archive, const uint32_t *ids, uint32_t count, const BatchReadOptions *options,
+                             BatchEntryCallback callback, void *context, BatchReadStats *stats)
+{
+    if (archive == NULL || (ids == NULL && count != 0) || callback == NULL)
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+    ArchiveReloader *reloader = NULL;
+    uint32_t epoch = 0;
+    bool read = batch_read_entries(wacko_enter(archive, &reloader, &epoch), ids, count, options, callback, context, stats);
+    wacko_leave(reloader, epoch);
+    return read ? WACKO_OK : WACKO_ERROR_IO;
+}
+
+WackoStatus wacko_enable_prefetch(WackoArchive *archive, uint32_t prefetch_flags, const char *replay_path, const char *record_path, size_t cache_bytes)
+{
+    if (archive == NULL || archive->dat_file.prefetcher != NULL || reloader_started(archive->reloader))
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+    if (!enable_prefetcher(&archive->dat_file, prefetch_flags, replay_path, record_path, cache_bytes))
+    {
+        return WACKO_ERROR_OPEN_FAILED;
+    }
+    return WACKO_OK;
+}
+
+WackoStatus wacko_enable_transcode_cache(WackoArchive *archive, const char *path, uint64_t max_bytes, uint32_t admit_reads)
+{
+    if (archive == NULL || path == NULL || archive->dat_file.transcode_cache != NULL || reloader_started(archive->reloader))
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+    if (!enable_transcode_cache(&archive->dat_file, path, max_bytes, admit_reads))
+    {
+        return WACKO_ERROR_OPEN_FAILED;
+    }
+    return WACKO_OK;
+}
+
+WackoStatus wacko_enable_live_reload(WackoArchive *archive, uint32_t quiet_milliseconds, ReloadCallback callback, void *context)
+{
+    if (archive == NULL)
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+    return start_reload_watcher(archive->reloader, quiet_milliseconds, callback, context) ? WACKO_OK : WACKO_ERROR_OPEN_FAILED;
+}
+
+WackoStatus wacko_reload(WackoArchive *archive)
+{
+    if (archive == NULL)
+    {
+        return WACKO_ERROR_INVALID_ARGUMENT;
+    }
+    return reload_if_changed(archive->reloader) ? WACKO_OK : WACKO_ERROR_BAD_FORMAT;
+}
+
+void wacko_free(void *data)
+{
+    buffer_free(data);
+}
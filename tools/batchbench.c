@@ -0,0 +1,167 @@
+// Batch read benchmark: reads every entry of an archive through the synchronous path and then each
+// batch engine at a range of queue depths, dropping the archive from the page cache before every
+// run, and reports IOPS and MB/s relative to the synchronous path.
+//
+// wacko_batchbench [--depths 1,4,16,64] [--workers n] [--raw] [--warm] path/to/Gw2.dat
+
+#include "wacko.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define BENCH_MAX_DEPTHS 16
+
+static void release_entry(void *context, uint32_t id, uint8_t *data, uint32_t size)
+{
+    (void)context;
+    (void)id;
+    (void)size;
+    buffer_free(data);
+}
+
+// Evict the archive's cached pages so every run starts from the device
+static void drop_page_cache(const char *file_path)
+{
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+// One id per MFT slot that has one, so entries reachable by several ids are read once
+static uint32_t collect_ids(DatFile *dat_file, uint32_t **ids)
+{
+    uint32_t entry_count = dat_file->mft_header.num_entries;
+    uint8_t *seen = (uint8_t *)calloc(entry_count ? entry_count : 1, 1);
+    *ids = (uint32_t *)malloc((dat_file->num_index_entries ? dat_file->num_index_entries : 1) * sizeof(uint32_t));
+    if (seen == NULL || *ids == NULL)
+    {
+        free(seen);
+        return 0;
+    }
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < dat_file->num_index_entries; ++i)
+    {
+        uint32_t mft_slot = 0;
+        uint32_t id = dat_file->mft_index_data[i].file_id;
+        if (find_mft_slot(dat_file, id, &mft_slot) && mft_slot < entry_count && !seen[mft_slot])
+        {
+            seen[mft_slot] = 1;
+            (*ids)[count++] = id;
+        }
+    }
+    free(seen);
+    return count;
+}
+
+static void print_row(const BatchReadStats *stats, double baseline_seconds)
+{
+    double seconds = stats->nanoseconds / 1e9;
+    printf("  %-9s %5u %8llu %10.0f %10.1f %10.1f %8.2fx\n", batch_engine_name(stats->engine), stats->queue_depth,
+           (unsigned long long)stats->entries, seconds > 0 ? stats->reads / seconds : 0.0,
+           seconds > 0 ? stats->bytes_read / 1048576.0 / seconds : 0.0, seconds > 0 ? stats->bytes_output / 1048576.0 / seconds : 0.0,
+           seconds > 0 ? baseline_seconds / seconds : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *file_path = NULL;
+    uint32_t depths[BENCH_MAX_DEPTHS] = {1, 4, 16, 64};
+    uint32_t depth_count = 4;
+    BatchReadOptions options;
+    memset(&options, 0, sizeof(BatchReadOptions));
+    bool warm = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--depths") == 0 && i + 1 < argc)
+        {
+            depth_count = 0;
+            for (char *cursor = argv[++i]; *cursor != '\0' && depth_count < BENCH_MAX_DEPTHS;)
+            {
+                char *end = NULL;
+                uint32_t depth = (uint32_t)strtoul(cursor, &end, 10);
+                if (end == cursor)
+                {
+                    break;
+                }
+                depths[depth_count++] = depth ? depth : 1;
+                cursor = *end == ',' ? end + 1 : end;
+            }
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+        {
+            options.workers = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--raw") == 0)
+        {
+            options.raw = true;
+        }
+        else if (strcmp(argv[i], "--warm") == 0)
+        {
+            warm = true;
+        }
+        else
+        {
+            file_path = argv[i];
+        }
+    }
+
+    if (file_path == NULL || depth_count == 0)
+    {
+        fprintf(stderr, "Usage: %s [--depths 1,4,16,64] [--workers n] [--raw] [--warm] path/to/Gw2.dat\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    DatFile dat_file;
+    memset(&dat_file, 0, sizeof(DatFile));
+    if (!load_dat_file_ex(file_path, &dat_file, DAT_OPEN_LAZY) || !ensure_mft_index(&dat_file))
+    {
+        return EXIT_FAILURE;
+    }
+    // Load every MFT page now so the runs measure payload reads only
+    for (uint32_t i = 0; i < dat_file.mft_header.num_entries; ++i)
+    {
+        get_mft_entry(&dat_file, i);
+    }
+
+    uint32_t *ids = NULL;
+    uint32_t count = collect_ids(&dat_file, &ids);
+    printf("Batch Benchmark: %u entries, %s page cache%s\n", count, warm ? "warm" : "cold", options.raw ? ", raw payloads" : "");
+    printf("  %-9s %5s %8s %10s %10s %10s %9s\n", "engine", "depth", "entries", "IOPS", "read MB/s", "out MB/s", "vs sync");
+
+    BatchReadStats stats;
+    options.engine = BATCH_ENGINE_SYNC;
+    if (!warm)
+    {
+        drop_page_cache(file_path);
+    }
+    batch_read_entries(&dat_file, ids, count, &options, release_entry, NULL, &stats);
+    double baseline_seconds = stats.nanoseconds / 1e9;
+    print_row(&stats, baseline_seconds);
+
+    const uint32_t engines[] = {BATCH_ENGINE_PREAD, BATCH_ENGINE_URING};
+    for (uint32_t e = 0; e < sizeof(engines) / sizeof(engines[0]); ++e)
+    {
+        for (uint32_t d = 0; d < depth_count; ++d)
+        {
+            options.engine = engines[e];
+            options.queue_depth = depths[d];
+            if (!warm)
+            {
+                drop_page_cache(file_path);
+            }
+            batch_read_entries(&dat_file, ids, count, &options, release_entry, NULL, &stats);
+            print_row(&stats, baseline_seconds);
+        }
+    }
+
+    free(ids);
+    close_dat_file(&dat_file);
+    return EXIT_SUCCESS;
+}
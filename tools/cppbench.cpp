@@ -0,0 +1,240 @@
+// C++ wrapper benchmark: walks the MFT and extracts every entry of an archive through wacko_api.h
+// and through wacko.hpp on the same open archive, alternating rounds with a warm page cache, and
+// reports the best time of each along with the entry buffers, allocator calls and C++ heap
+// allocations it took, so any overhead of the wrapper shows up as a difference between the rows.
+//
+// wacko_cppbench [--rounds n] path/to/Gw2.dat
+
+#include "wacko.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+static std::atomic<uint64_t> heap_allocations{0};
+
+void *operator new(std::size_t size)
+{
+    ++heap_allocations;
+    if (void *pointer = std::malloc(size ? size : 1))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+struct PathResult
+{
+    uint64_t walk_nanoseconds = UINT64_MAX;
+    uint64_t extract_nanoseconds = UINT64_MAX;
+    uint64_t bytes = 0;
+    uint64_t checksum = 0;
+    uint64_t buffer_allocs = 0;
+    uint64_t allocator_calls = 0;
+    uint64_t heap_allocations = 0;
+};
+
+// Counts what one run of a path allocates
+class AllocationProbe
+{
+  public:
+    AllocationProbe()
+    {
+        get_buffer_stats(&start_);
+        heap_start_ = heap_allocations.load();
+        clock_start_ = std::chrono::steady_clock::now();
+    }
+
+    uint64_t elapsed_nanoseconds() const
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - clock_start_).count();
+    }
+
+    void record(PathResult &result) const
+    {
+        BufferStats end;
+        get_buffer_stats(&end);
+        result.buffer_allocs = end.buffer_allocs - start_.buffer_allocs;
+        result.allocator_calls = end.allocator_calls - start_.allocator_calls;
+        result.heap_allocations = heap_allocations.load() - heap_start_;
+    }
+
+  private:
+    BufferStats start_;
+    uint64_t heap_start_;
+    std::chrono::steady_clock::time_point clock_start_;
+};
+
+// One id per MFT slot that has one, so entries reachable by several ids are read once
+static std::vector<uint32_t> collect_ids(WackoArchive *archive)
+{
+    std::vector<uint32_t> ids;
+    DatFile *dat_file = &archive->dat_file;
+    if (!ensure_mft_index(dat_file))
+    {
+        return ids;
+    }
+    std::vector<bool> seen(dat_file->mft_header.num_entries);
+    for (uint32_t i = 0; i < dat_file->num_index_entries; ++i)
+    {
+        uint32_t mft_slot = 0;
+        uint32_t id = dat_file->mft_index_data[i].file_id;
+        if (find_mft_slot(dat_file, id, &mft_slot) && mft_slot < seen.size() && !seen[mft_slot])
+        {
+            seen[mft_slot] = true;
+            ids.push_back(id);
+        }
+    }
+    return ids;
+}
+
+static void run_c_path(WackoArchive *archive, const std::vector<uint32_t> &ids, PathResult &result)
+{
+    AllocationProbe probe;
+    uint64_t walked = 0;
+    uint32_t count = wacko_entry_count(archive);
+    for (uint32_t mft_slot = 1; mft_slot < count; ++mft_slot)
+    {
+        WackoEntryInfo info;
+        if (wacko_entry_info(archive, mft_slot, &info) == WACKO_OK)
+        {
+            walked += info.size;
+        }
+    }
+    uint64_t walk_nanoseconds = probe.elapsed_nanoseconds();
+
+    uint64_t bytes = 0;
+    uint64_t checksum = walked;
+    for (uint32_t id : ids)
+    {
+        uint8_t *data = nullptr;
+        uint32_t size = 0;
+        if (wacko_extract(archive, id, &data, &size) == WACKO_OK)
+        {
+            bytes += size;
+            checksum += size ? data[size - 1] : 0;
+        }
+        wacko_free(data);
+    }
+    uint64_t total_nanoseconds = probe.elapsed_nanoseconds();
+    probe.record(result);
+
+    result.walk_nanoseconds = std::min(result.walk_nanoseconds, walk_nanoseconds);
+    result.extract_nanoseconds = std::min(result.extract_nanoseconds, total_nanoseconds - walk_nanoseconds);
+    result.bytes = bytes;
+    result.checksum = checksum;
+}
+
+static void run_cpp_path(const wacko::Archive &archive, const std::vector<uint32_t> &ids, PathResult &result)
+{
+    AllocationProbe probe;
+    uint64_t walked = 0;
+    for (const wacko::EntryInfo &info : archive)
+    {
+        walked += info.size;
+    }
+    uint64_t walk_nanoseconds = probe.elapsed_nanoseconds();
+
+    uint64_t bytes = 0;
+    uint64_t checksum = walked;
+    for (uint32_t id : ids)
+    {
+        try
+        {
+            wacko::Buffer entry = archive.extract(id);
+            wacko::ByteView view = entry.view();
+            bytes += view.size();
+            checksum += view.empty() ? 0 : (uint8_t)view[view.size() - 1];
+        }
+        catch (const wacko::Error &)
+        {
+        }
+    }
+    uint64_t total_nanoseconds = probe.elapsed_nanoseconds();
+    probe.record(result);
+
+    result.walk_nanoseconds = std::min(result.walk_nanoseconds, walk_nanoseconds);
+    result.extract_nanoseconds = std::min(result.extract_nanoseconds, total_nanoseconds - walk_nanoseconds);
+    result.bytes = bytes;
+    result.checksum = checksum;
+}
+
+static void print_row(const char *label, const PathResult &result)
+{
+    double seconds = result.extract_nanoseconds / 1e9;
+    std::printf("  %-5s %10.2f %12.2f %10.1f %14llu %16llu %12llu\n", label, result.walk_nanoseconds / 1e6, result.extract_nanoseconds / 1e6,
+                seconds > 0 ? result.bytes / 1048576.0 / seconds : 0.0, (unsigned long long)result.buffer_allocs,
+                (unsigned long long)result.allocator_calls, (unsigned long long)result.heap_allocations);
+}
+
+int main(int argc, char **argv)
+{
+    const char *file_path = nullptr;
+    uint32_t rounds = 5;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--rounds") == 0 && i + 1 < argc)
+        {
+            rounds = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            file_path = argv[i];
+        }
+    }
+
+    if (file_path == nullptr || rounds == 0)
+    {
+        std::fprintf(stderr, "Usage: %s [--rounds n] path/to/Gw2.dat\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        wacko::Archive archive(file_path);
+        std::vector<uint32_t> ids = collect_ids(archive.native());
+
+        // One untimed pass of each loads the MFT pages and warms the page cache
+        PathResult c_result;
+        PathResult cpp_result;
+        run_c_path(archive.native(), ids, c_result);
+        run_cpp_path(archive, ids, cpp_result);
+        for (uint32_t round = 0; round < rounds; ++round)
+        {
+            run_c_path(archive.native(), ids, c_result);
+            run_cpp_path(archive, ids, cpp_result);
+        }
+
+        std::printf("C++ Wrapper Benchmark: %zu entries, %u slots, best of %u rounds\n", ids.size(), archive.entry_count(), rounds);
+        std::printf("  %-5s %10s %12s %10s %14s %16s %12s\n", "path", "walk ms", "extract ms", "MB/s", "entry buffers", "allocator calls",
+                    "heap allocs");
+        print_row("C", c_result);
+        print_row("C++", cpp_result);
+        if (c_result.checksum != cpp_result.checksum || c_result.bytes != cpp_result.bytes)
+        {
+            std::fprintf(stderr, "The two paths read different data\n");
+            return EXIT_FAILURE;
+        }
+    }
+    catch (const wacko::Error &error)
+    {
+        std::fprintf(stderr, "%s: %s\n", file_path, error.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1111 @@
+// Differential decoder check: a deliberately plain reference decoder, written from the stream format
+// rather than from decompress.c, runs against the optimized decoder on a generated corpus and on
+// fuzzed copies of it, and their outputs are compared byte for byte. Every optimized entry point is
+// covered: whole decodes with and without checkpoints, decoding into a caller buffer, parallel
+// decodes, prefixes, checkpointed ranges and chunked streams. Throughput of both decoders is
+// reported at the end.
+//
+// The corpus is encoded here, with random block sizes, length bases, code length limits and match
+// search depths over text, binary, float and run-heavy data, so both decoders see trees and codes
+// the real archives rarely exercise. --archive adds every compressed entry of a real archive.
+//
+// wacko_decodecheck [--seed n] [--entries n] [--max-size bytes] [--fuzz n] [--archive path.dat]
+
+#include "wacko.h"
+
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Code lengths of the static tree that tree descriptions are coded with, by symbol
+static const uint8_t static_code_lengths[256] = {
+    4,  10, 10, 7,  6,  6,  5,  4,  3,  3,  3,  4,  4,  7,  11, 15, //
+    15, 15, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, //
+    6,  16, 13, 9,  8,  7,  7,  7,  6,  5,  5,  6,  6,  10, 13, 16, //
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, //
+    6,  16, 16, 10, 10, 10, 9,  8,  7,  7,  6,  8,  8,  11, 14, 16, //
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, //
+    9,  16, 16, 9,  11, 10, 10, 9,  9,  8,  8,  11, 11, 14, 16, 16, //
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, //
+    10, 16, 16, 12, 11, 11, 12, 10, 9,  9,  10, 11, 13, 15, 16, 16, //
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, //
+    9,  16, 16, 16, 11, 11, 12, 12, 10, 10, 11, 15, 15, 16, 16, 16, //
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, //
+    10, 16, 16, 16, 13, 16, 14, 12, 11, 10, 12, 16, 15, 16, 16, 16, //
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, //
+    5,  16, 16, 16, 13, 11, 13, 12, 9,  10, 15, 16, 14, 16, 16, 16, //
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, //
+};
+
+#define CHECK_SYMBOLS 285
+#define CHECK_COPY_SYMBOLS 34
+#define CHECK_MAX_CODE_BITS 32
+
+static uint64_t check_random_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t check_random(void)
+{
+    check_random_state ^= check_random_state << 13;
+    check_random_state ^= check_random_state >> 7;
+    check_random_state ^= check_random_state << 17;
+    return (uint32_t)(check_random_state >> 16);
+}
+
+static uint64_t check_now_nanoseconds(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// --- Huffman codes, shared by the reference decoder and the corpus encoder ---
+
+// Within one code length, codes count down from the top of the code space in increasing symbol
+// order; each longer length continues below the last code of the shorter one. A symbol of length 0
+// has no code. Returns false if no symbol has a code or the lengths oversubscribe the code space.
+static bool assign_codes(const uint8_t *lengths, uint32_t count, uint32_t *codes)
+{
+    int64_t code = 0;
+    bool any = false;
+    for (uint32_t length = 0; length < CHECK_MAX_CODE_BITS; ++length)
+    {
+        for (uint32_t symbol = 0; symbol < count; ++symbol)
+        {
+            if (length == 0 || lengths[symbol] != length)
+            {
+                continue;
+            }
+            if (code < 0)
+            {
+                return false;
+            }
+            codes[symbol] = (uint32_t)code;
+            --code;
+            any = true;
+        }
+        code = code * 2 + 1;
+    }
+    return any;
+}
+
+// --- Reference decoder ---
+
+// The stream is a run of little-endian 32-bit words read from their most significant bit down. A
+// final word cut short, and anything past the end, reads as zero bits.
+typedef struct
+{
+    const uint8_t *data;
+    uint32_t size;
+    uint64_t position;
+} ReferenceBits;
+
+static uint32_t reference_bit(ReferenceBits *bits)
+{
+    uint64_t word_offset = bits->position / 32 * 4;
+    uint32_t word = 0;
+    if (word_offset + 4 <= bits->size)
+    {
+        const uint8_t *bytes = bits->data + word_offset;
+        word = (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    }
+    uint32_t bit = (word >> (31 - bits->position % 32)) & 1;
+    ++bits->position;
+    return bit;
+}
+
+static uint32_t reference_read(ReferenceBits *bits, uint32_t count)
+{
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        value = (value << 1) | reference_bit(bits);
+    }
+    return value;
+}
+
+typedef struct
+{
+    uint8_t lengths[CHECK_SYMBOLS];
+    uint32_t codes[CHECK_SYMBOLS];
+    uint32_t count;
+
+    // Symbols by code length, so a code is found without scanning every symbol
+    uint16_t by_length[CHECK_SYMBOLS];
+    uint16_t length_start[CHECK_MAX_CODE_BITS + 1];
+} ReferenceTree;
+
+static void index_reference_tree(ReferenceTree *tree)
+{
+    uint16_t next = 0;
+    for (uint32_t length = 0; length < CHECK_MAX_CODE_BITS; ++length)
+    {
+        tree->length_start[length] = next;
+        for (uint32_t symbol = 0; length != 0 && symbol < tree->count; ++symbol)
+        {
+            if (tree->lengths[symbol] == length)
+            {
+                tree->by_length[next++] = (uint16_t)symbol;
+            }
+        }
+    }
+    tree->length_start[CHECK_MAX_CODE_BITS] = next;
+}
+
+// Read one bit at a time until the bits so far are the code of some symbol of that length
+static bool reference_symbol(ReferenceBits *bits, const ReferenceTree *tree, uint16_t *symbol)
+{
+    uint32_t code = 0;
+    for (uint32_t length = 1; length < CHECK_MAX_CODE_BITS; ++length)
+    {
+        code = (code << 1) | reference_bit(bits);
+        for (uint32_t i = tree->length_start[length]; i < tree->length_start[length + 1]; ++i)
+        {
+            if (tree->codes[tree->by_length[i]] == code)
+            {
+                *symbol = tree->by_length[i];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// A tree description: a 16-bit symbol count, then static-tree codes from the last symbol down, each
+// giving a code length (low 5 bits) for a run of 1 to 8 symbols (high 3 bits, plus one)
+static bool reference_read_tree(ReferenceBits *bits, const ReferenceTree *static_tree, ReferenceTree *tree)
+{
+    memset(tree, 0, sizeof(ReferenceTree));
+    tree->count = reference_read(bits, 16);
+    if (tree->count > CHECK_SYMBOLS)
+    {
+        return false;
+    }
+
+    int32_t symbol = (int32_t)tree->count - 1;
+    while (symbol >= 0)
+    {
+        uint16_t run = 0;
+        if (!reference_symbol(bits, static_tree, &run))
+        {
+            return false;
+        }
+        uint8_t length = run & 0x1F;
+        int32_t run_length = (run >> 5) + 1;
+        if (length != 0 && run_length > symbol + 1)
+        {
+            return false;
+        }
+        for (int32_t i = 0; i < run_length && symbol >= 0; ++i)
+        {
+            tree->lengths[symbol--] = length;
+        }
+    }
+    if (!assign_codes(tree->lengths, tree->count, tree->codes))
+    {
+        return false;
+    }
+    index_reference_tree(tree);
+    return true;
+}
+
+// Length codes 0-3 stand for themselves, 4-27 for (4 + code % 4) << (code / 4 - 1) plus that many
+// extra bits less one, and 28 for 255. Offset codes 0-1 stand for themselves and 2-33 for
+// (2 + code % 2) << (code / 2 - 1) plus code / 2 - 1 extra bits.
+static bool reference_match_base(uint32_t code, uint32_t groups, uint32_t group_size, uint32_t *base, uint32_t *extra_bits)
+{
+    *extra_bits = 0;
+    if (code < group_size)
+    {
+        *base = code;
+        return true;
+    }
+    if (code / group_size < groups)
+    {
+        *extra_bits = code / group_size - 1;
+        *base = (group_size + code % group_size) << *extra_bits;
+        return true;
+    }
+    return false;
+}
+
+static uint8_t *reference_decode(const uint8_t *input, uint32_t input_size, uint32_t *output_size)
+{
+    ReferenceTree static_tree;
+    memset(&static_tree, 0, sizeof(ReferenceTree));
+    memcpy(static_tree.lengths, static_code_lengths, sizeof(static_code_lengths));
+    static_tree.count = 256;
+    assign_codes(static_tree.lengths, static_tree.count, static_tree.codes);
+    index_reference_tree(&static_tree);
+
+    ReferenceBits bits = {input, input_size, 0};
+    reference_read(&bits, 32);
+    uint32_t size = reference_read(&bits, 32);
+    reference_read(&bits, 4);
+    uint32_t length_base = reference_read(&bits, 4) + 1;
+
+    uint8_t *output = (uint8_t *)malloc(size ? size : 1);
+    if (output == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t position = 0;
+    while (position < size)
+    {
+        ReferenceTree symbol_tree;
+        ReferenceTree copy_tree;
+        if (!reference_read_tree(&bits, &static_tree, &symbol_tree) || !reference_read_tree(&bits, &static_tree, &copy_tree))
+        {
+            free(output);
+            return NULL;
+        }
+
+        uint32_t codes = (reference_read(&bits, 4) + 1) << 12;
+        for (uint32_t code = 0; code < codes && position < size; ++code)
+        {
+            uint16_t symbol = 0;
+            if (!reference_symbol(&bits, &symbol_tree, &symbol))
+            {
+                free(output);
+                return NULL;
+            }
+            if (symbol < 0x100)
+            {
+                output[position++] = (uint8_t)symbol;
+                continue;
+            }
+
+            uint32_t length = 0xFF;
+            uint32_t extra_bits = 0;
+            if (symbol - 0x100u != 28 && !reference_match_base(symbol - 0x100u, 7, 4, &length, &extra_bits))
+            {
+                free(output);
+                return NULL;
+            }
+            length += reference_read(&bits, extra_bits) + length_base;
+
+            uint16_t offset_code = 0;
+            uint32_t offset = 0;
+            if (!reference_symbol(&bits, &copy_tree, &offset_code) || !reference_match_base(offset_code, 17, 2, &offset, &extra_bits))
+            {
+                free(output);
+                return NULL;
+            }
+            offset += reference_read(&bits, extra_bits) + 1;
+            if (offset > position)
+            {
+                free(output);
+                return NULL;
+            }
+
+            for (uint32_t i = 0; i < length && position < size; ++i, ++position)
+            {
+                output[position] = output[position - offset];
+            }
+        }
+    }
+
+    *output_size = size;
+    return output;
+}
+
+// --- Corpus encoder ---
+
+typedef struct
+{
+    uint8_t *data;
+    size_t capacity;
+    size_t size;
+    uint32_t word;
+    uint32_t word_bits;
+} BitWriter;
+
+static void put_bits(BitWriter *writer, uint32_t value, uint32_t count)
+{
+    for (uint32_t i = count; i-- > 0;)
+    {
+        writer->word = (writer->word << 1) | ((value >> i) & 1);
+        if (++writer->word_bits == 32)
+        {
+            if (writer->size + 4 > writer->capacity)
+            {
+                writer->capacity = writer->capacity * 2 + 64;
+                writer->data = (uint8_t *)realloc(writer->data, writer->capacity);
+            }
+            memcpy(writer->data + writer->size, &writer->word, 4);
+            writer->size += 4;
+            writer->word = 0;
+            writer->word_bits = 0;
+        }
+    }
+}
+
+// Bounded code lengths for freq: plain Huffman, with the counts halved until the longest code fits
+static void huffman_lengths(const uint32_t *freq, uint32_t count, uint32_t max_length, uint8_t *lengths)
+{
+    uint64_t weights[2 * CHECK_SYMBOLS];
+    int32_t parents[2 * CHECK_SYMBOLS];
+    int32_t leaves[CHECK_SYMBOLS];
+    uint32_t scaled[CHECK_SYMBOLS];
+    memcpy(scaled, freq, count * sizeof(uint32_t));
+
+    for (;;)
+    {
+        uint32_t nodes = 0;
+        bool alive[2 * CHECK_SYMBOLS];
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            leaves[i] = -1;
+            if (scaled[i] != 0)
+            {
+                weights[nodes] = scaled[i];
+                parents[nodes] = -1;
+                alive[nodes] = true;
+                leaves[i] = (int32_t)nodes++;
+            }
+        }
+        memset(lengths, 0, count);
+        if (nodes == 1)
+        {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                lengths[i] = scaled[i] != 0;
+            }
+            return;
+        }
+
+        for (uint32_t remaining = nodes; remaining > 1; --remaining)
+        {
+            int32_t first = -1;
+            int32_t second = -1;
+            for (uint32_t i = 0; i < nodes; ++i)
+            {
+                if (!alive[i])
+                {
+                    continue;
+                }
+                if (first < 0 || weights[i] < weights[first])
+                {
+                    second = first;
+                    first = (int32_t)i;
+                }
+                else if (second < 0 || weights[i] < weights[second])
+                {
+                    second = (int32_t)i;
+                }
+            }
+            alive[first] = alive[second] = false;
+            weights[nodes] = weights[first] + weights[second];
+            parents[nodes] = -1;
+            alive[nodes] = true;
+            parents[first] = parents[second] = (int32_t)nodes++;
+        }
+
+        uint32_t longest = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t depth = 0;
+            for (int32_t node = leaves[i]; node >= 0 && parents[node] >= 0; node = parents[node])
+            {
+                ++depth;
+            }
+            lengths[i] = (uint8_t)depth;
+            longest = depth > longest ? depth : longest;
+        }
+        if (longest <= max_length)
+        {
+            return;
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            scaled[i] = scaled[i] ? (scaled[i] + 1) / 2 : 0;
+        }
+    }
+}
+
+static void put_tree(BitWriter *writer, const uint32_t *static_codes, const uint8_t *lengths, uint32_t count, uint32_t *codes)
+{
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        used = lengths[i] ? i + 1 : used;
+    }
+    put_bits(writer, used, 16);
+
+    for (int32_t symbol = (int32_t)used - 1; symbol >= 0;)
+    {
+        uint32_t run = 1;
+        while (run < 8 && symbol - (int32_t)run >= 0 && lengths[symbol - (int32_t)run] == lengths[symbol])
+        {
+            ++run;
+        }
+        uint32_t run_symbol = ((run - 1) << 5) | lengths[symbol];
+        put_bits(writer, static_codes[run_symbol], static_code_lengths[run_symbol]);
+        symbol -= (int32_t)run;
+    }
+    assign_codes(lengths, count, codes);
+}
+
+typedef struct
+{
+    uint32_t length_base;  // 1 to 16
+    uint32_t block_code;   // blocks hold (block_code + 1) << 12 codes
+    uint32_t search_depth; // match candidates tried per position
+    uint32_t max_code_length;
+    bool literals_only;
+} EncodeOptions;
+
+typedef struct
+{
+    uint32_t length; // 0 for a literal
+    uint32_t offset;
+    uint8_t literal;
+} Token;
+
+// Inverse of the match code tables; returns the code and sets the extra bits to write
+static uint32_t match_code(uint32_t value, uint32_t group_size, uint32_t *extra, uint32_t *extra_bits)
+{
+    *extra_bits = 0;
+    if (value < group_size)
+    {
+        return value;
+    }
+    uint32_t top = 31 - (uint32_t)__builtin_clz(value);
+    uint32_t group_bits = group_size == 4 ? 2 : 1;
+    *extra_bits = top - group_bits;
+    *extra = value & ((1u << *extra_bits) - 1);
+    return group_size * (*extra_bits + 1) + ((value >> *extra_bits) - group_size);
+}
+
+static uint32_t hash_three(const uint8_t *bytes)
+{
+    return (bytes[0] * 2654435761u ^ bytes[1] * 40503u ^ bytes[2]) & 0xFFFF;
+}
+
+static uint8_t *encode_entry(const uint8_t *input, uint32_t size, const EncodeOptions *options, const uint32_t *static_codes, uint32_t *encoded_size)
+{
+    Token *tokens = (Token *)malloc((size + 1) * sizeof(Token));
+    int32_t *heads = (int32_t *)malloc(65536 * sizeof(int32_t));
+    int32_t *chain = (int32_t *)malloc((size + 1) * sizeof(int32_t));
+    memset(heads, 0xFF, 65536 * sizeof(int32_t));
+
+    // Greedy LZ77 over a hash chain, limited to what the length and offset codes can express
+    uint32_t token_count = 0;
+    uint32_t shortest = options->length_base > 3 ? options->length_base : 3;
+    uint32_t longest = 0xFF + options->length_base;
+    for (uint32_t position = 0; position < size;)
+    {
+        uint32_t best_length = 0;
+        uint32_t best_offset = 0;
+        if (!options->literals_only && position + 3 <= size)
+        {
+            uint32_t depth = options->search_depth;
+            for (int32_t candidate = heads[hash_three(input + position)]; candidate >= 0 && depth-- > 0 && position - candidate <= DECODE_WINDOW_SIZE;
+                 candidate = chain[candidate])
+            {
+                uint32_t length = 0;
+                while (position + length < size && length < longest && input[candidate + length] == input[position + length])
+                {
+                    ++length;
+                }
+                if (length > best_length)
+                {
+                    best_length = length;
+                    best_offset = position - (uint32_t)candidate;
+                }
+            }
+            // Runs, including ones that overlap the bytes they copy
+            uint32_t length = 0;
+            while (position > 0 && position + length < size && length < longest && input[position - 1 + length] == input[position + length])
+            {
+                ++length;
+            }
+            if (length > best_length)
+            {
+                best_length = length;
+                best_offset = 1;
+            }
+        }
+
+        uint32_t advance = 1;
+        if (best_length >= shortest)
+        {
+            tokens[token_count].length = best_length;
+            tokens[token_count].offset = best_offset;
+            advance = best_length;
+        }
+        else
+        {
+            tokens[token_count].length = 0;
+            tokens[token_count].literal = input[position];
+        }
+        ++token_count;
+
+        for (uint32_t i = 0; i < advance; ++i, ++position)
+        {
+            if (position + 3 <= size)
+            {
+                uint32_t hash = hash_three(input + position);
+                chain[position] = heads[hash];
+                heads[hash] = (int32_t)position;
+            }
+        }
+    }
+
+    BitWriter writer;
+    memset(&writer, 0, sizeof(BitWriter));
+    put_bits(&writer, 0, 32);
+    put_bits(&writer, size, 32);
+    put_bits(&writer, 0, 4);
+    put_bits(&writer, options->length_base - 1, 4);
+
+    uint32_t block_codes = (options->block_code + 1) << 12;
+    for (uint32_t first = 0; first < token_count; first += block_codes)
+    {
+        uint32_t last = first + block_codes < token_count ? first + block_codes : token_count;
+        uint32_t symbol_freq[CHECK_SYMBOLS] = {0};
+        uint32_t copy_freq[CHECK_COPY_SYMBOLS] = {0};
+        uint32_t extra = 0;
+        uint32_t extra_bits = 0;
+        for (uint32_t i = first; i < last; ++i)
+        {
+            if (tokens[i].length == 0)
+            {
+                ++symbol_freq[tokens[i].literal];
+                continue;
+            }
+            uint32_t length = tokens[i].length - options->length_base;
+            ++symbol_freq[0x100 + (length == 0xFF ? 28 : match_code(length, 4, &extra, &extra_bits))];
+            ++copy_freq[match_code(tokens[i].offset - 1, 2, &extra, &extra_bits)];
+        }
+        bool any_copy = false;
+        for (uint32_t i = 0; i < CHECK_COPY_SYMBOLS; ++i)
+        {
+            any_copy |= copy_freq[i] != 0;
+        }
+        copy_freq[0] += !any_copy;
+
+        uint8_t symbol_lengths[CHECK_SYMBOLS];
+        uint8_t copy_lengths[CHECK_COPY_SYMBOLS];
+        uint32_t symbol_codes[CHECK_SYMBOLS];
+        uint32_t copy_codes[CHECK_COPY_SYMBOLS];
+        huffman_lengths(symbol_freq, CHECK_SYMBOLS, options->max_code_length, symbol_lengths);
+        huffman_lengths(copy_freq, CHECK_COPY_SYMBOLS, options->max_code_length, copy_lengths);
+        put_tree(&writer, static_codes, symbol_lengths, CHECK_SYMBOLS, symbol_codes);
+        put_tree(&writer, static_codes, copy_lengths, CHECK_COPY_SYMBOLS, copy_codes);
+        put_bits(&writer, options->block_code, 4);
+
+        for (uint32_t i = first; i < last; ++i)
+        {
+            if (tokens[i].length == 0)
+            {
+                put_bits(&writer, symbol_codes[tokens[i].literal], symbol_lengths[tokens[i].literal]);
+                continue;
+            }
+            uint32_t length = tokens[i].length - options->length_base;
+            uint32_t code = length == 0xFF ? 28 : match_code(length, 4, &extra, &extra_bits);
+            extra_bits = length == 0xFF ? 0 : extra_bits;
+            put_bits(&writer, symbol_codes[0x100 + code], symbol_lengths[0x100 + code]);
+            put_bits(&writer, extra, extra_bits);
+
+            code = match_code(tokens[i].offset - 1, 2, &extra, &extra_bits);
+            put_bits(&writer, copy_codes[code], copy_lengths[code]);
+            put_bits(&writer, extra, extra_bits);
+        }
+    }
+
+    // Pad the last word and leave two zero words for the decoder's read-ahead
+    while (writer.word_bits != 0)
+    {
+        put_bits(&writer, 0, 1);
+    }
+    put_bits(&writer, 0, 32);
+    put_bits(&writer, 0, 32);
+
+    free(tokens);
+    free(heads);
+    free(chain);
+    *encoded_size = (uint32_t)writer.size;
+    return writer.data;
+}
+
+// Sample data of several shapes: words, noise, floats, sparse bytes, skewed letters and zeros
+static uint8_t *generate_data(uint32_t kind, uint32_t size)
+{
+    static const char *const words[] = {"terrain ", "prop ", "texture ", "model ", "the ", "map ", "asset\n", "guild ", "wars ", "0123 "};
+    static const char letters[] = "eeeeeeeeeeeetttttttttaaaaaaaaooooooooiiiiiiinnnnnnnsssssshhhhhhrrrrrddddlllluuucccmmwwffggyyppbbvk  ,.\n";
+    uint8_t *data = (uint8_t *)malloc(size + 4);
+    uint32_t i = 0;
+    switch (kind)
+    {
+    case 0:
+        while (i < size)
+        {
+            for (const char *word = words[check_random() % 10]; *word != '\0' && i < size; ++word)
+            {
+                data[i++] = (uint8_t)*word;
+            }
+        }
+        break;
+    case 1:
+        for (; i < size; ++i)
+        {
+            data[i] = (uint8_t)check_random();
+        }
+        break;
+    case 2:
+        for (; i < size; i += 4)
+        {
+            float value = (float)(i % 97) * 0.25f + (float)(check_random() % 4);
+            memcpy(data + i, &value, sizeof(float));
+        }
+        break;
+    case 3:
+        for (; i < size; ++i)
+        {
+            data[i] = (i / 50) % 3 ? (uint8_t)('a' + check_random() % 3) : 0;
+        }
+        break;
+    case 4:
+        for (; i < size; ++i)
+        {
+            data[i] = (uint8_t)letters[check_random() % (sizeof(letters) - 1)];
+        }
+        break;
+    default:
+        memset(data, 0, size);
+        break;
+    }
+    return data;
+}
+
+// --- Checks ---
+
+typedef struct
+{
+    uint64_t entries;
+    uint64_t checks;
+    uint64_t mismatches;
+    uint64_t fuzz_cases;
+    uint64_t fuzz_rejected; // both decoders refused the input
+    uint64_t fuzz_accepted; // both decoded it, to the same bytes
+    uint64_t bytes;
+    uint64_t reference_nanoseconds;
+    uint64_t optimized_nanoseconds;
+} CheckStats;
+
+static void report_mismatch(CheckStats *stats, const char *label, const char *path, uint32_t detail)
+{
+    ++stats->mismatches;
+    fprintf(stderr, "Mismatch: %s, %s (%u)\n", label, path, detail);
+}
+
+static bool same_bytes(const uint8_t *a, const uint8_t *b, uint32_t size)
+{
+    return size == 0 || memcmp(a, b, size) == 0;
+}
+
+// The decoder reports malformed input on stdout; keep that out of the fuzzing output
+static int silence_stdout(void)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0)
+    {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    return saved;
+#else
+    return -1;
+#endif
+}
+
+static void restore_stdout(int saved)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    fflush(stdout);
+    if (saved >= 0)
+    {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+#else
+    (void)saved;
+#endif
+}
+
+// Compare every optimized path against the reference output of a valid entry
+static void check_entry(CheckStats *stats, const char *label, const uint8_t *encoded, uint32_t encoded_size)
+{
+    // The optimized decoder takes non-const input, so it gets a copy
+    uint8_t *input = (uint8_t *)malloc(encoded_size ? encoded_size : 1);
+    memcpy(input, encoded, encoded_size);
+    ++stats->entries;
+
+    uint64_t start = check_now_nanoseconds();
+    uint32_t expected_size = 0;
+    uint8_t *expected = reference_decode(encoded, encoded_size, &expected_size);
+    stats->reference_nanoseconds += check_now_nanoseconds() - start;
+    if (expected == NULL)
+    {
+        report_mismatch(stats, label, "reference decoder rejected the entry", 0);
+        free(input);
+        return;
+    }
+    stats->bytes += expected_size;
+
+    ++stats->checks;
+    start = check_now_nanoseconds();
+    uint32_t size = 0;
+    uint8_t *output = decompress_data_indexed(input, encoded_size, &size, 0, NULL);
+    stats->optimized_nanoseconds += check_now_nanoseconds() - start;
+    if (output == NULL || size != expected_size || !same_bytes(output, expected, size))
+    {
+        report_mismatch(stats, label, "whole decode", size);
+    }
+    buffer_free(output);
+
+    // Checkpointed decode, then ranges resumed from its checkpoints
+    ++stats->checks;
+    DecodeCheckpointIndex checkpoint_index;
+    uint32_t interval = 4096u << (check_random() % 6);
+    output = decompress_data_indexed(input, encoded_size, &size, interval, &checkpoint_index);
+    bool indexed = output != NULL;
+    if (!indexed || size != expected_size || !same_bytes(output, expected, size))
+    {
+        report_mismatch(stats, label, "checkpointed decode", interval);
+    }
+    buffer_free(output);
+    for (uint32_t i = 0; indexed && i < 4; ++i)
+    {
+        ++stats->checks;
+        uint32_t offset = expected_size ? check_random() % expected_size : 0;
+        uint32_t length = check_random() % (expected_size - offset + 1);
+        uint8_t *range = (uint8_t *)malloc(length ? length : 1);
+        if (!decompress_range(input, encoded_size, &checkpoint_index, offset, length, range) || !same_bytes(range, expected + offset, length))
+        {
+            report_mismatch(stats, label, "checkpointed range", offset);
+        }
+        free(range);
+    }
+    if (indexed)
+    {
+        free_checkpoint_index(&checkpoint_index);
+    }
+
+    ++stats->checks;
+    output = (uint8_t *)buffer_alloc(expected_size ? expected_size : 1);
+    if (!decompress_data_into(input, encoded_size, output, expected_size) || !same_bytes(output, expected, expected_size))
+    {
+        report_mismatch(stats, label, "decode into a caller buffer", expected_size);
+    }
+    buffer_free(output);
+
+    ++stats->checks;
+    uint32_t thread_count = 1 + check_random() % 4;
+    output = decompress_data_parallel(input, encoded_size, &size, thread_count, NULL);
+    if (output == NULL || size != expected_size || !same_bytes(output, expected, size))
+    {
+        report_mismatch(stats, label, "parallel decode", thread_count);
+    }
+    buffer_free(output);
+
+    ++stats->checks;
+    uint32_t prefix_length = check_random() % (expected_size + 2);
+    uint32_t prefix_size = 0;
+    output = decompress_data_prefix(input, encoded_size, prefix_length, &prefix_size);
+    uint32_t expected_prefix = prefix_length < expected_size ? prefix_length : expected_size;
+    if (output == NULL || prefix_size != expected_prefix || !same_bytes(output, expected, prefix_size))
+    {
+        report_mismatch(stats, label, "prefix decode", prefix_length);
+    }
+    buffer_free(output);
+
+    ++stats->checks;
+    DecodeStream stream;
+    uint32_t chunk_size = DECODE_STREAM_MIN_CHUNK + check_random() % (1u << 16);
+    uint32_t streamed = 0;
+    bool ok = begin_decode_stream(&stream, input, encoded_size, chunk_size);
+    while (ok)
+    {
+        const uint8_t *chunk = NULL;
+        uint32_t chunk_bytes = 0;
+        ok = decode_stream_next(&stream, &chunk, &chunk_bytes);
+        if (!ok || chunk_bytes == 0)
+        {
+            break;
+        }
+        ok = streamed + chunk_bytes <= expected_size && same_bytes(chunk, expected + streamed, chunk_bytes);
+        streamed += chunk_bytes;
+    }
+    end_decode_stream(&stream);
+    if (!ok || streamed != expected_size)
+    {
+        report_mismatch(stats, label, "chunked stream", chunk_size);
+    }
+
+    free(expected);
+    free(input);
+}
+
+// Damage a valid entry and require both decoders to agree: both refuse it, or both decode it to the
+// same bytes. Whole, parallel and streamed decodes are compared; the other paths share their block
+// decoder.
+static void check_fuzzed(CheckStats *stats, const char *label, const uint8_t *encoded, uint32_t encoded_size)
+{
+    if (encoded_size <= 8)
+    {
+        return;
+    }
+    uint8_t *damaged = (uint8_t *)malloc(encoded_size);
+    memcpy(damaged, encoded, encoded_size);
+    uint32_t size = encoded_size;
+    switch (check_random() % 4)
+    {
+    case 0:
+        for (uint32_t flips = 1 + check_random() % 8; flips > 0; --flips)
+        {
+            damaged[8 + check_random() % (size - 8)] ^= (uint8_t)(1u << (check_random() % 8));
+        }
+        break;
+    case 1:
+        size = 8 + check_random() % (size - 8);
+        break;
+    case 2:
+        for (uint32_t i = 8 + check_random() % (size - 8); i < size; ++i)
+        {
+            damaged[i] = (uint8_t)check_random();
+        }
+        break;
+    default:
+        // A smaller declared size cuts the last match short
+        {
+            uint32_t declared = peek_decompressed_size(damaged, size);
+            declared = declared ? check_random() % declared : 0;
+            memcpy(damaged + 4, &declared, sizeof(uint32_t));
+        }
+        break;
+    }
+
+    ++stats->fuzz_cases;
+    uint32_t expected_size = 0;
+    uint8_t *expected = reference_decode(damaged, size, &expected_size);
+
+    int saved = silence_stdout();
+    uint8_t *input = (uint8_t *)malloc(size);
+    memcpy(input, damaged, size);
+    uint32_t output_size = 0;
+    uint8_t *output = decompress_data_indexed(input, size, &output_size, 0, NULL);
+    uint32_t parallel_size = 0;
+    uint8_t *parallel = decompress_data_parallel(input, size, &parallel_size, 1 + check_random() % 4, NULL);
+
+    DecodeStream stream;
+    uint32_t streamed = 0;
+    bool stream_ok = begin_decode_stream(&stream, input, size, DECODE_STREAM_MIN_CHUNK + check_random() % (1u << 15));
+    bool stream_same = true;
+    while (stream_ok)
+    {
+        const uint8_t *chunk = NULL;
+        uint32_t chunk_bytes = 0;
+        stream_ok = decode_stream_next(&stream, &chunk, &chunk_bytes);
+        if (!stream_ok || chunk_bytes == 0)
+        {
+            break;
+        }
+        stream_same = stream_same && expected != NULL && streamed + chunk_bytes <= expected_size &&
+                      same_bytes(chunk, expected + streamed, chunk_bytes);
+        streamed += chunk_bytes;
+    }
+    end_decode_stream(&stream);
+    restore_stdout(saved);
+
+    if ((expected == NULL) != (output == NULL))
+    {
+        report_mismatch(stats, label, expected == NULL ? "fuzzed: only the optimized decoder accepted" : "fuzzed: only the reference accepted", size);
+    }
+    else if (expected != NULL && (output_size != expected_size || !same_bytes(output, expected, output_size)))
+    {
+        report_mismatch(stats, label, "fuzzed: outputs differ", size);
+    }
+    else if (stream_ok != (expected != NULL) || (stream_ok && (!stream_same || streamed != expected_size)))
+    {
+        report_mismatch(stats, label, "fuzzed: stream disagrees", size);
+    }
+    else if ((parallel == NULL) != (expected == NULL) || (parallel != NULL && (parallel_size != expected_size || !same_bytes(parallel, expected, parallel_size))))
+    {
+        report_mismatch(stats, label, "fuzzed: parallel decode disagrees", size);
+    }
+    else if (expected == NULL)
+    {
+        ++stats->fuzz_rejected;
+    }
+    else
+    {
+        ++stats->fuzz_accepted;
+    }
+
+    buffer_free(output);
+    buffer_free(parallel);
+    free(expected);
+    free(input);
+    free(damaged);
+}
+
+static void check_generated(CheckStats *stats, uint32_t entries, uint32_t max_size, uint32_t fuzz_per_entry)
+{
+    uint32_t static_codes[256];
+    assign_codes(static_code_lengths, 256, static_codes);
+
+    for (uint32_t i = 0; i < entries; ++i)
+    {
+        // Mostly small and medium entries, some up to max_size, and a few empty ones
+        uint32_t shape = check_random() % 10;
+        uint32_t size = shape == 0 ? check_random() % 64 : shape < 4 ? check_random() % 4096 : shape < 8 ? check_random() % 65536 : check_random() % max_size;
+        uint8_t *data = generate_data(check_random() % 6, size);
+
+        EncodeOptions options;
+        options.length_base = 1 + check_random() % 16;
+        options.block_code = check_random() % 4 ? check_random() % 2 : check_random() % 16;
+        options.search_depth = 1 + check_random() % 40;
+        options.max_code_length = 9 + check_random() % 12;
+        options.literals_only = check_random() % 8 == 0;
+
+        uint32_t encoded_size = 0;
+        uint8_t *encoded = encode_entry(data, size, &options, static_codes, &encoded_size);
+
+        char label[128];
+        snprintf(label, sizeof(label), "generated entry %u (%u bytes, kind %u)", i, size, shape);
+        uint64_t mismatches = stats->mismatches;
+        check_entry(stats, label, encoded, encoded_size);
+        uint32_t reference_size = 0;
+        uint8_t *decoded = mismatches == stats->mismatches ? reference_decode(encoded, encoded_size, &reference_size) : NULL;
+        if (decoded != NULL && (reference_size != size || !same_bytes(decoded, data, size)))
+        {
+            report_mismatch(stats, label, "round trip through the encoder", size);
+        }
+        free(decoded);
+
+        for (uint32_t f = 0; f < fuzz_per_entry; ++f)
+        {
+            check_fuzzed(stats, label, encoded, encoded_size);
+        }
+        free(encoded);
+        free(data);
+    }
+}
+
+static bool check_archive(CheckStats *stats, const char *file_path, uint32_t fuzz_per_entry)
+{
+    DatFile dat_file;
+    memset(&dat_file, 0, sizeof(DatFile));
+    if (!load_dat_file_ex(file_path, &dat_file, DAT_OPEN_LAZY))
+    {
+        return false;
+    }
+    FILE *file = fopen(file_path, "rb");
+    if (file == NULL)
+    {
+        perror(file_path);
+        close_dat_file(&dat_file);
+        return false;
+    }
+
+    for (uint32_t slot = 0; slot < dat_file.mft_header.num_entries; ++slot)
+    {
+        MFTData *mft_entry = get_mft_entry(&dat_file, slot);
+        if (mft_entry == NULL || mft_entry->compression_flag == 0 || mft_entry->size == 0)
+        {
+            continue;
+        }
+        uint8_t *payload = (uint8_t *)malloc(mft_entry->size);
+        if (payload == NULL)
+        {
+            continue;
+        }
+        if (dat_fseek(file, (int64_t)mft_entry->offset, SEEK_SET) == 0 && fread(payload, 1, mft_entry->size, file) == mft_entry->size)
+        {
+            char label[64];
+            snprintf(label, sizeof(label), "MFT slot %u", slot);
+            check_entry(stats, label, payload, mft_entry->size);
+            for (uint32_t f = 0; f < fuzz_per_entry; ++f)
+            {
+                check_fuzzed(stats, label, payload, mft_entry->size);
+            }
+        }
+        clearerr(file);
+        free(payload);
+    }
+
+    fclose(file);
+    close_dat_file(&dat_file);
+    return true;
+}
+
+static void print_check_report(const CheckStats *stats)
+{
+    double reference_seconds = stats->reference_nanoseconds / 1e9;
+    double optimized_seconds = stats->optimized_nanoseconds / 1e9;
+    printf("Decoder Check Report:\n");
+    printf("  Entries:             %llu (%.1f MB decoded), %llu checks\n", (unsigned long long)stats->entries, stats->bytes / 1048576.0,
+           (unsigned long long)stats->checks);
+    printf("  Fuzzed inputs:       %llu (%llu refused by both, %llu decoded alike)\n", (unsigned long long)stats->fuzz_cases,
+           (unsigned long long)stats->fuzz_rejected, (unsigned long long)stats->fuzz_accepted);
+    printf("  Mismatches:          %llu\n", (unsigned long long)stats->mismatches);
+    printf("  Reference decoder:   %.1f MB/s\n", reference_seconds > 0 ? stats->bytes / 1048576.0 / reference_seconds : 0.0);
+    printf("  Optimized decoder:   %.1f MB/s (%.1fx)\n", optimized_seconds > 0 ? stats->bytes / 1048576.0 / optimized_seconds : 0.0,
+           optimized_seconds > 0 ? reference_seconds / optimized_seconds : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t entries = 200;
+    uint32_t max_size = 1u << 20;
+    uint32_t fuzz_per_entry = 8;
+    const char *archive_path = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            check_random_state = strtoull(argv[++i], NULL, 10) * 0x9E3779B97F4A7C15ull | 1;
+        }
+        else if (strcmp(argv[i], "--entries") == 0 && i + 1 < argc)
+        {
+            entries = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc)
+        {
+            max_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+            max_size = max_size ? max_size : 1;
+        }
+        else if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc)
+        {
+            fuzz_per_entry = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--archive") == 0 && i + 1 < argc)
+        {
+            archive_path = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--seed n] [--entries n] [--max-size bytes] [--fuzz n] [--archive path.dat]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    CheckStats stats;
+    memset(&stats, 0, sizeof(CheckStats));
+    check_generated(&stats, entries, max_size, fuzz_per_entry);
+    if (archive_path != NULL && !check_archive(&stats, archive_path, fuzz_per_entry))
+    {
+        return EXIT_FAILURE;
+    }
+
+    print_check_report(&stats);
+    return stats.mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,373 @@
+// Load generator for wacko serve: N client threads, each on its own keep-alive connection, request
+// random ids from a range and report throughput and latency percentiles.
+//
+// wacko_loadgen (--socket path | --http port) [--threads n] [--requests n] [--ids first-last] [--sniff n]
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef struct
+{
+    const char *socket_path;
+    uint16_t http_port;
+    uint32_t first_id;
+    uint32_t last_id;
+    uint32_t requests;
+    uint32_t sniff_bytes;
+} LoadOptions;
+
+typedef struct
+{
+    const LoadOptions *options;
+    uint32_t seed;
+    uint64_t *latencies; // nanoseconds, one per request
+    uint32_t completed;
+    uint32_t errors;
+    uint64_t bytes;
+} ClientState;
+
+static uint64_t now_nanoseconds(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static int connect_server(const LoadOptions *options)
+{
+    if (options->socket_path != NULL)
+    {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, options->socket_path, sizeof(address.sun_path) - 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options->http_port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Buffered reads over one connection
+typedef struct
+{
+    int fd;
+    char data[65536];
+    size_t start;
+    size_t end;
+} Reader;
+
+static bool reader_fill(Reader *reader)
+{
+    if (reader->start == reader->end)
+    {
+        reader->start = reader->end = 0;
+    }
+    else if (reader->end == sizeof(reader->data))
+    {
+        memmove(reader->data, reader->data + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    ssize_t received = recv(reader->fd, reader->data + reader->end, sizeof(reader->data) - reader->end, 0);
+    if (received < 0 && errno == EINTR)
+    {
+        return true;
+    }
+    if (received <= 0)
+    {
+        return false;
+    }
+    reader->end += (size_t)received;
+    return true;
+}
+
+// Read up to and including "\n", or "\r\n\r\n" for HTTP headers; the terminator is replaced by NUL
+static char *reader_take(Reader *reader, const char *terminator)
+{
+    size_t terminator_length = strlen(terminator);
+    for (;;)
+    {
+        size_t available = reader->end - reader->start;
+        char *begin = reader->data + reader->start;
+        for (size_t i = 0; i + terminator_length <= available; ++i)
+        {
+            if (memcmp(begin + i, terminator, terminator_length) == 0)
+            {
+                begin[i] = '\0';
+                reader->start += i + terminator_length;
+                return begin;
+            }
+        }
+        if (available == sizeof(reader->data) || !reader_fill(reader))
+        {
+            return NULL;
+        }
+    }
+}
+
+static bool reader_skip(Reader *reader, uint64_t size)
+{
+    while (size > 0)
+    {
+        if (reader->start == reader->end && !reader_fill(reader))
+        {
+            return false;
+        }
+        size_t available = reader->end - reader->start;
+        size_t step = size < available ? (size_t)size : available;
+        reader->start += step;
+        size -= step;
+    }
+    return true;
+}
+
+// Send one request and read its reply; returns false if the connection is unusable
+static bool run_request(ClientState *client, Reader *reader, uint32_t id)
+{
+    const LoadOptions *options = client->options;
+    char request[128];
+    int length = 0;
+    if (options->http_port != 0)
+    {
+        if (options->sniff_bytes != 0)
+        {
+            length = snprintf(request, sizeof(request), "GET /sniff/%u?length=%u HTTP/1.1\r\nHost: localhost\r\n\r\n", id, options->sniff_bytes);
+        }
+        else
+        {
+            length = snprintf(request, sizeof(request), "GET /entry/%u HTTP/1.1\r\nHost: localhost\r\n\r\n", id);
+        }
+    }
+    else if (options->sniff_bytes != 0)
+    {
+        length = snprintf(request, sizeof(request), "SNIFF %u %u\n", id, options->sniff_bytes);
+    }
+    else
+    {
+        length = snprintf(request, sizeof(request), "GET %u\n", id);
+    }
+
+    if (send(reader->fd, request, (size_t)length, MSG_NOSIGNAL) != length)
+    {
+        return false;
+    }
+
+    uint64_t size = 0;
+    bool ok = false;
+    if (options->http_port != 0)
+    {
+        char *headers = reader_take(reader, "\r\n\r\n");
+        if (headers == NULL)
+        {
+            return false;
+        }
+        ok = strncmp(headers, "HTTP/1.1 200", 12) == 0;
+        const char *content_length = strstr(headers, "Content-Length: ");
+        if (content_length == NULL)
+        {
+            return false;
+        }
+        size = strtoull(content_length + 16, NULL, 10);
+    }
+    else
+    {
+        char *status = reader_take(reader, "\n");
+        if (status == NULL)
+        {
+            return false;
+        }
+        ok = strncmp(status, "OK ", 3) == 0;
+        size = ok ? strtoull(status + 3, NULL, 10) : 0;
+    }
+
+    if (!reader_skip(reader, size))
+    {
+        return false;
+    }
+    if (ok)
+    {
+        client->bytes += size;
+    }
+    else
+    {
+        ++client->errors;
+    }
+    return true;
+}
+
+static int client_main(void *argument)
+{
+    ClientState *client = (ClientState *)argument;
+    const LoadOptions *options = client->options;
+
+    Reader *reader = (Reader *)calloc(1, sizeof(Reader));
+    if (reader == NULL)
+    {
+        return thrd_error;
+    }
+    reader->fd = connect_server(options);
+    if (reader->fd < 0)
+    {
+        perror("connect");
+        free(reader);
+        return thrd_error;
+    }
+
+    uint32_t span = options->last_id - options->first_id + 1;
+    for (uint32_t i = 0; i < options->requests; ++i)
+    {
+        // xorshift keeps each client's sequence independent and reproducible
+        client->seed ^= client->seed << 13;
+        client->seed ^= client->seed >> 17;
+        client->seed ^= client->seed << 5;
+        uint32_t id = options->first_id + client->seed % span;
+
+        uint64_t start = now_nanoseconds();
+        if (!run_request(client, reader, id))
+        {
+            ++client->errors;
+            break;
+        }
+        client->latencies[client->completed++] = now_nanoseconds() - start;
+    }
+
+    close(reader->fd);
+    free(reader);
+    return thrd_success;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+    return left < right ? -1 : left > right;
+}
+
+int main(int argc, char **argv)
+{
+    LoadOptions options;
+    memset(&options, 0, sizeof(LoadOptions));
+    options.first_id = 1;
+    options.last_id = 1000;
+    options.requests = 1000;
+    uint32_t thread_count = 4;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+        {
+            options.socket_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--http") == 0 && i + 1 < argc)
+        {
+            options.http_port = (uint16_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            thread_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc)
+        {
+            options.requests = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--ids") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%u-%u", &options.first_id, &options.last_id) != 2)
+            {
+                options.last_id = options.first_id;
+            }
+        }
+        else if (strcmp(argv[i], "--sniff") == 0 && i + 1 < argc)
+        {
+            options.sniff_bytes = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+    }
+
+    if ((options.socket_path == NULL) == (options.http_port == 0) || thread_count == 0 || options.last_id < options.first_id)
+    {
+        fprintf(stderr, "Usage: %s (--socket path | --http port) [--threads n] [--requests n] [--ids first-last] [--sniff n]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ClientState *clients = (ClientState *)calloc(thread_count, sizeof(ClientState));
+    thrd_t *threads = (thrd_t *)calloc(thread_count, sizeof(thrd_t));
+    uint64_t *latencies = (uint64_t *)calloc((size_t)thread_count * options.requests, sizeof(uint64_t));
+    if (clients == NULL || threads == NULL || latencies == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t start = now_nanoseconds();
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        clients[i].options = &options;
+        clients[i].seed = 2463534242u + i * 7919u;
+        clients[i].latencies = latencies + (size_t)i * options.requests;
+        if (thrd_create(&threads[i], client_main, &clients[i]) != thrd_success)
+        {
+            thread_count = i;
+            break;
+        }
+    }
+
+    uint64_t completed = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        thrd_join(threads[i], NULL);
+        // Compact every client's latencies to the front for sorting
+        memmove(latencies + completed, clients[i].latencies, clients[i].completed * sizeof(uint64_t));
+        completed += clients[i].completed;
+        errors += clients[i].errors;
+        bytes += clients[i].bytes;
+    }
+    double seconds = (now_nanoseconds() - start) / 1e9;
+
+    qsort(latencies, completed, sizeof(uint64_t), compare_latency);
+    printf("Load Report:\n");
+    printf("  Clients:             %u\n", thread_count);
+    printf("  Requests:            %llu (%llu errors) in %.2f s\n", (unsigned long long)completed, (unsigned long long)errors, seconds);
+    printf("  Throughput:          %.0f req/s, %.1f MB/s\n", seconds > 0 ? completed / seconds : 0.0,
+           seconds > 0 ? bytes / 1048576.0 / seconds : 0.0);
+    if (completed > 0)
+    {
+        printf("  Latency:             p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", latencies[completed / 2] / 1e6,
+               latencies[(completed * 99) / 100] / 1e6, latencies[completed - 1] / 1e6);
+    }
+
+    free(latencies);
+    free(threads);
+    free(clients);
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
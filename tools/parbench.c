@@ -0,0 +1,291 @@
+// Parallel decode benchmark: decodes the large compressed entries of an archive with the serial
+// decoder and with decompress_data_parallel at 1, 2, 4, ... threads, checks that every parallel
+// output is byte for byte the serial one, and reports the best time of each thread count with its
+// speedup over the serial decoder and how the parallel time splits over scan, tokens and resolve.
+// Entries are taken from --min-mb up; when none is that large, the largest entry is used.
+//
+// wacko_parbench [--threads n] [--rounds n] [--min-mb n] path/to/Gw2.dat
+
+#include "wacko.h"
+
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+typedef struct
+{
+    uint32_t mft_slot;
+    uint32_t compressed_size;
+    uint8_t *payload;
+} BenchEntry;
+
+typedef struct
+{
+    uint32_t threads; // 0 for the serial decoder
+    uint64_t nanoseconds;
+    ParallelDecodeStats stats;
+} BenchRow;
+
+static uint64_t bench_now_nanoseconds(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static uint32_t bench_online_cpus(void)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (uint32_t)cpus : 1;
+#else
+    return 1;
+#endif
+}
+
+// Read the compressed entries decoding to at least min_size bytes, or the largest one if there are none
+static BenchEntry *load_bench_entries(const char *file_path, uint32_t min_size, uint32_t *count)
+{
+    DatFile dat_file;
+    memset(&dat_file, 0, sizeof(DatFile));
+    if (!load_dat_file_ex(file_path, &dat_file, DAT_OPEN_LAZY))
+    {
+        return NULL;
+    }
+    FILE *file = fopen(file_path, "rb");
+    if (file == NULL)
+    {
+        perror(file_path);
+        close_dat_file(&dat_file);
+        return NULL;
+    }
+
+    BenchEntry *entries = (BenchEntry *)calloc(dat_file.mft_header.num_entries + 1, sizeof(BenchEntry));
+    *count = 0;
+    BenchEntry largest;
+    uint32_t largest_size = 0;
+    memset(&largest, 0, sizeof(BenchEntry));
+    for (uint32_t slot = 0; entries != NULL && slot < dat_file.mft_header.num_entries; ++slot)
+    {
+        MFTData *mft_entry = get_mft_entry(&dat_file, slot);
+        if (mft_entry == NULL || mft_entry->compression_flag == 0 || mft_entry->size < 2 * sizeof(uint32_t))
+        {
+            continue;
+        }
+        uint8_t *payload = (uint8_t *)malloc(mft_entry->size);
+        if (payload == NULL)
+        {
+            continue;
+        }
+        if (dat_fseek(file, (int64_t)mft_entry->offset, SEEK_SET) != 0 || fread(payload, 1, mft_entry->size, file) != mft_entry->size)
+        {
+            clearerr(file);
+            free(payload);
+            continue;
+        }
+
+        uint32_t size = peek_decompressed_size(payload, mft_entry->size);
+        BenchEntry entry = {slot, mft_entry->size, payload};
+        if (size >= min_size)
+        {
+            entries[(*count)++] = entry;
+        }
+        else if (size > largest_size)
+        {
+            free(largest.payload);
+            largest = entry;
+            largest_size = size;
+        }
+        else
+        {
+            free(payload);
+        }
+    }
+
+    if (entries != NULL && *count == 0 && largest.payload != NULL)
+    {
+        entries[(*count)++] = largest;
+    }
+    else
+    {
+        free(largest.payload);
+    }
+    fclose(file);
+    close_dat_file(&dat_file);
+    return entries;
+}
+
+// Decode every entry once on thread_count threads (0 for the serial decoder); false if an output
+// differs from the serial one in expected, which is filled in on the serial run
+static bool run_bench_round(BenchEntry *entries, uint32_t count, uint8_t **expected, uint32_t *expected_sizes, uint32_t thread_count,
+                            BenchRow *row)
+{
+    ParallelDecodeStats total;
+    memset(&total, 0, sizeof(ParallelDecodeStats));
+    uint64_t start = bench_now_nanoseconds();
+    bool same = true;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t size = 0;
+        if (thread_count == 0)
+        {
+            uint8_t *output = decompress_data_indexed(entries[i].payload, entries[i].compressed_size, &size, 0, NULL);
+            if (expected[i] == NULL)
+            {
+                expected[i] = output;
+                expected_sizes[i] = size;
+            }
+            else
+            {
+                buffer_free(output);
+            }
+            continue;
+        }
+
+        ParallelDecodeStats stats;
+        memset(&stats, 0, sizeof(ParallelDecodeStats));
+        uint8_t *output = decompress_data_parallel(entries[i].payload, entries[i].compressed_size, &size, thread_count, &stats);
+        if ((output == NULL) != (expected[i] == NULL) || size != expected_sizes[i] || (output != NULL && memcmp(output, expected[i], size) != 0))
+        {
+            fprintf(stderr, "MFT slot %u: parallel decode on %u threads differs from the serial decoder\n", entries[i].mft_slot, thread_count);
+            same = false;
+        }
+        buffer_free(output);
+        total.bytes += stats.bytes;
+        total.threads = stats.threads > total.threads ? stats.threads : total.threads;
+        total.blocks += stats.blocks;
+        total.matches += stats.matches;
+        total.serial_matches += stats.serial_matches;
+        total.scan_nanoseconds += stats.scan_nanoseconds;
+        total.token_nanoseconds += stats.token_nanoseconds;
+        total.resolve_nanoseconds += stats.resolve_nanoseconds;
+    }
+
+    uint64_t nanoseconds = bench_now_nanoseconds() - start;
+    if (nanoseconds < row->nanoseconds)
+    {
+        row->nanoseconds = nanoseconds;
+        row->stats = total;
+    }
+    return same;
+}
+
+static void print_bench_row(const BenchRow *row, uint64_t bytes, uint64_t serial_nanoseconds)
+{
+    double seconds = row->nanoseconds / 1e9;
+    double megabytes_per_second = seconds > 0 ? bytes / 1048576.0 / seconds : 0.0;
+    double speedup = row->nanoseconds ? (double)serial_nanoseconds / row->nanoseconds : 0.0;
+    if (row->threads == 0)
+    {
+        printf("  %-8s %10.2f %9.1f %8.2fx\n", "serial", row->nanoseconds / 1e6, megabytes_per_second, speedup);
+        return;
+    }
+
+    const ParallelDecodeStats *stats = &row->stats;
+    uint64_t phases = stats->scan_nanoseconds + stats->token_nanoseconds + stats->resolve_nanoseconds;
+    printf("  %-8u %10.2f %9.1f %8.2fx %7.1f%% %7.1f%% %8.1f%% %14.1f%%\n", row->stats.threads, row->nanoseconds / 1e6, megabytes_per_second,
+           speedup, phases ? 100.0 * stats->scan_nanoseconds / phases : 0.0, phases ? 100.0 * stats->token_nanoseconds / phases : 0.0,
+           phases ? 100.0 * stats->resolve_nanoseconds / phases : 0.0, stats->matches ? 100.0 * stats->serial_matches / stats->matches : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *file_path = NULL;
+    uint32_t cpus = bench_online_cpus();
+    uint32_t max_threads = cpus > 4 ? cpus : 4;
+    uint32_t rounds = 3;
+    uint32_t min_size = PARALLEL_DECODE_DEFAULT_THRESHOLD;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            max_threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc)
+        {
+            rounds = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--min-mb") == 0 && i + 1 < argc)
+        {
+            min_size = (uint32_t)strtoul(argv[++i], NULL, 10) << 20;
+        }
+        else
+        {
+            file_path = argv[i];
+        }
+    }
+    if (max_threads > PARALLEL_DECODE_MAX_THREADS)
+    {
+        max_threads = PARALLEL_DECODE_MAX_THREADS;
+    }
+
+    if (file_path == NULL || rounds == 0 || max_threads == 0)
+    {
+        fprintf(stderr, "Usage: %s [--threads n] [--rounds n] [--min-mb n] path/to/Gw2.dat\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint32_t count = 0;
+    BenchEntry *entries = load_bench_entries(file_path, min_size, &count);
+    if (entries == NULL || count == 0)
+    {
+        fprintf(stderr, "%s: no compressed entries to decode\n", file_path);
+        free(entries);
+        return EXIT_FAILURE;
+    }
+
+    // Thread counts 1, 2, 4, ... and max_threads itself, after the serial decoder
+    BenchRow rows[2 + 8 * sizeof(uint32_t)];
+    uint32_t row_count = 0;
+    rows[row_count++].threads = 0;
+    for (uint32_t threads = 1; threads < max_threads; threads *= 2)
+    {
+        rows[row_count++].threads = threads;
+    }
+    rows[row_count++].threads = max_threads;
+    for (uint32_t i = 0; i < row_count; ++i)
+    {
+        rows[i].nanoseconds = UINT64_MAX;
+        memset(&rows[i].stats, 0, sizeof(ParallelDecodeStats));
+    }
+
+    uint8_t **expected = (uint8_t **)calloc(count, sizeof(uint8_t *));
+    uint32_t *expected_sizes = (uint32_t *)calloc(count, sizeof(uint32_t));
+    bool same = expected != NULL && expected_sizes != NULL;
+    for (uint32_t round = 0; same && round < rounds; ++round)
+    {
+        for (uint32_t i = 0; i < row_count; ++i)
+        {
+            same = run_bench_round(entries, count, expected, expected_sizes, rows[i].threads, &rows[i]) && same;
+        }
+    }
+
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; expected_sizes != NULL && i < count; ++i)
+    {
+        bytes += expected_sizes[i];
+    }
+    printf("Parallel Decode Benchmark: %u entries, %.1f MB decompressed, best of %u rounds, %u CPUs online\n", count, bytes / 1048576.0,
+           rounds, cpus);
+    printf("  %-8s %10s %9s %9s %8s %8s %9s %15s\n", "threads", "time ms", "MB/s", "speedup", "scan", "tokens", "resolve",
+           "serial matches");
+    for (uint32_t i = 0; i < row_count; ++i)
+    {
+        print_bench_row(&rows[i], bytes, rows[0].nanoseconds);
+    }
+    printf("  Output:              %s\n", same ? "identical to the serial decoder" : "DIFFERS from the serial decoder");
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        free(entries[i].payload);
+        if (expected != NULL)
+        {
+            buffer_free(expected[i]);
+        }
+    }
+    free(expected);
+    free(expected_sizes);
+    free(entries);
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}